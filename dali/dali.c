@@ -17,8 +17,14 @@
 #include <nrfx_spim.h>
 //#include "nrf_drv_spi.h"
 //#include "nrf_log.h"
-#else
-
+#elif !defined(DALI_HOST)
+#include "pico/stdlib.h"
+#ifdef DALI_CORE1
+#include "pico/multicore.h"
+#endif
+#endif
+#if defined(DALI_CORE1) && (defined(NRF) || defined(DALI_HOST))
+#error "DALI_CORE1 is an RP2040 build option"
 #endif
 #include "dali.h"
 #include "dali_identify.h"
@@ -32,140 +38,1668 @@
 #include "dali_temperature.h"
 #include "dali_LED_Load.h"
 #include "dali_driver.h"
+#include "dali_bus.h"
 #include "dali_sequences.h"
+#include "dali_trace.h"
+#include "dali_spsc.h"
+
+typedef struct
+{
+    uint32_t pwr;
+    float    fPwr;
+    uint64_t nrg;
+}sPwr_t;
+
+typedef struct
+{
+    uint16_t volts;
+    uint16_t  amps;
+}sLEDLoadMeasurements_t;
+
+typedef struct
+{
+    uint16_t temp;
+}sGearMeasurements_t;
+
+sPwr_t                 sPwr[5];//support 4 drivers.  The 5th element will take pwr readings for any index after the 4th.
+sLEDLoadMeasurements_t sLEDLoadMsmts[5];
+sGearMeasurements_t    sGearMsmts   [5];
+
+#define MSMT_INDEX(addr) (((addr) > 4) ? 4 : (addr))/*!<Measurement array element of an address*/
+
+
+/** @brief */
+saDaliNetworkData_t saDaliNetworkData  __attribute__((aligned(4))) = 
+{
+    .numDrivers = 1,
+    .uData = {0}
+};
+
+/** @brief No gear on the bus outside saDaliNetworkData: a full or restore addressing run searched every gear
+ * and the list holds them all, and no incremental run since came across an address the list lacks*/
+static _Bool bBusListed = false;
+
+/** @brief  */
+eDaliTaskStatus_t   eDaliTaskStatus = evDaliNoTaskRunning;
+
+/** @brief */
+sDaliTask_t sCurDaliTask =
+{//currently executing dali task
+  .eDaliTask      = evNoTask,
+  .uTask.taskData = {0}
+};
+
+sDaliTask_t sIDaliTask = 
+{//holder for interrupted task if higher priority (dimming) task is injected
+    .eDaliTask = evNoTask,
+    .uTask.taskData = {0}
+};
+
+/**
+ * @brief Queued task and when it was queued
+ * 
+ */
+typedef struct
+{
+    sDaliTask_t sTask;
+    uint32_t    queuedUs;
+    uint32_t    deadlineUs;/*!<Must start within this long of queuedUs, 0 for none*/
+}sDaliTaskEntry_t;
+
+/**
+ * @brief FIFO ring of one priority
+ * 
+ */
+typedef struct
+{
+    sDaliTaskEntry_t saEntry[DALI_TASK_QUEUE_DEPTH];
+    uint8_t          head ;/*!<Next entry to start*/
+    uint8_t          count;
+}sDaliTaskFifo_t;
+
+#define TASK_FIFO_ENTRY(psFifo, pos) (&(psFifo)->saEntry[((psFifo)->head + (pos)) % DALI_TASK_QUEUE_DEPTH])/*!<pos counts from the oldest*/
+
+static sDaliTaskFifo_t       saTaskFifo[evDaliNumPrios];
+static uint8_t               taskReadyMask = 0;/*!<Bit per priority with tasks waiting, lowest set bit starts next*/
+static sDaliTaskQueueStats_t sTaskQueueStats;
+static sDaliDtrShadow_t      sIDtrShadow;/*!<DTRs sIDaliTask had set up when it was interrupted*/
+
+static const uint32_t aDeadlineUs[evDaliNumPrios] =
+{//default start deadline per priority
+    [evDaliPrioDimming    ] = DALI_DEADLINE_DIMMING_US    ,
+    [evDaliPrioInteractive] = DALI_DEADLINE_INTERACTIVE_US,
+    [evDaliPrioTelemetry  ] = DALI_DEADLINE_TELEMETRY_US  ,
+    [evDaliPrioCommission ] = DALI_DEADLINE_COMMISSION_US ,
+};
+
+/**
+ * @brief Progress of the multi-transaction task in the slot, kept while a DAPC runs in its place. Only one
+ * such task is in the slot or suspended at a time, and a DAPC is a single frame that needs none
+ * 
+ */
+typedef union
+{
+    sDaliCtx_t           sCtx       ;/*!<Timeout and cancel, first member of each. evDaliPollForControlGear steps it too*/
+    sDaliAddrCtx_t       sAddr      ;
+    sDaliIdentifyCtx_t   sIdentify  ;
+    sDaliCommissionCtx_t sCommission;
+}uDaliTaskCtx_t;
+
+static uDaliTaskCtx_t uTaskCtx;
+
+eDaliTaskPrio_t eCurDaliPrio = evDaliPrioCommission;/*!<Priority of sCurDaliTask*/
+eDaliTaskPrio_t eIDaliPrio   = evDaliPrioCommission;/*!<Priority of sIDaliTask*/
+eDaliTaskType_t eRunDaliTask = evNoTask;            /*!<Type of the task in the slot, sCurDaliTask.eDaliTask is cleared when it finishes*/
+
+/**
+ * @brief Batch the slot is working through, its items take the slot one after another
+ * 
+ */
+typedef struct
+{
+    sDaliTask_t       sTask  ;/*!<The evDaliBatch entry, its handle gets the aggregate status*/
+    eDaliTaskStatus_t eStatus;/*!<evDaliTaskComplete until an item ends otherwise*/
+    uint8_t           pos    ;/*!<aOrder entry of the item in the slot*/
+    _Bool             bActive;
+}sDaliBatchRun_t;
+
+static sDaliBatchRun_t sBatchRun;
+static _Bool           bCurBatchItem = false;/*!<sCurDaliTask is an item of sBatchRun*/
+static _Bool           bIBatchItem   = false;/*!<sIDaliTask is*/
+
+static sDaliTaskResult_t saResultStore[DALI_TASK_RESULT_RING_LEN];
+static sDaliSpsc_t       sResultRing;/*!<The engine produces, getDaliTaskResult consumes*/
+
+/**
+ * @brief Tasks that ended outside the engine: superseded by setDaliTaskHandle, or superseded or turned away
+ * by the core1 request loop. Only the engine pushes to sResultRing and calls back, the others leave the task
+ * here with interrupts masked and arm the engine
+ * 
+ */
+typedef struct
+{
+    sDaliTaskHandle_t *psFirst;/*!<Handles to notify, oldest first, linked through psNextNotify*/
+    sDaliTaskHandle_t *psLast ;
+    sDaliTaskResult_t  saRecord[DALI_TASK_RESULT_RING_LEN];/*!<Records of tasks queued without a handle*/
+    uint8_t            head   ;
+    uint8_t            count  ;
+}sDaliNotifyLater_t;
+
+static sDaliNotifyLater_t sNotifyLater;
+
+/**
+ * @brief Handles of DAPCs taken off the dimming FIFO with interrupts masked, told once they are unmasked
+ * 
+ */
+typedef struct
+{
+    sDaliTaskHandle_t *apHandle[DALI_TASK_QUEUE_DEPTH];/*!<NULL for DAPCs queued without one*/
+    uint8_t            count;
+}sDaliDapcDone_t;
+
+#ifdef DALI_CORE1
+/**
+ * @brief Task on its way from setDaliTaskPrio on core0 to the FIFOs on core1
+ * 
+ */
+typedef struct
+{
+    sDaliTask_t     sTask;
+    eDaliTaskPrio_t ePrio;
+}sDaliTaskRequest_t;
+
+#define CORE1_DOORBELL 0/*!<FIFO word, its value carries nothing*/
+
+static sDaliTaskRequest_t saRequestStore[DALI_CORE1_RING_LEN];
+static sDaliSpsc_t        sRequestRing;        /*!<core0 produces, core1 consumes*/
+static _Bool              bCore1Busy = false;  /*!<Published by core1: a task is queued, running or suspended*/
+#endif
+
+_Bool    daliDataInitStatus = false;/*!<Inidcates if saDaliNetworkData has been populated or not*/
+_Bool    bTaskValid         = false;/*!<Indicates internally if task is still being worked on*/  
+_Bool    bDALITaskSuspended = false;/*!<Indicates a multi-transfer task was suspended for a higher priority dimming event*/
+
+#ifdef NRF
+ typedef struct k_timer daliTimer;
+#elif defined(DALI_HOST)
+typedef uint32_t daliTimer;
+#else
+typedef alarm_id_t daliTimer;
+static alarm_pool_t *psEngineAlarmPool = NULL;/*!<Pool of the core running the engine*/
+#endif
+
+#define ENGINE_MAX_STEPS 4/*!<Task layer calls per engine run that queue no transfer, covers the completion handshake*/
+
+static daliTimer sDaliTimer;
+static _Bool     bEngineArmed = false;/*!<Timer is set to run the engine*/
+static uint64_t  engineDueUs  = 0;    /*!<When the armed engine runs*/
+static _Bool     bEngineStepping = false;/*!<Engine is calling the task layer, which sees a completion it ends itself*/
+
+void dali_periodic_fnc(daliTimer *pDaliTimer);
+
+/**
+ * @brief Run the engine after delayUs, sooner if it is already armed for later. Safe from thread or interrupt context
+ * @param delayUs 0 to run as soon as possible
+ */
+static void daliEngineArm(uint32_t delayUs);
+
+/**
+ * @brief true while a task is queued, running or suspended, or a transfer is in flight. Engine core only
+ * @return _Bool
+ */
+static _Bool daliTaskBusy(void);
+
+/**
+ * @brief calculate checksum of memory region for verification of saDaliNetworkData in particular
+ * 
+ * @param pCKSMSrc start of memory to perform checksum over
+ * @param CKSMLen number of bytes to take checksum of
+ * @return uint8_t checksum
+ */
+uint8_t  Calc_Checksum      (uint8_t *pCKSMSrc, 
+                             uint32_t CKSMLen );
+
+
+#if !defined(NRF) && !defined(DALI_HOST)
+/**
+ * @brief Alarm pool callback, runs the engine in the timer interrupt
+ * @return int64_t 0, the engine re-arms itself
+ */
+static int64_t daliEngineAlarm(alarm_id_t id, void *pUserData)
+{
+    dali_periodic_fnc(&id);
+    return 0;
+}
+#endif
+
+
+/**
+ * @brief Engine clock
+ * @return uint64_t microseconds
+ */
+static uint64_t daliEngineNowUs(void)
+{
+#ifdef NRF
+    return k_ticks_to_us_floor64(k_uptime_ticks());
+#elif defined(DALI_HOST)
+    return daliHostNowUs();
+#else
+    return time_us_64();
+#endif
+}
+
+
+static void daliEngineArm(uint32_t delayUs)
+{
+    uint64_t dueUs = daliEngineNowUs() + delayUs;
+    DALI_CRITICAL_ENTER();
+    if(  (false == bEngineArmed)
+       ||(dueUs <  engineDueUs ))
+    {
+        engineDueUs  = dueUs;
+        bEngineArmed = true;
+#ifdef NRF
+        k_timer_start(&sDaliTimer, K_USEC(delayUs), K_NO_WAIT);
+#elif !defined(DALI_HOST)
+        alarm_pool_cancel_alarm(psEngineAlarmPool, sDaliTimer);//no-op if it already fired
+        sDaliTimer = alarm_pool_add_alarm_in_us(psEngineAlarmPool, delayUs, daliEngineAlarm, NULL, true);
+#endif
+    }
+    DALI_CRITICAL_EXIT();
+}
+
+
+/**
+ * @brief Transfer complete interrupt, the last queued transaction is done so the next one may start
+ */
+static void daliEngineXferIdle(void)
+{
+    if(false == bEngineStepping)
+    {//a reply window the engine cuts short completes inside its step, which goes on without a second run
+        daliEngineArm(0);
+    }
+}
+
+
+/**
+ * @brief Bus, its interrupts and the engine timer, on the core that is to run them
+ */
+static void daliEngineInit(void)
+{
+    daliInit();//sets up the spi interface, spi dma end of transfer interrupt, starts a spi transfer to force the line high
+#ifdef NRF
+    k_timer_init(&sDaliTimer, dali_periodic_fnc, NULL);//one shot, armed by the engine
+#elif defined(DALI_CORE1)
+    psEngineAlarmPool = alarm_pool_create(DALI_CORE1_HW_ALARM, 4);//alarm interrupt is taken by the creating core
+#elif !defined(DALI_HOST)
+    psEngineAlarmPool = alarm_pool_get_default();
+#endif
+    daliSetXferIdleHook(daliEngineXferIdle);
+}
+
+#ifdef DALI_CORE1
+static _Bool daliTaskEnqueue    (sDaliTask_t *psDaliTask, eDaliTaskPrio_t ePrio, sDaliDapcDone_t *psDone);
+static void  daliTaskNotifyLater(eDaliTaskType_t eDaliTask, eDaliTaskStatus_t eStatus, sDaliTaskHandle_t *psHandle);
+static void  daliDapcNotifyLater(sDaliDapcDone_t *psDone);
+
+/**
+ * @brief core1: brings up the bus, then moves tasks from the request ring to the FIFOs each time core0 rings.
+ * The engine runs in this core's dma and alarm interrupts. busy is raised before a request leaves the ring, so
+ * core0 never sees both the ring empty and core1 idle while a task is in between
+ */
+static void daliCore1Main(void)
+{
+    sDaliTaskRequest_t sRequest;
+    sDaliDapcDone_t    sDone;
+    _Bool              bTaken;
+    _Bool              bRejected;
+    daliEngineInit();
+    for(;;)
+    {
+        (void)multicore_fifo_pop_blocking();//doorbell, sleeps in wfe
+        do
+        {
+            sDone.count = 0;
+            bRejected   = false;
+            {
+                DALI_CRITICAL_ENTER();
+                __atomic_store_n(&bCore1Busy, true, __ATOMIC_RELEASE);
+                bTaken = daliSpscPop(&sRequestRing, &sRequest);
+                if(true == bTaken)
+                {
+                    bRejected = !daliTaskEnqueue(&sRequest.sTask, sRequest.ePrio, &sDone);
+                }
+                __atomic_store_n(&bCore1Busy, daliTaskBusy(), __ATOMIC_RELEASE);
+                DALI_CRITICAL_EXIT();
+            }
+            if(true == bRejected)
+            {//this loop is not the engine, which alone pushes results
+                if(NULL != sRequest.sTask.psHandle)
+                {
+                    memcpy(&sRequest.sTask.psHandle->sResult,&sRequest.sTask,sizeof(sDaliTask_t));
+                }
+                daliTaskNotifyLater(sRequest.sTask.eDaliTask, evDaliTaskRejected, sRequest.sTask.psHandle);
+            }
+            daliDapcNotifyLater(&sDone);
+        }while(true == bTaken);
+    }
+}
+#endif
+
+
+void initDALI(void)
+{
+    daliSpscInit(&sResultRing, saResultStore, sizeof(sDaliTaskResult_t), DALI_TASK_RESULT_RING_LEN);
+#ifdef DALI_CORE1
+    daliSpscInit(&sRequestRing, saRequestStore, sizeof(sDaliTaskRequest_t), DALI_CORE1_RING_LEN);
+    multicore_launch_core1(daliCore1Main);
+#else
+    daliEngineInit();
+#endif
+}
+
+/**
+ * @brief A queued task is done and its handle, if any, holds the result: make the status final, put a record on
+ * the result ring, call back. Engine only, so the result ring has one producer, and not with interrupts
+ * masked so the callback may queue tasks
+ * @param eDaliTask task type
+ * @param eStatus how it ended
+ * @param psHandle NULL if queued without one
+ */
+static void daliTaskNotify(eDaliTaskType_t eDaliTask, eDaliTaskStatus_t eStatus, sDaliTaskHandle_t *psHandle)
+{
+    sDaliTaskResult_t  sResult;
+    daliTaskCallback_t pfnDone = NULL;
+    if(NULL != psHandle)
+    {
+        pfnDone = psHandle->pfnDone;//the owner may reuse the handle once the status is final
+        __atomic_store_n(&psHandle->eStatus, eStatus, __ATOMIC_RELEASE);
+    }
+    sResult.eDaliTask = eDaliTask;
+    sResult.eStatus   = eStatus;
+    sResult.psHandle  = psHandle;
+    if(false == daliSpscPush(&sResultRing, &sResult))
+    {//nobody is reading results
+        sTaskQueueStats.resultsDropped++;
+    }
+    if(NULL != pfnDone)
+    {
+        pfnDone(psHandle);
+    }
+}
+
+/**
+ * @brief A queued task is done, copy it to its handle and notify
+ * @param psTask the task as it finished, result fields filled in
+ * @param eStatus how it ended
+ */
+static void daliTaskFinish(sDaliTask_t *psTask, eDaliTaskStatus_t eStatus)
+{
+    if(NULL != psTask->psHandle)
+    {
+        memcpy(&psTask->psHandle->sResult,psTask,sizeof(sDaliTask_t));
+    }
+    daliTaskNotify(psTask->eDaliTask, eStatus, psTask->psHandle);
+}
+
+/**
+ * @brief A DAPC leaves the dimming FIFO without being sent. Called with interrupts masked, the copy is cheap
+ * and the notification waits for daliDapcNotify or daliDapcNotifyLater
+ * @param psDone list of DAPCs taken off
+ * @param psTask DAPC being taken off
+ */
+static void daliDapcDone(sDaliDapcDone_t *psDone, const sDaliTask_t *psTask)
+{
+    if(NULL != psTask->psHandle)
+    {
+        memcpy(&psTask->psHandle->sResult,psTask,sizeof(sDaliTask_t));
+    }
+    psDone->apHandle[psDone->count++] = psTask->psHandle;
+}
+
+/**
+ * @brief Engine: notify the DAPCs taken off, interrupts unmasked
+ * @param psDone list of DAPCs taken off
+ * @param eStatus evDaliTaskSuperseded, or evDaliTaskComplete if folded into a group or broadcast DAPC
+ */
+static void daliDapcNotify(sDaliDapcDone_t *psDone, eDaliTaskStatus_t eStatus)
+{
+    uint8_t i;
+    for(i = 0; i < psDone->count; i++)
+    {
+        daliTaskNotify(evDaliSetLevel, eStatus, psDone->apHandle[i]);
+    }
+    psDone->count = 0;
+}
+
+/**
+ * @brief A queued task ended outside the engine and its handle, if any, holds the result: leave the
+ * notification to the engine, the result ring has the engine as its only producer. Any context
+ * @param eDaliTask task type
+ * @param eStatus how it ended
+ * @param psHandle NULL if queued without one
+ */
+static void daliTaskNotifyLater(eDaliTaskType_t eDaliTask, eDaliTaskStatus_t eStatus, sDaliTaskHandle_t *psHandle)
+{
+    uint8_t tail;
+    if(NULL != psHandle)
+    {
+        psHandle->eNotify      = eStatus;
+        psHandle->psNextNotify = NULL;
+    }
+    {
+        DALI_CRITICAL_ENTER();
+        if(NULL != psHandle)
+        {
+            if(NULL == sNotifyLater.psFirst)
+            {
+                sNotifyLater.psFirst = psHandle;
+            }
+            else
+            {
+                sNotifyLater.psLast->psNextNotify = psHandle;
+            }
+            sNotifyLater.psLast = psHandle;
+        }
+        else if(sNotifyLater.count < DALI_TASK_RESULT_RING_LEN)
+        {
+            tail = (uint8_t)((sNotifyLater.head + sNotifyLater.count) % DALI_TASK_RESULT_RING_LEN);
+            sNotifyLater.saRecord[tail].eDaliTask = eDaliTask;
+            sNotifyLater.saRecord[tail].eStatus   = eStatus;
+            sNotifyLater.saRecord[tail].psHandle  = NULL;
+            sNotifyLater.count++;
+        }
+        else
+        {//nobody waits on it, lost as if the result ring were full
+            sTaskQueueStats.resultsDropped++;
+        }
+        DALI_CRITICAL_EXIT();
+    }
+    daliEngineArm(0);
+}
+
+/**
+ * @brief The DAPCs taken off outside the engine are superseded, leave their notification to the engine
+ * @param psDone list of DAPCs taken off
+ */
+static void daliDapcNotifyLater(sDaliDapcDone_t *psDone)
+{
+    uint8_t i;
+    for(i = 0; i < psDone->count; i++)
+    {
+        daliTaskNotifyLater(evDaliSetLevel, evDaliTaskSuperseded, psDone->apHandle[i]);
+    }
+    psDone->count = 0;
+}
+
+/**
+ * @brief Engine: notify the tasks that ended outside it, oldest first. Handles before records without one
+ */
+static void daliTaskNotifyPending(void)
+{
+    sDaliTaskHandle_t *psHandle;
+    sDaliTaskResult_t  sRecord;
+    for(;;)
+    {
+        {
+            DALI_CRITICAL_ENTER();
+            psHandle = sNotifyLater.psFirst;
+            if(NULL != psHandle)
+            {
+                sNotifyLater.psFirst = psHandle->psNextNotify;
+            }
+            else if(0 != sNotifyLater.count)
+            {
+                memcpy(&sRecord,&sNotifyLater.saRecord[sNotifyLater.head],sizeof(sDaliTaskResult_t));
+                sNotifyLater.head = (uint8_t)((sNotifyLater.head + 1) % DALI_TASK_RESULT_RING_LEN);
+                sNotifyLater.count--;
+            }
+            else
+            {
+                DALI_CRITICAL_EXIT();
+                return;
+            }
+            DALI_CRITICAL_EXIT();
+        }
+        if(NULL != psHandle)
+        {
+            daliTaskNotify(psHandle->sResult.eDaliTask, psHandle->eNotify, psHandle);
+        }
+        else
+        {
+            daliTaskNotify(sRecord.eDaliTask, sRecord.eStatus, NULL);
+        }
+    }
+}
+
+/**
+ * @brief Fill the result fields of a finished task from the measurement arrays
+ * @param psTask task that just left the slot
+ */
+static void daliTaskFillResult(sDaliTask_t *psTask)
+{
+    switch(psTask->eDaliTask)
+    {
+        case evDaliGetPwr:
+            psTask->uTask.sGetPwr.pfPwr = (float)sPwr[MSMT_INDEX(psTask->uTask.sGetPwr.addr)].pwr
+                                          *saDaliNetworkData.uData[psTask->uTask.sGetPwr.addr].sData.sStaticData.fPowerUnit;
+        break;
+        case evDaliGetTotNrg:
+            psTask->uTask.sGetNrg.pNrg = sPwr[MSMT_INDEX(psTask->uTask.sGetNrg.addr)].nrg;
+        break;
+        case evDaliGetOutputCurrent:
+            psTask->uTask.sGetIout.pAmps = sLEDLoadMsmts[MSMT_INDEX(psTask->uTask.sGetIout.addr)].amps;
+        break;
+        case evDaliGetOutputVoltage:
+            psTask->uTask.sGetVout.pVolts = sLEDLoadMsmts[MSMT_INDEX(psTask->uTask.sGetVout.addr)].volts;
+        break;
+        case evDaliGetDriverTemperature:
+            psTask->uTask.sGetGearTemp.temp = sGearMsmts[MSMT_INDEX(psTask->uTask.sGetGearTemp.addr)].temp;
+        break;
+        default:
+        break;
+    }
+}
+
+
+_Bool getDaliTaskResult(sDaliTaskResult_t *psResult)
+{
+    return daliSpscPop(&sResultRing, psResult);
+}
+
+/**
+ * @brief Microsecond clock for queue wait times
+ * @return uint32_t 
+ */
+static uint32_t daliTaskTimeUs(void)
+{
+#ifdef NRF
+    return k_cyc_to_us_floor32(k_cycle_get_32());
+#elif defined(DALI_HOST)
+    return (uint32_t)daliHostNowUs();
+#else
+    return time_us_32();
+#endif
+}
+
+/**
+ * @brief Priority a task type is queued at by setDaliTask
+ * @param eDaliTask task type
+ * @return eDaliTaskPrio_t 
+ */
+static eDaliTaskPrio_t daliTaskDefaultPrio(eDaliTaskType_t eDaliTask)
+{
+    switch(eDaliTask)
+    {
+        case evDaliSetLevel:
+            return evDaliPrioDimming;
+        case evDaliGetPwr:
+        case evDaliGetTotNrg:
+        case evDaliGetOutputCurrent:
+        case evDaliGetOutputVoltage:
+        case evDaliGetDriverTemperature:
+        case evDaliReadMemoryBank:
+        case evDaliWriteMemoryBank:
+            return evDaliPrioInteractive;
+        default:
+        break;
+    }
+    return evDaliPrioCommission;
+}
+
+/**
+ * @brief Drop a waiting task, later ones move up. Called with interrupts masked
+ * @param psFifo FIFO
+ * @param pos position counted from the oldest
+ */
+static void daliTaskFifoRemove(sDaliTaskFifo_t *psFifo, uint8_t pos)
+{
+    for(; (pos + 1) < psFifo->count; pos++)
+    {
+        memcpy(TASK_FIFO_ENTRY(psFifo, pos),TASK_FIFO_ENTRY(psFifo, pos + 1),sizeof(sDaliTaskEntry_t));
+    }
+    psFifo->count--;
+}
+
+/**
+ * @brief DAPC of psA may change the level of gear targeted by psB. Group membership on the gear is
+ * not known for certain, so a group overlaps every short address and every other group
+ * @return _Bool 
+ */
+static _Bool daliDapcOverlaps(const sDaliDAPC_t *psA, const sDaliDAPC_t *psB)
+{
+    if(  (evShortAddress == psA->sAddrType.eAddrType)
+       &&(evShortAddress == psB->sAddrType.eAddrType))
+    {
+        return (psA->sAddrType.addr == psB->sAddrType.addr);
+    }
+    return true;
+}
+
+/**
+ * @brief DAPC of psA and psB set exactly the same gear
+ * @return _Bool 
+ */
+static _Bool daliDapcSameTarget(const sDaliDAPC_t *psA, const sDaliDAPC_t *psB)
+{
+    if(psA->sAddrType.eAddrType != psB->sAddrType.eAddrType)
+    {
+        return false;
+    }
+    return (  (evBroadcastAll         == psA->sAddrType.eAddrType        )
+            ||(evBroadcastUnaddressed == psA->sAddrType.eAddrType        )
+            ||(psA->sAddrType.addr    == psB->sAddrType.addr             ));
+}
+
+/**
+ * @brief Fold a new DAPC into the dimming FIFO. A pending DAPC to the same target takes the new level and
+ * handle in place, unless a DAPC queued after it touches the same gear. A broadcast replaces every pending
+ * DAPC. Nothing is folded across a batch, its DAPCs are not looked at. Called with interrupts masked
+ * @param psNew new DAPC task
+ * @param psDone collects the DAPCs superseded
+ * @return _Bool true if it was absorbed and needs no entry of its own
+ */
+static _Bool daliDapcCoalesce(const sDaliTask_t *psNew, sDaliDapcDone_t *psDone)
+{
+    sDaliTaskFifo_t   *psFifo = &saTaskFifo[evDaliPrioDimming];
+    const sDaliDAPC_t *psDapc = &psNew->uTask.sSetDAPC;
+    sDaliTask_t       *psTask;
+    uint8_t            pos;
+    if(evBroadcastAll == psDapc->sAddrType.eAddrType)
+    {
+        for(pos = psFifo->count; pos > 0; pos--)
+        {//only DAPCs queued after the last batch
+            if(evDaliBatch == TASK_FIFO_ENTRY(psFifo, pos - 1)->sTask.eDaliTask)
+            {
+                break;
+            }
+        }
+        while(pos < psFifo->count)
+        {
+            if(evDaliSetLevel == TASK_FIFO_ENTRY(psFifo, pos)->sTask.eDaliTask)
+            {
+                daliDapcDone(psDone, &TASK_FIFO_ENTRY(psFifo, pos)->sTask);
+                daliTaskFifoRemove(psFifo, pos);
+                sTaskQueueStats.dapcCoalesced++;
+            }
+            else
+            {
+                pos++;
+            }
+        }
+        return false;
+    }
+    for(pos = psFifo->count; pos > 0; pos--)
+    {//newest first, the first DAPC touching the same gear decides
+        psTask = &TASK_FIFO_ENTRY(psFifo, pos - 1)->sTask;
+        if(evDaliBatch == psTask->eDaliTask)
+        {
+            return false;
+        }
+        if(evDaliSetLevel != psTask->eDaliTask)
+        {
+            continue;
+        }
+        if(true == daliDapcSameTarget(&psTask->uTask.sSetDAPC, psDapc))
+        {
+            daliDapcDone(psDone, psTask);
+            psTask->uTask.sSetDAPC.level = psDapc->level;
+            psTask->psHandle             = psNew->psHandle;
+            sTaskQueueStats.dapcCoalesced++;
+            return true;
+        }
+        if(true == daliDapcOverlaps(&psTask->uTask.sSetDAPC, psDapc))
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief A short address DAPC is about to go out. If every known member of a group, or every driver on the
+ * bus, has a DAPC to the same level at the front of the dimming FIFO, send one group or broadcast DAPC
+ * instead and drop the others. Only while no gear outside saDaliNetworkData can be on the bus, and for groups
+ * only once identification has read the groups of every driver, as any other gear would follow the level too. Only the run of short address DAPCs at the front is looked at: those target
+ * different gear, so sending them in one frame cannot reorder anything. Called with interrupts masked
+ * @param psDaliTask task being started, rewritten to the group or broadcast DAPC
+ * @param psDone collects the DAPCs folded in, they complete with it
+ */
+static void daliDapcCollapse(sDaliTask_t *psDaliTask, sDaliDapcDone_t *psDone)
+{
+    sDaliTaskFifo_t *psFifo   = &saTaskFifo[evDaliPrioDimming];
+    sDaliDAPC_t     *psDapc   = &psDaliTask->uTask.sSetDAPC;
+    sDaliTask_t     *psTask;
+    uint64_t         sameMask;
+    uint64_t         knownMask = 0;
+    uint64_t         aGroupMask[MAX_GROUP_ADDRESS + 1] = {0};
+    uint64_t         foldMask  = 0;
+    uint8_t          numKnown  = (saDaliNetworkData.numDrivers < MAX_SUPPORTED_DRIVERS) ? saDaliNetworkData.numDrivers : MAX_SUPPORTED_DRIVERS;
+    uint8_t          addr;
+    uint8_t          group;
+    uint8_t          pos;
+    _Bool            bGroupsRead = true;
+    if(  (evDaliSetLevel != psDaliTask->eDaliTask      )
+       ||(evShortAddress != psDapc->sAddrType.eAddrType)
+       ||(MAX_SHORT_ADDRESS < psDapc->sAddrType.addr   )
+       ||(false          == bBusListed                 ))
+    {
+        return;
+    }
+    sameMask = 1ull << psDapc->sAddrType.addr;
+    for(pos = 0; pos < psFifo->count; pos++)
+    {
+        psTask = &TASK_FIFO_ENTRY(psFifo, pos)->sTask;
+        if(  (evDaliSetLevel    != psTask->eDaliTask                     )
+           ||(evShortAddress    != psTask->uTask.sSetDAPC.sAddrType.eAddrType)
+           ||(MAX_SHORT_ADDRESS <  psTask->uTask.sSetDAPC.sAddrType.addr ))
+        {
+            break;
+        }
+        if(psDapc->level == psTask->uTask.sSetDAPC.level)
+        {
+            sameMask |= 1ull << psTask->uTask.sSetDAPC.sAddrType.addr;
+        }
+    }
+    for(pos = 0; pos < numKnown; pos++)
+    {
+        addr = saDaliNetworkData.uData[pos].sData.sStaticData.addr;
+        if(addr > MAX_SHORT_ADDRESS)
+        {
+            continue;
+        }
+        knownMask   |= 1ull << addr;
+        bGroupsRead  = (  (true == bGroupsRead                                            )
+                        &&(true == saDaliNetworkData.uData[pos].sData.sUserConfig.bGroupsRead));
+        for(group = 0; group <= MAX_GROUP_ADDRESS; group++)
+        {
+            if(0 != (saDaliNetworkData.uData[pos].sData.sUserConfig.gearGroups & (1u << group)))
+            {
+                aGroupMask[group] |= 1ull << addr;
+            }
+        }
+    }
+    if(  (saDaliNetworkData.numDrivers <= MAX_SUPPORTED_DRIVERS)
+       &&(__builtin_popcountll(knownMask) >= 2              )
+       &&(0 == (knownMask & ~sameMask)                      ))
+    {//every driver on the bus
+        psDapc->sAddrType.eAddrType = evBroadcastAll;
+        foldMask                    = knownMask;
+    }
+    else if(true == bGroupsRead)
+    {
+        for(group = 0; group <= MAX_GROUP_ADDRESS; group++)
+        {
+            if(  (0 != (aGroupMask[group] & (1ull << psDapc->sAddrType.addr)))
+               &&(__builtin_popcountll(aGroupMask[group]) >= 2                 )
+               &&(0 == (aGroupMask[group] & ~sameMask)                         )
+               &&(__builtin_popcountll(aGroupMask[group]) > __builtin_popcountll(foldMask)))
+            {
+                psDapc->sAddrType.eAddrType = evGroupAddress;
+                psDapc->sAddrType.addr      = group;
+                foldMask                    = aGroupMask[group];
+            }
+        }
+    }
+    if(0 == foldMask)
+    {
+        return;
+    }
+    for(pos = 0; pos < psFifo->count;)
+    {
+        psTask = &TASK_FIFO_ENTRY(psFifo, pos)->sTask;
+        if(  (evDaliSetLevel    != psTask->eDaliTask                     )
+           ||(evShortAddress    != psTask->uTask.sSetDAPC.sAddrType.eAddrType)
+           ||(MAX_SHORT_ADDRESS <  psTask->uTask.sSetDAPC.sAddrType.addr ))
+        {
+            break;
+        }
+        if(  (psDapc->level == psTask->uTask.sSetDAPC.level                           )
+           &&(0             != (foldMask & (1ull << psTask->uTask.sSetDAPC.sAddrType.addr))))
+        {
+            daliDapcDone(psDone, psTask);
+            daliTaskFifoRemove(psFifo, pos);
+            sTaskQueueStats.dapcCollapsed++;
+        }
+        else
+        {
+            pos++;
+        }
+    }
+}
+
+/**
+ * @brief Take the oldest task of the highest priority waiting
+ * @param psDaliTask where the task is copied to
+ * @param pePrio priority it was queued at
+ * @return _Bool false if nothing is waiting
+ */
+static _Bool daliTaskDequeue(sDaliTask_t *psDaliTask, eDaliTaskPrio_t *pePrio)
+{
+    sDaliTaskFifo_t *psFifo;
+    sDaliDapcDone_t  sDone;
+    uint32_t         waitUs;
+    uint32_t         deadlineUs;
+    uint8_t          prio;
+    sDone.count = 0;
+    DALI_CRITICAL_ENTER();
+    if(0 == taskReadyMask)
+    {
+        DALI_CRITICAL_EXIT();
+        return false;
+    }
+    prio   = (uint8_t)__builtin_ctz(taskReadyMask);
+    psFifo = &saTaskFifo[prio];
+    memcpy(psDaliTask,&psFifo->saEntry[psFifo->head].sTask,sizeof(sDaliTask_t));
+    waitUs       = daliTaskTimeUs() - psFifo->saEntry[psFifo->head].queuedUs;
+    deadlineUs   = psFifo->saEntry[psFifo->head].deadlineUs;
+    psFifo->head = (uint8_t)((psFifo->head + 1) % DALI_TASK_QUEUE_DEPTH);
+    psFifo->count--;
+    if(evDaliPrioDimming == prio)
+    {
+        daliDapcCollapse(psDaliTask, &sDone);
+    }
+    if(0 == psFifo->count)
+    {
+        taskReadyMask &= (uint8_t)~(1u << prio);
+    }
+    sTaskQueueStats.depth    [prio]  = psFifo->count;
+    sTaskQueueStats.started  [prio]++;
+    sTaskQueueStats.waitUsSum[prio] += waitUs;
+    if(waitUs > sTaskQueueStats.waitUsMax[prio])
+    {
+        sTaskQueueStats.waitUsMax[prio] = waitUs;
+    }
+    if(  (0      != deadlineUs)
+       &&(waitUs >  deadlineUs))
+    {
+        sTaskQueueStats.deadlineMissed[prio]++;
+        if((waitUs - deadlineUs) > sTaskQueueStats.lateUsMax[prio])
+        {
+            sTaskQueueStats.lateUsMax[prio] = waitUs - deadlineUs;
+        }
+        DALI_TRACE(DALI_TRACE_LVL_INFO, evTraceDeadlineMissed, psDaliTask->eDaliTask, waitUs - deadlineUs);
+    }
+    DALI_CRITICAL_EXIT();
+    daliDapcNotify(&sDone, evDaliTaskComplete);//their level goes out in this frame
+    *pePrio = (eDaliTaskPrio_t)prio;
+    return true;
+}
+
+/**
+ * @brief Timeout of a task that did not set its own
+ * @param psTask task
+ * @return uint32_t microseconds, 0 for none
+ */
+static uint32_t daliTaskDefaultTimeoutUs(const sDaliTask_t *psTask)
+{
+    uint8_t numDrivers = (0 != saDaliNetworkData.numDrivers) ? saDaliNetworkData.numDrivers : 1;
+    switch(psTask->eDaliTask)
+    {
+        case evDaliSetLevel:
+            return 0;//one frame
+        case evDaliAddress:
+            return DALI_TIMEOUT_ADDRESS_US;
+        case evDaliIdentify:
+            return DALI_TIMEOUT_IDENTIFY_US * numDrivers;
+        case evJCPHCommission:
+            return DALI_TIMEOUT_COMMISSION_US;
+        case evDaliReadMemoryBank:
+        case evDaliWriteMemoryBank:
+            return DALI_TIMEOUT_ACCESS_US + (2u * DALI_FRAME_US * psTask->uTask.sDaliReadMB.len);
+        default:
+        break;
+    }
+    return DALI_TIMEOUT_ACCESS_US;
+}
+
+/**
+ * @brief Short addresses of the drivers saDaliNetworkData holds
+ * @return uint64_t bit per short address
+ */
+static uint64_t daliNetworkAddrMask(void)
+{
+    uint8_t  numKnown = (saDaliNetworkData.numDrivers < MAX_SUPPORTED_DRIVERS) ? saDaliNetworkData.numDrivers : MAX_SUPPORTED_DRIVERS;
+    uint64_t mask     = 0;
+    uint8_t  pos;
+    for(pos = 0; pos < numKnown; pos++)
+    {
+        if(saDaliNetworkData.uData[pos].sData.sStaticData.addr <= MAX_SHORT_ADDRESS)
+        {
+            mask |= 1ull << saDaliNetworkData.uData[pos].sData.sStaticData.addr;
+        }
+    }
+    return mask;
+}
+
+/**
+ * @brief Forget the random addresses identification read, of drivers whose gear may have drawn another
+ * @param keep bit per short address of the drivers still known, 0 after a RANDOMISE reached every gear
+ */
+static void daliNetworkForgetRandom(uint64_t keep)
+{
+    uint8_t addr;
+    uint8_t pos;
+    for(pos = 0; pos < MAX_SUPPORTED_DRIVERS; pos++)
+    {
+        addr = saDaliNetworkData.uData[pos].sData.sStaticData.addr;
+        if(  (MAX_SHORT_ADDRESS >= addr                  )
+           &&(0                 != (keep & (1ull << addr))))
+        {
+            continue;
+        }
+        memset(saDaliNetworkData.uData[pos].sData.sStaticData.aRandomAddr, 0xff, sizeof(saDaliNetworkData.uData[pos].sData.sStaticData.aRandomAddr));
+    }
+}
+
+/**
+ * @brief Record the drivers a full addressing run found: short address i at index i. Groups are
+ * unknown until identification reads them, the gear behind an entry may have changed
+ */
+static void daliNetworkAddressed(void)
+{
+    uint8_t pos;
+    for(pos = 0; (pos < saDaliNetworkData.numDrivers) && (pos < MAX_SUPPORTED_DRIVERS); pos++)
+    {
+        saDaliNetworkData.uData[pos].sData.sStaticData.addr = pos;
+        memset(&saDaliNetworkData.uData[pos].sData.sUserConfig, 0, sizeof(sUserConfig_t));
+    }
+    daliNetworkForgetRandom(0);
+    saDaliNetworkData.checksum = Calc_Checksum((uint8_t *)&saDaliNetworkData,
+                                               sizeof(sDaliNetworkPld_t)    );
+}
+
+/**
+ * @brief Append the drivers an incremental or restore run gave short addresses to, the entries already
+ * there are kept. An entry left by gear that no longer answered at its address is cleared for the new
+ * gear there. Past MAX_SUPPORTED_DRIVERS only numDrivers counts them
+ * @param added bit per short address given out
+ */
+static void daliNetworkMerge(uint64_t added)
+{
+    uint8_t numKnown = (saDaliNetworkData.numDrivers < MAX_SUPPORTED_DRIVERS) ? saDaliNetworkData.numDrivers : MAX_SUPPORTED_DRIVERS;
+    uint8_t addr;
+    uint8_t pos;
+    while(0 != added)
+    {
+        addr   = (uint8_t)__builtin_ctzll(added);
+        added &= added - 1;
+        for(pos = 0; pos < numKnown; pos++)
+        {
+            if(addr == saDaliNetworkData.uData[pos].sData.sStaticData.addr)
+            {
+                break;
+            }
+        }
+        if(pos == numKnown)
+        {
+            saDaliNetworkData.numDrivers++;
+            if(numKnown >= MAX_SUPPORTED_DRIVERS)
+            {
+                continue;
+            }
+            numKnown++;
+        }
+        memset(&saDaliNetworkData.uData[pos],0,sizeof(uDaliDriverData_t));
+        memset(saDaliNetworkData.uData[pos].sData.sStaticData.aRandomAddr, 0xff, sizeof(saDaliNetworkData.uData[pos].sData.sStaticData.aRandomAddr));
+        saDaliNetworkData.uData[pos].sData.sStaticData.addr = addr;
+    }
+    saDaliNetworkData.checksum = Calc_Checksum((uint8_t *)&saDaliNetworkData,
+                                               sizeof(sDaliNetworkPld_t)    );
+}
+
+/**
+ * @brief Rebuild the driver list after a restore run. Entries of gear the run did not find at their
+ * short address are dropped and the rest close up in their order, then the gear it gave new short
+ * addresses are appended. Past MAX_SUPPORTED_DRIVERS only numDrivers counts them
+ * @param found bit per short address of the entries whose gear was restored or kept its address
+ * @param added bit per short address given to gear the list did not hold
+ */
+static void daliNetworkRestored(uint64_t found, uint64_t added)
+{
+    uint8_t  numKnown = (saDaliNetworkData.numDrivers < MAX_SUPPORTED_DRIVERS) ? saDaliNetworkData.numDrivers : MAX_SUPPORTED_DRIVERS;
+    uint8_t  numKept  = 0;
+    uint64_t listed   = 0;
+    uint8_t  addr;
+    uint8_t  pos;
+    for(pos = 0; pos < numKnown; pos++)
+    {
+        addr = saDaliNetworkData.uData[pos].sData.sStaticData.addr;
+        if(  (MAX_SHORT_ADDRESS <  addr                     )
+           ||(0                 == (found  & (1ull << addr)))
+           ||(0                 != (listed & (1ull << addr))))
+        {//gone, or a second entry for the same gear
+            continue;
+        }
+        listed |= 1ull << addr;
+        if(pos != numKept)
+        {
+            saDaliNetworkData.uData[numKept] = saDaliNetworkData.uData[pos];
+        }
+        numKept++;
+    }
+    memset(&saDaliNetworkData.uData[numKept], 0, (MAX_SUPPORTED_DRIVERS - numKept) * sizeof(uDaliDriverData_t));
+    saDaliNetworkData.numDrivers = numKept;
+    daliNetworkMerge(added);
+}
+
+/**
+ * @brief Put the state machines a task type steps back to their first step, for the next task whether
+ * this one finished, timed out or was cancelled. Bus is idle
+ * @param eDaliTask task type
+ */
+static void daliTaskCtxReset(eDaliTaskType_t eDaliTask)
+{
+    switch(eDaliTask)
+    {
+        case evDaliSetLevel:
+        break;//the context belongs to the task it preempted
+        case evDaliAddress:
+            daliAddressingReset(&uTaskCtx.sAddr);
+        break;
+        case evDaliIdentify:
+            identifyDaliDriversReset(&uTaskCtx.sIdentify);
+        break;
+        case evJCPHCommission:
+            daliJCPHCommissionReset(&uTaskCtx.sCommission);
+        break;
+        default://measurements and memory bank access
+            memset(&uTaskCtx,0,sizeof(uTaskCtx));
+            daliMemoryBankReset();
+        break;
+    }
+}
 
-typedef struct
+/**
+ * @brief A task other than a DAPC takes the slot: fresh context, timeout from now
+ * @param psTask task
+ */
+static void daliTaskCtxStart(const sDaliTask_t *psTask)
 {
-    uint32_t pwr;
-    float    fPwr;
-    uint64_t nrg;
-}sPwr_t;
+    daliTaskCtxReset(psTask->eDaliTask);
+    daliCtxInit(&uTaskCtx.sCtx, (0 != psTask->timeoutUs) ? psTask->timeoutUs : daliTaskDefaultTimeoutUs(psTask));
+    if(evDaliAddress == psTask->eDaliTask)
+    {//known drivers keep their short address even if they do not answer the scan
+        uTaskCtx.sAddr.bIncremental = psTask->uTask.sAddress.bIncremental;
+        uTaskCtx.sAddr.bRestore     = (  (false == psTask->uTask.sAddress.bIncremental)
+                                       &&(true  == psTask->uTask.sAddress.bRestore    ));
+        uTaskCtx.sAddr.inUse        = daliNetworkAddrMask();
+        uTaskCtx.sAddr.puKnown      = saDaliNetworkData.uData;
+        uTaskCtx.sAddr.numKnown     = (saDaliNetworkData.numDrivers < MAX_SUPPORTED_DRIVERS) ? saDaliNetworkData.numDrivers : MAX_SUPPORTED_DRIVERS;
+    }
+}
 
-typedef struct
+/**
+ * @brief A handle asked to cancel its task
+ * @param psHandle NULL if queued without one
+ * @return _Bool 
+ */
+static _Bool daliTaskCancelAsked(sDaliTaskHandle_t *psHandle)
 {
-    uint16_t volts;
-    uint16_t  amps;
-}sLEDLoadMeasurements_t;
+    return (  (NULL != psHandle                                              )
+            &&(true == __atomic_load_n(&psHandle->bCancel, __ATOMIC_ACQUIRE)));
+}
 
-typedef struct
+/**
+ * @brief Whether the task in the slot is to end before its next step: its handle, or that of its batch,
+ * asked to cancel it, or it ran past its timeout. A DAPC is one frame, only a cancel stops it
+ * @return eDaliTaskStatus_t evDaliTaskRunning to carry on, else evDaliTaskCancelled or evDaliTaskTimedOut
+ */
+static eDaliTaskStatus_t daliTaskCheckEnd(void)
 {
-    uint16_t temp;
-}sGearMeasurements_t;
-
-sPwr_t                 sPwr[5];//support 4 drivers.  The 5th element will take pwr readings for any index after the 4th.
-sLEDLoadMeasurements_t sLEDLoadMsmts[5];
-sGearMeasurements_t    sGearMsmts   [5];
-
+    _Bool bCancel = daliTaskCancelAsked((true == bCurBatchItem) ? sBatchRun.sTask.psHandle : sCurDaliTask.psHandle);
+    if(evNoTask == sCurDaliTask.eDaliTask)
+    {
+        return evDaliTaskRunning;
+    }
+    if(evDaliSetLevel == sCurDaliTask.eDaliTask)
+    {
+        return (true == bCancel) ? evDaliTaskCancelled : evDaliTaskRunning;
+    }
+    if(true == bCancel)
+    {
+        daliCtxCancel(&uTaskCtx.sCtx);
+    }
+    switch(daliCtxCheck(&uTaskCtx.sCtx))
+    {
+        case evDaliCtxTimedOut:
+            return evDaliTaskTimedOut;
+        case evDaliCtxCancelled:
+            return evDaliTaskCancelled;
+        default:
+        break;
+    }
+    return evDaliTaskRunning;
+}
 
-/** @brief */
-saDaliNetworkData_t saDaliNetworkData  __attribute__((aligned(4))) = 
+/**
+ * @brief Put the next item of the batch in the slot, as if it had just been dequeued
+ */
+static void daliBatchLoad(void)
 {
-    .numDrivers = 1,
-    .uData = {0}
-};
+    const sDaliTaskBatch_t *psBatch = sBatchRun.sTask.uTask.psBatch;
+    memcpy(&sCurDaliTask,&psBatch->psTasks[psBatch->aOrder[sBatchRun.pos]],sizeof(sDaliTask_t));
+    sCurDaliTask.psHandle = NULL;//the batch handle reports for it
+    bCurBatchItem         = true;
+    bTaskValid            = true;
+    eDaliTaskStatus       = evDaliNoTaskRunning;
+    eRunDaliTask          = sCurDaliTask.eDaliTask;
+    if(evDaliSetLevel != sCurDaliTask.eDaliTask)
+    {
+        daliTaskCtxStart(&sCurDaliTask);
+    }
+}
 
-/** @brief  */
-eDaliTaskStatus_t   eDaliTaskStatus = evDaliNoTaskRunning;
+/**
+ * @brief A batch was dequeued into the slot, its first item takes its place
+ */
+static void daliBatchStart(void)
+{
+    memcpy(&sBatchRun.sTask,&sCurDaliTask,sizeof(sDaliTask_t));
+    sBatchRun.eStatus = evDaliTaskComplete;
+    sBatchRun.pos     = 0;
+    sBatchRun.bActive = true;
+    daliMemoryBankReuseDtr(true);//items are reads and DAPCs only, nothing else sets a DTR until the batch ends
+    daliBatchLoad();
+}
 
-/** @brief */
-sDaliTask_t sCurDaliTask =
-{//currently executing dali task
-  .eDaliTask      = evNoTask,
-  .uTask.taskData = {0}
-};
+/**
+ * @brief Record how an item of the running batch ended
+ * @param item index into psTasks
+ * @param eStatus final status
+ */
+static void daliBatchItemStatus(uint8_t item, eDaliTaskStatus_t eStatus)
+{
+    sDaliTaskBatch_t *psBatch = sBatchRun.sTask.uTask.psBatch;
+    if(NULL != psBatch->peStatus)
+    {
+        psBatch->peStatus[item] = eStatus;
+    }
+    if(evDaliTaskComplete == eStatus)
+    {
+        psBatch->numComplete++;
+    }
+    else if(evDaliTaskComplete == sBatchRun.eStatus)
+    {
+        sBatchRun.eStatus = eStatus;
+    }
+}
 
-sDaliTask_t sIDaliTask = 
-{//holder for interrupted task if higher priority (dimming) task is injected
-    .eDaliTask = evNoTask,
-    .uTask.taskData = {0}
-};
+/**
+ * @brief The item in the slot left it: write it back, then load the next item, or end the batch once every
+ * item is done or its handle asked to cancel. Bus is idle
+ * @param eStatus how the item ended, sCurDaliTask holds it with its result fields filled in
+ */
+static void daliBatchNext(eDaliTaskStatus_t eStatus)
+{
+    sDaliTaskBatch_t *psBatch = sBatchRun.sTask.uTask.psBatch;
+    uint8_t           item    = psBatch->aOrder[sBatchRun.pos];
+    memcpy(&psBatch->psTasks[item],&sCurDaliTask,sizeof(sDaliTask_t));
+    daliBatchItemStatus(item, eStatus);
+    sCurDaliTask.eDaliTask = evNoTask;
+    eRunDaliTask           = evNoTask;
+    bCurBatchItem          = false;
+    for(sBatchRun.pos++; sBatchRun.pos < psBatch->numTasks; sBatchRun.pos++)
+    {
+        if(false == daliTaskCancelAsked(sBatchRun.sTask.psHandle))
+        {
+            daliBatchLoad();
+            return;
+        }
+        daliBatchItemStatus(psBatch->aOrder[sBatchRun.pos], evDaliTaskCancelled);
+    }
+    sBatchRun.bActive = false;
+    daliMemoryBankReuseDtr(false);
+    daliTaskFinish(&sBatchRun.sTask, sBatchRun.eStatus);
+}
 
-_Bool    daliDataInitStatus = false;/*!<Inidcates if saDaliNetworkData has been populated or not*/
-_Bool    bTaskValid         = false;/*!<Indicates internally if task is still being worked on*/  
-_Bool    bDALITaskSuspended = false;/*!<Indicates a multi-transfer task was suspended for a higher priority dimming event*/
+/**
+ * @brief A DAPC is next on the dimming FIFO. Other tasks share the driver's multi-transaction state
+ * machines with whatever they would interrupt, so only a DAPC preempts
+ * @return _Bool 
+ */
+static _Bool daliTaskDapcWaiting(void)
+{
+    const sDaliTaskFifo_t *psFifo = &saTaskFifo[evDaliPrioDimming];
+    return (  (0              != psFifo->count                              )
+            &&(evDaliSetLevel == psFifo->saEntry[psFifo->head].sTask.eDaliTask));
+}
 
-#ifdef NRF
- typedef struct k_timer daliTimer;
-#else
-typedef struct uint32_t daliTimer;//@TODO: fix!!!
-#endif
+/**
+ * @brief A running task other than dimming may be preempted: ask its sequence to give way at the next
+ * safe point while a DAPC waits
+ */
+static void daliTaskGiveWay(void)
+{
+    daliSeqGiveWay(  (true              == bTaskValid            )
+                   &&(evNoTask          != sCurDaliTask.eDaliTask)
+                   &&(evDaliPrioDimming != eCurDaliPrio          )
+                   &&(false             == bDALITaskSuspended    )
+                   &&(true              == daliTaskDapcWaiting()));
+}
 
-#
-void dali_periodic_fnc(daliTimer *pDaliTimer);
+/**
+ * @brief Send the DTRs the interrupted task had set up again, where the tasks run in its place left
+ * them changed or unknown. Bus is idle, so the shadow is final
+ */
+static void daliTaskDtrRestore(void)
+{
+    static const eDaliSpecialCommands_t aeSetDtr[] = {evSetDTR0, evSetDTR1, evSetDTR2};
+    sDaliDtrShadow_t sNow;
+    uint8_t          dtr;
+    daliGetDtrShadow(&sNow);
+    daliBusSetTag((uint8_t)sIDaliTask.eDaliTask);//resent on its behalf
+    for(dtr = 0; dtr < sizeof(aeSetDtr)/sizeof(aeSetDtr[0]); dtr++)
+    {
+        if(  (0 != (sIDtrShadow.validMask & (1u << dtr)))
+           &&(  (0                      == (sNow.validMask & (1u << dtr)))
+              ||(sIDtrShadow.aDtr[dtr] != sNow.aDtr[dtr]                )))
+        {
+            sendSpecialCmdNoReply(sIDtrShadow.aDtr[dtr], aeSetDtr[dtr]);
+            daliBusCountRetry();
+            sTaskQueueStats.dtrRestored++;
+        }
+    }
+}
 
 /**
- * @brief calculate checksum of memory region for verification of saDaliNetworkData in particular
- * 
- * @param pCKSMSrc start of memory to perform checksum over
- * @param CKSMLen number of bytes to take checksum of
- * @return uint8_t checksum
+ * @brief Pick the task to work on at a transaction boundary. An idle slot takes the suspended task
+ * back once no dimming is waiting and the bus has drained, else the next queued task. A DAPC preempts
+ * a running task of any other priority unless its last sequence holds the bus; the DTRs it had set
+ * up are sent again when it is restored. Everything else waits for the running task to finish, as
+ * those tasks share the driver's multi-transaction state machines
  */
-uint8_t  Calc_Checksum      (uint8_t *pCKSMSrc, 
-                             uint32_t CKSMLen );
+static void daliTaskSchedule(void)
+{
+    if(  (false    == bTaskValid            )
+       ||(evNoTask == sCurDaliTask.eDaliTask))
+    {
+        if(  (true  == bDALITaskSuspended    )
+           &&(false == daliTaskDapcWaiting() )
+           &&(false == transmitForwardFrame()))
+        {
+            daliTaskDtrRestore();
+            memcpy(&sCurDaliTask,&sIDaliTask,sizeof(sDaliTask_t));
+            eCurDaliPrio       = eIDaliPrio;
+            bCurBatchItem      = bIBatchItem;
+            bDALITaskSuspended = false;
+            bTaskValid         = true;
+            eDaliTaskStatus    = evDaliTaskRunning;
+            eRunDaliTask       = sCurDaliTask.eDaliTask;
+            DALI_TRACE(DALI_TRACE_LVL_INFO, evTraceTaskRestored, sCurDaliTask.eDaliTask, 0);
+        }
+        else if(  (false == bDALITaskSuspended   )
+                ||(true  == daliTaskDapcWaiting()))
+        {//suspended task waits for the bus to drain, not for other tasks
+            if(true == daliTaskDequeue(&sCurDaliTask, &eCurDaliPrio))
+            {
+                bTaskValid      = true;
+                eDaliTaskStatus = evDaliNoTaskRunning;
+                eRunDaliTask    = sCurDaliTask.eDaliTask;
+                if(evDaliBatch == sCurDaliTask.eDaliTask)
+                {
+                    daliBatchStart();
+                }
+                else if(evDaliSetLevel != sCurDaliTask.eDaliTask)
+                {//only a DAPC runs while a task is suspended, so the context is free
+                    daliTaskCtxStart(&sCurDaliTask);
+                }
+            }
+        }
+    }
+    else if(  (evDaliPrioDimming != eCurDaliPrio                          )
+            &&(false             == bDALITaskSuspended                    )
+            &&(true              == daliTaskDapcWaiting()                 )
+            &&(false             == daliSeqHeld()                         ))
+    {
+        DALI_TRACE(DALI_TRACE_LVL_INFO, evTraceTaskPreempted, sCurDaliTask.eDaliTask, 0);
+        memcpy(&sIDaliTask,&sCurDaliTask,sizeof(sDaliTask_t));//copy the interrupted task to be restored later
+        daliSnapDtrShadow(&sIDtrShadow);
+        eIDaliPrio         = eCurDaliPrio;
+        bIBatchItem        = bCurBatchItem;
+        bCurBatchItem      = false;
+        bDALITaskSuspended = true;
+        sTaskQueueStats.preempted++;
+        daliTaskDequeue(&sCurDaliTask, &eCurDaliPrio);
+        eDaliTaskStatus    = evDaliNoTaskRunning;
+        eRunDaliTask       = sCurDaliTask.eDaliTask;
+    }
+    daliTaskGiveWay();
+}
 
 
-void initDALI(void)
+_Bool setDaliTask(sDaliTask_t *psDaliTask)
 {
-    daliInit();//sets up the spi interface, spi dma end of transfer interrupt, starts a spi transfer to force the line high
-//    k_timer_init (&daliTimer, dali_periodic_fnc, NULL       );//init zephyr timer for DALI scheduling 
-//    k_timer_start(&daliTimer, K_MSEC(25)      , K_MSEC(25));//start zephyr timer for DAIL scheduling
+    return setDaliTaskPrio(psDaliTask, daliTaskDefaultPrio(psDaliTask->eDaliTask));
 }
 
+
 /**
- * @brief Assign DALI task if idle, return false if no idle, inject priority dimming tasks
- * @param psDaliTask Task to assign
- * @return False if not idle, true if task assigned
+ * @brief Put a task on its priority FIFO, on the core running the engine
+ * @param psDaliTask task, cleared if queued
+ * @param ePrio priority FIFO to queue on
+ * @param psDone collects DAPCs superseded by this one, for daliDapcNotifyLater
+ * @return _Bool false if that FIFO is full
  */
-_Bool setDaliTask(sDaliTask_t *psDaliTask)
+static _Bool daliTaskEnqueue(sDaliTask_t *psDaliTask, eDaliTaskPrio_t ePrio, sDaliDapcDone_t *psDone)
 {
-#if 0//commented out to test injecting high priority dimming tasks code
-    if(false == getDaliTransferStatus())
-    {//return and indicate task not scheduled if DALI is mid-transfer
-        return false;
+    sDaliTaskFifo_t *psFifo = &saTaskFifo[ePrio];
+    uint8_t          tail;
+    DALI_CRITICAL_ENTER();
+    if(  (evDaliPrioDimming == ePrio                                       )
+       &&(evDaliSetLevel    == psDaliTask->eDaliTask                       )
+       &&(true              == daliDapcCoalesce(psDaliTask, psDone)))
+    {//latest level rides on the pending DAPC
+        sTaskQueueStats.depth[ePrio] = psFifo->count;
+        DALI_CRITICAL_EXIT();
+        memset(psDaliTask,0,sizeof(sDaliTask_t));
+        return true;
     }
-    if(eDaliTaskStatus != evDaliNoTaskRunning)
-    {//return and indicate task not scheduled if DALI is in the middle of a multi-transfer task
+    if(psFifo->count >= DALI_TASK_QUEUE_DEPTH)
+    {//return and indicate task not scheduled if this priority is backed up
+        sTaskQueueStats.rejected[ePrio]++;
+        DALI_CRITICAL_EXIT();
         return false;
     }
-    memcpy(&sCurDaliTask,psDaliTask,sizeof(sDaliTask_t));
+    tail = (uint8_t)((psFifo->head + psFifo->count) % DALI_TASK_QUEUE_DEPTH);
+    memcpy(&psFifo->saEntry[tail].sTask,psDaliTask,sizeof(sDaliTask_t));
+    psFifo->saEntry[tail].queuedUs   = daliTaskTimeUs();
+    psFifo->saEntry[tail].deadlineUs = (0 != psDaliTask->deadlineUs) ? psDaliTask->deadlineUs : aDeadlineUs[ePrio];
+    psFifo->count++;
+    taskReadyMask |= (uint8_t)(1u << ePrio);
+    sTaskQueueStats.enqueued[ePrio]++;
+    sTaskQueueStats.depth   [ePrio] = psFifo->count;
+    if(psFifo->count > sTaskQueueStats.maxDepth[ePrio])
+    {
+        sTaskQueueStats.maxDepth[ePrio] = psFifo->count;
+    }
+    DALI_CRITICAL_EXIT();
     memset(psDaliTask,0,sizeof(sDaliTask_t));
-    bTaskValid = true;
+    daliTaskGiveWay();
+    if(false == transmitForwardFrame())
+    {//bus is free, otherwise the transfer complete interrupt gets the engine going
+        daliEngineArm(0);
+    }
     return true;
+}
+
+
+_Bool setDaliTaskPrio(sDaliTask_t *psDaliTask, eDaliTaskPrio_t ePrio)
+{
+    return setDaliTaskHandle(psDaliTask, ePrio, NULL);
+}
+
+
+_Bool setDaliTaskHandle(sDaliTask_t *psDaliTask, eDaliTaskPrio_t ePrio, sDaliTaskHandle_t *psHandle)
+{
+#ifdef DALI_CORE1
+    sDaliTaskRequest_t sRequest;
+#else
+    sDaliDapcDone_t    sDone;
 #endif
-    if(  (psDaliTask->eDaliTask  == evDaliSetLevel)  //allow task interruption if new task is dimming
-       &&(sCurDaliTask.eDaliTask != evDaliSetLevel))//and a dimming task is not already scheduled (this shouldn't happen)
+    _Bool              bQueued;
+    if(ePrio >= evDaliNumPrios)
     {
-        printk("Running task interrupted for high priority dimming task\n");
-        memcpy(&sIDaliTask,&sCurDaliTask,sizeof(sDaliTask_t));//copy the interrupted task to be restored later
-        bDALITaskSuspended = true;
+        return false;
+    }
+    psDaliTask->psHandle = psHandle;
+    if(NULL != psHandle)
+    {
+        psHandle->eStatus = evDaliTaskRunning;
+        psHandle->bCancel = false;
+    }
+#ifdef DALI_CORE1
+    memcpy(&sRequest.sTask,psDaliTask,sizeof(sDaliTask_t));
+    sRequest.ePrio = ePrio;
+    bQueued = daliSpscPush(&sRequestRing, &sRequest);
+    if(true == bQueued)
+    {
+        memset(psDaliTask,0,sizeof(sDaliTask_t));
+        if(true == multicore_fifo_wready())
+        {//a full FIFO already holds rings that core1 has yet to answer, each one drains the whole ring
+            multicore_fifo_push_blocking(CORE1_DOORBELL);
+        }
+    }
+#else
+    sDone.count = 0;
+    bQueued     = daliTaskEnqueue(psDaliTask, ePrio, &sDone);
+    daliDapcNotifyLater(&sDone);//may be thread context, the engine notifies them
+#endif
+    if(  (false == bQueued )
+       &&(NULL  != psHandle))
+    {
+        psHandle->eStatus = evDaliTaskRejected;
+    }
+    return bQueued;
+}
+
+
+/**
+ * @brief Address of a DAPC or memory bank read is in range for its type
+ * @return _Bool 
+ */
+static _Bool daliBatchAddrOk(eDaliStandardAddressType_t eAddrType, uint8_t addr)
+{
+    switch(eAddrType)
+    {
+        case evShortAddress:
+            return (MAX_SHORT_ADDRESS >= addr);
+        case evGroupAddress:
+            return (MAX_GROUP_ADDRESS >= addr);
+        case evBroadcastUnaddressed:
+        case evBroadcastAll:
+            return true;
+        default:
+        break;
+    }
+    return false;
+}
+
+/**
+ * @brief A task may be an item of a batch: one the slot runs to the end by itself, that sets no DTR
+ * other than through memory bank reads
+ * @param psTask item
+ * @return _Bool 
+ */
+static _Bool daliBatchItemOk(const sDaliTask_t *psTask)
+{
+    switch(psTask->eDaliTask)
+    {
+        case evDaliSetLevel:
+            return daliBatchAddrOk(psTask->uTask.sSetDAPC.sAddrType.eAddrType, psTask->uTask.sSetDAPC.sAddrType.addr);
+        case evDaliGetPwr:
+        case evDaliGetTotNrg:
+        case evDaliGetOutputCurrent:
+        case evDaliGetOutputVoltage:
+        case evDaliGetDriverTemperature://addr is the first member of each
+            return (  (psTask->uTask.sGetPwr.addr < saDaliNetworkData.numDrivers)
+                    &&(psTask->uTask.sGetPwr.addr < MAX_SUPPORTED_DRIVERS       ));
+        case evDaliReadMemoryBank:
+            return (  (NULL  != psTask->uTask.sDaliReadMB.cPtr)
+                    &&(0     != psTask->uTask.sDaliReadMB.len )
+                    &&(true  == daliBatchAddrOk(psTask->uTask.sDaliReadMB.eAddrType, psTask->uTask.sDaliReadMB.addr)));
+        case evDaliPollForControlGear:
+            return true;
+        default:
+        break;
+    }
+    return false;
+}
+
+/**
+ * @brief Sort key of a batch item, items run in ascending order and equal keys keep their order. DAPCs are
+ * forward frames only and go first; reads of the same memory bank location follow one another so DTR1 and
+ * DTR0 are set once for all of them, and a measurement of a driver type always reads the same location
+ * @param psTask item
+ * @return uint32_t 
+ */
+static uint32_t daliBatchOrderKey(const sDaliTask_t *psTask)
+{
+    switch(psTask->eDaliTask)
+    {
+        case evDaliSetLevel:
+            return 0;
+        case evDaliReadMemoryBank:
+            return (1ul << 24) | ((uint32_t)psTask->uTask.sDaliReadMB.memBank << 16) | ((uint32_t)psTask->uTask.sDaliReadMB.index << 8);
+        case evDaliPollForControlGear:
+            return (3ul << 24);
+        default:
+        break;
+    }
+    return (2ul << 24) | ((uint32_t)psTask->eDaliTask << 8)
+                       | (uint32_t)saDaliNetworkData.uData[psTask->uTask.sGetPwr.addr].sData.sStaticData.eDaliType;
+}
+
+
+_Bool setDaliTaskBatch(sDaliTaskBatch_t *psBatch, eDaliTaskPrio_t ePrio, sDaliTaskHandle_t *psHandle)
+{
+    sDaliTask_t sTask;
+    uint32_t    key;
+    uint8_t     i;
+    uint8_t     j;
+    for(psBatch->badTask = 0; psBatch->badTask < psBatch->numTasks; psBatch->badTask++)
+    {
+        if(  (DALI_BATCH_MAX_TASKS <= psBatch->badTask                                    )
+           ||(false                == daliBatchItemOk(&psBatch->psTasks[psBatch->badTask])))
+        {
+            break;
+        }
     }
-    else if(false == getDaliTransferStatus())
-    {//return and indicate task not scheduled if DALI is mid-transfer
+    if(  (0                == psBatch->numTasks)
+       ||(psBatch->badTask != psBatch->numTasks))
+    {
+        if(NULL != psHandle)
+        {
+            psHandle->eStatus = evDaliTaskRejected;
+        }
         return false;
     }
-    else if(eDaliTaskStatus != evDaliNoTaskRunning)
-    {//return and indicate task not scheduled if DALI is in the middle of a multi-transfer task
+    for(i = 0; i < psBatch->numTasks; i++)
+    {//insertion sort, stable
+        key = daliBatchOrderKey(&psBatch->psTasks[i]);
+        for(j = i; (j > 0) && (daliBatchOrderKey(&psBatch->psTasks[psBatch->aOrder[j - 1]]) > key); j--)
+        {
+            psBatch->aOrder[j] = psBatch->aOrder[j - 1];
+        }
+        psBatch->aOrder[j] = i;
+        if(NULL != psBatch->peStatus)
+        {
+            psBatch->peStatus[i] = evDaliTaskRunning;
+        }
+    }
+    psBatch->numComplete = 0;
+    memset(&sTask,0,sizeof(sTask));
+    sTask.eDaliTask      = evDaliBatch;
+    sTask.uTask.psBatch  = psBatch;
+    return setDaliTaskHandle(&sTask, ePrio, psHandle);
+}
+
+
+eDaliTaskStatus_t getDaliTaskHandleStatus(const sDaliTaskHandle_t *psHandle)
+{
+    return __atomic_load_n(&psHandle->eStatus, __ATOMIC_ACQUIRE);
+}
+
+
+_Bool cancelDaliTask(sDaliTaskHandle_t *psHandle)
+{
+    if(evDaliTaskRunning != getDaliTaskHandleStatus(psHandle))
+    {
         return false;
     }
-    memcpy(&sCurDaliTask,psDaliTask,sizeof(sDaliTask_t));
-    memset(psDaliTask,0,sizeof(sDaliTask_t));
-    bTaskValid = true;
+    __atomic_store_n(&psHandle->bCancel, true, __ATOMIC_RELEASE);//engine looks at it at each step
     return true;
 }
 
 
+const sDaliTaskQueueStats_t *getDaliTaskQueueStats(void)
+{
+    return &sTaskQueueStats;
+}
+
+
+void resetDaliTaskQueueStats(void)
+{
+    uint8_t prio;
+    DALI_CRITICAL_ENTER();
+    memset(&sTaskQueueStats,0,sizeof(sTaskQueueStats));
+    for(prio = 0; prio < evDaliNumPrios; prio++)
+    {
+        sTaskQueueStats.depth[prio] = saTaskFifo[prio].count;
+    }
+    DALI_CRITICAL_EXIT();
+}
+
+
 void dali_periodic_fnc(daliTimer *pDaliTimer)
+{//Engine: runs the task layer at each transaction boundary, from the timer interrupt
+    uint32_t pollUs;
+    uint8_t  step;
+    bEngineArmed = false;
+    daliTaskNotifyPending();
+    bEngineStepping = true;
+    for(step = 0; step < ENGINE_MAX_STEPS; step++)
+    {
+        daliManageTask();
+        if(  (true  == transmitForwardFrame())//transfer complete interrupt re-arms once the bus is free
+           ||(false == daliTaskBusy()       ))//idle until setDaliTask
+        {
+            break;
+        }
+    }
+    bEngineStepping = false;
+    if(ENGINE_MAX_STEPS == step)
+    {
+        daliEngineArm(DALI_ENGINE_TICK_US);//task is waiting on something other than the bus
+    }
+    pollUs = daliReplyPollUs();
+    if(0 != pollUs)
+    {//nothing else looks at a reply window while the dma fills it, come back to end it early
+        daliEngineArm(pollUs);
+    }
+#ifdef DALI_CORE1
+    __atomic_store_n(&bCore1Busy, daliTaskBusy(), __ATOMIC_RELEASE);
+#endif
+}
+
+#ifdef DALI_HOST
+void daliEngineHostRun(uint32_t us)
 {
-    static uint8_t state = 0;
-    static sDaliTask_t sDaliTask;
-    
-    eDaliTaskStatus_t eDaliTaskStatus;
-    eDaliTaskStatus = daliManageTask();
+    uint64_t endUs = daliHostNowUs() + us;
+    while(daliHostNowUs() < endUs)
+    {
+        if(  (true == bEngineArmed                    )
+           &&(true == daliHostClockUntil(engineDueUs)))
+        {//engine is due part way through the transfer, as its alarm would interrupt the dma. Like a whole
+         //transfer clocked below, this may run past endUs
+            dali_periodic_fnc(&sDaliTimer);
+            continue;
+        }
+        if(  (false == daliBusPollDone()    )
+           ||(daliHostNowUs() >= endUs))
+        {//clocked a transfer through, completion may have armed the engine
+            continue;
+        }
+        if(  (false == bEngineArmed)
+           ||(engineDueUs >= endUs ))
+        {
+            daliHostIdle((uint32_t)(endUs - daliHostNowUs()));
+            break;
+        }
+        if(engineDueUs > daliHostNowUs())
+        {
+            daliHostIdle((uint32_t)(engineDueUs - daliHostNowUs()));
+        }
+        dali_periodic_fnc(&sDaliTimer);
+    }
 }
+#endif
 
 //eDaliTaskStatus_t daliManageTask(sDaliTask_t *psDaliTask)
 eDaliTaskStatus_t daliManageTask(void)
 {
+    eDaliTaskStatus_t eResult = evDaliTaskComplete;
+    eDaliTaskStatus_t eEnd;
     if(false == getDaliTransferStatus())
     {//exit if transfers still in progress...this is critical
         return evDaliTaskRunning;
@@ -182,13 +1716,51 @@ eDaliTaskStatus_t daliManageTask(void)
       bTaskValid = false;
       return evDaliTaskComplete;
     }
+    daliTaskSchedule();//transfers are idle, this is a transaction boundary
+    eEnd = daliTaskCheckEnd();
+    if(evDaliTaskRunning != eEnd)
+    {//the finish below resets what it was stepping
+        DALI_TRACE(DALI_TRACE_LVL_INFO, evTraceTaskEnded, sCurDaliTask.eDaliTask, eEnd);
+        if(evDaliTaskTimedOut == eEnd)
+        {
+            sTaskQueueStats.timedOut[eCurDaliPrio]++;
+        }
+        else
+        {
+            sTaskQueueStats.cancelled[eCurDaliPrio]++;
+        }
+        eResult                = eEnd               ;
+        eDaliTaskStatus        = evDaliNoTaskRunning;
+        sCurDaliTask.eDaliTask = evNoTask           ;
+        bTaskValid             = false              ;
+    }
+    daliBusSetTag((uint8_t)sCurDaliTask.eDaliTask);//frames queued below are the task's bus time
     switch(sCurDaliTask.eDaliTask)
     {
         case evDaliAddress:
             eDaliTaskStatus = evDaliTaskRunning;
-            if(true == daliAddressingAlgorithm(&saDaliNetworkData.numDrivers))
+            if(true == daliAddressingAlgorithm(&uTaskCtx.sAddr, &saDaliNetworkData.numDrivers))
             {
-                printk("daliManageTask:addressing complete.\n");
+                if(true == uTaskCtx.sAddr.bRestore)
+                {//gear found by the search may hold a driver's short address but have drawn another random one
+                    daliNetworkForgetRandom((0 != uTaskCtx.sAddr.numRandomise) ? 0 : uTaskCtx.sAddr.restored);
+                    daliNetworkRestored(uTaskCtx.sAddr.restored | uTaskCtx.sAddr.kept, uTaskCtx.sAddr.added);
+                    bBusListed = true;
+                }
+                else if(true == uTaskCtx.sAddr.bIncremental)
+                {//its scan marks the short addresses that answered in inUse, the list may lack some
+                    daliNetworkMerge(uTaskCtx.sAddr.added);
+                    bBusListed = (  (true == bBusListed                                      )
+                                  &&(0    == (uTaskCtx.sAddr.inUse & ~daliNetworkAddrMask())));
+                }
+                else
+                {
+                    daliNetworkAddressed();
+                    bBusListed = true;
+                }
+                bBusListed = (  (true                         == bBusListed           )
+                              &&(saDaliNetworkData.numDrivers <= MAX_SUPPORTED_DRIVERS));
+                DALI_TRACE(DALI_TRACE_LVL_INFO, evTraceAddressed, saDaliNetworkData.numDrivers, 0);
                 eDaliTaskStatus        = evDaliTaskComplete ;
                 sCurDaliTask.eDaliTask = evNoTask           ;
                 bTaskValid             = false              ;
@@ -196,9 +1768,9 @@ eDaliTaskStatus_t daliManageTask(void)
         break;
         case evDaliIdentify:
             eDaliTaskStatus = evDaliTaskRunning;
-            if(true == identifyDaliDrivers(&saDaliNetworkData))
+            if(true == identifyDaliDrivers(&uTaskCtx.sIdentify, &saDaliNetworkData))
             {
-                printk("daliManageTask:identifying complete.\n");
+                DALI_TRACE(DALI_TRACE_LVL_INFO, evTraceIdentified, saDaliNetworkData.numDrivers, 0);
                 
                 saDaliNetworkData.checksum = Calc_Checksum((uint8_t *)&saDaliNetworkData,
                                                            sizeof(sDaliNetworkPld_t)    );
@@ -208,10 +1780,9 @@ eDaliTaskStatus_t daliManageTask(void)
             }
         break;
         case evDaliSetLevel:
-            printk("Sending DAPC level %d to address %d, address type %d.\n",
-                   sCurDaliTask.uTask.sSetDAPC.level       ,
-                    sCurDaliTask.uTask.sSetDAPC.sAddrType.addr,
-                    sCurDaliTask.uTask.sSetDAPC.sAddrType.eAddrType);
+            DALI_TRACE(DALI_TRACE_LVL_INFO, evTraceDapc,
+                       sCurDaliTask.uTask.sSetDAPC.level                                                  ,
+                       sCurDaliTask.uTask.sSetDAPC.sAddrType.addr | (sCurDaliTask.uTask.sSetDAPC.sAddrType.eAddrType << 8));
             sendCmdDapc(sCurDaliTask.uTask.sSetDAPC.sAddrType.addr     ,
                         sCurDaliTask.uTask.sSetDAPC.sAddrType.eAddrType,
                         sCurDaliTask.uTask.sSetDAPC.level              );
@@ -224,21 +1795,23 @@ eDaliTaskStatus_t daliManageTask(void)
 //            if(true == readDALIPowerFloat(&saDaliNetworkData.uData[sCurDaliTask.uTask.sGetPwr.addr].sData,
 //                                         &sCurDaliTask.uTask.sGetPwr.pfPwr ))
             if(true == readDALIPower(&saDaliNetworkData.uData[sCurDaliTask.uTask.sGetPwr.addr].sData,
-                                     &sPwr[sCurDaliTask.uTask.sGetPwr.addr].pwr))
+                                     &sPwr[MSMT_INDEX(sCurDaliTask.uTask.sGetPwr.addr)].pwr))
             {               
                 eDaliTaskStatus        = evDaliTaskComplete;
                 sCurDaliTask.eDaliTask = evNoTask           ;
                 bTaskValid             = false              ;
-                printk("Raw power read: %d\n",sPwr[sCurDaliTask.uTask.sGetPwr.addr].pwr);
+                DALI_TRACE(DALI_TRACE_LVL_DEBUG, evTraceMsmtRead, evDaliGetPwr | (sCurDaliTask.uTask.sGetPwr.addr << 8),
+                           sPwr[MSMT_INDEX(sCurDaliTask.uTask.sGetPwr.addr)].pwr);
             }
         break;
         case evDaliGetTotNrg:
             eDaliTaskStatus = evDaliTaskRunning;
             if(true == readDALIEnergy(&saDaliNetworkData.uData[sCurDaliTask.uTask.sGetPwr.addr].sData,
-                                      &sPwr[sCurDaliTask.uTask.sGetNrg.addr].nrg)) 
+                                      &sPwr[MSMT_INDEX(sCurDaliTask.uTask.sGetNrg.addr)].nrg)) 
             {
 //              memcpy(psDaliTask,&sCurDaliTask,sizeof(sDaliTask_t));
-              printk("Energy read: %llu\n",sPwr[sCurDaliTask.uTask.sGetNrg.addr].nrg);
+              DALI_TRACE(DALI_TRACE_LVL_DEBUG, evTraceMsmtRead, evDaliGetTotNrg | (sCurDaliTask.uTask.sGetNrg.addr << 8),
+                         sPwr[MSMT_INDEX(sCurDaliTask.uTask.sGetNrg.addr)].nrg);
               eDaliTaskStatus        = evDaliTaskComplete;
               sCurDaliTask.eDaliTask = evNoTask           ;
               bTaskValid             = false              ; 
@@ -247,39 +1820,42 @@ eDaliTaskStatus_t daliManageTask(void)
         case evDaliGetOutputCurrent:
             eDaliTaskStatus = evDaliTaskRunning;
             if(true == readDALILEDCurrent(&saDaliNetworkData.uData[sCurDaliTask.uTask.sGetIout.addr].sData,
-                                          &sLEDLoadMsmts[sCurDaliTask.uTask.sGetIout.addr].amps))
+                                          &sLEDLoadMsmts[MSMT_INDEX(sCurDaliTask.uTask.sGetIout.addr)].amps))
             {
                 eDaliTaskStatus        = evDaliTaskComplete;
                 sCurDaliTask.eDaliTask = evNoTask           ;
                 bTaskValid             = false              ; 
-                printk("Raw current read: %d\n",sLEDLoadMsmts[sCurDaliTask.uTask.sGetPwr.addr].amps);
+                DALI_TRACE(DALI_TRACE_LVL_DEBUG, evTraceMsmtRead, evDaliGetOutputCurrent | (sCurDaliTask.uTask.sGetIout.addr << 8),
+                           sLEDLoadMsmts[MSMT_INDEX(sCurDaliTask.uTask.sGetIout.addr)].amps);
             }
         break;
         case evDaliGetOutputVoltage:
             eDaliTaskStatus = evDaliTaskRunning;
             if(true == readDALILEDVoltage(&saDaliNetworkData.uData[sCurDaliTask.uTask.sGetVout.addr].sData,
-                                          &sLEDLoadMsmts[sCurDaliTask.uTask.sGetVout.addr].volts))
+                                          &sLEDLoadMsmts[MSMT_INDEX(sCurDaliTask.uTask.sGetVout.addr)].volts))
             {
                 eDaliTaskStatus        = evDaliTaskComplete;
                 sCurDaliTask.eDaliTask = evNoTask           ;
                 bTaskValid             = false              ; 
-                printk("Raw voltage read: %d\n",sLEDLoadMsmts[sCurDaliTask.uTask.sGetPwr.addr].volts);
+                DALI_TRACE(DALI_TRACE_LVL_DEBUG, evTraceMsmtRead, evDaliGetOutputVoltage | (sCurDaliTask.uTask.sGetVout.addr << 8),
+                           sLEDLoadMsmts[MSMT_INDEX(sCurDaliTask.uTask.sGetVout.addr)].volts);
             }
         break;
         case evDaliGetDriverTemperature:
             eDaliTaskStatus = evDaliTaskRunning;
             if(true == readDALIDriverTemperature(&saDaliNetworkData.uData[sCurDaliTask.uTask.sGetGearTemp.addr].sData,
-                                                 &sGearMsmts[sCurDaliTask.uTask.sGetGearTemp.addr].temp))
+                                                 &sGearMsmts[MSMT_INDEX(sCurDaliTask.uTask.sGetGearTemp.addr)].temp))
             {
                 eDaliTaskStatus        = evDaliTaskComplete;
                 sCurDaliTask.eDaliTask = evNoTask           ;
                 bTaskValid             = false              ;
-                printk("Raw temperature read: %d\n", sGearMsmts[sCurDaliTask.uTask.sGetGearTemp.addr].temp); 
+                DALI_TRACE(DALI_TRACE_LVL_DEBUG, evTraceMsmtRead, evDaliGetDriverTemperature | (sCurDaliTask.uTask.sGetGearTemp.addr << 8),
+                           sGearMsmts[MSMT_INDEX(sCurDaliTask.uTask.sGetGearTemp.addr)].temp);
             }
         break;
         case evDaliPollForControlGear:
           eDaliTaskStatus = evDaliTaskRunning;
-          if(true == daliPollForControlGear())
+          if(true == daliPollForControlGear(&uTaskCtx.sCtx))
           {
             eDaliTaskStatus = evDaliTaskComplete;
             sCurDaliTask.eDaliTask = evNoTask  ;
@@ -297,7 +1873,8 @@ eDaliTaskStatus_t daliManageTask(void)
             break;
         case evJCPHCommission:
           eDaliTaskStatus = evDaliTaskRunning;
-          if(true == daliJCPHCommission(sCurDaliTask.uTask.sCommission.addrToSet,
+          if(true == daliJCPHCommission(&uTaskCtx.sCommission                   ,
+                                        sCurDaliTask.uTask.sCommission.addrToSet,
                                         sCurDaliTask.uTask.sCommission.tuneVal))
           {
             eDaliTaskStatus = evDaliNoTaskRunning;
@@ -310,18 +1887,35 @@ eDaliTaskStatus_t daliManageTask(void)
         default:
             eDaliTaskStatus        = evDaliNoTaskRunning;
             sCurDaliTask.eDaliTask = evNoTask           ;
+            eResult                = evDaliTaskNotSupported;
         break;
     }
+    daliBusSetTag((uint8_t)evNoTask);
+    if(  (evNoTask != eRunDaliTask          )
+       &&(evNoTask == sCurDaliTask.eDaliTask))
+    {//left the slot, its last frame may still be on the way out
+        sCurDaliTask.eDaliTask = eRunDaliTask;
+        daliTaskCtxReset(eRunDaliTask);
+        if(evDaliTaskComplete == eResult)
+        {
+            daliTaskFillResult(&sCurDaliTask);
+        }
+        if(true == bCurBatchItem)
+        {//next item takes the slot
+            daliBatchNext(eResult);
+        }
+        else
+        {
+            daliTaskFinish(&sCurDaliTask, eResult);
+            sCurDaliTask.eDaliTask = evNoTask;
+            sCurDaliTask.psHandle  = NULL;
+            eRunDaliTask           = evNoTask;
+        }
+    }
     if(true == transmitForwardFrame())
     {
         return evDaliTaskRunning;
     }
-    if(bDALITaskSuspended)
-    {
-        memcpy(&sCurDaliTask,&sIDaliTask,sizeof(sDaliTask_t));//copy the interrupted task to be restored later
-        bDALITaskSuspended = false;
-        printk("Previously running task has been restored.\n");
-    }
     return eDaliTaskStatus;
 }
 
@@ -346,8 +1940,8 @@ _Bool initDaliStaticData(const void * psaDaliNetworkData)
 
 uint8_t Calc_Checksum(uint8_t *pCKSMSrc, uint32_t CKSMLen)
 {
-    uint8_t Cksm    = 0;
-    uint8_t CksmCtr = 0;
+    uint8_t  Cksm    = 0;
+    uint32_t CksmCtr = 0;//the network data outgrows 255 bytes with more than 4 drivers
     for(;CksmCtr<CKSMLen;CksmCtr++)
     {
         Cksm+= *(pCKSMSrc+CksmCtr);
@@ -383,14 +1977,15 @@ eDaliTaskType_t   getCurDaliTask   (void)
   return sCurDaliTask.eDaliTask;
 }
 
-/**
- * @brief Returns true if a DALI task is running
- * @return _Bool true if DALI task is running
- */
-_Bool isDaliTaskRunning(void)
+static _Bool daliTaskBusy(void)
 {
 if(  (false           == getDaliTransferStatus())
-   ||(eDaliTaskStatus != evDaliNoTaskRunning    ))
+   ||(eDaliTaskStatus != evDaliNoTaskRunning    )
+   ||(true            == bDALITaskSuspended     )
+   ||(true            == sBatchRun.bActive      )
+   ||(0               != taskReadyMask          )
+   ||(NULL            != sNotifyLater.psFirst   )
+   ||(0               != sNotifyLater.count     ))
 {
   return true;//task is running
 }
@@ -398,6 +1993,26 @@ if(  (false           == getDaliTransferStatus())
 }
 
 
+_Bool isDaliTaskRunning(void)
+{
+#ifdef DALI_CORE1
+  if(0 != daliSpscCount(&sRequestRing))
+  {//ring is read before busy, core1 raises busy before a request leaves the ring
+    return true;
+  }
+  return __atomic_load_n(&bCore1Busy, __ATOMIC_ACQUIRE);
+#else
+  return daliTaskBusy();
+#endif
+}
+
+
+eDaliTaskStatus_t getDaliTaskStatus(void)
+{
+  return (true == isDaliTaskRunning()) ? evDaliTaskRunning : evDaliNoTaskRunning;
+}
+
+
 void getDaliFlavor(uint8_t addr, uint8_t * pDaliType)
 {
   if(addr > 3)
@@ -18,6 +18,50 @@
 
 //#define DALICLI
 
+#ifndef DALI_TASK_QUEUE_DEPTH
+#define DALI_TASK_QUEUE_DEPTH 8/**< Tasks waiting per priority*/
+#endif
+#ifndef DALI_ENGINE_TICK_US
+#define DALI_ENGINE_TICK_US 10000/**< Engine runs again after this long when a task queued no transfer*/
+#endif
+#ifndef DALI_TASK_RESULT_RING_LEN
+#define DALI_TASK_RESULT_RING_LEN 16/**< Finished task records waiting for getDaliTaskResult, power of 2*/
+#endif
+#ifndef DALI_CORE1_RING_LEN
+#define DALI_CORE1_RING_LEN 16/**< Tasks in flight from core0 to core1 in DALI_CORE1 builds, power of 2*/
+#endif
+#ifndef DALI_CORE1_HW_ALARM
+#define DALI_CORE1_HW_ALARM 2/**< Hardware alarm of the core1 alarm pool, the default pool of core0 uses 3*/
+#endif
+#define DALI_FRAME_US 39167/**< Longest single frame transaction: forward frame, backward frame window and settling, 94 TE*/
+#ifndef DALI_DEADLINE_DIMMING_US
+#define DALI_DEADLINE_DIMMING_US (2 * DALI_FRAME_US)/**< Default start deadline of a dimming task, 0 for none*/
+#endif
+#ifndef DALI_DEADLINE_INTERACTIVE_US
+#define DALI_DEADLINE_INTERACTIVE_US 1000000/**< Default start deadline of an interactive task, 0 for none*/
+#endif
+#ifndef DALI_DEADLINE_TELEMETRY_US
+#define DALI_DEADLINE_TELEMETRY_US 10000000/**< Default start deadline of a telemetry task, 0 for none*/
+#endif
+#ifndef DALI_DEADLINE_COMMISSION_US
+#define DALI_DEADLINE_COMMISSION_US 0/**< Default start deadline of a commissioning task, 0 for none*/
+#endif
+#ifndef DALI_TIMEOUT_ACCESS_US
+#define DALI_TIMEOUT_ACCESS_US 2000000/**< Default timeout of a measurement or poll, memory bank tasks get two frames per byte on top*/
+#endif
+#ifndef DALI_TIMEOUT_ADDRESS_US
+#define DALI_TIMEOUT_ADDRESS_US 300000000/**< Default timeout of addressing, a full bus of 64 gear takes about 210 s*/
+#endif
+#ifndef DALI_TIMEOUT_IDENTIFY_US
+#define DALI_TIMEOUT_IDENTIFY_US 3000000/**< Default timeout of identification, per driver*/
+#endif
+#ifndef DALI_TIMEOUT_COMMISSION_US
+#define DALI_TIMEOUT_COMMISSION_US 10000000/**< Default timeout of evJCPHCommission*/
+#endif
+#ifndef DALI_BATCH_MAX_TASKS
+#define DALI_BATCH_MAX_TASKS 64/**< Most items in one setDaliTaskBatch, up to 255*/
+#endif
+
 
 /*! Enum of supported scheduleable DALI task types */
 typedef enum
@@ -34,7 +78,8 @@ typedef enum
   evDaliReadMemoryBank,
   evDaliWriteMemoryBank,
   evDaliPollForControlGear,
-  evJCPHCommission/*For hospital retrofit, pre-address and tune ULT driver*/
+  evJCPHCommission,/*For hospital retrofit, pre-address and tune ULT driver*/
+  evDaliBatch     /*Several tasks queued as one entry, see setDaliTaskBatch*/
 }eDaliTaskType_t;
 
 
@@ -44,9 +89,23 @@ typedef enum
   evDaliNoTaskRunning,
   evDaliTaskRunning,
   evDaliTaskComplete,
-  evDaliTaskNotSupported
+  evDaliTaskNotSupported,
+  evDaliTaskRejected,  /*!<Never started, its FIFO or the request ring to core1 was full*/
+  evDaliTaskSuperseded,/*!<DAPC replaced by a later level for the same target before it was sent*/
+  evDaliTaskTimedOut,  /*!<Ran past its timeout, its state machines were reset*/
+  evDaliTaskCancelled  /*!<cancelDaliTask was called before it finished, its state machines were reset*/
 }eDaliTaskStatus_t;
 
+/*! Enum of task priorities, highest first. Each priority has its own FIFO*/
+typedef enum
+{
+  evDaliPrioDimming    ,/*!<DAPC, preempts a running task at its next safe point*/
+  evDaliPrioInteractive,/*!<Queries and memory bank access on behalf of a user*/
+  evDaliPrioTelemetry  ,/*!<Background polling*/
+  evDaliPrioCommission ,/*!<Addressing, identification, commissioning*/
+  evDaliNumPrios
+}eDaliTaskPrio_t;
+
 /*! Struct of address and address type to target*/
 typedef struct
 {
@@ -99,13 +158,27 @@ typedef struct
   uint8_t addrToSet;
   uint8_t tuneVal;
 }sCommission_t;
+
+/*! struct of evDaliAddress options, all 0 runs a full addressing*/
+typedef struct
+{
+    _Bool bIncremental;/*!<Address only gear without a short address, append them to saDaliNetworkData and leave the rest alone*/
+    _Bool bRestore    ;/*!<Without bIncremental: select each driver of saDaliNetworkData by the random address identification read and give it its short address, search only for gear that did not match*/
+}sDaliAddress_t;
+
+typedef struct sDaliTaskHandle sDaliTaskHandle_t;
+typedef struct sDaliTaskBatch  sDaliTaskBatch_t;
+
 /**
  * @brief struct encoding the dali task type and pertinent information, to be expanded as more task types are added
  * 
  */
 typedef struct
 {
-    eDaliTaskType_t eDaliTask;
+    eDaliTaskType_t    eDaliTask ;
+    sDaliTaskHandle_t *psHandle  ;/*!<Set by setDaliTaskHandle, NULL if nobody waits on this task*/
+    uint32_t           deadlineUs;/*!<Start within this long of being queued, 0 for the default of its priority*/
+    uint32_t           timeoutUs ;/*!<Give up this long after it starts, 0 for the default of its type*/
     union 
     {
         sDaliDAPC_t         sSetDAPC    ;
@@ -117,11 +190,85 @@ typedef struct
         sDaliReadMB_t       sDaliReadMB ;
         sDaliReadMB_t       sDaliWriteMB;
         sCommission_t       sCommission ;
+        sDaliAddress_t      sAddress    ;
+        sDaliTaskBatch_t   *psBatch     ;/*!<evDaliBatch*/
         uint8_t             taskData[32];//Generic buffer
     }uTask;
 }sDaliTask_t;
 
- 
+/**
+ * @brief Completion callback, called from the engine once the handle status is final. That is interrupt
+ * context, on core1 in DALI_CORE1 builds where it must not queue tasks; keep it short
+ */
+typedef void (*daliTaskCallback_t)(sDaliTaskHandle_t *psHandle);
+
+/**
+ * @brief Caller owned record of one queued task. Set pfnDone and pUser, then pass it to setDaliTaskHandle
+ * and leave it alone until the status is no longer evDaliTaskRunning
+ */
+struct sDaliTaskHandle
+{
+  eDaliTaskStatus_t  eStatus;/*!<evDaliTaskRunning while queued or running, read with getDaliTaskHandleStatus*/
+  sDaliTask_t        sResult;/*!<The task as it finished: sGetPwr.pfPwr, sGetNrg.pNrg, sGetIout.pAmps, sGetVout.pVolts
+                                 and sGetGearTemp.temp are filled in, memory bank data is at sDaliReadMB.cPtr*/
+  daliTaskCallback_t pfnDone;/*!<Optional*/
+  void              *pUser  ;/*!<For the callback*/
+  _Bool              bCancel;/*!<Raised by cancelDaliTask*/
+  eDaliTaskStatus_t  eNotify;/*!<Engine use: status it is to make final, for a task that ended outside the engine*/
+  sDaliTaskHandle_t *psNextNotify;/*!<Engine use: next handle waiting for the engine to notify it*/
+};
+
+/**
+ * @brief Caller owned list of tasks queued as one by setDaliTaskBatch. Fill psTasks, peStatus and numTasks,
+ * then leave it alone until the batch handle is final
+ */
+struct sDaliTaskBatch
+{
+  sDaliTask_t       *psTasks    ;/*!<Items, each written back in place once it finishes with its result fields
+                                     filled in, as sResult of a handle*/
+  eDaliTaskStatus_t *peStatus   ;/*!<Optional, numTasks entries: final status of each item*/
+  uint8_t            numTasks   ;/*!<1 to DALI_BATCH_MAX_TASKS*/
+  uint8_t            numComplete;/*!<Items that completed so far*/
+  uint8_t            badTask    ;/*!<Set by setDaliTaskBatch: first item that may not be batched, numTasks if none*/
+  uint8_t            aOrder[DALI_BATCH_MAX_TASKS];/*!<Set by setDaliTaskBatch: items in the order they run*/
+};
+
+/**
+ * @brief Task queue counters, for sizing DALI_TASK_QUEUE_DEPTH under load
+ *
+ */
+typedef struct
+{
+  uint8_t  depth    [evDaliNumPrios];/*!<Tasks waiting now*/
+  uint8_t  maxDepth [evDaliNumPrios];/*!<Most tasks ever waiting*/
+  uint32_t enqueued [evDaliNumPrios];
+  uint32_t rejected [evDaliNumPrios];/*!<Turned away, FIFO full*/
+  uint32_t started  [evDaliNumPrios];
+  uint32_t waitUsMax[evDaliNumPrios];/*!<Longest enqueue to start*/
+  uint64_t waitUsSum[evDaliNumPrios];/*!<Divide by started for the mean wait*/
+  uint32_t deadlineMissed[evDaliNumPrios];/*!<Started after their deadline*/
+  uint32_t lateUsMax     [evDaliNumPrios];/*!<Furthest past a deadline a task started*/
+  uint32_t timedOut      [evDaliNumPrios];/*!<Ended by their timeout*/
+  uint32_t cancelled     [evDaliNumPrios];/*!<Ended by cancelDaliTask*/
+  uint32_t preempted;                /*!<Running tasks suspended for dimming*/
+  uint32_t dtrRestored;              /*!<DTRs sent again for a restored task, after the dimming task changed them*/
+  uint32_t dapcCoalesced;            /*!<DAPCs that overwrote a pending level for the same target*/
+  uint32_t dapcCollapsed;            /*!<Short address DAPCs folded into a group or broadcast DAPC*/
+  uint32_t resultsDropped;           /*!<Finished task records lost, result ring full*/
+}sDaliTaskQueueStats_t;
+
+/**
+ * @brief Record of a task leaving the task slot, read with getDaliTaskResult
+ *
+ */
+typedef struct
+{
+  eDaliTaskType_t    eDaliTask;
+  eDaliTaskStatus_t  eStatus  ;/*!<Final status, as in the handle*/
+  sDaliTaskHandle_t *psHandle ;/*!<NULL if queued without one*/
+}sDaliTaskResult_t;
+
+
 /**
  * @brief This typedef exists for the sole purpose of mirroring the payload of saDaliNetworkData_t to more easily get the size right for checksum calculation
  * 
@@ -147,19 +294,108 @@ typedef struct
 /*Function prototypes*/
 
 /**
- * @brief Handles executing the scheduled DALI task, should continue to be called periodically until returns evDaliNoTaskRunning 
- * @param psDaliTask 
+ * @brief Handles executing the scheduled DALI task. Called by the engine (dali_periodic_fnc) from the transfer
+ * complete and timer interrupts once initDALI has run, the application only queues tasks
  * @return eDaliTaskStatus_t 
  */
 eDaliTaskStatus_t daliManageTask      (void);
 
 /**
- * @brief Set the Dali Task if not currently busy, copies internally and clears contents of psDaliTask if free. 
+ * @brief State of the task layer, for callers waiting on a task they queued
+ * @return eDaliTaskStatus_t evDaliTaskRunning while a task is running or queued
+ */
+eDaliTaskStatus_t getDaliTaskStatus   (void);
+
+#ifdef DALI_HOST
+/**
+ * @brief Host stand-in for the interrupts: clocks transfers and fires the engine timer on the simulated clock
+ * @param us microseconds of simulated time to run for
+ */
+void              daliEngineHostRun   (uint32_t us);
+#endif
+
+/**
+ * @brief Queue a Dali Task at the default priority of its type, copies internally and clears contents of psDaliTask if queued.
+ * In DALI_CORE1 builds the task is handed to core1 and a full FIFO shows up as an evDaliTaskRejected result
  * @param psDaliTask Task to assign.
- * @return _Bool 
+ * @return _Bool false if the FIFO of its priority is full, or the request ring to core1 is
  */
 _Bool             setDaliTask         (sDaliTask_t * psDaliTask         );
 
+/**
+ * @brief Queue a Dali Task at a given priority, copies internally and clears contents of psDaliTask if queued.
+ * @param psDaliTask Task to assign.
+ * @param ePrio priority FIFO to queue on
+ * @return _Bool false if that FIFO is full, or the request ring to core1 is
+ */
+_Bool             setDaliTaskPrio     (sDaliTask_t * psDaliTask,
+                                       eDaliTaskPrio_t ePrio            );
+
+/**
+ * @brief Take the oldest finished task record. One record per queued task once it is done, whether it ran,
+ * was superseded or was turned away by core1. Call from one context only
+ * @param psResult where the record is copied to
+ * @return _Bool false if none is waiting
+ */
+_Bool             getDaliTaskResult   (sDaliTaskResult_t * psResult     );
+
+/**
+ * @brief Queue a Dali Task with a handle that receives its final status and result, and calls its pfnDone.
+ * Copies internally and clears contents of psDaliTask if queued. Any number may be in flight
+ * @param psDaliTask Task to assign.
+ * @param ePrio priority FIFO to queue on
+ * @param psHandle NULL behaves as setDaliTaskPrio, else its status is evDaliTaskRejected on a false return
+ * @return _Bool false if that FIFO is full, or the request ring to core1 is
+ */
+_Bool             setDaliTaskHandle   (sDaliTask_t       * psDaliTask,
+                                       eDaliTaskPrio_t     ePrio     ,
+                                       sDaliTaskHandle_t * psHandle  );
+
+/**
+ * @brief Queue several tasks as one entry of a priority FIFO, all or none. The items are checked here, once:
+ * DAPCs, measurements of a driver in saDaliNetworkData, memory bank reads and polls may be batched; addressing,
+ * identification, commissioning and memory bank writes may not. The engine runs the items back to back in an
+ * order of its own: DAPCs first, in the order given, then reads grouped by memory bank location so gear that
+ * still hold DTR1 and DTR0 from the read before are not sent them again. Each item gets the timeout of its type.
+ * Cancelling the handle ends the item running and the ones after it
+ * @param psBatch items, caller owned until the handle is final
+ * @param ePrio priority FIFO to queue on. At evDaliPrioDimming no DAPC preempts the batch
+ * @param psHandle NULL, or final once every item is: evDaliTaskComplete if all completed, else the status of the
+ * first that did not. sResult.uTask.psBatch is psBatch
+ * @return _Bool false if an item may not be batched (see psBatch->badTask), or as setDaliTaskHandle
+ */
+_Bool             setDaliTaskBatch    (sDaliTaskBatch_t  * psBatch   ,
+                                       eDaliTaskPrio_t     ePrio     ,
+                                       sDaliTaskHandle_t * psHandle  );
+
+/**
+ * @brief Status of a handle, safe from either core
+ * @param psHandle handle passed to setDaliTaskHandle
+ * @return eDaliTaskStatus_t evDaliTaskRunning until sResult is valid
+ */
+eDaliTaskStatus_t getDaliTaskHandleStatus(const sDaliTaskHandle_t * psHandle);
+
+/**
+ * @brief Stop a task queued with a handle. A queued task ends without sending anything once it reaches
+ * the front of its FIFO; a running one ends at its next transaction boundary, and the state machines it
+ * was using start over for the next task. The status becomes evDaliTaskCancelled, or whatever the task
+ * reached first. Safe from either core
+ * @param psHandle handle passed to setDaliTaskHandle
+ * @return _Bool false if the status is already final
+ */
+_Bool             cancelDaliTask      (sDaliTaskHandle_t * psHandle     );
+
+/**
+ * @brief Get the task queue counters, updated by core1 in DALI_CORE1 builds
+ * @return const sDaliTaskQueueStats_t*
+ */
+const sDaliTaskQueueStats_t *getDaliTaskQueueStats(void         );
+
+/**
+ * @brief Clear the task queue counters, depth is kept. In DALI_CORE1 builds call it while the bus is idle
+ */
+void              resetDaliTaskQueueStats(void                          );
+
 /**
  * @brief Get the Currently running DALI Task 
  * @return eDaliTaskType_t 
@@ -167,8 +403,8 @@ _Bool             setDaliTask         (sDaliTask_t * psDaliTask         );
 eDaliTaskType_t   getCurDaliTask      (void                             );
 
 /**
- * @brief Returns true if a DALI task is running
- * @return _Bool true if DALI task is running
+ * @brief Returns true if a DALI task is running or queued
+ * @return _Bool true if DALI task is running or queued
  */
 _Bool             isDaliTaskRunning   (void                             );
 
@@ -186,7 +422,8 @@ _Bool             initDaliStaticData  (const void  * psaDaliNetworkData );
 void *            getAddressOfDaliData(void                             );
 
 /**
- * @brief initialize dali peripheral 
+ * @brief initialize dali peripheral. In DALI_CORE1 builds this launches core1, which owns the bus, its
+ * interrupts and the task engine from then on; core0 may only queue tasks and read results and counters
  */
 void              initDALI            (void                             );
 
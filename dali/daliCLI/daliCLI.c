@@ -8,6 +8,7 @@
 
 #include "..\dali.h"
 #include "..\lib\dali_sequences.h"
+#include "..\lib\dali_driver.h"
 
 
 //#define RX_PIN_NUMBER  6//22
@@ -58,6 +59,7 @@ typedef struct
 #define SETDAPC          3
 #define COMMISSION       4
 #define POLLFORCTRLGEAR  5
+#define BUSSTATS         6
 #define RETURNDALIDATA 254
 #define ACK            255
 
@@ -71,6 +73,7 @@ volatile uint8_t dummyRead;
 _Bool   uartErrCheck(void     );
 _Bool   rxData      (uint8_t *);
 _Bool   txData      (uint8_t  );
+uint8_t busStatsFill(uint8_t *);
 
 
 _Bool uartErrCheck(void)
@@ -111,6 +114,58 @@ _Bool txData(uint8_t data)
 }
 
 
+static uint8_t putLE(uint8_t *pDst, uint32_t val, uint8_t len)
+{
+  uint8_t i;
+  for(i = 0; i < len; i++)
+  {
+    pDst[i] = (uint8_t)(val >> (8 * i));
+  }
+  return len;
+}
+
+/**
+ * @brief Reply to BUSSTATS, little endian: utilisation permille over 1, 10 and 60s (3x16), frames
+ * no reply, twice and with reply (3x32), replies, no replies, corrupt replies and retries (4x32), then
+ * the task type and the short address (64 group, 65 broadcast) with the most bus time, each followed by
+ * its permille of the total (8+16)
+ * @param pDst daliBuf
+ * @return uint8_t bytes filled
+ */
+uint8_t busStatsFill(uint8_t *pDst)
+{
+  const sDaliBusStats_t *psStats = getDaliBusStats();
+  uint8_t                len     = 0;
+  uint8_t                top     = 0;
+  uint8_t                i;
+  len += putLE(&pDst[len], daliBusUtilPermille(1) , 2);
+  len += putLE(&pDst[len], daliBusUtilPermille(10), 2);
+  len += putLE(&pDst[len], daliBusUtilPermille(60), 2);
+  for(i = 0; i < sizeof(psStats->frames)/sizeof(psStats->frames[0]); i++)
+  {
+    len += putLE(&pDst[len], psStats->frames[i], 4);
+  }
+  len += putLE(&pDst[len], psStats->replies  , 4);
+  len += putLE(&pDst[len], psStats->noReplies, 4);
+  len += putLE(&pDst[len], psStats->corrupt  , 4);
+  len += putLE(&pDst[len], psStats->retries  , 4);
+  for(i = 1; i < DALI_BUS_NUM_TAGS; i++)
+  {
+    top = (psStats->tagUs[i] > psStats->tagUs[top]) ? i : top;
+  }
+  len += putLE(&pDst[len], top, 1);
+  len += putLE(&pDst[len], (0 != psStats->busUs) ? (uint32_t)((psStats->tagUs[top] * 1000) / psStats->busUs) : 0, 2);
+  top = 0;
+  for(i = 1; i < DALI_BUS_NUM_ADDR; i++)
+  {
+    top = (psStats->addrUs[i] > psStats->addrUs[top]) ? i : top;
+  }
+  len += putLE(&pDst[len], top, 1);
+  len += putLE(&pDst[len], (0 != psStats->busUs) ? (uint32_t)((psStats->addrUs[top] * 1000) / psStats->busUs) : 0, 2);
+  return len;
+}
+
+
 void daliCLIInit(void)
 {
   NRF_UART0->ENABLE   = 4             ;//Turn it on
@@ -137,7 +192,7 @@ void daliCLIMinder(void)
 //  txData(0x55);
 //  return;
   eDaliTaskStatus_t eTaskStatus;
-  eTaskStatus = daliManageTask();
+  eTaskStatus = getDaliTaskStatus();//engine runs the tasks
   if(true == uartErrCheck())
   {
     daliCLIcase       = 0;
@@ -211,6 +266,12 @@ void daliCLIMinder(void)
               sdTask.uTask.sCommission.tuneVal   = sDaliCLI.sCommission.tuneVal;
               setDaliTask(&sdTask);
             break;
+            case BUSSTATS://0x06 xx xx xx xx xx, counters go back straight away
+              __LOG(LOG_SRC_APP, LOG_LEVEL_INFO,"Bus stats\n");
+              sDaliCLI.sReadMemBank.len = busStatsFill(daliBuf);
+              cliTxIterator = 0;
+              daliCLIcase   = RETURNDALIDATA;
+            break;
             case POLLFORCTRLGEAR:
             sdTask.eDaliTask = evDaliPollForControlGear;
             setDaliTask(&sdTask);
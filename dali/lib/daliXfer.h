@@ -0,0 +1,84 @@
+/**
+ * @file daliXfer.h
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Data types of the driver transaction queue
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include "dali_frames.h"
+#include "manchester.h"
+
+/*configuration*/
+#ifndef DALI_XFER_QUEUE_LEN
+#define DALI_XFER_QUEUE_LEN 8/**< Number of transactions the driver can hold, started back to back*/
+#endif
+#ifndef DALI_XFER_PINGPONG
+#define DALI_XFER_PINGPONG 2/**< Send twice and reply buffers, one can be filled or decoded while another is on the bus*/
+#endif
+#ifndef DALI_SEQ_MAX_STEPS
+#define DALI_SEQ_MAX_STEPS 16/**< Forward frames in one chained dma sequence*/
+#endif
+#ifndef DALI_SEQ_SAFE_STEPS
+#define DALI_SEQ_SAFE_STEPS 1/**< Steps between safe points, where a sequence can give way to another frame. 0 for none*/
+#endif
+
+/**
+ * @brief Kind of bus transaction, sets the TX and RX lengths
+ */
+typedef enum
+{
+  evXferNoReply  ,/*!< Send once forward frame followed by the inter-frame idle*/
+  evXferTwice    ,/*!< Send twice forward frame, both frames inside the 100mS window*/
+  evXferWithReply,/*!< Send once forward frame followed by the backward frame window and bus settling*/
+  evXferSequence  /*!< Chained dma sequence of forward frames, see daliQueueSeq*/
+}eDaliXferKind_t;
+
+/**
+ * @brief What a sequence step's backward frame must look like for the sequence to carry on
+ */
+typedef enum
+{
+  evReplyAny     ,/*!< Not checked until the sequence ends, the step is not a checkpoint*/
+  evReplyRequired,/*!< A valid backward frame, the sequence stops here otherwise*/
+  evReplyNone     /*!< No backward frame, the sequence stops here otherwise*/
+}eDaliReplyExpect_t;
+
+/**
+ * @brief Completion slot of a queued transaction, written from the transfer complete interrupt
+ */
+typedef struct
+{
+  volatile _Bool      bDone  ;/*!< Set once the transaction has left the bus*/
+  sManchesterDecode_t sDecode;/*!< Decoded backward frame, evNoDataFound for kinds with no reply*/
+}sDaliXferResult_t;
+
+/**
+ * @brief One forward frame of a sequence
+ */
+typedef struct
+{
+  uForwardFrame_t    uFwdFrame;
+  eDaliXferKind_t    eKind    ;/*!< evXferNoReply, evXferTwice or evXferWithReply*/
+  eDaliReplyExpect_t eExpect  ;/*!< Only used with evXferWithReply*/
+  _Bool              bHold    ;/*!< No other frame may go between this step and the next, e.g. while write is enabled*/
+}sDaliSeqStep_t;
+
+/**
+ * @brief Forward frames run back to back by chained dma, the cpu only sees the end of the sequence,
+ * the checkpoints (steps expecting a particular reply) and the safe points
+ */
+typedef struct
+{
+  const sDaliSeqStep_t *psSteps   ;
+  sDaliXferResult_t    *psResults ;/*!< One per step*/
+  uint8_t               numSteps  ;
+  uint8_t               failedStep;/*!< First step whose reply broke its expectation, numSteps if none*/
+  uint8_t               numRun    ;/*!< Steps sent: numSteps, failedStep + 1, or fewer if the sequence gave way at a safe point*/
+  volatile _Bool        bDone     ;/*!< Set once the sequence has left the bus, steps from numRun on were not sent*/
+}sDaliSeq_t;
@@ -10,12 +10,96 @@
  */
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 //#include "nrf_log.h"
 #include "dali_MemoryBank.h"
 #include "dali_commands.h"
 #include "dali_driver.h"
+/*Local types*/
+
+/**
+ * @brief Parameters of a memory bank access, read by the step generators
+ */
+typedef struct
+{
+  eDaliStandardAddressType_t eAddrType    ;
+  uint8_t                    addr         ;
+  uint8_t                    memoryBankNum;
+  uint8_t                    index        ;
+  uint8_t                    numBytes     ;
+  uint8_t                   *pData        ;
+}sMBAccess_t;
+
+/**
+ * @brief Fills in step number stepNum of a memory bank access
+ */
+typedef void (*pfnMBStep_t)(const sMBAccess_t *psAccess, uint16_t stepNum, sDaliSeqStep_t *psStep);
+
+/**
+ * @brief Progress of the memory bank access in flight. The bus carries one access at a time, so all of
+ * them share it; daliMemoryBankReset puts it back for an access that was abandoned
+ */
+typedef struct
+{
+  uint16_t stepsDone    ;/*!<Steps of the access sent by earlier sequences*/
+  _Bool    bQueued      ;/*!<sMBSeq is with the driver*/
+  uint8_t  setOffsetStep;/*!<daliSetMemoryBankandOffset*/
+  uint8_t  writeCnt     ;/*!<daliWriteMemoryBank*/
+  _Bool    bDtrReused   ;/*!<Read started at its first READ MEMORY LOCATION*/
+}sMBRun_t;
+
+/**
+ * @brief What the gear hold in DTR1 and DTR0 after the last read, for daliMemoryBankReuseDtr. SET DTR is
+ * broadcast but READ MEMORY LOCATION moves DTR0 of the gear read only
+ */
+typedef struct
+{
+  _Bool    bReuse     ;/*!<daliMemoryBankReuseDtr*/
+  _Bool    bValid     ;/*!<The rest is known*/
+  uint8_t  bank       ;/*!<DTR1 of every gear*/
+  uint8_t  index      ;/*!<DTR0 of the gear in atIndexMask*/
+  uint8_t  dtr0Shadow ;/*!<Driver's DTR0 shadow after the last read, anything else means another frame set DTR0*/
+  uint64_t atIndexMask;/*!<Short addresses not read since DTR0 was set*/
+}sMBDtr_t;
+
+/*Local data*/
+static sDaliSeqStep_t    saMBSteps  [DALI_SEQ_MAX_STEPS];
+static sDaliXferResult_t saMBResults[DALI_SEQ_MAX_STEPS];
+static sDaliSeq_t        sMBSeq = {.psSteps = &saMBSteps[0], .psResults = &saMBResults[0]};
+static sMBRun_t          sMBRun;
+static sMBDtr_t          sMBDtr;
+
 /*Local function prototypes*/
 
+/**
+ * @brief Runs the steps of a memory bank access as driver sequences, as many steps per sequence as fit.
+ * A sequence that gave way at a safe point is carried on by the next one
+ * 
+ * @param psAccess access parameters
+ * @param numSteps total steps
+ * @param pfnStep step generator
+ * @param replyBase first step whose reply is data for psAccess->pData, numSteps if none
+ * @return _Bool true when every step has been sent, or a checkpoint failed
+ */
+static _Bool daliMBRunSteps(const sMBAccess_t *psAccess,
+                            uint16_t           numSteps,
+                            pfnMBStep_t        pfnStep ,
+                            uint16_t           replyBase);
+
+/**
+ * @brief Step generator for daliReadMemoryBank: DTR1, DTR0, then READ MEMORY LOCATION, which post-increments DTR0
+ */
+static void  daliMBReadStep         (const sMBAccess_t *psAccess,
+                                     uint16_t           stepNum ,
+                                     sDaliSeqStep_t    *psStep  );
+
+/**
+ * @brief Step generator for daliUnlockWriteLockMemoryBank
+ */
+static void  daliMBUnlockWriteStep  (const sMBAccess_t *psAccess,
+                                     uint16_t           stepNum ,
+                                     sDaliSeqStep_t    *psStep  );
+
 /**
  * @brief Sets data transfer registers to memory bank and offset for subsequent memory bank read
  * 
@@ -46,16 +130,15 @@ _Bool daliEnableWriteMemory(eDaliStandardAddressType_t eAddr,
 
 _Bool daliSetMemoryBankandOffset(uint8_t memoryBankNum, uint8_t offset)
 {
-  static uint8_t setMemBankState = 0;
-  switch(setMemBankState)
+  switch(sMBRun.setOffsetStep)
   {
   case 0:
     sendSpecialCmdNoReply(memoryBankNum,evSetDTR1);
-    setMemBankState = 1;
+    sMBRun.setOffsetStep = 1;
   break;
   case 1:
     sendSpecialCmdNoReply(offset,evSetDTR0);
-    setMemBankState = 0;
+    sMBRun.setOffsetStep = 0;
     return true;
   break;
   }
@@ -72,6 +155,220 @@ _Bool daliReadMB(sDaliReadMB_t * sDaliReadMB)
                               sDaliReadMB->len      ,
                               sDaliReadMB->cPtr     );
 }
+static _Bool daliMBRunSteps(const sMBAccess_t *psAccess,
+                            uint16_t           numSteps,
+                            pfnMBStep_t        pfnStep ,
+                            uint16_t           replyBase)
+{
+  uint8_t         i;
+  uint16_t        stepNum;
+  if(false == sMBRun.bQueued)
+  {
+    sMBSeq.numSteps = ((numSteps - sMBRun.stepsDone) > DALI_SEQ_MAX_STEPS) ? DALI_SEQ_MAX_STEPS : (numSteps - sMBRun.stepsDone);
+    for(i = 0; i < sMBSeq.numSteps; i++)
+    {
+      pfnStep(psAccess, sMBRun.stepsDone + i, &saMBSteps[i]);
+    }
+    sMBRun.bQueued = daliQueueSeq(&sMBSeq);
+    return false;
+  }
+  if(false == sMBSeq.bDone)
+  {
+    return false;
+  }
+  sMBRun.bQueued = false;
+  for(i = 0; i < sMBSeq.numRun; i++)
+  {
+    stepNum = sMBRun.stepsDone + i;
+    if(  (stepNum          >= replyBase                      )
+       &&(evValidDataFound == saMBResults[i].sDecode.eStatus))
+    {
+      psAccess->pData[stepNum - replyBase] = saMBResults[i].sDecode.backFrame;
+    }
+  }
+  sMBRun.stepsDone += sMBSeq.numRun;
+  if(  (sMBRun.stepsDone  >= numSteps       )
+     ||(sMBSeq.failedStep <  sMBSeq.numSteps))
+  {
+    sMBRun.stepsDone = 0;
+    return true;
+  }
+  return false;
+}
+
+
+void daliMemoryBankReset(void)
+{//a queued sequence is done by the time the bus is idle, its step and result buffers may be reused
+  if(  (0     != sMBRun.stepsDone)
+     ||(true  == sMBRun.bQueued  ))
+  {//abandoned part way, DTR0 of the gear read is not known
+    sMBDtr.bValid = false;
+  }
+  memset(&sMBRun,0,sizeof(sMBRun));
+}
+
+
+void daliMemoryBankReuseDtr(_Bool bReuse)
+{
+  sMBDtr.bReuse = bReuse;
+  sMBDtr.bValid = false;
+}
+
+
+/**
+ * @brief A read about to start may skip its DTR steps: the gear still hold the bank and index, and the
+ * driver's shadow shows no other DTR frame since the last read. Bus is idle
+ */
+static _Bool daliMBDtrHeld(const sMBAccess_t *psAccess)
+{
+  sDaliDtrShadow_t sShadow;
+  if(  (false             == sMBDtr.bReuse                                 )
+     ||(false             == sMBDtr.bValid                                 )
+     ||(evShortAddress    != psAccess->eAddrType                           )
+     ||(MAX_SHORT_ADDRESS <  psAccess->addr                                )
+     ||(sMBDtr.bank       != psAccess->memoryBankNum                       )
+     ||(sMBDtr.index      != psAccess->index                               )
+     ||(0                 == (sMBDtr.atIndexMask & (1ull << psAccess->addr))))
+  {
+    return false;
+  }
+  daliGetDtrShadow(&sShadow);
+  return (  (0x03              == (sShadow.validMask & 0x03))
+          &&(sMBDtr.bank       == sShadow.aDtr[1]            )
+          &&(sMBDtr.dtr0Shadow == sShadow.aDtr[0]            ));
+}
+
+
+/**
+ * @brief A read that cannot skip both DTR steps may still skip DTR1: SET DTR1 is broadcast and the
+ * driver's shadow shows the gear hold the bank. Bus is idle
+ */
+static _Bool daliMBDtr1Held(const sMBAccess_t *psAccess)
+{
+  sDaliDtrShadow_t sShadow;
+  if(false == sMBDtr.bReuse)
+  {
+    return false;
+  }
+  daliGetDtrShadow(&sShadow);
+  return (  (0                       != (sShadow.validMask & 0x02))
+          &&(psAccess->memoryBankNum == sShadow.aDtr[1]            ));
+}
+
+
+/**
+ * @brief A read finished, note what it left in the DTRs. Bus is idle, so the shadow is final
+ */
+static void daliMBDtrAfterRead(const sMBAccess_t *psAccess)
+{
+  sDaliDtrShadow_t sShadow;
+  daliGetDtrShadow(&sShadow);
+  if(  (false             == sMBDtr.bReuse              )
+     ||(evShortAddress    != psAccess->eAddrType        )
+     ||(MAX_SHORT_ADDRESS <  psAccess->addr             )
+     ||(0x03              != (sShadow.validMask & 0x03)))
+  {//a group read moves DTR0 of gear not known
+    sMBDtr.bValid = false;
+    return;
+  }
+  if(false == sMBRun.bDtrReused)
+  {//this read set them on every gear
+    sMBDtr.bank        = psAccess->memoryBankNum;
+    sMBDtr.index       = psAccess->index;
+    sMBDtr.atIndexMask = ~0ull;
+  }
+  sMBDtr.atIndexMask &= ~(1ull << psAccess->addr);
+  sMBDtr.dtr0Shadow   = sShadow.aDtr[0];
+  sMBDtr.bValid       = true;
+}
+
+
+/**
+ * @brief Fill a step with a special command
+ */
+static void daliMBSpecialStep(sDaliSeqStep_t *psStep, eDaliSpecialCommands_t eCmd, uint8_t data, eDaliXferKind_t eKind)
+{
+  psStep->uFwdFrame.sSpecialCmd.opcode = (uint8_t)eCmd;
+  psStep->uFwdFrame.sSpecialCmd.data   = data;
+  psStep->eKind                        = eKind;
+  psStep->eExpect                      = evReplyAny;
+  psStep->bHold                        = false;
+}
+
+
+/**
+ * @brief Fill a step with a standard command to the accessed gear
+ */
+static void daliMBStandardStep(sDaliSeqStep_t *psStep, const sMBAccess_t *psAccess, eDaliStandardCommands_t eCmd, eDaliXferKind_t eKind)
+{
+  generateAddr(psAccess->eAddrType, psAccess->addr, &psStep->uFwdFrame.sStandardCmd.address);
+  psStep->uFwdFrame.sStandardCmd.address |= 1;
+  psStep->uFwdFrame.sStandardCmd.opcode   = (uint8_t)eCmd;
+  psStep->eKind                           = eKind;
+  psStep->eExpect                         = evReplyAny;
+  psStep->bHold                           = false;
+}
+
+
+static void daliMBReadStep(const sMBAccess_t *psAccess,
+                           uint16_t           stepNum ,
+                           sDaliSeqStep_t    *psStep  )
+{
+  switch(stepNum)
+  {
+    case 0:
+      daliMBSpecialStep(psStep, evSetDTR1, psAccess->memoryBankNum, evXferNoReply);
+    break;
+    case 1:
+      daliMBSpecialStep(psStep, evSetDTR0, psAccess->index, evXferNoReply);
+    break;
+    default:
+      daliMBStandardStep(psStep, psAccess, evReadMemoryBank, evXferWithReply);
+    break;
+  }
+}
+
+
+static void daliMBUnlockWriteStep(const sMBAccess_t *psAccess,
+                                  uint16_t           stepNum ,
+                                  sDaliSeqStep_t    *psStep  )
+{
+  uint16_t lockStep = 6 + psAccess->numBytes;//first step after the data writes
+  if(stepNum == 0)
+  {//Set DTRs to memory bank and index for lock byte
+    daliMBSpecialStep(psStep, evSetDTR1, psAccess->memoryBankNum, evXferNoReply);
+  }
+  else if((stepNum == 1) || (stepNum == lockStep))
+  {
+    daliMBSpecialStep(psStep, evSetDTR0, 2, evXferNoReply);
+  }
+  else if((stepNum == 2) || (stepNum == 5) || (stepNum == (lockStep + 1)))
+  {
+    daliMBStandardStep(psStep, psAccess, evEnableWriteMemory, evXferTwice);
+  }
+  else if(stepNum == 3)
+  {//write 0x55 to lock byte to unlock memory bank, the writes are pointless if it is not answered
+    daliMBSpecialStep(psStep, evWriteMemoryBank, 0x55, evXferWithReply);
+    psStep->eExpect = evReplyRequired;
+  }
+  else if(stepNum == 4)
+  {//Set DTR to index for write
+    daliMBSpecialStep(psStep, evSetDTR0, psAccess->index, evXferNoReply);
+  }
+  else if(stepNum < lockStep)
+  {//perform write actions
+    daliMBSpecialStep(psStep, evWriteMemoryBank, psAccess->pData[stepNum - 6], evXferWithReply);
+  }
+  else
+  {//Write 0xff to lock byte to lock back
+    daliMBSpecialStep(psStep, evWriteMemoryBank, 0xff, evXferWithReply);
+  }
+  //any other command in between disables write enable, the last step is the only safe point after it
+  psStep->bHold = (  (stepNum >= 2           )
+                   &&(stepNum <  (lockStep + 2)));
+}
+
+
 _Bool daliReadMemoryBank(eDaliStandardAddressType_t eAddrType           ,
                          uint8_t                    addr                ,
                          uint8_t                    memoryBankNum       ,
@@ -79,49 +376,34 @@ _Bool daliReadMemoryBank(eDaliStandardAddressType_t eAddrType           ,
                          uint8_t                    numBytestoRead      ,
                          uint8_t                    *cptr               )
 {
-  static uint8_t readNum          = 0;
-  static uint8_t readMemBankState = 0;
-  switch(readMemBankState)
+  sMBAccess_t sAccess = {eAddrType, addr, memoryBankNum, memoryBankStartIndex, numBytestoRead, cptr};
+  _Bool       bDone;
+  if(0 == numBytestoRead)
   {
-  case 0:
-    if(true == daliSetMemoryBankandOffset(memoryBankNum, memoryBankStartIndex))
-    {
-      readMemBankState = 1;
-    }
-  break;
-  case 1://Read memory bank
-    sendStandardCmdWithReply(addr, eAddrType,evReadMemoryBank);
-    readMemBankState = 2;
-  break;
-  case 2://sp added 2/6/2020
-    getDaliBackFrame(cptr + readNum);
-    if(readNum >= (numBytestoRead-1))
-    {
-      readNum = 0;
-      readMemBankState = 0;
-      return true;
-    }
-    else
-    {
-      readNum++;
-      sendStandardCmdWithReply(addr, eAddrType,evReadMemoryBank);
-      //readMemBankState = 1;
-    }
-  default:
-    break;
+    return true;
   }
-  return false;
+  if(  (0     == sMBRun.stepsDone)
+     &&(false == sMBRun.bQueued  ))
+  {//first sequence of the read
+    sMBRun.bDtrReused = daliMBDtrHeld(&sAccess);
+    sMBRun.stepsDone  = (true == sMBRun.bDtrReused) ? 2 : ((true == daliMBDtr1Held(&sAccess)) ? 1 : 0);
+  }
+  bDone = daliMBRunSteps(&sAccess, 2 + numBytestoRead, daliMBReadStep, 2);
+  if(true == bDone)
+  {
+    daliMBDtrAfterRead(&sAccess);
+  }
+  return bDone;
 }
 
 
 _Bool daliWriteMemoryBank(uint8_t numBytes, uint8_t *pSrc)
 {
-static uint8_t pCnt = 0;
-  sendSpecialCmdWithReply(*(pSrc + pCnt),evWriteMemoryBank);
-  pCnt++;
-  if(pCnt >= numBytes)
+  sendSpecialCmdWithReply(*(pSrc + sMBRun.writeCnt),evWriteMemoryBank);
+  sMBRun.writeCnt++;
+  if(sMBRun.writeCnt >= numBytes)
   {
-    pCnt = 0;
+    sMBRun.writeCnt = 0;
     return true;
   }
 return false;
@@ -136,52 +418,11 @@ _Bool daliUnlockWriteLockMemoryBank(eDaliStandardAddressType_t eAddrType,
                                     uint8_t numBytes                    ,
                                     uint8_t *psrc                       )
 {
-  static uint8_t mbState = 0;
-  switch(mbState)
-  {
-    case 0://EnableWriteMemory
-      if(true == daliSetMemoryBankandOffset(memoryBankNum, 2))
-      {
-        mbState = 1;
-      }
-    break;
-    case 1://Set DTRs to memory bank and index for lock byte
-      daliEnableWriteMemory(eAddrType, addr);
-      mbState = 2;
-    break;
-    case 2://write 0x55 to lock byte to unlock memory bank
-      sendSpecialCmdWithReply(0x55, evWriteMemoryBank);//evWriteMemBnkNoReply);
-      mbState = 3;
-    break;
-    case 3://Set DTR to index for write
-      sendSpecialCmdNoReply(index,evSetDTR0);
-      mbState = 4;
-    break;
-    case 4:
-      daliEnableWriteMemory(eAddrType, addr);
-      mbState = 5;
-    break;
-    case 5://perform write actions
-    if(true == daliWriteMemoryBank(numBytes, psrc))
-    {
-      mbState = 6;
-    }
-    break;
-    case 6://Set DTR back to index for lock byte
-      sendSpecialCmdNoReply(2,evSetDTR0);
-      mbState = 7;
-    break;
-    case 7:
-      daliEnableWriteMemory(eAddrType, addr);
-      mbState = 8;
-    break;
-    case 8://Write 0xff to lock byte to lock back
-      sendSpecialCmdWithReply(0xff, evWriteMemoryBank);//evWriteMemBnkNoReply);
-      mbState = 0;
-    return true;
-    break;
-    default:
-    break;
+  sMBAccess_t sAccess = {eAddrType, addr, memoryBankNum, index, numBytes, psrc};
+  _Bool       bDone   = daliMBRunSteps(&sAccess, 9 + numBytes, daliMBUnlockWriteStep, 9 + numBytes);
+  if(true == bDone)
+  {//DTR0 moved on the gear written, and is 2 on the rest
+    sMBDtr.bValid = false;
   }
-  return false;
+  return bDone;
 }
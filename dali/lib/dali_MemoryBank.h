@@ -73,4 +73,19 @@ _Bool daliUnlockWriteLockMemoryBank (eDaliStandardAddressType_t eAddrType,
                                      uint8_t numBytes                    ,
                                      uint8_t *psrc                       );
 
+/**
+ * @brief Forget the memory bank access in progress, the next access starts from its first step. Call
+ * while the bus is idle, from the reset of an operation that was abandoned part way
+ */
+void  daliMemoryBankReset           (void                                );
+
+/**
+ * @brief While set, a read of a short address skips DTR1 and DTR0 when a previous read set them on every
+ * gear to its bank and index and this gear has not been read since, and skips DTR1 alone when the gear
+ * already hold the bank. Only sound while every frame that changes a DTR comes from this module, as in a
+ * task batch; clearing it forgets what the gear hold
+ * @param bReuse
+ */
+void  daliMemoryBankReuseDtr        (_Bool bReuse                        );
+
 
@@ -8,112 +8,528 @@
  * @copyright Copyright (c) 2021
  * 
  */
+#include <string.h>
 #include "dali_addressing.h"
 #include "dali_commands.h"
 #include "dali_driver.h"
 #include "dali_frames.h"
 
-uint32_t        searchAddr[3] = {0xffffff,0x000000,0x000000};
-uint8_t         curShortAddr  = 0;
-eRXDataStatus_t eRXDataStatus;
-uint8_t         compareResponse = 0;
+#define SEARCH_NO_COLLISION 0x1000000/*!< collideAddr when no COMPARE collided*/
 
 /**
  * @brief Sets the 24 bit search address to use in the current iteration of the addressing algorithm
  * 
+ * @param psCtx addressing context, bytes the gear already hold per the bus shadow are not sent
  * @param searchAddress 
  * @return _Bool 
  */
-_Bool daliSetSearchAddress(uint32_t searchAddress);
+_Bool daliSetSearchAddress(sDaliAddrCtx_t *psCtx, uint32_t searchAddress);
 
+/**
+ * @brief Whether the gear in initialisation hold a byte of a search address, as the frames that have
+ * left the bus set SEARCHADDR
+ * 
+ * @param psShadow bus shadow
+ * @param byte 0 for H, 1 for M, 2 for L
+ * @param searchAddress 
+ * @return _Bool false if it differs or is not known
+ */
+static _Bool daliSearchByteHeld(const sDaliDtrShadow_t *psShadow, uint8_t byte, uint32_t searchAddress)
+{
+  return (  (0                                              != (psShadow->searchMask & (1u << byte)))
+          &&((uint8_t)(searchAddress >> (16 - (8 * byte))) == psShadow->aSearch[byte]             ));
+}
 
+/**
+ * @brief Whether the gear in initialisation hold all of a search address
+ * 
+ * @param searchAddress 
+ * @return _Bool 
+ */
+static _Bool daliSearchAddrHeld(uint32_t searchAddress)
+{
+  sDaliDtrShadow_t sShadow;
+  daliGetDtrShadow(&sShadow);
+  return (  (true == daliSearchByteHeld(&sShadow, 0, searchAddress))
+          &&(true == daliSearchByteHeld(&sShadow, 1, searchAddress))
+          &&(true == daliSearchByteHeld(&sShadow, 2, searchAddress)));
+}
 
-_Bool daliAddressingAlgorithm(uint8_t * numDrivers)
+/**
+ * @brief Next guess of a bisection of [low, high]: the common high bits, a 0 where they first differ and
+ * 1s below. It halves the aligned block the two share, so the lower SEARCHADDR bytes stay at 0xff until
+ * the search gets down to them and each guess changes one byte
+ * 
+ * @param low lowest address the gear can have
+ * @param high a gear answered here, above low
+ * @return uint32_t guess, low to high-1
+ */
+static uint32_t daliSearchSplit(uint32_t low, uint32_t high)
+{
+  uint32_t mask = 0x800000;
+  while(0 == ((low ^ high) & mask))
+  {
+    mask >>= 1;
+  }
+  return (high & ~((mask << 1) - 1)) | (mask - 1);
+}
+
+/**
+ * @brief Guess while no gear above low has answered yet: the end of the aligned block of 2^bits holding
+ * low. Each miss doubles the block, so a guess sized to the gap to the next gear finds an upper bound
+ * for the bisection in a compare or two
+ * 
+ * @param low lowest address the gear can have
+ * @param bits block size
+ * @return uint32_t guess, at most 0xffffff
+ */
+static uint32_t daliSearchProbe(uint32_t low, uint8_t bits)
 {
-  static uint32_t deltaGuess;
-  static uint8_t addressingState = 0;
-  switch(addressingState)
+  if(bits >= 24)
+  {
+    return 0xffffff;
+  }
+  return low | ((1ul << bits) - 1);
+}
+
+/**
+ * @brief Block size of the first guess of a search, the mean spacing of the gear found so far as
+ * random addresses are spread evenly
+ * 
+ * @param low lowest address the next gear can have
+ * @param numFound gear found below low, with none or a low of 0 the block is half the range
+ * @return uint8_t bits
+ */
+static uint8_t daliSearchProbeBits(uint32_t low, uint8_t numFound)
+{
+  uint32_t gap  = ((0 != numFound) && (0 != low)) ? (low / numFound) : 0xffffff;
+  uint8_t  bits = 0;
+  while(1 < gap)
+  {
+    gap >>= 1;
+    bits++;
+  }
+  return bits;
+}
+
+
+/**
+ * @brief Set up the search for the next gear, every gear left has a random address from low up. A
+ * collision above the gear just found means at least one of them is at or below it, so that bounds
+ * the search. Otherwise the guesses step up from low
+ * 
+ * @param psCtx addressing context
+ * @param low lowest random address left
+ */
+static void daliSearchStart(sDaliAddrCtx_t *psCtx, uint32_t low)
+{
+  psCtx->searchLow  = low;
+  psCtx->searchHigh = 0xffffff;
+  psCtx->bHighFound = false;
+  psCtx->bHighHint  = false;
+  if(  (SEARCH_NO_COLLISION != psCtx->collideAddr)
+     &&(low                 <= psCtx->collideAddr))
+  {
+    psCtx->searchHigh = psCtx->collideAddr;
+    psCtx->bHighFound = true;
+    psCtx->bHighHint  = true;
+    psCtx->searchAddr = (low == psCtx->searchHigh) ? low : daliSearchSplit(low, psCtx->searchHigh);
+  }
+  else
+  {
+    psCtx->probeBits  = daliSearchProbeBits(low, psCtx->shortAddr);
+    psCtx->searchAddr = daliSearchProbe(low, psCtx->probeBits);
+  }
+  psCtx->collideAddr = SEARCH_NO_COLLISION;
+}
+
+/**
+ * @brief Whether the run leaves the short addresses the gear already hold alone, allocating from inUse
+ * 
+ * @param psCtx addressing context
+ * @return _Bool false for a full run
+ */
+static _Bool daliKeepsShortAddrs(const sDaliAddrCtx_t *psCtx)
+{
+  return ((true == psCtx->bIncremental) || (true == psCtx->bRestore));
+}
+
+/**
+ * @brief Random address a driver had when it was identified
+ * 
+ * @param psStaticData driver
+ * @return uint32_t RANDOM_ADDR_UNKNOWN if it was not read
+ */
+static uint32_t daliKnownRandomAddr(const sStaticData_t *psStaticData)
+{
+  return (  ((uint32_t)psStaticData->aRandomAddr[0] << 16)
+          | ((uint32_t)psStaticData->aRandomAddr[1] <<  8)
+          |  (uint32_t)psStaticData->aRandomAddr[2]       );
+}
+
+/**
+ * @brief Whether a restore can select a driver by its random address: it has a short address and a
+ * random address, and no earlier entry has the same random address. A gear withdrawn already answers
+ * QUERY SHORT ADDRESS too, so a second entry would reprogram it
+ * 
+ * @param psCtx addressing context
+ * @param idx entry of puKnown
+ * @return _Bool 
+ */
+static _Bool daliKnownRestorable(const sDaliAddrCtx_t *psCtx, uint8_t idx)
+{
+  const sStaticData_t *psStaticData = &psCtx->puKnown[idx].sData.sStaticData;
+  uint32_t             randomAddr   = daliKnownRandomAddr(psStaticData);
+  uint8_t              prev;
+  if(  (MAX_SHORT_ADDRESS   <  psStaticData->addr)
+     ||(RANDOM_ADDR_UNKNOWN == randomAddr        ))
+  {
+    return false;
+  }
+  for(prev = 0; prev < idx; prev++)
+  {
+    if(randomAddr == daliKnownRandomAddr(&psCtx->puKnown[prev].sData.sStaticData))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Short address for the gear about to be programmed
+ * 
+ * @param psCtx addressing context
+ * @return uint8_t count of gear found in a full run, lowest short address not in use in an incremental
+ * or restore one, above MAX_SHORT_ADDRESS if all are taken
+ */
+static uint8_t daliNextShortAddr(const sDaliAddrCtx_t *psCtx)
+{
+  if(false == daliKeepsShortAddrs(psCtx))
+  {
+    return psCtx->shortAddr;
+  }
+  if(UINT64_MAX == psCtx->inUse)
+  {
+    return MAX_SHORT_ADDRESS + 1;
+  }
+  return (uint8_t)__builtin_ctzll(~psCtx->inUse);
+}
+
+/**
+ * @brief Next short address the QUERY CONTROL GEAR PRESENT scan has to ask about
+ * 
+ * @param psCtx addressing context
+ * @param from lowest short address to consider
+ * @return uint8_t lowest short address from 'from' not already in inUse, above MAX_SHORT_ADDRESS if none
+ */
+static uint8_t daliScanFrom(const sDaliAddrCtx_t *psCtx, uint8_t from)
+{
+  uint64_t unknown;
+  if(from > MAX_SHORT_ADDRESS)
+  {
+    return MAX_SHORT_ADDRESS + 1;
+  }
+  unknown = ~psCtx->inUse & (UINT64_MAX << from);
+  if(0 == unknown)
+  {
+    return MAX_SHORT_ADDRESS + 1;
+  }
+  return (uint8_t)__builtin_ctzll(unknown);
+}
+
+/**
+ * @brief Program the gear at SEARCHADDR with the next short address and go on to verify it
+ * 
+ * @param psCtx addressing context
+ */
+static void daliProgramFound(sDaliAddrCtx_t *psCtx)
+{
+  psCtx->progAddr = daliNextShortAddr(psCtx);
+  if(psCtx->progAddr > MAX_SHORT_ADDRESS)
+  {//no short address left, the rest stay unaddressed
+    psCtx->sCtx.state = 7;
+    return;
+  }
+  sendSpecialCmdNoReply((psCtx->progAddr<<1)|1,evprogramShortAddr);
+  psCtx->sCtx.state = 5;
+}
+
+/**
+ * @brief The gear at SEARCHADDR holds progAddr: withdraw it and search for the next, above this one
+ * as withdrawn gear no longer answer
+ * 
+ * @param psCtx addressing context
+ */
+static void daliWithdrawFound(sDaliAddrCtx_t *psCtx)
+{
+  sendSpecialCmdNoReply(0,evWithdraw);
+  psCtx->shortAddr++;
+  if(true == daliKeepsShortAddrs(psCtx))
+  {
+    if(0 == (psCtx->inUse & (1ull << psCtx->progAddr)))
+    {
+      psCtx->inUse |= 1ull << psCtx->progAddr;
+      psCtx->added |= 1ull << psCtx->progAddr;
+    }
+    else
+    {//a driver the caller knows kept its short address
+      psCtx->kept  |= 1ull << psCtx->progAddr;
+    }
+  }
+  if(0xffffff == psCtx->searchHigh)
+  {
+    psCtx->sCtx.state = 7;
+    return;
+  }
+  daliSearchStart(psCtx, psCtx->searchHigh + 1);
+  psCtx->sCtx.state = 2;
+}
+
+
+_Bool daliAddressingAlgorithm(sDaliAddrCtx_t *psCtx, uint8_t * numDrivers)
+{
+  eRXDataStatus_t eRXDataStatus;
+  uint8_t         compareResponse = 0;
+  switch(psCtx->sCtx.state)
   {
   case 0://Put drivers in initialise mode
-    daliResetAddressing();
-    addressingState = 1;
+    daliResetAddressing(psCtx);
+    psCtx->sCtx.state = (true == psCtx->bIncremental) ? 13 : ((true == psCtx->bRestore) ? 16 : 1);
+    break;
+  case 13://any gear without a short address?
+    sendStandardCmdWithReply(0,evBroadcastAll,evQueryMissingShortAddress);
+    psCtx->sCtx.state = 14;
+    break;
+  case 14:
+    eRXDataStatus = getDaliBackFrame(&compareResponse);
+    if(  (evValidDataFound != eRXDataStatus)
+       &&(evDataCorrupt    != eRXDataStatus))
+    {//nothing new on the bus
+      psCtx->sCtx.state = 7;
+      break;
+    }
+    psCtx->scanAddr = daliScanFrom(psCtx, 0);//addresses the caller knows are taken need no query
+    if(psCtx->scanAddr > MAX_SHORT_ADDRESS)
+    {
+      psCtx->sCtx.state = 1;
+      break;
+    }
+    sendStandardCmdWithReply(psCtx->scanAddr,evShortAddress,evQueryControlGearPresent);
+    psCtx->sCtx.state = 15;
     break;
+  case 15://note which short addresses answer, the new gear get the others
+    eRXDataStatus = getDaliBackFrame(&compareResponse);
+    if(  (evValidDataFound == eRXDataStatus)
+       ||(evDataCorrupt    == eRXDataStatus))
+    {
+      psCtx->inUse |= 1ull << psCtx->scanAddr;
+    }
+    psCtx->scanAddr = daliScanFrom(psCtx, psCtx->scanAddr + 1);
+    if(psCtx->scanAddr <= MAX_SHORT_ADDRESS)
+    {
+      sendStandardCmdWithReply(psCtx->scanAddr,evShortAddress,evQueryControlGearPresent);
+      break;
+    }
+    psCtx->sCtx.state = 1;
+    //fall through
   case 1://Tell initialised drivers to randomise
     sendSpecialCmdTwice(0,evRandomise);
-    addressingState = 2;
+    psCtx->sCtx.state = 2;
     break;
-  case 2://set up next search address guess
-    if(true == daliSetSearchAddress((uint32_t)(searchAddr[0])&0xffffff))
+  case 2://compare at the guess
+    if(true == daliSetSearchAddress(psCtx, psCtx->searchAddr))
      {
-      addressingState = 8;
+      psCtx->sCtx.state = 8;
      }
     break;
   case 8:
-    searchAddr[2] = searchAddr[1];
-    searchAddr[1] = searchAddr[0];
-    deltaGuess = (searchAddr[2] > searchAddr[1])? (searchAddr[2] - searchAddr[1]):(searchAddr[1] - searchAddr[2]);  
     eRXDataStatus = getDaliBackFrame(&compareResponse);
+    if(  (evDataCorrupt == eRXDataStatus     )
+       &&(psCtx->searchAddr < psCtx->collideAddr))
+    {//several gear answered, at least two are at or below the guess
+      psCtx->collideAddr = psCtx->searchAddr;
+    }
     if(  (evValidDataFound == eRXDataStatus)
        ||(evDataCorrupt    == eRXDataStatus))
-    {//reduce address guess
-      if(deltaGuess <= 1)
-      {//search address has been found.
-        sendSpecialCmdNoReply((curShortAddr<<1)|1,evprogramShortAddr);
-        addressingState = 5;
+    {//a gear is at or below the guess
+      psCtx->searchHigh = psCtx->searchAddr;
+      psCtx->bHighFound = true;
+      psCtx->bHighHint  = false;
+    }
+    else if(0xffffff == psCtx->searchAddr)
+    {//every gear has been withdrawn
+      psCtx->sCtx.state = 7;
+      break;
+    }
+    else
+    {
+      psCtx->searchLow = psCtx->searchAddr + 1;
+    }
+    if(  (true             == psCtx->bHighFound)
+       &&(psCtx->searchLow >  psCtx->searchHigh))
+    {//collision left by the previous search was noise, nothing is at or below it
+      psCtx->bHighFound = false;
+      psCtx->bHighHint  = false;
+      psCtx->probeBits  = daliSearchProbeBits(psCtx->searchLow, psCtx->shortAddr);
+      psCtx->searchAddr = daliSearchProbe(psCtx->searchLow, psCtx->probeBits);
+    }
+    else if(false == psCtx->bHighFound)
+    {//step up in doubling blocks until a gear answers
+      psCtx->probeBits++;
+      psCtx->searchAddr = daliSearchProbe(psCtx->searchLow, psCtx->probeBits);
+    }
+    else if(psCtx->searchLow == psCtx->searchHigh)
+    {
+      psCtx->searchAddr = psCtx->searchHigh;
+      if(true == psCtx->bHighHint)
+      {//only the previous search saw a gear here, compare before programming
+        psCtx->bHighHint = false;
+      }
+      else if(psCtx->collideAddr == psCtx->searchHigh)
+      {//nothing below and several here, the gear share a random address
+        psCtx->sCtx.state = 12;
+        break;
+      }
+      else if(  (true     == psCtx->bRestore     )
+              &&(0xffffff == psCtx->searchHigh   )
+              &&(0        == psCtx->numRandomise))
+      {//factory fresh gear, a restore does not randomise them and any number of them answer here as one
+        psCtx->sCtx.state = 12;
         break;
       }
       else
-      {
-        searchAddr[0] =  searchAddr[1] - (deltaGuess>>1) - (deltaGuess%2);
+      {//search address has been found, SEARCHADDR is moved onto it before programming
+        psCtx->sCtx.state = 11;
+        break;
       }
     }
     else
-    {//increase address guess
-      if(0xffffff == searchAddr[0])
-      {
-        addressingState = 7;
-        break;
-      }
-      searchAddr[0] =  searchAddr[1] + (deltaGuess>>1) + (deltaGuess%2);
-      searchAddr[0] = (searchAddr[0] > 0xffffff) ? 0xffffff : searchAddr[0];//clamp
+    {//bisect
+      psCtx->searchAddr = daliSearchSplit(psCtx->searchLow, psCtx->searchHigh);
     }
-    if(false == daliSetSearchAddress((uint32_t)(searchAddr[0])&0xffffff))
+    psCtx->sCtx.state = (true == daliSetSearchAddress(psCtx, psCtx->searchAddr)) ? 8 : 2;
+    break;
+  case 11://program the gear at SEARCHADDR
+    if(false == daliSearchAddrHeld(psCtx->searchAddr))
     {
-      addressingState = 2;
+      daliSetSearchAddress(psCtx, psCtx->searchAddr);//SEARCHADDR bytes only, never reaches the compare
+      break;
     }
-    else
-    {
-      addressingState = 8;
-    }    
+    psCtx->sSetSearch.state = 0;//next search starts from the high byte
+    if(true == psCtx->bRestore)
+    {//a gear whose short address is free keeps it
+      sendSpecialCmdWithReply(0,evQueryShortAddr);
+      psCtx->sCtx.state = 20;
+      break;
+    }
+    daliProgramFound(psCtx);
+    break;
+  case 20:
+    eRXDataStatus = getDaliBackFrame(&compareResponse);
+    if(  (evValidDataFound == eRXDataStatus                                                    )
+       &&(0x01             == (compareResponse & 0x81)                                         )
+       &&(0                == ((psCtx->restored | psCtx->kept | psCtx->added) & (1ull << (compareResponse >> 1)))))
+    {//not taken by this run, likely the gear of an entry that drew a new random address
+      psCtx->progAddr = compareResponse >> 1;
+      daliWithdrawFound(psCtx);
+      break;
+    }
+    daliProgramFound(psCtx);
     break;
   case 5://verify short address
-    sendSpecialCmdWithReply((curShortAddr<<1)|1,evVerifyShortAddr);
-    addressingState = 9;      
+    sendSpecialCmdWithReply((psCtx->progAddr<<1)|1,evVerifyShortAddr);
+    psCtx->sCtx.state = 9;      
     break;
   case 9:
     eRXDataStatus = getDaliBackFrame(&compareResponse);
     if(  (evValidDataFound == eRXDataStatus)
        ||(evDataCorrupt    == eRXDataStatus))
     {
-      sendSpecialCmdNoReply(0,evWithdraw);
-      //start addressing over, searching for another driver
-      searchAddr[0]   = 0xffffff;
-      searchAddr[1]   = 0       ;
-      searchAddr[2]   = 0       ;
-      addressingState = 2       ;
-      curShortAddr++            ;
+      daliWithdrawFound(psCtx);
     }
     else
-    {//What do?
+    {//What do? Stays here until the context times out
     }
   break;
+  case 17://gear of puKnown at its random address?
+    eRXDataStatus = getDaliBackFrame(&compareResponse);
+    if(evValidDataFound == eRXDataStatus)
+    {
+      psCtx->progAddr = psCtx->puKnown[psCtx->knownIdx].sData.sStaticData.addr;
+      if(compareResponse != ((psCtx->progAddr<<1)|1))
+      {//found, with another short address
+        sendSpecialCmdNoReply((psCtx->progAddr<<1)|1,evprogramShortAddr);
+        psCtx->sCtx.state = 18;
+        break;
+      }
+      sendSpecialCmdNoReply(0,evWithdraw);
+      psCtx->inUse    |= 1ull << psCtx->progAddr;
+      psCtx->restored |= 1ull << psCtx->progAddr;
+      psCtx->knownIdx++;
+      psCtx->sCtx.state = 16;
+      break;
+    }
+    //gone, re-randomised, or sharing it with another gear; the search finds it
+    psCtx->knownIdx++;
+    psCtx->sCtx.state = 16;
+    //fall through
+  case 16://select the next gear of puKnown by its random address
+    while(  (psCtx->knownIdx < psCtx->numKnown                      )
+          &&(false           == daliKnownRestorable(psCtx, psCtx->knownIdx)))
+    {
+      psCtx->knownIdx++;
+    }
+    if(psCtx->knownIdx >= psCtx->numKnown)
+    {//search for the rest, one COMPARE at the top tells whether there are any
+      psCtx->probeBits  = 24;
+      psCtx->searchAddr = daliSearchProbe(0, psCtx->probeBits);
+      psCtx->sCtx.state = (true == daliSetSearchAddress(psCtx, psCtx->searchAddr)) ? 8 : 2;
+      break;
+    }
+    psCtx->searchAddr = daliKnownRandomAddr(&psCtx->puKnown[psCtx->knownIdx].sData.sStaticData);
+    if(false == daliSearchAddrHeld(psCtx->searchAddr))
+    {
+      daliSetSearchAddress(psCtx, psCtx->searchAddr);//SEARCHADDR bytes only, never reaches the compare
+      break;
+    }
+    psCtx->sSetSearch.state = 0;
+    sendSpecialCmdWithReply(0,evQueryShortAddr);//answered only at an exact match, a COMPARE would add nothing
+    psCtx->sCtx.state = 17;
+    break;
+  case 18://verify the short address given
+    sendSpecialCmdWithReply((psCtx->progAddr<<1)|1,evVerifyShortAddr);
+    psCtx->sCtx.state = 19;
+    break;
+  case 19:
+    eRXDataStatus = getDaliBackFrame(&compareResponse);
+    if(evValidDataFound == eRXDataStatus)
+    {
+      sendSpecialCmdNoReply(0,evWithdraw);
+      psCtx->inUse    |= 1ull << psCtx->progAddr;
+      psCtx->restored |= 1ull << psCtx->progAddr;
+    }//else the search finds it
+    psCtx->knownIdx++;
+    psCtx->sCtx.state = 16;
+    break;
+  case 12://give the gear sharing a random address new ones, the gear not yet found get new ones too
+    sendSpecialCmdTwice(0,evRandomise);//withdrawn gear keep quiet whatever they draw
+    psCtx->numRandomise++;
+    psCtx->collideAddr = SEARCH_NO_COLLISION;
+    daliSearchStart(psCtx, 0);
+    psCtx->sCtx.state  = 2;
+    break;
   case 7://terminate.  End identification process
     sendSpecialCmdNoReply(0,evTerminate);
-    addressingState = 10;
+    psCtx->sCtx.state = 10;
     break;
   case 10:
-    *numDrivers     = curShortAddr;//inform calling function how many driversd were addressed.
-    addressingState = 0;
+    if(  (false == psCtx->bIncremental)
+       &&(false == psCtx->bRestore    ))
+    {
+      *numDrivers     = psCtx->shortAddr;//inform calling function how many driversd were addressed.
+    }
+    psCtx->sCtx.state = 0;
     return true;
   default:
     break;
@@ -121,44 +537,42 @@ _Bool daliAddressingAlgorithm(uint8_t * numDrivers)
   return false;
 }
 
-_Bool daliSetSearchAddress(uint32_t searchAddress)
+_Bool daliSetSearchAddress(sDaliAddrCtx_t *psCtx, uint32_t searchAddress)
 {
-//  static uint32_t lastAddr = 0;
-  static uint8_t setSearchAddressState = 0;
-  static uint32_t curAddr = 0;
-  switch(setSearchAddressState)
+  sDaliDtrShadow_t sShadow;
+  daliGetDtrShadow(&sShadow);//bus is idle, the bytes sent by earlier steps have left
+  switch(psCtx->sSetSearch.state)
   {
   case 0://Set high address
-    if((curAddr & 0xff0000) != (searchAddress & 0xff0000))
+    if(false == daliSearchByteHeld(&sShadow, 0, searchAddress))
     {
       sendSpecialCmdNoReply((uint8_t)((searchAddress&0xff0000)>>16),evSearchAddrH);
-      curAddr = (curAddr & 0x00ffff) | (searchAddress & 0xff0000);
-      setSearchAddressState = 1;
+      psCtx->sSetSearch.state = 1;
       break;
-      
     }
-  setSearchAddressState = 1;
+    psCtx->sSetSearch.state = 1;
+    //fall through
   case 1://Set mid address
-    if((curAddr & 0x00ff00) != (searchAddress & 0x00ff00))
+    if(false == daliSearchByteHeld(&sShadow, 1, searchAddress))
     {
       sendSpecialCmdNoReply((uint8_t)((searchAddress&0xff00)>>8),evSearchAddrM);
-      curAddr = (curAddr & 0xff00ff) | (searchAddress & 0x00ff00);
-      setSearchAddressState = 2;
+      psCtx->sSetSearch.state = 2;
       break;
     }
-    setSearchAddressState = 2;
+    psCtx->sSetSearch.state = 2;
+    //fall through
   case 2://Set low address
-    if((curAddr & 0x0000ff) != (searchAddress & 0x0000ff))
+    if(false == daliSearchByteHeld(&sShadow, 2, searchAddress))
     {
       sendSpecialCmdNoReply((uint8_t)(searchAddress & 0xff),evSearchAddrL);
-      curAddr = (curAddr & 0xffff00) | (searchAddress & 0x0000ff);
-      setSearchAddressState = 3;
+      psCtx->sSetSearch.state = 3;
       break;
     }
-    setSearchAddressState = 3;
+    psCtx->sSetSearch.state = 3;
+    //fall through
   case 3://compare
     sendSpecialCmdWithReply(0,evCompare);
-    setSearchAddressState = 0;
+    psCtx->sSetSearch.state = 0;
     return true;
   default:
   break;
@@ -167,12 +581,33 @@ return false;
 }
 
 
-_Bool daliResetAddressing(void)
-{//TODO: choose between initialize all and initialize all unaddressed?
-    sendSpecialCmdTwice(0,evInitialise);//0 address tells all drivers to initialise.  All control gear will participate.
-    searchAddr[0]   = 0xffffff;//reset stuff to initial values so they can be rerun
-    searchAddr[1]   = 0;
-    searchAddr[2]   = 0;
-    curShortAddr    = 0;
+_Bool daliResetAddressing(sDaliAddrCtx_t *psCtx)
+{
+    if(true == psCtx->bIncremental)
+    {
+      sendSpecialCmdTwice(0xff,evInitialise);//gear without a short address initialise, the rest keep theirs
+    }
+    else
+    {
+      sendSpecialCmdTwice(0,evInitialise);//0 address tells all drivers to initialise.  All control gear will participate.
+    }
+    psCtx->shortAddr    = 0;//reset stuff to initial values so they can be rerun
+    psCtx->added        = 0;
+    psCtx->knownIdx     = 0;
+    psCtx->restored     = 0;
+    psCtx->kept         = 0;
+    psCtx->numRandomise = 0;
+    psCtx->collideAddr  = SEARCH_NO_COLLISION;
+    daliSearchStart(psCtx, 0);//nothing to size the first guess on
     return true;
+}
+
+
+void daliAddressingReset(sDaliAddrCtx_t *psCtx)
+{
+  if(0 != psCtx->sCtx.state)
+  {//gear may be left in initialisation mode
+    sendSpecialCmdNoReply(0,evTerminate);
+  }
+  memset(psCtx,0,sizeof(sDaliAddrCtx_t));
 }
\ No newline at end of file
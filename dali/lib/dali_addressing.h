@@ -8,21 +8,71 @@
  * @copyright Copyright (c) 2021
  * 
  */
+#pragma once
 #include <stdint.h>
 #include <stdbool.h>
+#include "dali_ctx.h"
+#include "dali_staticData.h"
+
+/**
+ * @brief Progress of a run of the addressing algorithm
+ */
+typedef struct
+{
+  sDaliCtx_t sCtx           ;
+  _Bool      bIncremental   ;/*!<Address only gear without a short address and keep the rest, set after daliAddressingReset*/
+  uint64_t   inUse          ;/*!<Bit per short address taken, incremental and restore runs. Caller may set the ones it knows of with the mode*/
+  uint64_t   added          ;/*!<Bit per short address given out by this incremental or restore run to gear not in puKnown*/
+  uint8_t    scanAddr       ;/*!<Short address QUERY CONTROL GEAR PRESENT was last sent to*/
+  _Bool      bRestore       ;/*!<Select the gear in puKnown by their random address first, search only for the rest, set after daliAddressingReset*/
+  const uDaliDriverData_t *puKnown;/*!<Drivers to restore, their short address and aRandomAddr*/
+  uint8_t    numKnown       ;/*!<Entries in puKnown*/
+  uint8_t    knownIdx       ;/*!<Entry of puKnown being restored*/
+  uint64_t   restored       ;/*!<Bit per short address of the gear of puKnown found at their random address*/
+  uint64_t   kept           ;/*!<Bit per short address of puKnown the search found a gear holding, it keeps it*/
+  uint32_t   searchAddr     ;/*!<Guess being compared*/
+  uint32_t   searchLow      ;/*!<Lowest random address the next gear can have, withdrawn gear are below*/
+  uint32_t   searchHigh     ;/*!<A gear not yet withdrawn answered a COMPARE here, once bHighFound*/
+  _Bool      bHighFound     ;/*!<searchHigh is set, else guesses step up from searchLow*/
+  _Bool      bHighHint      ;/*!<searchHigh is left from a collision in the previous search, no gear has answered there since*/
+  uint32_t   collideAddr    ;/*!<Lowest guess of this search that several gear answered at once, above 0xffffff if none*/
+  uint8_t    probeBits      ;/*!<Guesses step up to the end of the aligned block of this many bits holding searchLow*/
+  uint8_t    shortAddr      ;/*!<Count of gear found so far, the next gear gets it in a full run*/
+  uint8_t    progAddr       ;/*!<Short address the gear being programmed gets*/
+  uint8_t    numRandomise   ;/*!<RANDOMISE resent as two gear had the same random address*/
+  sDaliCtx_t sSetSearch     ;/*!<daliSetSearchAddress*/
+}sDaliAddrCtx_t;
 
 
 /**
- * @brief Addressing algorithm statemachine
+ * @brief Addressing algorithm statemachine. A full run initialises all gear and gives them short
+ * addresses from 0 in the order found. An incremental run initialises unaddressed gear only, stops
+ * after one query if there are none, else finds the short addresses in use and gives each new gear the
+ * lowest free one; psCtx->added holds what it gave out. A restore run initialises all gear but keeps
+ * their random addresses: each gear of psCtx->puKnown is selected by its random address and given its
+ * short address, then the gear left are searched for, keeping their short address where it is free
  * 
- * @param numDrivers 
+ * @param psCtx progress, start from daliAddressingReset
+ * @param numDrivers count of gear addressed, set by full runs only. After a restore run the caller
+ * rebuilds its list from restored, kept and added
  * @return _Bool 
  */
-_Bool daliAddressingAlgorithm(uint8_t * numDrivers);
+_Bool daliAddressingAlgorithm(sDaliAddrCtx_t *psCtx       ,
+                              uint8_t        *numDrivers  );
 
 /**
- * @brief Tells all drivers to initialize, resets addressing variables 
+ * @brief Tells all drivers, or only unaddressed ones in an incremental run, to initialize, resets
+ * addressing variables 
  * 
+ * @param psCtx progress
  * @return _Bool 
  */
-_Bool daliResetAddressing    (void                );
+_Bool daliResetAddressing    (sDaliAddrCtx_t *psCtx       );
+
+/**
+ * @brief Abandon a run part way, or set up for the first one. Sends TERMINATE if gear were left in
+ * initialisation mode, so call while the bus is idle. Clears the timeout and cancel of psCtx->sCtx too
+ * 
+ * @param psCtx progress
+ */
+void  daliAddressingReset    (sDaliAddrCtx_t *psCtx       );
@@ -0,0 +1,173 @@
+/**
+ * @file dali_bus.h
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Bus backend interface. The driver queues, encodes and decodes; a backend only moves bytes
+ * over the wire, one spi byte per TE. Backends: dali_bus_pico.c (spi + chained dma),
+ * dali_bus_nrf.c (spim) and dali_bus_host.c (simulated bus and control gear, DALI_HOST builds)
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "dali_frames.h"
+
+#ifdef NRF
+#include <zephyr.h>
+#define DALI_BUS_CHAINED 0/**< spim has no descriptor chaining, the driver starts sequence frames one by one*/
+#define DALI_BUS_RXCOUNT 0/**< easydma reports what it received only at the end*/
+#define DALI_CRITICAL_ENTER() unsigned int irqKey = irq_lock()
+#define DALI_CRITICAL_EXIT()  irq_unlock(irqKey)
+#elif defined(DALI_HOST)
+#define DALI_BUS_CHAINED 1/**< Sequence blocks are replayed*/
+#define DALI_BUS_RXCOUNT 1/**< daliHostClockUntil clocks a transfer part way*/
+#define DALI_CRITICAL_ENTER()
+#define DALI_CRITICAL_EXIT()
+#else
+#include "hardware/sync.h"
+#define DALI_BUS_CHAINED 1/**< Sequence blocks become dma control blocks*/
+#define DALI_BUS_RXCOUNT 1/**< Read back from the rx channel's transfer count*/
+#define DALI_CRITICAL_ENTER() uint32_t irqKey = save_and_disable_interrupts()
+#define DALI_CRITICAL_EXIT()  restore_interrupts(irqKey)
+#endif
+
+/**
+ * @brief One transfer. The bus clocks max(txLen, rxLen) TEs, idle is sent once txLen runs out
+ */
+typedef struct
+{
+  const uint8_t *pTx  ;/*!< Encoded TEs to send*/
+  uint8_t       *pRx  ;/*!< Received TEs are stored here, holds max(txLen, rxLen). NULL to discard them*/
+  uint8_t        txLen;
+  uint8_t        rxLen;
+}sDaliBusXfer_t;
+
+
+/**
+ * @brief Set up the interface and the completion interrupt
+ */
+void           daliBusInit     (void);
+
+/**
+ * @brief Start a transfer, daliBusOnDone is called once rxLen bytes are in. Called with
+ * interrupts masked or from daliBusOnDone
+ * @param psXfer Transfer, copied before returning. Buffers must stay valid until done
+ */
+void           daliBusStart    (const sDaliBusXfer_t *psXfer);
+
+/**
+ * @brief Service the backend from thread context. Interrupt driven backends only report, the host
+ * backend runs the simulated bus through the transfer and completes it from here
+ * @return _Bool true once nothing is on the bus
+ */
+_Bool          daliBusPollDone (void);
+
+/**
+ * @brief Bytes received so far by the transfer on the bus, lets the driver decode a reply early
+ * @return uint8_t 0 if the backend cannot tell before the end, see DALI_BUS_RXCOUNT
+ */
+uint8_t        daliBusRxCount  (void);
+
+/**
+ * @brief Where the last transfer stored its received bytes
+ * @return const uint8_t* pRx of the transfer, or the backend's own buffer if it was NULL and the
+ * backend keeps discarded bytes. NULL if they were dropped
+ */
+const uint8_t *daliBusGetRx    (void);
+
+/**
+ * @brief Stop the transfer on the bus. Called with interrupts masked, never waits for the bus
+ * @return _Bool true if nothing of the stopped transfer is left to be received and daliBusOnDone will
+ * not be called. false if the backend still drops what its spi holds, daliBusOnDone follows once it
+ * has and the next transfer may only start from there
+ */
+_Bool          daliBusAbort    (void);
+
+/**
+ * @brief Transfer or sequence run complete. Called by the backend from its interrupt, implemented
+ * by the driver
+ */
+void           daliBusOnDone   (void);
+
+#if DALI_BUS_CHAINED
+/*Sequences: tx and rx block lists run back to back without the cpu up to each stop*/
+
+/**
+ * @brief Empty the block lists. Only while no sequence is on the bus
+ */
+void           daliBusSeqClear (void);
+
+/**
+ * @brief Append a tx block
+ * @param pRead data to send
+ * @param count bytes to send
+ * @param bIncr false to send *pRead count times
+ */
+void           daliBusSeqTx    (const uint8_t *pRead, uint16_t count, _Bool bIncr);
+
+/**
+ * @brief Append an rx block
+ * @param pWrite destination, NULL to discard the bytes
+ * @param count bytes to receive
+ */
+void           daliBusSeqRx    (uint8_t *pWrite, uint16_t count);
+
+/**
+ * @brief End a run: both lists stop here and daliBusOnDone is called
+ */
+void           daliBusSeqStop  (void);
+
+/**
+ * @brief Run the lists from the start up to the first stop
+ */
+void           daliBusSeqStart (void);
+
+/**
+ * @brief Run on from the last stop to the next one
+ */
+void           daliBusSeqResume(void);
+#endif
+
+#ifdef DALI_HOST
+/**
+ * @brief Replace the simulated gear with a line model, called once per TE byte clocked out
+ * @param pfnWire returns the byte received while txByte is sent, NULL restores the simulated bus
+ */
+void           daliHostSetWire (uint8_t (*pfnWire)(uint8_t txByte));
+
+/**
+ * @brief Clock the single transfer on the bus up to a point in simulated time without completing it,
+ * as the dma runs on while the cpu takes a timer interrupt
+ * @param us simulated time to stop at
+ * @return _Bool true if the transfer got there with TEs still to go, false if it would end first (the
+ * rest is left to daliBusPollDone) or no single transfer is on the bus
+ */
+_Bool          daliHostClockUntil(uint64_t us);
+
+/**
+ * @brief Host stand-in for the dma interrupt: completes transfers until the driver queue is empty
+ */
+void           daliHostRun     (void);
+
+/**
+ * @brief Let the bus idle, nothing is sent
+ * @param us microseconds of simulated time
+ */
+void           daliHostIdle    (uint32_t us);
+
+/**
+ * @brief Simulated time, advanced one TE per byte on the wire and by daliHostIdle
+ * @return uint64_t microseconds since daliBusInit
+ */
+uint64_t       daliHostNowUs   (void);
+
+/**
+ * @brief Pace the simulated clock against the wall clock
+ * @param scale simulated seconds per real second, 0 runs as fast as the host can
+ */
+void           daliHostSetTimeScale(uint32_t scale);
+#endif
@@ -0,0 +1,311 @@
+/**
+ * @file dali_bus_host.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Host bus backend for DALI_HOST builds. Transfers and sequence blocks are clocked one TE
+ * at a time through the simulated gear of dali_gearSim.c, or a line model set by daliHostSetWire.
+ * Simulated time runs as fast as the host allows unless a time scale is set
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifdef DALI_HOST
+#include <stddef.h>
+#include <time.h>
+#include "dali_bus.h"
+#include "dali_gearSim.h"
+#include "daliXfer.h"
+
+#define SEQ_TX_BLOCKS (5 * DALI_SEQ_MAX_STEPS + 1)/*!< Same bounds as the dma block lists*/
+#define SEQ_RX_BLOCKS (4 * DALI_SEQ_MAX_STEPS + 1)
+#define HOST_SINK_LEN 256                         /*!< Longest transfer, its length is a uint8_t*/
+
+typedef struct
+{
+  const uint8_t *pRead;/*!< NULL ends the run*/
+  uint16_t       count;
+  _Bool          bIncr;
+}sHostTxBlock_t;
+
+typedef struct
+{
+  uint8_t       *pWrite;/*!< NULL discards*/
+  uint16_t       count ;
+  _Bool          bStop ;/*!< Run ends here*/
+}sHostRxBlock_t;
+
+typedef enum
+{
+  evHostIdle,
+  evHostXfer,
+  evHostSeq
+}eHostPending_t;
+
+static sHostTxBlock_t  saSeqTxBlocks[SEQ_TX_BLOCKS];
+static sHostRxBlock_t  saSeqRxBlocks[SEQ_RX_BLOCKS];
+static uint8_t         seqTxBlocks  = 0;    /*!< Blocks appended since daliBusSeqClear*/
+static uint8_t         seqRxBlocks  = 0;
+static uint8_t         hostTxBlock  = 0;    /*!< First block of the next run*/
+static uint8_t         hostRxBlock  = 0;
+static eHostPending_t  eHostPending = evHostIdle;
+static sDaliBusXfer_t  sHostXfer;
+static uint8_t         hostXferTE   = 0;    /*!< TEs of sHostXfer clocked so far*/
+static uint8_t         aHostSink[HOST_SINK_LEN];/*!< Received bytes of transfers without pRx*/
+static const uint8_t  *pHostLastRx  = NULL;
+static uint8_t       (*pfnHostWire)(uint8_t txByte) = NULL;/*!< NULL clocks the simulated gear*/
+static uint32_t        hostTimeScale = 0;
+static uint64_t        hostPacedTE   = 0;   /*!< Simulated TEs already paced against the wall clock*/
+
+/**
+ * @brief One TE on the bus
+ */
+static uint8_t daliHostTE(uint8_t txByte)
+{
+  if(NULL == pfnHostWire)
+  {
+    return daliGearSimTE(txByte);
+  }
+  daliGearSimIdle(1);//keep the clock running under a line model
+  return pfnHostWire(txByte);
+}
+
+/**
+ * @brief Sleep until the wall clock catches up with scaled simulated time
+ */
+static void daliHostPace(void)
+{
+  uint64_t        teNow = daliGearSimNowTE();
+  uint64_t        ns;
+  struct timespec sSleep;
+  if(  (0     == hostTimeScale)
+     ||(teNow <= hostPacedTE  ))
+  {
+    hostPacedTE = teNow;
+    return;
+  }
+  ns             = (DALI_GEARSIM_TE_TO_US(teNow - hostPacedTE) * 1000u) / hostTimeScale;
+  hostPacedTE    = teNow;
+  sSleep.tv_sec  = (time_t)(ns / 1000000000u);
+  sSleep.tv_nsec = (long)  (ns % 1000000000u);
+  nanosleep(&sSleep, NULL);
+}
+
+/**
+ * @brief Walk the sequence blocks the way the two dma chains would, up to the next stop
+ */
+static void daliHostReplaySeq(void)
+{
+  const sHostTxBlock_t *psTx   = &saSeqTxBlocks[hostTxBlock];
+  const sHostRxBlock_t *psRx   = &saSeqRxBlocks[hostRxBlock];
+  uint32_t              txDone = 0;
+  uint32_t              rxDone = 0;
+  uint8_t               txByte;
+  uint8_t               rxByte;
+  while(false == psRx->bStop)
+  {
+    while(  (NULL   != psTx->pRead)
+          &&(txDone >= psTx->count))
+    {
+      psTx++;
+      txDone = 0;
+    }
+    txByte = 0x00;//tx chain ended, idle
+    if(NULL != psTx->pRead)
+    {
+      txByte = psTx->bIncr ? psTx->pRead[txDone] : *psTx->pRead;
+      txDone++;
+    }
+    rxByte = daliHostTE(txByte);
+    if(NULL != psRx->pWrite)
+    {
+      psRx->pWrite[rxDone] = rxByte;
+    }
+    if(++rxDone >= psRx->count)
+    {
+      psRx++;
+      rxDone = 0;
+    }
+  }
+  while(NULL != psTx->pRead)
+  {
+    psTx++;
+  }
+  hostTxBlock = (uint8_t)(psTx - &saSeqTxBlocks[0]) + 1;
+  hostRxBlock = (uint8_t)(psRx - &saSeqRxBlocks[0]) + 1;
+}
+
+/**
+ * @brief Clock a single transfer, idle once txLen runs out
+ */
+static void daliHostReplayXfer(void)
+{
+  uint8_t *pRx     = (NULL != sHostXfer.pRx) ? sHostXfer.pRx : &aHostSink[0];
+  uint8_t  wireLen = (sHostXfer.txLen > sHostXfer.rxLen) ? sHostXfer.txLen : sHostXfer.rxLen;
+  for(; hostXferTE < wireLen; hostXferTE++)
+  {
+    pRx[hostXferTE] = daliHostTE((hostXferTE < sHostXfer.txLen) ? sHostXfer.pTx[hostXferTE] : 0x00);
+  }
+  pHostLastRx = pRx;
+}
+
+
+void daliBusInit(void)
+{
+  seqTxBlocks  = 0;
+  seqRxBlocks  = 0;
+  eHostPending = evHostIdle;
+  pHostLastRx  = NULL;
+  hostPacedTE  = daliGearSimNowTE();
+}
+
+
+void daliBusStart(const sDaliBusXfer_t *psXfer)
+{
+  sHostXfer    = *psXfer;
+  hostXferTE   = 0;
+  eHostPending = evHostXfer;
+}
+
+
+_Bool daliBusPollDone(void)
+{
+  eHostPending_t eRun = eHostPending;
+  if(evHostIdle == eRun)
+  {
+    return true;
+  }
+  if(evHostSeq == eRun)
+  {
+    daliHostReplaySeq();
+  }
+  else
+  {
+    daliHostReplayXfer();
+  }
+  daliHostPace();
+  eHostPending = evHostIdle;
+  daliBusOnDone();//may start the next transfer or run
+  return (evHostIdle == eHostPending);
+}
+
+
+uint8_t daliBusRxCount(void)
+{
+  return (evHostXfer == eHostPending) ? hostXferTE : 0;//only daliHostClockUntil leaves one part way
+}
+
+
+const uint8_t *daliBusGetRx(void)
+{
+  return pHostLastRx;
+}
+
+
+_Bool daliBusAbort(void)
+{
+  eHostPending = evHostIdle;
+  return true;
+}
+
+
+void daliBusSeqClear(void)
+{
+  seqTxBlocks = 0;
+  seqRxBlocks = 0;
+}
+
+
+void daliBusSeqTx(const uint8_t *pRead, uint16_t count, _Bool bIncr)
+{
+  sHostTxBlock_t *psBlock = &saSeqTxBlocks[seqTxBlocks++];
+  psBlock->pRead = pRead;
+  psBlock->count = count;
+  psBlock->bIncr = bIncr;
+}
+
+
+void daliBusSeqRx(uint8_t *pWrite, uint16_t count)
+{
+  sHostRxBlock_t *psBlock = &saSeqRxBlocks[seqRxBlocks++];
+  psBlock->pWrite = pWrite;
+  psBlock->count  = count;
+  psBlock->bStop  = false;
+}
+
+
+void daliBusSeqStop(void)
+{
+  daliBusSeqTx(NULL, 0, false);
+  daliBusSeqRx(NULL, 0);
+  saSeqRxBlocks[seqRxBlocks - 1].bStop = true;
+}
+
+
+void daliBusSeqStart(void)
+{
+  hostTxBlock  = 0;
+  hostRxBlock  = 0;
+  pHostLastRx  = NULL;
+  eHostPending = evHostSeq;
+}
+
+
+void daliBusSeqResume(void)
+{
+  eHostPending = evHostSeq;
+}
+
+
+void daliHostSetWire(uint8_t (*pfnWire)(uint8_t txByte))
+{
+  pfnHostWire = pfnWire;
+}
+
+
+_Bool daliHostClockUntil(uint64_t us)
+{
+  uint8_t *pRx     = (NULL != sHostXfer.pRx) ? sHostXfer.pRx : &aHostSink[0];
+  uint8_t  wireLen = (sHostXfer.txLen > sHostXfer.rxLen) ? sHostXfer.txLen : sHostXfer.rxLen;
+  if(evHostXfer != eHostPending)
+  {
+    return false;
+  }
+  while(  (hostXferTE      <  wireLen)
+        &&(daliHostNowUs() <  us     ))
+  {
+    pRx[hostXferTE] = daliHostTE((hostXferTE < sHostXfer.txLen) ? sHostXfer.pTx[hostXferTE] : 0x00);
+    hostXferTE++;
+  }
+  daliHostPace();
+  return (hostXferTE < wireLen);
+}
+
+
+void daliHostRun(void)
+{
+  while(false == daliBusPollDone())
+  {
+  }
+}
+
+
+void daliHostIdle(uint32_t us)
+{
+  daliGearSimIdle(DALI_GEARSIM_US_TO_TE(us));
+  daliHostPace();
+}
+
+
+uint64_t daliHostNowUs(void)
+{
+  return DALI_GEARSIM_TE_TO_US(daliGearSimNowTE());
+}
+
+
+void daliHostSetTimeScale(uint32_t scale)
+{
+  hostTimeScale = scale;
+  hostPacedTE   = daliGearSimNowTE();
+}
+#endif
@@ -0,0 +1,123 @@
+/**
+ * @file dali_bus_nrf.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief nRF bus backend on nrfx_spim. The spim has no descriptor chaining, so DALI_BUS_CHAINED is 0
+ * and the driver starts sequence frames itself
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifdef NRF
+#include <stddef.h>
+#include <zephyr.h>
+#include <nrfx_spim.h>
+#include <nrfx_timer.h>
+#include "dali_bus.h"
+#include "dali_driver.h"
+
+#define SPIM_NODE DT_NODELABEL(DALISPIINSTANCE)
+
+static const nrfx_spim_t spi = NRFX_SPIM_INSTANCE(DALI_SPI_INSTANCE);
+static uint8_t           aRxSink[2 * sizeof(sEncodedFwdFrame_t) + 2 * INTERFRAMEIDLE];/*!< The spim always stores what it receives, discarded bytes land here*/
+static const uint8_t     aDummyTx[sizeof(sEncodedFwdFrame_t)];/*!< Idle frame sent by daliBusInit*/
+static volatile _Bool    bBusy    = false;
+static _Bool             bDummy   = false;/*!< Completion of the init frame is not reported*/
+static sDaliBusXfer_t    sDeferred;       /*!< Transfer started while the init frame was still out*/
+static _Bool             bDeferred = false;
+nrfx_spim_xfer_desc_t spim_xfer_desc =
+{
+  .p_tx_buffer = &aDummyTx[0]        ,
+  .tx_length   = sizeof(aDummyTx)    ,
+  .p_rx_buffer = &aRxSink[0]         ,
+  .rx_length   = sizeof(aDummyTx)
+};
+
+/**
+ * @brief Called upon spi event interrupt, completes the transfer on the bus
+ * @param p_event
+ * @param p_context
+ */
+static void spi_event_handler(nrfx_spim_evt_t const * p_event,
+                              void *                p_context)
+{
+  bBusy = false;
+  if(true == bDummy)
+  {
+    bDummy = false;
+    if(true == bDeferred)
+    {
+      bDeferred = false;
+      daliBusStart(&sDeferred);
+    }
+    return;
+  }
+  daliBusOnDone();
+}
+
+
+void daliBusInit(void)
+{
+  nrfx_spim_config_t spi_config = NRFX_SPIM_DEFAULT_CONFIG(SPI_SCK_PIN ,
+                                                           SPI_MOSI_PIN,
+                                                           SPI_MISO_PIN,
+                                                           SPI_SS_PIN  );
+  spi_config.frequency = (0x00500000UL);
+  nrfx_spim_init(&spi,&spi_config, spi_event_handler, NULL);
+  IRQ_CONNECT(DT_IRQN(SPIM_NODE          ),
+              DT_IRQ (SPIM_NODE, priority),
+              nrfx_isr,
+              nrfx_spim_0_irq_handler,
+              0);
+  irq_enable(DT_IRQN(SPIM_NODE));
+  bDummy = true;//dummy frame forces the idle polarity on the pins
+  bBusy  = true;
+  nrfx_spim_xfer(&spi,&spim_xfer_desc,0);
+
+  NRF_P0->PIN_CNF[29] &= ~(3<<2);
+}
+
+
+void daliBusStart(const sDaliBusXfer_t *psXfer)
+{
+  if(true == bDummy)
+  {//spim is still busy with the init frame
+    sDeferred = *psXfer;
+    bDeferred = true;
+    return;
+  }
+  bBusy = true;
+  spim_xfer_desc.p_tx_buffer = psXfer->pTx;
+  spim_xfer_desc.tx_length   = psXfer->txLen;
+  spim_xfer_desc.p_rx_buffer = (NULL != psXfer->pRx) ? psXfer->pRx : &aRxSink[0];
+  spim_xfer_desc.rx_length   = psXfer->rxLen;
+  nrfx_spim_xfer(&spi,&spim_xfer_desc,0) ;
+}
+
+
+_Bool daliBusPollDone(void)
+{
+  return (false == bBusy);
+}
+
+
+uint8_t daliBusRxCount(void)
+{
+  return 0;//easydma only reports the amount at the end
+}
+
+
+const uint8_t *daliBusGetRx(void)
+{
+  return spim_xfer_desc.p_rx_buffer;
+}
+
+
+_Bool daliBusAbort(void)
+{
+  nrfx_spim_abort(&spi);
+  bBusy = false;
+  return true;
+}
+#endif
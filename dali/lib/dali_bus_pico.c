@@ -0,0 +1,296 @@
+/**
+ * @file dali_bus_pico.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief RP2040 bus backend: spi0 with a data and a control dma channel each way. The control
+ * channels load 4 word blocks into the data channels' alias registers, so transfers and whole
+ * sequences run without the cpu
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#if !defined(NRF) && !defined(DALI_HOST)
+#include <stddef.h>
+#include "dali_bus.h"
+#include "daliXfer.h"
+#include "hardware/spi.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "pico/stdlib.h"
+#include "pico/binary_info.h"
+
+#define SEQ_TX_BLOCKS (5 * DALI_SEQ_MAX_STEPS + 1)/*!< frame+idle twice and a stop per send twice step, plus the end*/
+#define SEQ_RX_BLOCKS (4 * DALI_SEQ_MAX_STEPS + 1)/*!< skip+window+settle and a stop per query step, plus the end*/
+
+/**
+ * @brief TX control block, register order of dma alias 3 so the control channel writes it in one go
+ */
+typedef struct
+{
+  uint32_t             ctrl  ;
+  volatile void       *pWrite;
+  uint32_t             count ;
+  const volatile void *pRead ;/*!< NULL ends the chain*/
+}sDaliTxBlock_t;
+
+/**
+ * @brief RX control block, register order of dma alias 2
+ */
+typedef struct
+{
+  uint32_t             ctrl  ;
+  uint32_t             count ;
+  const volatile void *pRead ;
+  volatile void       *pWrite;/*!< NULL ends the chain and raises the quiet irq*/
+}sDaliRxBlock_t;
+
+uint dma_tx;
+uint dma_rx;
+uint dma_txctl;/*!< Loads control blocks into dma_tx*/
+uint dma_rxctl;/*!< Loads control blocks into dma_rx*/
+
+static sDaliTxBlock_t saSeqTxBlocks[SEQ_TX_BLOCKS] __attribute__((aligned(16)));
+static sDaliRxBlock_t saSeqRxBlocks[SEQ_RX_BLOCKS] __attribute__((aligned(16)));
+static uint8_t        seqTxBlocks = 0;     /*!< Blocks appended since daliBusSeqClear*/
+static uint8_t        seqRxBlocks = 0;
+static uint32_t       aSeqCtrl[2][2];      /*!< [tx/rx][fixed/incrementing] chained data channel ctrl words*/
+static uint32_t       aXferRxCtrl[2];      /*!< [fixed/incrementing] rx ctrl words of a single transfer, no chaining, irq at the end*/
+static volatile void *pSpiDr    = NULL;    /*!< spi data register*/
+static const uint8_t  idleTx    = 0x00;    /*!< Read over and over for idle TEs*/
+static uint8_t        rxSink;              /*!< Written over and over with received bytes nobody reads*/
+static sDaliTxBlock_t saXferTxBlocks[3] __attribute__((aligned(16)));/*!< frame, idle, end. Per transfer only the frame pointer and counts change*/
+static uint8_t        xferWireLen = 0;     /*!< TEs clocked by the transfer on the bus*/
+static uint8_t       *pXferRx     = NULL;  /*!< Destination of the transfer on the bus*/
+
+/**
+ * @brief dma irq 0, the rx channel finished its block or its chain
+ */
+static void daliBusPicoIrq(void)
+{
+  if(0 == (dma_hw->ints0 & (1u << dma_rx)))
+  {//already retired by daliBusAbort, irq was latched during the abort
+    return;
+  }
+  dma_hw->ints0 = 1u << dma_rx;
+  daliBusOnDone();
+}
+
+
+void daliBusInit(void)
+{
+  dma_channel_config c;
+  spi_init(spi_default, 19200);
+  spi_set_format(spi_default, 8, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
+  gpio_set_function(PICO_DEFAULT_SPI_RX_PIN, GPIO_FUNC_SPI);
+  gpio_set_function(PICO_DEFAULT_SPI_TX_PIN, GPIO_FUNC_SPI);
+  gpio_init(PICO_DEFAULT_SPI_CSN_PIN);
+  gpio_set_function(PICO_DEFAULT_SPI_SCK_PIN, GPIO_FUNC_SPI);
+
+  dma_tx    = dma_claim_unused_channel(true);
+  dma_rx    = dma_claim_unused_channel(true);
+  dma_txctl = dma_claim_unused_channel(true);
+  dma_rxctl = dma_claim_unused_channel(true);
+  pSpiDr    = &spi_get_hw(spi_default)->dr;
+
+  // Data channel ctrl words: each data channel chains to its control channel after every block, and
+  // only raises its irq when a NULL trigger ends the chain
+  c = dma_channel_get_default_config(dma_tx);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+  channel_config_set_dreq(&c, spi_get_dreq(spi_default, true));
+  channel_config_set_chain_to(&c, dma_txctl);
+  channel_config_set_irq_quiet(&c, true);
+  channel_config_set_read_increment(&c, false);
+  aSeqCtrl[0][0] = channel_config_get_ctrl_value(&c);
+  channel_config_set_read_increment(&c, true);
+  aSeqCtrl[0][1] = channel_config_get_ctrl_value(&c);
+  c = dma_channel_get_default_config(dma_rx);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+  channel_config_set_dreq(&c, spi_get_dreq(spi_default, false));
+  channel_config_set_read_increment(&c, false);
+  channel_config_set_write_increment(&c, false);
+  aXferRxCtrl[0] = channel_config_get_ctrl_value(&c);
+  channel_config_set_write_increment(&c, true);
+  aXferRxCtrl[1] = channel_config_get_ctrl_value(&c);
+  channel_config_set_chain_to(&c, dma_rxctl);
+  channel_config_set_irq_quiet(&c, true);
+  aSeqCtrl[1][1] = channel_config_get_ctrl_value(&c);
+  channel_config_set_write_increment(&c, false);
+  aSeqCtrl[1][0] = channel_config_get_ctrl_value(&c);
+  dma_channel_set_read_addr(dma_rx, pSpiDr, false);//single transfers leave it alone
+  dma_channel_set_irq0_enabled(dma_rx, true);
+
+  // Single transfers run their tx side through the control channel as well, frame then idle, so
+  // the spi keeps clocking (and receiving) through the whole reply window and settling time
+  saXferTxBlocks[0].ctrl   = aSeqCtrl[0][1];
+  saXferTxBlocks[0].pWrite = pSpiDr;
+  saXferTxBlocks[1].ctrl   = aSeqCtrl[0][0];
+  saXferTxBlocks[1].pWrite = pSpiDr;
+  saXferTxBlocks[2].ctrl   = aSeqCtrl[0][0];
+  saXferTxBlocks[2].pWrite = pSpiDr;
+  saXferTxBlocks[2].pRead  = NULL;
+
+  // Control channels copy one 4 word block per run into the alias registers of their data
+  // channel, the last word written triggers it. The write ring wraps after the 4 words
+  c = dma_channel_get_default_config(dma_txctl);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+  channel_config_set_read_increment(&c, true);
+  channel_config_set_write_increment(&c, true);
+  channel_config_set_ring(&c, true, 4);
+  dma_channel_configure(dma_txctl, &c,
+                        &dma_hw->ch[dma_tx].al3_ctrl, // write address
+                        &saSeqTxBlocks[0]           , // read address
+                        4                           , // words per block
+                        false                       ); // don't start yet
+  c = dma_channel_get_default_config(dma_rxctl);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+  channel_config_set_read_increment(&c, true);
+  channel_config_set_write_increment(&c, true);
+  channel_config_set_ring(&c, true, 4);
+  dma_channel_configure(dma_rxctl, &c,
+                        &dma_hw->ch[dma_rx].al2_ctrl, // write address
+                        &saSeqRxBlocks[0]           , // read address
+                        4                           , // words per block
+                        false                       ); // don't start yet
+
+  // Configure the processor to run daliBusPicoIrq() when DMA IRQ 0 is asserted
+  irq_set_exclusive_handler(DMA_IRQ_0, daliBusPicoIrq);
+  irq_set_enabled(DMA_IRQ_0, true);
+}
+
+
+void daliBusStart(const sDaliBusXfer_t *psXfer)
+{
+  // Configs were prepared in daliBusInit, only addresses and counts are written here. The spi only
+  // clocks while tx has data, so tx sends idle until rx has the whole window (send twice is the
+  // other way round, its idle is part of the frame buffer)
+  dma_channel_hw_t *psRx   = dma_channel_hw_addr(dma_rx);
+  xferWireLen              = (psXfer->rxLen > psXfer->txLen) ? psXfer->rxLen : psXfer->txLen;
+  pXferRx                  = psXfer->pRx;
+  saXferTxBlocks[0].pRead  = psXfer->pTx;
+  saXferTxBlocks[0].count  = psXfer->txLen;
+  saXferTxBlocks[1].pRead  = (xferWireLen > psXfer->txLen) ? &idleTx : NULL;//NULL ends the chain after the frame
+  saXferTxBlocks[1].count  = xferWireLen - psXfer->txLen;
+  psRx->al1_ctrl                = aXferRxCtrl[(NULL != pXferRx) ? 1 : 0];//a sequence may have left its chained ctrl
+  psRx->write_addr              = (NULL != pXferRx) ? (uintptr_t)pXferRx : (uintptr_t)&rxSink;
+  psRx->al1_transfer_count_trig = xferWireLen;
+  dma_hw->ch[dma_txctl].al3_read_addr_trig = (uintptr_t)&saXferTxBlocks[0];
+}
+
+
+_Bool daliBusPollDone(void)
+{
+  return (  (false == dma_channel_is_busy(dma_rx   ))
+          &&(false == dma_channel_is_busy(dma_rxctl)));
+}
+
+
+uint8_t daliBusRxCount(void)
+{
+  return (uint8_t)(xferWireLen - dma_channel_hw_addr(dma_rx)->transfer_count);
+}
+
+
+const uint8_t *daliBusGetRx(void)
+{
+  return pXferRx;
+}
+
+
+/**
+ * @brief Bytes the tx side of a stopped single transfer handed to the spi
+ */
+static uint32_t daliBusTxWritten(void)
+{
+  uint32_t loaded = (dma_channel_hw_addr(dma_txctl)->read_addr - (uintptr_t)&saXferTxBlocks[0]) / sizeof(sDaliTxBlock_t);
+  uint32_t left   = dma_channel_hw_addr(dma_tx)->transfer_count;
+  switch(loaded)
+  {
+    case 1://frame
+      return saXferTxBlocks[0].count - left;
+    case 2://idle, or the NULL that ended the chain after the frame with a count of 0
+      return saXferTxBlocks[0].count + saXferTxBlocks[1].count - left;
+    default:
+      return xferWireLen;
+  }
+}
+
+
+_Bool daliBusAbort(void)
+{
+  dma_channel_hw_t *psRx = dma_channel_hw_addr(dma_rx);
+  uint32_t          residue;
+  /*The channel irq is masked around the abort (RP2040-E13)*/
+  dma_channel_set_irq0_enabled(dma_rx, false);
+  dma_channel_abort(dma_txctl);
+  dma_channel_abort(dma_rxctl);
+  dma_channel_abort(dma_tx);
+  dma_channel_abort(dma_rx);
+  dma_hw->ints0 = 1u << dma_rx;
+  /*The dma leaves up to 8 bytes in each spi fifo and one in the shifter. Rather than wait for tx to
+    shift them out (3mS of idle TEs), rx drops exactly that many into the sink and its irq completes
+    the transfer, so the next transfer's buffer still starts aligned*/
+  residue = daliBusTxWritten() - (xferWireLen - psRx->transfer_count);
+  if((0 == residue) || (residue > xferWireLen))
+  {
+    dma_channel_set_irq0_enabled(dma_rx, true);
+    return true;
+  }
+  psRx->al1_ctrl                = aXferRxCtrl[0];
+  psRx->write_addr              = (uintptr_t)&rxSink;
+  psRx->al1_transfer_count_trig = residue;
+  dma_channel_set_irq0_enabled(dma_rx, true);
+  return false;
+}
+
+
+void daliBusSeqClear(void)
+{
+  seqTxBlocks = 0;
+  seqRxBlocks = 0;
+}
+
+
+void daliBusSeqTx(const uint8_t *pRead, uint16_t count, _Bool bIncr)
+{
+  sDaliTxBlock_t *psBlock = &saSeqTxBlocks[seqTxBlocks++];
+  psBlock->ctrl   = aSeqCtrl[0][bIncr ? 1 : 0];
+  psBlock->pWrite = pSpiDr;
+  psBlock->count  = count;
+  psBlock->pRead  = pRead;
+}
+
+
+void daliBusSeqRx(uint8_t *pWrite, uint16_t count)
+{
+  sDaliRxBlock_t *psBlock = &saSeqRxBlocks[seqRxBlocks++];
+  psBlock->ctrl   = aSeqCtrl[1][(NULL != pWrite) ? 1 : 0];
+  psBlock->count  = count;
+  psBlock->pRead  = pSpiDr;
+  psBlock->pWrite = (NULL != pWrite) ? pWrite : &rxSink;
+}
+
+
+void daliBusSeqStop(void)
+{//NULL triggers stop both chains, the rx one raises the irq
+  daliBusSeqTx(NULL, 0, false);
+  daliBusSeqRx(NULL, 0);
+  saSeqRxBlocks[seqRxBlocks - 1].pWrite = NULL;
+}
+
+
+void daliBusSeqStart(void)
+{
+  pXferRx = NULL;
+  dma_channel_set_read_addr(dma_txctl, &saSeqTxBlocks[0], false);
+  dma_channel_set_read_addr(dma_rxctl, &saSeqRxBlocks[0], false);
+  dma_start_channel_mask((1u << dma_txctl) | (1u << dma_rxctl));
+}
+
+
+void daliBusSeqResume(void)
+{
+  //control channels' read pointers already sit past the stop's NULL blocks
+  dma_start_channel_mask((1u << dma_txctl) | (1u << dma_rxctl));
+}
+#endif
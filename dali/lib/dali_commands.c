@@ -17,11 +17,10 @@
 
 #define BROADCAST_UNADDRESSED 0xFC    /**<Forward frame address byte for broadcasting to unaddressed drivers, standard command*/
 #define BROADCAST_ALL         0xFE    /**<Forward frame address byte for broadcasting to all drivers, standard command*/
+#define GROUP_ADDRESS         0x80    /**<Forward frame address byte 100GGGGS for group GGGG, standard command*/
 
 
 #define MAX_SEARCH_ADDRESS    0xffffff/**< Search address is on the range [0:(2^24)-1]*/
-#define MAX_SHORT_ADDRESS     63      /**< Short addresses take the range 0-63*/
-#define MAX_GROUP_ADDRESS     15      /**<Group addresses take the range 0-15*/
 
 uForwardFrame_t uForwardFrame;
 
@@ -34,8 +33,7 @@ void generateAddr(eDaliStandardAddressType_t eAddrType, uint8_t addr, uint8_t *d
             (*dest) = (addr <= MAX_SHORT_ADDRESS) ? (addr<<1) : (MAX_SHORT_ADDRESS<<1);
         break;
         case evGroupAddress:
-            (*dest) = (addr <= MAX_GROUP_ADDRESS) ? (addr<<1) : (MAX_GROUP_ADDRESS<<1); 
-            if(addr <= MAX_GROUP_ADDRESS)
+            (*dest) = GROUP_ADDRESS | ((addr <= MAX_GROUP_ADDRESS) ? (addr<<1) : (MAX_GROUP_ADDRESS<<1));
         break;
         case evBroadcastUnaddressed:
             *dest = BROADCAST_UNADDRESSED;
@@ -12,6 +12,10 @@
 
 
 #include <stdint.h>
+
+#define MAX_SHORT_ADDRESS     63      /**< Short addresses take the range 0-63*/
+#define MAX_GROUP_ADDRESS     15      /**<Group addresses take the range 0-15*/
+
 /*enums*/
 
 /**
@@ -0,0 +1,65 @@
+/**
+ * @file dali_ctx.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Context of a multi-transaction operation: timeout and cancel
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <string.h>
+#ifdef NRF
+#include <zephyr.h>
+#elif defined(DALI_HOST)
+#include "dali_bus.h"
+#else
+#include "pico/stdlib.h"
+#endif
+#include "dali_ctx.h"
+
+
+void daliCtxInit(sDaliCtx_t *psCtx, uint32_t timeoutUs)
+{
+  memset(psCtx,0,sizeof(sDaliCtx_t));
+  psCtx->timeoutUs = timeoutUs;
+}
+
+
+void daliCtxCancel(sDaliCtx_t *psCtx)
+{
+  __atomic_store_n(&psCtx->bCancel, true, __ATOMIC_RELEASE);
+}
+
+
+eDaliCtxStatus_t daliCtxCheck(sDaliCtx_t *psCtx)
+{
+  uint64_t now = daliCtxNowUs();
+  if(true == __atomic_load_n(&psCtx->bCancel, __ATOMIC_ACQUIRE))
+  {
+    return evDaliCtxCancelled;
+  }
+  if(false == psCtx->bStarted)
+  {
+    psCtx->startUs  = now;
+    psCtx->bStarted = true;
+  }
+  if(  (0                      != psCtx->timeoutUs)
+     &&((now - psCtx->startUs) >= psCtx->timeoutUs))
+  {
+    return evDaliCtxTimedOut;
+  }
+  return evDaliCtxRunning;
+}
+
+
+uint64_t daliCtxNowUs(void)
+{
+#ifdef NRF
+  return k_ticks_to_us_floor64(k_uptime_ticks());
+#elif defined(DALI_HOST)
+  return daliHostNowUs();
+#else
+  return time_us_64();
+#endif
+}
@@ -0,0 +1,63 @@
+/**
+ * @file dali_ctx.h
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Context of a multi-transaction operation: the step its state machine is on, a timeout and a
+ * cancel request. Operations keep their progress in a context passed by the caller instead of function
+ * local statics, so an operation that is abandoned can be reset and the next caller starts clean
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*! Enum of what the next step of an operation should do*/
+typedef enum
+{
+  evDaliCtxRunning  ,/*!<Carry on*/
+  evDaliCtxTimedOut ,/*!<Ran longer than timeoutUs, reset it*/
+  evDaliCtxCancelled /*!<daliCtxCancel was called, reset it*/
+}eDaliCtxStatus_t;
+
+/**
+ * @brief Common part of an operation context. Nested operations use state only
+ */
+typedef struct
+{
+  uint8_t  state    ;/*!<Step of the state machine, 0 before the first and once done*/
+  _Bool    bCancel  ;/*!<Set by daliCtxCancel*/
+  _Bool    bStarted ;/*!<startUs is set*/
+  uint32_t timeoutUs;/*!<Give up this long after the first step, 0 for never*/
+  uint64_t startUs  ;/*!<Clock at the first daliCtxCheck*/
+}sDaliCtx_t;
+
+
+/**
+ * @brief Set up a context for a new run of an operation, state 0
+ * @param psCtx context
+ * @param timeoutUs 0 for no timeout
+ */
+void             daliCtxInit  (sDaliCtx_t *psCtx, uint32_t timeoutUs);
+
+/**
+ * @brief Ask the operation to stop, it ends at its next step
+ * @param psCtx context
+ */
+void             daliCtxCancel(sDaliCtx_t *psCtx);
+
+/**
+ * @brief Call before each step of the operation. The first call starts the timeout
+ * @param psCtx context
+ * @return eDaliCtxStatus_t anything but evDaliCtxRunning means the caller resets the operation instead of stepping it
+ */
+eDaliCtxStatus_t daliCtxCheck (sDaliCtx_t *psCtx);
+
+/**
+ * @brief Clock of the timeouts
+ * @return uint64_t microseconds
+ */
+uint64_t         daliCtxNowUs (void);
@@ -86,10 +86,9 @@ _Bool convertD4iRawUnitToFloat(int8_t rawUnit, float *pFloatUnit       );
 
 
 
-_Bool getD4iUnits(sDaliDriverData_t * psDaliDriverData)
+_Bool getD4iUnits(sDaliCtx_t * psCtx, sDaliDriverData_t * psDaliDriverData)
 {
-  static uint8_t getUnitState = 0;
-  switch(getUnitState)
+  switch(psCtx->state)
   {
     case 0:
       if(true == getD4iPowerUnitFloat(psDaliDriverData->sStaticData.addr       ,
@@ -97,14 +96,14 @@ _Bool getD4iUnits(sDaliDriverData_t * psDaliDriverData)
       {
         getD4iEnergyUnitFloat(psDaliDriverData->sStaticData.addr        ,
                               &psDaliDriverData->sStaticData.fEnergyUnit);
-        getUnitState = 1;
+        psCtx->state = 1;
       }
     break;
     case 1:
       if(true == getD4iEnergyUnitFloat(psDaliDriverData->sStaticData.addr        ,
                                        &psDaliDriverData->sStaticData.fEnergyUnit))
       {
-        getUnitState = 0;
+        psCtx->state = 0;
         return true;
       }
     break;
@@ -204,6 +203,7 @@ _Bool getD4iEnergyRaw(uint8_t addr, uint64_t *pNrgRaw)
     *(pNrgRaw) =  uD4iNrg.u64Nrg;
     return true;
   }
+  return false;
 }
 
 
@@ -332,6 +332,7 @@ _Bool getD4iLightSrcVoltage(uint8_t addr, uint16_t *pVolts)
         swap1 = ((*pVolts) & 0xff00)>>8;
         *pVolts = swap1 + (swap0<<8);
     }
+    return done;
 }
 
 _Bool getD4iLightSrcCurrent(uint8_t addr, uint16_t *pAmps)
@@ -347,6 +348,7 @@ _Bool getD4iLightSrcCurrent(uint8_t addr, uint16_t *pAmps)
         swap1 = ((*pAmps) & 0xff00)>>8;
         *pAmps = swap1 + (swap0<<8);
     }
+    return done;
 }
 
 _Bool getD4iGearTemperature(uint8_t addr, uint16_t *pTemp)
@@ -15,6 +15,7 @@
 #include <stdbool.h>
 
 #include "dali_staticData.h"
+#include "dali_ctx.h"
 
 
 #define SIZE_MB_202  16
@@ -28,9 +29,11 @@
 /**
  * @brief Fetches D4I energy units
  * 
+ * @param psCtx progress, state 0 to start
  * @return _Bool 
  */
-_Bool getD4iUnits    (sDaliDriverData_t *);
+_Bool getD4iUnits    (sDaliCtx_t        *,
+                      sDaliDriverData_t *);
 
 /**
  * @brief Fetches raw D4I power data
@@ -1,268 +1,1006 @@
 /**
  * @file dali_driver.c
  * @author Scott Price (sprice@unvlt.com)
- * @brief 
+ * @brief
  * @version 0.1
  * @date 2021-02-09
- * 
+ *
  * @copyright Copyright (c) 2021
- * 
+ *
  */
 
 #include <string.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include "dali_driver.h"
+#include "dali_bus.h"
 #include "dali.h"
 #include "manchester.h"
-#ifdef NRF
-#include <zephyr.h>
-#include <nrfx_spim.h>
-#include <nrfx_timer.h>
-#else
-#include "hardware/spi.h"
-#include "hardware/dma.h"
-#include "hardware/irq.h"
-#include "pico/stdlib.h"
-#include "pico/binary_info.h"
-#endif
+#include "dali_frameCache.h"
+#include "dali_trace.h"
+#include "dali_ctx.h"
 //#include "log.h"
 //#include "dali/daliCLI/daliCLI.h"
 
 //SPI STUFF START
-static volatile bool spiXferDone          = true;  /**< Flag used to indicate that SPI instance completed the transfer. */
-static volatile bool frameReadyToTransmit = false;/**< Flag used to indicate a forward frame has been prepared to transmit*/      
-uint8_t rxLen, txLen;
-uEncodedFwdFrameBuf_t      uEncodedFwdFrame;
-uRawDaliRXBuffer_t         uRawDaliRXBuffer;
+uEncodedFwdFrameBuf_t      uEncodedFwdFrame[DALI_XFER_PINGPONG] __attribute__((aligned(4)));/*!<Send twice frames, idle regions are zeroed once in daliInit and never written*/
+uRawDaliRXBuffer_t         uRawDaliRXBuffer[DALI_XFER_PINGPONG];/*!< Reply windows, one per query queued or on the bus up to DALI_XFER_PINGPONG*/
+static sManchesterStream_t saBackFrameStream[DALI_XFER_PINGPONG];/**< Incremental decode of each reply window, lets a query end early*/
+static sManchesterDecode_t sLastReply = {.eStatus = evNoDataFound};/**< Outcome of the most recent query, read by getDaliBackFrame*/
 
+/**
+ * @brief One queued bus transaction
+ */
+typedef struct
+{
+  const uint8_t            *pTx     ;/*!< Encoded data read by the TX dma*/
+  const sEncodedFwdFrame_t *pCached ;/*!< Cache entry pinned by the frame, NULL if encoded locally*/
+  uint8_t                   txLen   ;/*!< Bytes to transmit*/
+  uint8_t                   rxLen   ;/*!< Bytes to receive, includes the inter-frame settling time*/
+  eDaliXferKind_t           eKind   ;
+  uint8_t                   buf     ;/*!< Ping-pong buffer owned by a send twice or reply entry*/
+  sDaliXferResult_t        *psResult;/*!< Completion slot, may be NULL*/
+  sDaliSeq_t               *psSeq   ;/*!< Sequence run by an evXferSequence entry*/
+  uForwardFrame_t           uFwdFrame;/*!< Frame sent, for the DTR shadow*/
+  uint8_t                   tag     ;/*!< Bus time is charged to this, busTag when queued*/
+}sDaliXfer_t;
+
+static sDaliXfer_t        saXferQueue[DALI_XFER_QUEUE_LEN];
+static sEncodedFwdFrame_t saXferScratch[DALI_XFER_QUEUE_LEN] __attribute__((aligned(4)));/*!< Per slot encode buffer for when the cache set is fully pinned, idle regions stay zero*/
+static volatile uint8_t   xferHead        = 0;    /**< Oldest entry, on the bus while bXferActive*/
+static volatile uint8_t   xferTail        = 0;    /**< Next free entry*/
+static volatile uint8_t   xferCount       = 0;    /**< Entries queued, including the one on the bus*/
+static volatile uint8_t   numReplyPending = 0;    /**< Queries queued or on the bus*/
+static volatile uint8_t   numTwicePending = 0;    /**< Send twice frames queued or on the bus, each owns a uEncodedFwdFrame*/
+static uint8_t            twiceNext       = 0;    /**< uEncodedFwdFrame of the next send twice frame, handed out in queue order*/
+static uint8_t            replyNext       = 0;    /**< uRawDaliRXBuffer of the next query, handed out in queue order*/
+static volatile uint8_t   numSeqPending   = 0;    /**< Sequences queued or on the bus, they share the descriptor lists*/
+static volatile bool      bXferActive     = false;/**< A transfer is running on the spi*/
+
+/*Sequences*/
+#define SEQ_REPLY_LEN     (MAXBYTESTOBACKFRAMESTART + SIZE_BACKWARD_FRAME)/*!< Backward frame window kept per query step*/
+#define SEQ_REPLY_SKIP    (sizeof(sEncodedFwdFrame_t) + 2)                /*!< Received bytes before the window, as in sRXWithReply*/
+#define SEQ_NOREPLY_LEN   (sizeof(sEncodedFwdFrame_t) + INTERFRAMEIDLE)
+#define SEQ_WITHREPLY_LEN (SEQ_REPLY_SKIP + SEQ_REPLY_LEN + BACKFRAMESETTLINGTES)
+static const uint8_t     *paSeqFrame [DALI_SEQ_MAX_STEPS];/*!< Encoded frame of each step*/
+static const sEncodedFwdFrame_t *paSeqCached[DALI_SEQ_MAX_STEPS];/*!< Cache entry pinned by each step, NULL if encoded locally*/
+static sEncodedFwdFrame_t saSeqScratch[DALI_SEQ_MAX_STEPS] __attribute__((aligned(4)));
+static uint8_t            aSeqReply  [DALI_SEQ_MAX_STEPS][SEQ_REPLY_LEN];
+static uint8_t            seqNext = 0;/*!< First step not yet checked*/
+static const uint8_t      seqIdleTx = 0x00;/*!< Sent over and over for idle TEs*/
+static void             (*pfnXferIdleHook)(void) = NULL;/*!< Told when the queue drains*/
+static volatile _Bool     bSeqGiveWay = false;/*!< A sequence stops at its next safe point*/
+static volatile _Bool     bSeqHeld    = false;/*!< Last sequence ended on a held step*/
+static sDaliDtrShadow_t   sDtrShadow;         /*!< DTRs as the frames that left the bus set them*/
+static sDaliDtrShadow_t  *psDtrSnap   = NULL; /*!< Copy of sDtrShadow taken once saXferQueue[dtrSnapSlot] retires*/
+static uint8_t            dtrSnapSlot = 0;
+
+/*Bus accounting*/
+static sDaliBusStats_t    sBusStats;
+static uint8_t            busTag    = 0;/*!< Tag of the frames queued from now on*/
+static uint8_t            xferCutTE = 0;/*!< TEs clocked by a query cut short once its reply was decoded, 0 if it ran out*/
+static uint32_t           aUtilUs[DALI_BUS_UTIL_SECONDS + 1];/*!< Bus time per second, ring indexed by second*/
+static uint64_t           utilSec   = 0;/*!< Second aUtilUs was last moved on to*/
+
+#if !DALI_BUS_CHAINED
+static uint8_t seqStep    = 0;/*!< Step on the bus, the backend has no chaining so steps are started from the irq*/
+static uint8_t seqStepSub = 0;/*!< Frame of a send twice step*/
+#endif
 
 
-//int dma_chan;
-uint dma_tx;
-uint dma_rx; 
+/**
+ * @brief Feeds the reply window received so far to the incremental decoder, and ends the transfer
+ * as soon as the outcome (valid, no reply, collision) is certain and the bus has settled
+ * @return uint32_t TEs until a poll could end the first query queued, 0 if there is none or its
+ * window cannot be cut short
+ */
+static uint32_t daliPollBackFrame(void);
 
+/**
+ * @brief Start the spi transfer of a queued transaction. Called with interrupts masked or from the
+ * transfer complete interrupt
+ * @param psXfer Transaction to start
+ */
+static void daliStartXfer(const sDaliXfer_t *psXfer);
+
+/**
+ * @brief Retire the transaction on the bus: decode its reply, fill its completion slot, unpin its
+ * frame and start the next queued transaction straight away
+ */
+static void daliXferComplete(void);
 
-//void initializeDALI(void);
+/**
+ * @brief Encode and pin every step of a sequence, and build its control blocks
+ * @param psSeq Sequence to build
+ */
+static void daliSeqBuild(const sDaliSeq_t *psSeq);
 
-#ifdef NRF
-#define SPIM_NODE DT_NODELABEL(DALISPIINSTANCE)
-static const nrfx_spim_t spi = NRFX_SPIM_INSTANCE(DALI_SPI_INSTANCE);
-nrfx_spim_xfer_desc_t spim_xfer_desc =
+/**
+ * @brief Decode and check the steps the sequence has run since the last check
+ * @param psSeq Sequence on the bus
+ * @return _Bool true if the dma stopped at a checkpoint that passed and the sequence carries on
+ */
+static _Bool daliSeqCheck(sDaliSeq_t *psSeq);
+
+/**
+ * @brief Step a sequence on to its next checkpoint or its end
+ * @param psSeq Sequence on the bus
+ */
+static void daliSeqResume(const sDaliSeq_t *psSeq);
+
+/**
+ * @brief A query step ends a dma run, so its reply can be checked before the sequence goes on
+ * @param psStep Step to test
+ * @return _Bool true if the step is a checkpoint
+ */
+static inline _Bool daliSeqIsCheckpoint(const sDaliSeqStep_t *psStep)
 {
-  .p_tx_buffer = &uEncodedFwdFrame.sEncodedFwdFrame.encodedData[0] ,
-  .tx_length   = sizeof(sEncodedFwdFrame_t),
-  .p_rx_buffer = (uint8_t *)&uRawDaliRXBuffer,
-  .rx_length   = sizeof(uRawDaliRXBuffer.sRXNoReply)
-};
-#else
-//TODO: FIX!!!!
-#endif
+  return (  (evXferWithReply == psStep->eKind  )
+          &&(evReplyAny      != psStep->eExpect));
+}
 
 /**
- * @brief Called upon spi event interrupt, sets spiXferDone flag to indicate transaction complete
- * @param p_event 
- * @param p_context 
+ * @brief A dma run ends after a checkpoint, and after every DALI_SEQ_SAFE_STEPS steps unless the
+ * step holds the bus to the next one
+ * @param psStep Step to test
+ * @param stepNum its position in the sequence
+ * @return _Bool true if the cpu sees the sequence after this step
  */
-#ifdef NRF
-void spi_event_handler(nrfx_spim_evt_t const * p_event,
-                       void *                p_context)
+static inline _Bool daliSeqEndsRun(const sDaliSeqStep_t *psStep, uint8_t stepNum)
 {
-    spiXferDone = true;
+  return (  (true  == daliSeqIsCheckpoint(psStep))
+          ||(  (false == psStep->bHold)
+             &&(0     != DALI_SEQ_SAFE_STEPS)
+             &&(0     == ((stepNum + 1) % (DALI_SEQ_SAFE_STEPS ? DALI_SEQ_SAFE_STEPS : 1)))));
 }
-#else
-void spi_event_handler(void)
+
+/**
+ * @brief Follow the DTRs and SEARCHADDR through a frame that has left the bus
+ * @param psFrame Frame sent
+ * @param psDecode Its backward frame, evNoDataFound for frames with no reply
+ */
+static void daliDtrTrack(const uForwardFrame_t *psFrame, const sManchesterDecode_t *psDecode);
+
+/**
+ * @brief Count a transaction that has left the bus and charge its bus time
+ * @param psFrame frame sent
+ * @param eKind evXferNoReply, evXferTwice or evXferWithReply
+ * @param psDecode outcome of a query
+ * @param tag owner of the bus time
+ * @param te TEs the bus was busy for
+ */
+static void daliBusAcct(const uForwardFrame_t *psFrame, eDaliXferKind_t eKind, const sManchesterDecode_t *psDecode, uint8_t tag, uint32_t te);
+
+/**
+ * @brief Move the utilisation ring on to the current second, clearing the seconds skipped
+ * @param nowSec current second
+ */
+static void daliBusUtilAdvance(uint64_t nowSec);
+
+
+void daliBusOnDone(void)
 {
-  dma_hw->ints0 = 1u << dma_rx;
-  printf("SPI DONE\n");
-  spiXferDone = true;
+  daliXferComplete();
 }
-#endif
 //SPI STUFF END
 
+void daliSetXferIdleHook(void (*pfnHook)(void))
+{
+  pfnXferIdleHook = pfnHook;
+}
+
+
 void daliInit(void)
 {
-    memset(&uEncodedFwdFrame,0x00,sizeof(uEncodedFwdFrame));
-#ifdef NRF    
-    nrfx_spim_config_t spi_config = NRFX_SPIM_DEFAULT_CONFIG(SPI_SCK_PIN ,
-                                                             SPI_MOSI_PIN,
-                                                             SPI_MISO_PIN,
-                                                             SPI_SS_PIN  );
-    spi_config.frequency = (0x00500000UL);
-    nrfx_spim_init(&spi,&spi_config, spi_event_handler, NULL);
-    IRQ_CONNECT(DT_IRQN(SPIM_NODE          ),
-                DT_IRQ (SPIM_NODE, priority),
-                nrfx_isr, 
-                nrfx_spim_0_irq_handler,
-                0);
-    irq_enable(DT_IRQN(SPIM_NODE));
-    nrfx_spim_xfer(&spi,&spim_xfer_desc,0);
-    
-    NRF_P0->PIN_CNF[29] &= ~(3<<2);
-//    k_timer_init (&daliTimer, dali_periodic_fnc, NULL       );//init zephyr timer for DALI scheduling 
-//    k_timer_start(&daliTimer, K_MSEC(100)      , K_MSEC(100));//start zephyr timer for DAIL scheduling
-#else
-    spi_init(spi_default, 19200);
-    spi_set_format(spi_default, 8, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
-    gpio_set_function(PICO_DEFAULT_SPI_RX_PIN, GPIO_FUNC_SPI);
-    gpio_set_function(PICO_DEFAULT_SPI_TX_PIN, GPIO_FUNC_SPI);
-    gpio_init(PICO_DEFAULT_SPI_CSN_PIN);
-    gpio_set_function(PICO_DEFAULT_SPI_SCK_PIN, GPIO_FUNC_SPI);
-    
-    dma_tx = dma_claim_unused_channel(true);
-    dma_rx = dma_claim_unused_channel(true);
-
-   // We set the outbound DMA to transfer from a memory buffer to the SPI transmit FIFO paced by the SPI TX FIFO DREQ
-    // The default is for the read address to increment every element (in this case 1 byte = DMA_SIZE_8)
-    // and for the write address to remain unchanged.
-
-    printf("Configure TX DMA\n");
-    dma_channel_config c = dma_channel_get_default_config(dma_tx);
-    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
-    channel_config_set_dreq(&c, spi_get_dreq(spi_default, true));
-    dma_channel_configure(dma_tx, &c,
-                          &spi_get_hw(spi_default)->dr                     , // write address
-                          &uEncodedFwdFrame.sEncodedFwdFrame.encodedData[0], // read address
-                          sizeof(sEncodedFwdFrame_t)                       , // element count (each element is of size transfer_data_size)
-                          false                                            ); // don't start yet
-
-    printf("Configure RX DMA\n");
-
-    // We set the inbound DMA to transfer from the SPI receive FIFO to a memory buffer paced by the SPI RX FIFO DREQ
-    // We configure the read address to remain unchanged for each element, but the write
-    // address to increment (so data is written throughout the buffer)
-    c = dma_channel_get_default_config(dma_rx);
-    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
-    channel_config_set_dreq(&c, spi_get_dreq(spi_default, false));
-    channel_config_set_read_increment(&c, false);
-    channel_config_set_write_increment(&c, true);
-    dma_channel_configure(dma_rx, &c,
-                           (uint8_t *)&uRawDaliRXBuffer      , // write address
-                          &spi_get_hw(spi_default)->dr       , // read address
-                          sizeof(uRawDaliRXBuffer.sRXNoReply), // element count (each element is of size transfer_data_size)
-                          false                              ); // don't start yet
-  // Tell the DMA to raise IRQ line 0 when the channel finishes a block
-    dma_channel_set_irq0_enabled(dma_rx, true);
-
-    // Configure the processor to run dma_handler() when DMA IRQ 0 is asserted
-    irq_set_exclusive_handler(DMA_IRQ_0, spi_event_handler);
-    irq_set_enabled(DMA_IRQ_0, true);
+    memset(&uEncodedFwdFrame[0],0x00,sizeof(uEncodedFwdFrame));
+    daliBusInit();
+}
+
+
+
+/**
+ * @brief Point a queued transaction at the encoded copy of a single forward frame, from the frame cache where possible
+ * @param psXfer Queue entry being filled
+ * @param ufwdFrame Data to transmit
+ */
+static void daliStageFrame(sDaliXfer_t *psXfer, uForwardFrame_t *ufwdFrame)
+{
+  psXfer->pCached = daliFrameCacheAcquire(ufwdFrame);
+  if(NULL != psXfer->pCached)
+  {
+    psXfer->pTx = &psXfer->pCached->encodedData[0];
+  }
+  else
+  {//every entry of the set is pinned, encode into the slot's own buffer
+    sEncodedFwdFrame_t *psScratch = &saXferScratch[psXfer - &saXferQueue[0]];
+    manchesterEncodeFrame16(&ufwdFrame->ui8ForwardFrame[0],&psScratch->encodedData[0]);
+    psXfer->pTx = &psScratch->encodedData[0];
+  }
+  psXfer->txLen = sizeof(sEncodedFwdFrame_t);
+}
+
+
+_Bool daliQueueXfer(uForwardFrame_t   *ufwdFrame,
+                    eDaliXferKind_t    eKind    ,
+                    sDaliXferResult_t *psResult )
+{
+  sDaliXfer_t *psXfer;
+  DALI_CRITICAL_ENTER();
+  if(  (xferCount >= DALI_XFER_QUEUE_LEN                  )
+     ||((evXferTwice == eKind) && (DALI_XFER_PINGPONG <= numTwicePending)))
+  {//no room, or every send twice buffer is still owned by a queued transaction
+    DALI_CRITICAL_EXIT();
+    return false;
+  }
+  psXfer           = &saXferQueue[xferTail];
+  psXfer->eKind    = eKind;
+  psXfer->psResult  = psResult;
+  psXfer->psSeq     = NULL;
+  psXfer->uFwdFrame = *ufwdFrame;
+  psXfer->tag       = busTag;
+  if(NULL != psResult)
+  {
+    psResult->bDone = false;
+  }
+  switch(eKind)
+  {
+    case evXferTwice:
+      //buffers are handed out in queue order, so this one was released by the oldest send twice entry
+      psXfer->buf = twiceNext;
+      twiceNext   = (twiceNext + 1) % DALI_XFER_PINGPONG;
+      manchesterEncodeFrame16(&ufwdFrame->ui8ForwardFrame[0],&uEncodedFwdFrame[psXfer->buf].s2xFwdFrame.sEncodedFwdFrame1.encodedData[0]);
+      manchesterEncodeFrame16(&ufwdFrame->ui8ForwardFrame[0],&uEncodedFwdFrame[psXfer->buf].s2xFwdFrame.sEncodedFwdFrame2.encodedData[0]);//repeat
+      psXfer->pCached = NULL;//send twice needs both frames contiguous, not cached
+      psXfer->pTx     = &uEncodedFwdFrame[psXfer->buf].s2xFwdFrame.sEncodedFwdFrame1.encodedData[0];
+      psXfer->txLen   = sizeof(uEncodedFwdFrame[0].s2xFwdFrame);
+      psXfer->rxLen   = sizeof(uRawDaliRXBuffer[0].sRXSendTwice);
+      numTwicePending++;
+    break;
+    case evXferWithReply:
+      //a query only starts once the one DALI_XFER_PINGPONG ahead of it has been decoded
+      psXfer->buf = replyNext;
+      replyNext   = (replyNext + 1) % DALI_XFER_PINGPONG;
+      daliStageFrame(psXfer, ufwdFrame);
+      psXfer->rxLen = sizeof(uRawDaliRXBuffer[0].sRXWithReply) + BACKFRAMESETTLINGTES;
+      numReplyPending++;
+    break;
+    case evXferNoReply:
+    case evXferSequence://use daliQueueSeq
+    default:
+      psXfer->eKind = evXferNoReply;
+      daliStageFrame(psXfer, ufwdFrame);
+      psXfer->rxLen = sizeof(sEncodedFwdFrame_t) + INTERFRAMEIDLE;
+    break;
+  }
+  xferTail = (xferTail + 1) % DALI_XFER_QUEUE_LEN;
+  xferCount++;
+  if(false == bXferActive)
+  {
+    daliStartXfer(psXfer);
+  }
+  DALI_CRITICAL_EXIT();
+  return true;
+}
+
+
+_Bool daliQueueSeq(sDaliSeq_t *psSeq)
+{
+  sDaliXfer_t *psXfer;
+  uint8_t      i;
+  if(  (0                  == psSeq->numSteps)
+     ||(DALI_SEQ_MAX_STEPS <  psSeq->numSteps)
+     ||(0                  != numSeqPending  ))
+  {//only the irq decrements numSeqPending, so the descriptor lists are ours once it reads 0
+    return false;
+  }
+  daliSeqBuild(psSeq);
+  DALI_CRITICAL_ENTER();
+  if(xferCount >= DALI_XFER_QUEUE_LEN)
+  {
+    for(i = 0; i < psSeq->numSteps; i++)
+    {
+      daliFrameCacheRelease(paSeqCached[i]);
+    }
+    DALI_CRITICAL_EXIT();
+    return false;
+  }
+  psSeq->bDone      = false;
+  psSeq->failedStep = psSeq->numSteps;
+  psSeq->numRun     = psSeq->numSteps;
+  for(i = 0; i < psSeq->numSteps; i++)
+  {
+    psSeq->psResults[i].bDone = false;
+  }
+  psXfer           = &saXferQueue[xferTail];
+  psXfer->eKind    = evXferSequence;
+  psXfer->psSeq    = psSeq;
+  psXfer->psResult = NULL;
+  psXfer->pCached  = NULL;//steps are pinned in paSeqCached
+  psXfer->tag      = busTag;
+  numSeqPending++;
+  xferTail = (xferTail + 1) % DALI_XFER_QUEUE_LEN;
+  xferCount++;
+  if(false == bXferActive)
+  {
+    daliStartXfer(psXfer);
+  }
+  DALI_CRITICAL_EXIT();
+  return true;
+}
+
+
+static void daliSeqBuild(const sDaliSeq_t *psSeq)
+{
+  const sDaliSeqStep_t *psStep;
+  uint8_t               i;
+#if DALI_BUS_CHAINED
+  daliBusSeqClear();
+#endif
+  for(i = 0; i < psSeq->numSteps; i++)
+  {
+    psStep = &psSeq->psSteps[i];
+    {
+      DALI_CRITICAL_ENTER();//pins are also released from the irq
+      paSeqCached[i] = daliFrameCacheAcquire(&psStep->uFwdFrame);
+      DALI_CRITICAL_EXIT();
+    }
+    if(NULL != paSeqCached[i])
+    {
+      paSeqFrame[i] = &paSeqCached[i]->encodedData[0];
+    }
+    else
+    {
+      manchesterEncodeFrame16(&psStep->uFwdFrame.ui8ForwardFrame[0], &saSeqScratch[i].encodedData[0]);
+      paSeqFrame[i] = &saSeqScratch[i].encodedData[0];
+    }
+#if DALI_BUS_CHAINED
+    switch(psStep->eKind)
+    {
+      case evXferTwice://same frame twice, no contiguous copy needed
+        daliBusSeqTx(paSeqFrame[i], sizeof(sEncodedFwdFrame_t), true );
+        daliBusSeqTx(&seqIdleTx   , INTERFRAMEIDLE            , false);
+        daliBusSeqTx(paSeqFrame[i], sizeof(sEncodedFwdFrame_t), true );
+        daliBusSeqTx(&seqIdleTx   , INTERFRAMEIDLE            , false);
+        daliBusSeqRx(NULL, sizeof(uEncodedFwdFrame[0].s2xFwdFrame));
+      break;
+      case evXferWithReply:
+        daliBusSeqTx(paSeqFrame[i], sizeof(sEncodedFwdFrame_t)                    , true );
+        daliBusSeqTx(&seqIdleTx   , SEQ_WITHREPLY_LEN - sizeof(sEncodedFwdFrame_t), false);
+        daliBusSeqRx(NULL         , SEQ_REPLY_SKIP      );
+        daliBusSeqRx(aSeqReply[i] , SEQ_REPLY_LEN       );
+        daliBusSeqRx(NULL         , BACKFRAMESETTLINGTES);
+      break;
+      default:
+        daliBusSeqTx(paSeqFrame[i], sizeof(sEncodedFwdFrame_t), true );
+        daliBusSeqTx(&seqIdleTx   , INTERFRAMEIDLE            , false);
+        daliBusSeqRx(NULL, SEQ_NOREPLY_LEN);
+      break;
+    }
+    if(  (true == daliSeqEndsRun(psStep, i))
+       ||(i    == (psSeq->numSteps - 1)  ))
+    {
+      daliBusSeqStop();
+    }
 #endif
+  }
+}
+
 
+#if !DALI_BUS_CHAINED
+/**
+ * @brief Start the frame of the current sequence step
+ * @param psSeq Sequence on the bus
+ */
+static void daliSeqStepStart(const sDaliSeq_t *psSeq)
+{
+  sDaliBusXfer_t sBusXfer;
+  sBusXfer.pTx   = paSeqFrame[seqStep];
+  sBusXfer.pRx   = NULL;
+  sBusXfer.txLen = sizeof(sEncodedFwdFrame_t);
+  sBusXfer.rxLen = (evXferWithReply == psSeq->psSteps[seqStep].eKind) ? SEQ_WITHREPLY_LEN : SEQ_NOREPLY_LEN;
+  daliBusStart(&sBusXfer);
 }
 
+/**
+ * @brief A sequence frame is done, start the next one up to the next checkpoint
+ * @param psSeq Sequence on the bus
+ * @return _Bool true if another frame was started
+ */
+static _Bool daliSeqStepDone(const sDaliSeq_t *psSeq)
+{
+  const sDaliSeqStep_t *psStep = &psSeq->psSteps[seqStep];
+  if(evXferWithReply == psStep->eKind)
+  {
+    memcpy(aSeqReply[seqStep], daliBusGetRx() + SEQ_REPLY_SKIP, SEQ_REPLY_LEN);
+  }
+  else if(  (evXferTwice == psStep->eKind)
+          &&(0           == seqStepSub   ))
+  {
+    seqStepSub = 1;
+    daliSeqStepStart(psSeq);
+    return true;
+  }
+  seqStepSub = 0;
+  seqStep++;
+  if(  (seqStep <  psSeq->numSteps                         )
+     &&(false   == daliSeqEndsRun(psStep, seqStep - 1)))
+  {
+    daliSeqStepStart(psSeq);
+    return true;
+  }
+  return false;
+}
+#endif
 
 
-void transmitDaliCmdNoReply(uForwardFrame_t *ufwdFrame)
+static _Bool daliSeqCheck(sDaliSeq_t *psSeq)
 {
-  memset(&uRawDaliRXBuffer                                    ,
-         0x00                                                 ,
-         sizeof(uRawDaliRXBuffer)                             );
-  memset(&uEncodedFwdFrame.sEncodedFwdFrame.encodedData[0]    ,
-         0x00                                                 ,
-         sizeof(uEncodedFwdFrame.sEncodedFwdFrame.encodedData));
+  const sDaliSeqStep_t *psStep;
+  sDaliXferResult_t    *psResult;
+  _Bool                 bFailed;
+  while(seqNext < psSeq->numSteps)
+  {
+    psStep   = &psSeq->psSteps  [seqNext];
+    psResult = &psSeq->psResults[seqNext];
+    if(evXferWithReply == psStep->eKind)
+    {
+      manchesterDecodeBackFrameEx(aSeqReply[seqNext], SEQ_REPLY_LEN, &psResult->sDecode);
+      sLastReply = psResult->sDecode;
+    }
+    else
+    {
+      psResult->sDecode.eStatus = evNoDataFound;
+    }
+    daliDtrTrack(&psStep->uFwdFrame, &psResult->sDecode);
+    daliBusAcct(&psStep->uFwdFrame, psStep->eKind, &psResult->sDecode, saXferQueue[xferHead].tag,
+                (evXferWithReply == psStep->eKind) ? SEQ_WITHREPLY_LEN
+                                                   : ((evXferTwice == psStep->eKind) ? 2 * SEQ_NOREPLY_LEN : SEQ_NOREPLY_LEN));
+    bFailed = (  (true == daliSeqIsCheckpoint(psStep))
+               &&(((evReplyRequired == psStep->eExpect) && (evValidDataFound != psResult->sDecode.eStatus))
+                ||((evReplyNone     == psStep->eExpect) && (evNoDataFound    != psResult->sDecode.eStatus))));
+    psResult->bDone = true;
+    daliFrameCacheRelease(paSeqCached[seqNext]);
+    seqNext++;
+    if(  (true == bFailed)
+       ||(  (true    == bSeqGiveWay                      )
+          &&(false   == psStep->bHold                    )
+          &&(seqNext <  psSeq->numSteps                  )
+          &&(true    == daliSeqEndsRun(psStep, seqNext - 1))))
+    {//the rest is never sent
+      if(true == bFailed)
+      {
+        psSeq->failedStep = seqNext - 1;
+      }
+      else
+      {
+        DALI_TRACE(DALI_TRACE_LVL_INFO, evTraceSeqGaveWay, seqNext, psSeq->numSteps);
+      }
+      psSeq->numRun = seqNext;
+      while(seqNext < psSeq->numSteps)
+      {
+        daliFrameCacheRelease(paSeqCached[seqNext++]);
+      }
+      bSeqHeld = false;
+      return false;
+    }
+    if(  (true    == daliSeqEndsRun(psStep, seqNext - 1))
+       &&(seqNext <  psSeq->numSteps                    ))
+    {
+      return true;
+    }
+  }
+  bSeqHeld = psSeq->psSteps[psSeq->numSteps - 1].bHold;
+  return false;
+}
 
-  manchesterEncodeMsg((uint8_t *)ufwdFrame                             ,
-                      2                                                ,
-                      &uEncodedFwdFrame.sEncodedFwdFrame.encodedData[0]);
-  rxLen = sizeof(sEncodedFwdFrame_t) + INTERFRAMEIDLE;
-  txLen = sizeof(sEncodedFwdFrame_t);
-  frameReadyToTransmit = true;
-  spiXferDone          = false;
+
+static void daliDtrTrack(const uForwardFrame_t *psFrame, const sManchesterDecode_t *psDecode)
+{
+  uint8_t address = psFrame->sStandardCmd.address;
+  uint8_t opcode  = psFrame->sStandardCmd.opcode;
+  uint8_t dtr     = 0;
+  if(  (0x01 != (address & 0x01))
+     ||((0xCB <  address) && (0xFC > address)))
+  {//DAPC, or reserved
+    return;
+  }
+  if((0xA1 <= address) && (0xCB >= address))
+  {//special command, opcode is in the address byte and data in the opcode byte
+    switch(address)
+    {
+      case evSetDTR2:
+        dtr++;
+      //fall through
+      case evSetDTR1:
+        dtr++;
+      //fall through
+      case evSetDTR0:
+        sDtrShadow.aDtr[dtr]  = opcode;
+        sDtrShadow.validMask |= (uint8_t)(1u << dtr);
+      break;
+      case evSearchAddrL:
+        dtr++;
+      //fall through
+      case evSearchAddrM:
+        dtr++;
+      //fall through
+      case evSearchAddrH:
+        sDtrShadow.aSearch[dtr] = opcode;
+        sDtrShadow.searchMask  |= (uint8_t)(1u << dtr);
+      break;
+      case evInitialise:
+      case evRandomise:
+      case evTerminate:
+        sDtrShadow.searchMask = 0;
+      break;
+      case evWriteMemoryBank:
+      case evWriteMemBnkNoReply:
+        if(  (evWriteMemoryBank == address         )
+           &&(evNoDataFound     == psDecode->eStatus))
+        {//nothing was write enabled, DTR0 is as it was
+          break;
+        }
+        if(sDtrShadow.aDtr[0] < 0xFF)
+        {//post-incremented by the write enabled gear
+          sDtrShadow.aDtr[0]++;
+        }
+      break;
+      default:
+      break;
+    }
+    return;
+  }
+  switch(opcode)
+  {
+    case evReadMemoryBank:
+      if(evNoDataFound == psDecode->eStatus)
+      {//gear may not have the location, cannot tell whether it moved on
+        sDtrShadow.validMask &= (uint8_t)~0x01u;
+      }
+      else if(sDtrShadow.aDtr[0] < 0xFF)
+      {
+        sDtrShadow.aDtr[0]++;
+      }
+    break;
+    case evStoreActualLevelInDTR0:
+      sDtrShadow.validMask &= (uint8_t)~0x01u;
+    break;
+    case evQueryLightSourceType://a MASK answer lists the types in DTR0-2
+      sDtrShadow.validMask = 0;
+    break;
+    default:
+      if(opcode >= 0xE0)
+      {//application extended commands may answer through the DTRs
+        sDtrShadow.validMask = 0;
+      }
+    break;
+  }
 }
 
-void transmitDaliCmdWithReply(uForwardFrame_t *ufwdFrame)
+
+static void daliBusUtilAdvance(uint64_t nowSec)
 {
-  memset(&uRawDaliRXBuffer                    ,
-         0x00                                 ,
-         sizeof(uRawDaliRXBuffer.sRXWithReply));
-  memset(&uEncodedFwdFrame.sEncodedFwdFrame.encodedData[0]    ,
-         0x00                                                 ,
-         sizeof(uEncodedFwdFrame.sEncodedFwdFrame.encodedData));
-  manchesterEncodeMsg((uint8_t *)ufwdFrame                             ,
-                      2                                                ,
-                      &uEncodedFwdFrame.sEncodedFwdFrame.encodedData[0]);
-  rxLen = sizeof(uRawDaliRXBuffer.sRXWithReply);
-  txLen = sizeof(sEncodedFwdFrame_t);
-  frameReadyToTransmit = true;
-  spiXferDone          = false;
+  if((nowSec - utilSec) > DALI_BUS_UTIL_SECONDS)
+  {//whole ring is out of date
+    memset(aUtilUs, 0, sizeof(aUtilUs));
+    utilSec = nowSec;
+  }
+  while(utilSec < nowSec)
+  {
+    utilSec++;
+    aUtilUs[utilSec % (DALI_BUS_UTIL_SECONDS + 1)] = 0;
+  }
 }
 
 
+static void daliBusAcct(const uForwardFrame_t *psFrame, eDaliXferKind_t eKind, const sManchesterDecode_t *psDecode, uint8_t tag, uint32_t te)
+{
+  uint8_t  address = psFrame->sStandardCmd.address;
+  uint32_t us      = (uint32_t)DALI_BUS_TE_TO_US(te);
+  uint8_t  addrIdx;
+  if(eKind > evXferWithReply)
+  {
+    return;
+  }
+  sBusStats.frames[eKind]++;
+  if(evXferWithReply == eKind)
+  {
+    switch(psDecode->eStatus)
+    {
+      case evValidDataFound:
+        sBusStats.replies++;
+      break;
+      case evNoDataFound:
+        sBusStats.noReplies++;
+      break;
+      default:
+        sBusStats.corrupt++;
+      break;
+    }
+  }
+  if(0 == (address & 0x80))
+  {//short address
+    addrIdx = address >> 1;
+  }
+  else if(0x80 == (address & 0xE0))
+  {
+    addrIdx = DALI_BUS_ADDR_GROUP;
+  }
+  else
+  {//broadcast, unaddressed and special commands
+    addrIdx = DALI_BUS_ADDR_ALL;
+  }
+  if(tag >= DALI_BUS_NUM_TAGS)
+  {
+    tag = DALI_BUS_NUM_TAGS - 1;
+  }
+  sBusStats.busUs          += us;
+  sBusStats.addrUs[addrIdx] += us;
+  sBusStats.tagUs [tag]     += us;
+  daliBusUtilAdvance(daliCtxNowUs() / 1000000u);
+  aUtilUs[utilSec % (DALI_BUS_UTIL_SECONDS + 1)] += us;
+}
+
+
+static void daliSeqResume(const sDaliSeq_t *psSeq)
+{
+#if DALI_BUS_CHAINED
+  (void)psSeq;
+  daliBusSeqResume();
+#else
+  daliSeqStepStart(psSeq);
+#endif
+}
+
+
+void transmitDaliCmdNoReply(uForwardFrame_t *ufwdFrame)
+{
+  daliQueueXfer(ufwdFrame, evXferNoReply, NULL);
+}
+
+void transmitDaliCmdWithReply(uForwardFrame_t *ufwdFrame)
+{
+  daliQueueXfer(ufwdFrame, evXferWithReply, NULL);
+}
+
 void transmitDaliCmdTwice(uForwardFrame_t *fwdFrame)
 {
-  memset(&uRawDaliRXBuffer                    ,
-         0x00                                 ,
-         sizeof(uRawDaliRXBuffer.sRXSendTwice));
-  memset(&uEncodedFwdFrame.sEncodedFwdFrame.encodedData[0]    ,
-         0x00                                                 ,
-         sizeof(uEncodedFwdFrame.sEncodedFwdFrame.encodedData));
-  manchesterEncodeMsg((uint8_t *)fwdFrame,2,&uEncodedFwdFrame.s2xFwdFrame.sEncodedFwdFrame1.encodedData[0]);
-  manchesterEncodeMsg((uint8_t *)fwdFrame,2,&uEncodedFwdFrame.s2xFwdFrame.sEncodedFwdFrame2.encodedData[0]);//repeat
-  rxLen = sizeof(uRawDaliRXBuffer.sRXSendTwice);
-  txLen = sizeof(uEncodedFwdFrame.s2xFwdFrame);
-  frameReadyToTransmit = true;
-  spiXferDone          = false;                                   
+  daliQueueXfer(fwdFrame, evXferTwice, NULL);
 }
 
 _Bool getDaliTransferStatus(void)
 {
-    return spiXferDone;
+    if(0 != numReplyPending)
+    {
+      (void)daliPollBackFrame();
+    }
+    return (  (xferCount       <  DALI_XFER_QUEUE_LEN)
+            &&(0               == numReplyPending    )
+            &&(DALI_XFER_PINGPONG > numTwicePending  )
+            &&(0               == numSeqPending      ));
+}
+
+
+static void daliStartXfer(const sDaliXfer_t *psXfer)
+{
+  sDaliBusXfer_t sBusXfer;
+  bXferActive = true;
+  DALI_TRACE(DALI_TRACE_LVL_DEBUG, evTraceXferStart, psXfer->eKind, psXfer->rxLen);
+  if(evXferSequence == psXfer->eKind)
+  {
+    seqNext = 0;
+#if DALI_BUS_CHAINED
+    daliBusSeqStart();
+#else
+    seqStep    = 0;
+    seqStepSub = 0;
+    daliSeqStepStart(psXfer->psSeq);
+#endif
+    return;
+  }
+  sBusXfer.pTx   = psXfer->pTx;
+  sBusXfer.pRx   = NULL;
+  sBusXfer.txLen = psXfer->txLen;
+  sBusXfer.rxLen = psXfer->rxLen;
+  if(evXferWithReply == psXfer->eKind)
+  {
+    sBusXfer.pRx = (uint8_t *)&uRawDaliRXBuffer[psXfer->buf];
+    manchesterStreamInit(&saBackFrameStream[psXfer->buf]                                  ,
+                         &uRawDaliRXBuffer[psXfer->buf].sRXWithReply.backFrameRegion[0]    ,
+                         MAXBYTESTOBACKFRAMESTART                                          ,
+                         sizeof(uRawDaliRXBuffer[0].sRXWithReply.backFrameRegion)          );
+  }
+  daliBusStart(&sBusXfer);
+}
+
+
+static void daliXferComplete(void)
+{
+  sDaliXfer_t *psXfer;
+  if(0 == xferCount)
+  {//nothing was queued
+    bXferActive = false;
+    return;
+  }
+  psXfer = &saXferQueue[xferHead];
+  if(evXferSequence == psXfer->eKind)
+  {
+#if !DALI_BUS_CHAINED
+    if(true == daliSeqStepDone(psXfer->psSeq))
+    {
+      return;
+    }
+#endif
+    if(true == daliSeqCheck(psXfer->psSeq))
+    {//checkpoint passed, run on to the next one
+      daliSeqResume(psXfer->psSeq);
+      return;
+    }
+    psXfer->psSeq->bDone = true;
+    numSeqPending--;
+  }
+  //Hand the bus over first, the next entry never uses this one's ping-pong buffer so it can be
+  //decoded while the next frame is on the wire. The slot is not reused before this returns, only
+  //daliQueueXfer/daliQueueSeq fill slots and they run with the irq masked
+  xferHead = (xferHead + 1) % DALI_XFER_QUEUE_LEN;
+  xferCount--;
+  if(0 != xferCount)
+  {//next frame goes out now, its settling time was part of the previous rx length
+    daliStartXfer(&saXferQueue[xferHead]);
+  }
+  else
+  {
+    bXferActive = false;
+  }
+  switch(psXfer->eKind)
+  {
+    case evXferWithReply:
+      //whole window is in, the stream reaches a final outcome unless the reply runs off the end
+      manchesterStreamFeed(&saBackFrameStream[psXfer->buf], sizeof(uRawDaliRXBuffer[0].sRXWithReply.backFrameRegion));
+      sLastReply = saBackFrameStream[psXfer->buf].sDecode;
+      numReplyPending--;
+    break;
+    case evXferTwice:
+      numTwicePending--;
+    break;
+    default:
+    break;
+  }
+  if(evXferSequence != psXfer->eKind)
+  {//sequence steps were followed in daliSeqCheck
+    sManchesterDecode_t sNoReply = {.eStatus = evNoDataFound};
+    daliDtrTrack(&psXfer->uFwdFrame, (evXferWithReply == psXfer->eKind) ? &sLastReply : &sNoReply);
+    daliBusAcct(&psXfer->uFwdFrame, psXfer->eKind, &sLastReply, psXfer->tag,
+                (0 != xferCutTE) ? xferCutTE : ((psXfer->txLen > psXfer->rxLen) ? psXfer->txLen : psXfer->rxLen));
+    xferCutTE = 0;
+  }
+  if(  (NULL        != psDtrSnap                         )
+     &&(dtrSnapSlot == (uint8_t)(psXfer - &saXferQueue[0])))
+  {
+    *psDtrSnap = sDtrShadow;
+    psDtrSnap  = NULL;
+  }
+  if(NULL != psXfer->psResult)
+  {
+    if(evXferWithReply == psXfer->eKind)
+    {
+      psXfer->psResult->sDecode = sLastReply;
+    }
+    else
+    {
+      psXfer->psResult->sDecode.eStatus = evNoDataFound;
+    }
+    psXfer->psResult->bDone = true;
+  }
+  daliFrameCacheRelease(psXfer->pCached);
+  DALI_TRACE(DALI_TRACE_LVL_DEBUG, evTraceXferDone, psXfer->eKind, xferCount);
+  if(  (0    == xferCount      )
+     &&(NULL != pfnXferIdleHook))
+  {//reply is decoded, the task layer may queue what comes next
+    pfnXferIdleHook();
+  }
+}
+
+
+static uint32_t daliPollBackFrame(void)
+{
+  const sDaliXfer_t   *psXfer;
+  sManchesterStream_t *psStream;
+  uint32_t             received;
+  uint32_t             aheadTE = 0;
+  uint32_t             needTE;
+  uint8_t              i;
+  DALI_CRITICAL_ENTER();
+  if(  (false == bXferActive)
+     ||(0     != xferCutTE  ))
+  {//nothing on the bus, or the query was cut and the bus is dropping what its spi held
+    DALI_CRITICAL_EXIT();
+    return 0;
+  }
+  received = daliBusRxCount();
+  for(i = 0; i < xferCount; i++)
+  {//frames ahead of the first query run out in full
+    psXfer = &saXferQueue[(xferHead + i) % DALI_XFER_QUEUE_LEN];
+    if(evXferWithReply == psXfer->eKind)
+    {
+      break;
+    }
+    if(evXferSequence == psXfer->eKind)
+    {//length unknown
+      DALI_CRITICAL_EXIT();
+      return 0;
+    }
+    aheadTE += (psXfer->txLen > psXfer->rxLen) ? psXfer->txLen : psXfer->rxLen;
+  }
+  if(i == xferCount)
+  {
+    DALI_CRITICAL_EXIT();
+    return 0;
+  }
+  if(0 != i)
+  {//query is still queued behind other frames, look again once it has started
+    DALI_CRITICAL_EXIT();
+    return (aheadTE > received) ? (aheadTE - received + 1) : 1;
+  }
+  psStream = &saBackFrameStream[saXferQueue[xferHead].buf];
+  if(received <= sizeof(uRawDaliRXBuffer[0].sRXWithReply.fwdFrameRegion))
+  {//still sending the forward frame, or the backend cannot tell
+    DALI_CRITICAL_EXIT();
+    return sizeof(uRawDaliRXBuffer[0].sRXWithReply.fwdFrameRegion) - received
+           + manchesterStreamNeed(psStream) + BACKFRAMESETTLINGTES;
+  }
+  received -= sizeof(uRawDaliRXBuffer[0].sRXWithReply.fwdFrameRegion);
+  (void)manchesterStreamFeed(psStream, (uint8_t)received);
+  needTE = (uint32_t)manchesterStreamNeed(psStream) + BACKFRAMESETTLINGTES;
+  if(  (evDataIncomplete == psStream->sDecode.eStatus)
+     ||(received         <  needTE                   ))
+  {//outcome unknown, or known and the bus is still settling before the next forward frame may start
+    DALI_CRITICAL_EXIT();
+    return (needTE > received) ? (needTE - received) : 1;
+  }
+  /*Abort the rest of the reply window*/
+  xferCutTE = daliBusRxCount();
+  if(true == daliBusAbort())
+  {
+    daliXferComplete();
+  }//else daliBusOnDone completes it once the bus has dropped the rest
+
+  DALI_CRITICAL_EXIT();
+  return 0;
+}
+
+
+uint32_t daliReplyPollUs(void)
+{
+#if DALI_BUS_RXCOUNT
+  if(0 == numReplyPending)
+  {
+    return 0;
+  }
+  return TE_TO_US(daliPollBackFrame());
+#else
+  return 0;
+#endif
 }
 
 
 eRXDataStatus_t getDaliBackFrame(uint8_t *cptr)
 {
- return manchesterDecodeBackFrame(&uRawDaliRXBuffer.sRXWithReply.backFrameRegion[0]    ,
-                                  cptr                                                 ,
-                                  sizeof(uRawDaliRXBuffer.sRXWithReply.backFrameRegion));
+  sManchesterDecode_t sDecode;
+  if(evValidDataFound == getDaliBackFrameEx(&sDecode))
+  {
+    *cptr = sDecode.backFrame;
+  }
+  return sDecode.eStatus;
+}
+
+
+eRXDataStatus_t getDaliBackFrameEx(sManchesterDecode_t *psDecode)
+{
+  *psDecode = sLastReply;
+  return psDecode->eStatus;
 }
 
 
 _Bool transmitForwardFrame(void)
 {
-  if(true == frameReadyToTransmit)
-  {
-    frameReadyToTransmit = false;
-    #ifdef NRF
-    spiXferDone = false;
-    spim_xfer_desc.tx_length = txLen;
-    spim_xfer_desc.rx_length = rxLen;
-    nrfx_spim_xfer(&spi,&spim_xfer_desc,0) ;
-    #else
-    spiXferDone = false;
-    printf("Configure TX DMA\n");
-    dma_channel_config c = dma_channel_get_default_config(dma_tx);
-    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
-    channel_config_set_dreq(&c, spi_get_dreq(spi_default, true));
-    dma_channel_configure(dma_tx, &c,
-                          &spi_get_hw(spi_default)->dr                     , // write address
-                          &uEncodedFwdFrame.sEncodedFwdFrame.encodedData[0], // read address
-                          txLen                       , // element count (each element is of size transfer_data_size)
-                          false                                            ); // don't start yet
-
-    printf("Configure RX DMA\n");
-
-    // We set the inbound DMA to transfer from the SPI receive FIFO to a memory buffer paced by the SPI RX FIFO DREQ
-    // We configure the read address to remain unchanged for each element, but the write
-    // address to increment (so data is written throughout the buffer)
-    c = dma_channel_get_default_config(dma_rx);
-    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
-    channel_config_set_dreq(&c, spi_get_dreq(spi_default, false));
-    channel_config_set_read_increment(&c, false);
-    channel_config_set_write_increment(&c, true);
-    dma_channel_configure(dma_rx, &c,
-                           (uint8_t *)&uRawDaliRXBuffer      , // write address
-                          &spi_get_hw(spi_default)->dr       , // read address
-                          rxLen, // element count (each element is of size transfer_data_size)
-                          false                              ); // don't start yet
-    dma_start_channel_mask((1u << dma_tx) | (1u << dma_rx));
-    #endif
-    return true;
+  return (0 != xferCount);
+}
+
+
+void daliSeqGiveWay(_Bool bGiveWay)
+{
+  bSeqGiveWay = bGiveWay;
+}
+
+
+_Bool daliSeqHeld(void)
+{
+  return bSeqHeld;
+}
+
+
+void daliGetDtrShadow(sDaliDtrShadow_t *psShadow)
+{
+  DALI_CRITICAL_ENTER();
+  *psShadow = sDtrShadow;
+  DALI_CRITICAL_EXIT();
+}
+
+
+void daliSnapDtrShadow(sDaliDtrShadow_t *psShadow)
+{
+  DALI_CRITICAL_ENTER();
+  *psShadow = sDtrShadow;
+  if(0 != xferCount)
+  {//last one queued so far
+    psDtrSnap   = psShadow;
+    dtrSnapSlot = (uint8_t)((xferTail + DALI_XFER_QUEUE_LEN - 1) % DALI_XFER_QUEUE_LEN);
   }
-  return false;
+  DALI_CRITICAL_EXIT();
+}
+
+
+void daliBusSetTag(uint8_t tag)
+{
+  busTag = tag;
+}
+
+
+void daliBusCountRetry(void)
+{
+  DALI_CRITICAL_ENTER();
+  sBusStats.retries++;
+  DALI_CRITICAL_EXIT();
+}
+
+
+const sDaliBusStats_t *getDaliBusStats(void)
+{
+  return &sBusStats;
 }
 
+
+void resetDaliBusStats(void)
+{
+  DALI_CRITICAL_ENTER();
+  memset(&sBusStats, 0, sizeof(sBusStats));
+  memset(aUtilUs   , 0, sizeof(aUtilUs  ));
+  utilSec = daliCtxNowUs() / 1000000u;
+  DALI_CRITICAL_EXIT();
+}
+
+
+uint16_t daliBusUtilPermille(uint8_t seconds)
+{
+  uint64_t sum = 0;
+  uint64_t nowSec;
+  uint8_t  i;
+  if(seconds > DALI_BUS_UTIL_SECONDS)
+  {
+    seconds = DALI_BUS_UTIL_SECONDS;
+  }
+  nowSec = daliCtxNowUs() / 1000000u;
+  if(seconds > nowSec)
+  {//not up that long
+    seconds = (uint8_t)nowSec;
+  }
+  if(0 == seconds)
+  {
+    return 0;
+  }
+  DALI_CRITICAL_ENTER();
+  daliBusUtilAdvance(nowSec);
+  for(i = 1; i <= seconds; i++)
+  {//whole seconds only, the current one is still filling
+    sum += aUtilUs[(nowSec - i) % (DALI_BUS_UTIL_SECONDS + 1)];
+  }
+  DALI_CRITICAL_EXIT();
+  sum /= (uint64_t)seconds * 1000u;
+  return (sum > 1000) ? 1000 : (uint16_t)sum;
+}
+
+
 #if 0
 void timerDALIeventHandler(nrf_timer_event_t event_type, void *p_context)
 {
@@ -280,4 +1018,3 @@ void timerDALIeventHandler(nrf_timer_event_t event_type, void *p_context)
   }
 }
 #endif
-
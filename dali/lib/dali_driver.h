@@ -36,6 +36,46 @@
 #define SPI_SS_PIN 31
 #endif
 
+#ifndef DALI_BUS_NUM_TAGS
+#define DALI_BUS_NUM_TAGS     16/**< Owners bus time is charged to, see daliBusSetTag*/
+#endif
+#ifndef DALI_BUS_UTIL_SECONDS
+#define DALI_BUS_UTIL_SECONDS 60/**< Longest daliBusUtilPermille window*/
+#endif
+#define DALI_BUS_ADDR_GROUP   64/**< addrUs entry of frames to a group*/
+#define DALI_BUS_ADDR_ALL     65/**< addrUs entry of broadcast frames and special commands*/
+#define DALI_BUS_NUM_ADDR     66
+#define DALI_BUS_TE_TO_US(te) (((uint64_t)(te) * 2500u) / 6u)/**< One TE is 416.67uS*/
+
+/**
+ * @brief DTR0-2 and SEARCHADDR as set by the frames that have left the bus. Gear only change their own
+ * DTR0 on memory bank access, so DTR0 follows the gear last read or written. SEARCHADDR is forgotten on
+ * INITIALISE, RANDOMISE and TERMINATE, gear joining or leaving initialisation may hold another
+ */
+typedef struct
+{
+  uint8_t aDtr[3]   ;
+  uint8_t validMask ;/*!< Bit n set if aDtr[n] is known*/
+  uint8_t aSearch[3];/*!< SEARCHADDR H, M, L*/
+  uint8_t searchMask;/*!< Bit n set if aSearch[n] is known*/
+}sDaliDtrShadow_t;
+
+/**
+ * @brief Bus counters, updated as transactions leave the bus. Bus time is the TEs actually clocked, so a
+ * query that ends early on a decoded reply counts only up to its settling time
+ */
+typedef struct
+{
+  uint32_t frames [evXferWithReply + 1];/*!< Per kind: evXferNoReply, evXferTwice, evXferWithReply, sequence steps included*/
+  uint32_t replies                     ;/*!< Queries answered with a valid backward frame*/
+  uint32_t noReplies                   ;/*!< Queries whose reply window stayed empty*/
+  uint32_t corrupt                     ;/*!< Backward frames that did not decode, usually several gear answering at once*/
+  uint32_t retries                     ;/*!< Frames sent again, see daliBusCountRetry*/
+  uint64_t busUs                       ;/*!< Bus in use*/
+  uint64_t tagUs  [DALI_BUS_NUM_TAGS]  ;/*!< busUs by the tag set when the frame was queued*/
+  uint64_t addrUs [DALI_BUS_NUM_ADDR]  ;/*!< busUs by short address of the frame, or DALI_BUS_ADDR_GROUP or DALI_BUS_ADDR_ALL*/
+}sDaliBusStats_t;
+
 
 
 
@@ -45,6 +85,29 @@
 void daliInit(void);
 
 
+/**
+ * @brief Encodes and queues a bus transaction. The transfer complete interrupt starts queued
+ * transactions back to back, so a sequence can queue several frames in one tick
+ * @param ufwdFrame Data to encode and transmit, copied before returning
+ * @param eKind send once, send twice, or send once with a backward frame window
+ * @param psResult Completion slot, filled in when the transaction leaves the bus. May be NULL
+ * @return _Bool false if the queue is full, or a send twice frame is already queued
+ */
+_Bool daliQueueXfer(uForwardFrame_t   *ufwdFrame,
+                    eDaliXferKind_t    eKind    ,
+                    sDaliXferResult_t *psResult );
+
+
+/**
+ * @brief Queues a sequence of forward frames. On the RP2040 its encoded frames and reply windows are
+ * described by dma control blocks up front, and chained channels run the whole sequence without the
+ * cpu, which only sees the end and the checkpoint steps (queries with an expected reply)
+ * @param psSeq Steps, result slots and status. Must stay valid until psSeq->bDone
+ * @return _Bool false if the queue is full, another sequence is queued, or the step count is out of range
+ */
+_Bool daliQueueSeq(sDaliSeq_t *psSeq);
+
+
 /**
  * @brief Encodes and schedules for transmit a send once dali forward frame with no reply expected 
  * @param ufwdFrame Data to encode and transmit
@@ -67,24 +130,111 @@ void transmitDaliCmdTwice(uForwardFrame_t *ufwdFrame);
 
 
 /**
- * @brief Get the status of current DALI transaction
- * @return _Bool Returns false if DALI transaction is underway, true if complete
+ * @brief Get whether the driver can take the next frame
+ * @return _Bool Returns false while a query or send twice frame is outstanding or the queue is full, true otherwise
  */
 _Bool getDaliTransferStatus(void);
 
+/**
+ * @brief Poll the reply of the first query queued and tell when to poll it again. Nothing else sees the
+ * reply window while the dma fills it, so the caller arms a timer for the time returned and calls
+ * getDaliTransferStatus then, which ends the window once the outcome is known and the bus has settled
+ * @return uint32_t microseconds, 0 if no query is queued or the backend cannot count received bytes
+ */
+uint32_t daliReplyPollUs(void);
+
 
 /**
- * @brief Begin the spi transmission of a forward frame scheduled by transmitDaliCmdTwice, transmitDaliCmdNoReply, or transmitDaliCmdWithReply
- * @return _Bool 
+ * @brief Register a function called from the transfer complete interrupt whenever the last queued
+ * transaction retires, so the next one can be queued without polling
+ * @param pfnHook NULL to remove
+ */
+void daliSetXferIdleHook(void (*pfnHook)(void));
+
+
+/**
+ * @brief Queued frames start on their own, kept for callers that wait for the bus to drain
+ * @return _Bool true while frames scheduled by transmitDaliCmdTwice, transmitDaliCmdNoReply, or transmitDaliCmdWithReply are queued or on the bus
  */
 _Bool transmitForwardFrame(void);
 
 
 /**
- * @brief Get the backframe data from the SPI dma buffer, and decode
+ * @brief Get the decoded backframe of the most recent query
  * @param cptr decoded data is written here
  * @return eRXDataStatus_t 
  */
 eRXDataStatus_t getDaliBackFrame (uint8_t *cptr);
 
 
+/**
+ * @brief Get the decoded backframe of the most recent query, with start offset and bit timing
+ * @param psDecode decoded data, start sample and measured TE width are written here
+ * @return eRXDataStatus_t 
+ */
+eRXDataStatus_t getDaliBackFrameEx(sManchesterDecode_t *psDecode);
+
+
+/**
+ * @brief Ask a running or queued sequence to stop at its next safe point, so a frame queued after it
+ * goes out sooner. Steps from psSeq->numRun on are not sent; no step holding the bus is split off
+ * @param bGiveWay false to let sequences run to the end
+ */
+void daliSeqGiveWay(_Bool bGiveWay);
+
+
+/**
+ * @brief Get whether the last sequence ended on a step that holds the bus to the next, so the
+ * sequence that carries on from it must go out before any other frame
+ * @return _Bool 
+ */
+_Bool daliSeqHeld(void);
+
+
+/**
+ * @brief Get the DTRs as the frames that have left the bus set them
+ * @param psShadow copied here
+ */
+void daliGetDtrShadow(sDaliDtrShadow_t *psShadow);
+
+
+/**
+ * @brief Get the DTRs as the frames queued so far leave them. Copied now, and again once the last
+ * queued frame has left the bus, so psShadow must stay valid until then
+ * @param psShadow copied here
+ */
+void daliSnapDtrShadow(sDaliDtrShadow_t *psShadow);
+
+
+/**
+ * @brief Charge the bus time of frames queued from now on to a tag, e.g. the type of the task queuing them
+ * @param tag below DALI_BUS_NUM_TAGS, larger values use the last
+ */
+void daliBusSetTag(uint8_t tag);
+
+
+/**
+ * @brief Count a frame its caller is sending again, having sent it once already
+ */
+void daliBusCountRetry(void);
+
+
+/**
+ * @brief Get the bus counters
+ * @return const sDaliBusStats_t*
+ */
+const sDaliBusStats_t *getDaliBusStats(void);
+
+
+/**
+ * @brief Clear the bus counters and utilisation history
+ */
+void resetDaliBusStats(void);
+
+
+/**
+ * @brief Share of time the bus was in use over the last whole seconds
+ * @param seconds window, 1 to DALI_BUS_UTIL_SECONDS
+ * @return uint16_t permille
+ */
+uint16_t daliBusUtilPermille(uint8_t seconds);
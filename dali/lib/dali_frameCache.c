@@ -0,0 +1,136 @@
+/**
+ * @file dali_frameCache.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Cache of already manchester-encoded forward frames. The bus mostly repeats the same few
+ * hundred frames (DAPC, READ MEMORY LOCATION, SET DTRx, queries) so most frames are never re-encoded.
+ * @version 0.1
+ * @date 2021-02-09
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include <stddef.h>
+#include <stdbool.h>
+#include "dali_frameCache.h"
+#include "manchester.h"
+
+/**
+ * @brief One cached frame. The encoded data is first so an entry can be recovered from the pointer handed out.
+ * 
+ */
+typedef struct
+{
+  sEncodedFwdFrame_t sEncoded;/*!< Encoded frame, read directly by dma*/
+  uint16_t           key     ;/*!< ui16ForwardFrame of the encoded frame*/
+  uint8_t            valid   ;/*!< Entry holds an encoded frame*/
+  uint8_t            age     ;/*!< Uses of its set since this entry was last used, saturating*/
+  volatile uint8_t   pins    ;/*!< Number of queued or in-flight transfers reading the entry*/
+}__attribute__((aligned(4))) sDaliFrameCacheEntry_t;
+
+static sDaliFrameCacheEntry_t saFrameCache[DALI_FRAME_CACHE_SETS][DALI_FRAME_CACHE_WAYS];
+static sDaliFrameCacheStats_t sFrameCacheStats;
+
+_Static_assert((DALI_FRAME_CACHE_WAYS >= 1) && (DALI_FRAME_CACHE_WAYS <= 255), "way index is a uint8_t");
+
+/**
+ * @brief Fibonacci hash of the forward frame to a set, spreads short addresses, levels and DTR data
+ * 
+ * @param key 16 bit forward frame
+ * @return uint16_t set index
+ */
+static inline uint16_t daliFrameCacheSet(uint16_t key)
+{
+  return (uint16_t)(((uint32_t)key * 40503u) & 0xffffu) >> (16 - DALI_FRAME_CACHE_SET_BITS);
+}
+
+/**
+ * @brief Make a way the most recently used of its set
+ * 
+ * @param set set index
+ * @param way way just used
+ */
+static void daliFrameCacheTouch(uint16_t set, uint8_t way)
+{
+  uint8_t other;
+  for(other = 0; other < DALI_FRAME_CACHE_WAYS; other++)
+  {
+    if(saFrameCache[set][other].age < UINT8_MAX)
+    {
+      saFrameCache[set][other].age++;
+    }
+  }
+  saFrameCache[set][way].age = 0;
+}
+
+
+const sEncodedFwdFrame_t * daliFrameCacheAcquire(const uForwardFrame_t *pFwdFrame)
+{
+  uint16_t                set    = daliFrameCacheSet(pFwdFrame->ui16ForwardFrame);
+  uint8_t                 way    = 0;
+  sDaliFrameCacheEntry_t *pEntry = NULL;
+  for(way = 0; way < DALI_FRAME_CACHE_WAYS; way++)
+  {
+    pEntry = &saFrameCache[set][way];
+    if(  (pEntry->valid)
+       &&(pEntry->key == pFwdFrame->ui16ForwardFrame))
+    {
+      sFrameCacheStats.hits++;
+      pEntry->pins++;
+      daliFrameCacheTouch(set, way);
+      return &pEntry->sEncoded;
+    }
+  }
+  /*Miss, fill a free way or replace the least recently used one a transfer is not still reading*/
+  pEntry = NULL;
+  for(way = 0; way < DALI_FRAME_CACHE_WAYS; way++)
+  {
+    if(0 != saFrameCache[set][way].pins)
+    {
+      continue;
+    }
+    if(false == saFrameCache[set][way].valid)
+    {
+      pEntry = &saFrameCache[set][way];
+      break;
+    }
+    if(  (NULL                       == pEntry     )
+       ||(saFrameCache[set][way].age >  pEntry->age))
+    {
+      pEntry = &saFrameCache[set][way];
+    }
+  }
+  if(NULL == pEntry)
+  {
+    sFrameCacheStats.bypasses++;
+    return NULL;
+  }
+  way = (uint8_t)(pEntry - &saFrameCache[set][0]);
+  if(pEntry->valid)
+  {
+    sFrameCacheStats.evictions++;
+  }
+  sFrameCacheStats.misses++;
+  manchesterEncodeFrame16(&pFwdFrame->ui8ForwardFrame[0], &pEntry->sEncoded.encodedData[0]);
+  pEntry->key   = pFwdFrame->ui16ForwardFrame;
+  pEntry->valid = true;
+  pEntry->pins++;
+  daliFrameCacheTouch(set, way);
+  return &pEntry->sEncoded;
+}
+
+
+void daliFrameCacheRelease(const sEncodedFwdFrame_t *pEncoded)
+{
+  sDaliFrameCacheEntry_t *pEntry = (sDaliFrameCacheEntry_t *)pEncoded;
+  if(  (NULL != pEntry   )
+     &&(0    != pEntry->pins))
+  {
+    pEntry->pins--;
+  }
+}
+
+
+void daliFrameCacheGetStats(sDaliFrameCacheStats_t *psStats)
+{
+  *psStats = sFrameCacheStats;
+}
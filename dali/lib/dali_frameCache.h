@@ -0,0 +1,59 @@
+/**
+ * @file dali_frameCache.h
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Cache of already manchester-encoded forward frames, keyed by the 16 bit forward frame
+ * @version 0.1
+ * @date 2021-02-09
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#include <stdint.h>
+#include "dali_frames.h"
+
+/*configuration*/
+#ifndef DALI_FRAME_CACHE_SET_BITS
+#define DALI_FRAME_CACHE_SET_BITS 6/**< log2 of the number of sets*/
+#endif
+#define DALI_FRAME_CACHE_SETS     (1u << DALI_FRAME_CACHE_SET_BITS)
+#ifndef DALI_FRAME_CACHE_WAYS
+#define DALI_FRAME_CACHE_WAYS     2/**< entries per set*/
+#endif
+
+/**
+ * @brief Cache usage counters
+ * 
+ */
+typedef struct
+{
+  uint32_t hits     ;/*!< Frame was already encoded*/
+  uint32_t misses   ;/*!< Frame had to be encoded into a free or evicted entry*/
+  uint32_t evictions;/*!< A valid entry was replaced*/
+  uint32_t bypasses ;/*!< Every way of the set was pinned by a queued transfer, caller encodes itself*/
+}sDaliFrameCacheStats_t;
+
+
+/**
+ * @brief Get the encoded copy of a forward frame, encoding it on a miss. The entry is pinned (never
+ * rewritten) until released, so dma can read it directly and several queued transfers can share it.
+ * 
+ * @param pFwdFrame forward frame to look up
+ * @return const sEncodedFwdFrame_t* encoded frame, NULL if every candidate entry is pinned
+ */
+const sEncodedFwdFrame_t * daliFrameCacheAcquire (const uForwardFrame_t *pFwdFrame);
+
+/**
+ * @brief Unpin an entry returned by daliFrameCacheAcquire once its transfer is complete
+ * 
+ * @param pEncoded entry to release, NULL is ignored
+ */
+void                       daliFrameCacheRelease (const sEncodedFwdFrame_t *pEncoded);
+
+/**
+ * @brief Copy out the hit/miss counters
+ * 
+ * @param psStats counters are written here
+ */
+void                       daliFrameCacheGetStats(sDaliFrameCacheStats_t *psStats);
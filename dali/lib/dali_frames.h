@@ -25,6 +25,8 @@
 #define SEND_TWICE_FORWARD_FRAME_IDLE_TES (48)/*!< (20 milliseconds/417uS)*/ 
 #define INTERFRAMEIDLE                    (36)/*!< 20 milliseconds,min time between fwd frames, can go as low as 13.5*/
 #define MAXBYTESTOBACKFRAMESTART          (26)/*!< 10.5 milliseconds/417uS, round up*/
+#define BACKFRAMESETTLINGTES              ( 6)/*!< 2.4 milliseconds/417uS, bus settling after a backward frame before the next forward frame*/
+#define TE_TO_US(te) ((((uint32_t)(te)) * 2500u + 5u) / 6u)/*!< One TE is 1/2400 s, rounded up*/
 
 
 
@@ -0,0 +1,693 @@
+/**
+ * @file dali_gearSim.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Simulated IEC 62386-102 control gear: addressing, queries, DTRs, groups and memory banks
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifdef DALI_HOST
+#include <string.h>
+#include "dali_gearSim.h"
+#include "dali_commands.h"
+#include "dali_frames.h"
+
+#define GEARSIM_FRAME_TES    (2 * (NUM_START_BITS + NUM_DATA_BITS_FORWARD_FRAME))/*!< start bit and 16 data bits*/
+#define GEARSIM_REPLY_TES    (2 * (NUM_START_BITS + NUM_DATA_BITS_BACK_FRAME   ))/*!< start bit and 8 data bits*/
+#define GEARSIM_STOP_TES     4                                                   /*!< Idle needed before the next frame*/
+#define GEARSIM_TWICE_TES    240                                                 /*!< Send twice frames at most 100mS apart*/
+#define GEARSIM_INIT_TES     DALI_GEARSIM_US_TO_TE(15u * 60u * 1000000u)         /*!< initialisationState lasts 15 minutes*/
+#define GEARSIM_YES          0xff
+#define GEARSIM_NO_ANSWER    (-1)
+#define GEARSIM_BUS_LOW      0x00/*!< Receiver TE while the bus is pulled low*/
+#define GEARSIM_BUS_HIGH     0xff
+
+static sDaliGear_t         saGear[DALI_GEARSIM_MAX_GEAR];
+static uint8_t             numGear      = 0;
+static uint32_t            randState    = 1;
+static uint64_t            nowTE        = 0;
+static sDaliGearSimStats_t sStats;
+
+/*Forward frame receiver*/
+static uint8_t             aFrameTE[GEARSIM_FRAME_TES];
+static uint8_t             frameTEs     = 0;    /*!< TEs of the frame collected so far*/
+static uint8_t             idleTEs      = GEARSIM_STOP_TES;
+/*Send twice detection*/
+static _Bool               bTwiceArmed  = false;
+static uint16_t            twiceFrame;
+static uint64_t            twiceEndTE;
+/*Backward frame on the bus*/
+static uint8_t             aReplyTE[GEARSIM_REPLY_TES + DALI_GEARSIM_MAX_SKEW_TE];
+static _Bool               bReplyPending = false;
+static uint64_t            replyStartTE;
+
+/**
+ * @brief xorshift32, repeatable for a given seed
+ */
+static uint32_t daliGearSimRand(void)
+{
+  randState ^= randState << 13;
+  randState ^= randState >> 17;
+  randState ^= randState << 5;
+  return randState;
+}
+
+/**
+ * @brief Bank slot of a gear
+ * @return sDaliGearBank_t* NULL if the bank is not implemented
+ */
+static sDaliGearBank_t *daliGearSimBank(sDaliGear_t *psGear, uint8_t bankNum)
+{
+  uint8_t i;
+  for(i = 0; i < DALI_GEARSIM_NUM_BANKS; i++)
+  {
+    if(bankNum == psGear->saBank[i].num)
+    {
+      return &psGear->saBank[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Keeps bank 0 location 0x02 (last accessible bank) in step with the banks present
+ */
+static void daliGearSimUpdateBank0(sDaliGear_t *psGear)
+{
+  uint8_t i;
+  uint8_t last = 0;
+  for(i = 1; i < DALI_GEARSIM_NUM_BANKS; i++)
+  {
+    if(  (DALI_GEARSIM_MASK != psGear->saBank[i].num)
+       &&(last              <  psGear->saBank[i].num))
+    {
+      last = psGear->saBank[i].num;
+    }
+  }
+  psGear->saBank[0].aData[0x02] = last;
+}
+
+/**
+ * @brief Factory defaults of a gear, bank 0 identification and a lockable bank 1
+ */
+static void daliGearSimDefaults(sDaliGear_t *psGear, uint8_t idx)
+{
+  sDaliGearBank_t *psBank;
+  memset(psGear, 0, sizeof(*psGear));
+  memset(psGear->saBank, DALI_GEARSIM_MASK, sizeof(psGear->saBank));
+  psGear->shortAddr   = DALI_GEARSIM_MASK;
+  psGear->randomAddr  = 0xffffff;
+  psGear->searchAddr  = 0xffffff;
+  psGear->actualLevel = 254;
+  psGear->maxLevel    = 254;
+  psGear->minLevel    = 1;
+  psBank              = &psGear->saBank[0];
+  psBank->num         = 0;
+  psBank->aData[0x00] = 0x1a;          //last accessible location
+  psBank->aData[0x03] = 0x00;          //GTIN 0x03-0x08
+  psBank->aData[0x08] = idx;
+  psBank->aData[0x09] = 0x01;          //firmware version
+  psBank->aData[0x0a] = 0x00;
+  memset(&psBank->aData[0x0b], 0, 8);  //identification number 0x0b-0x12
+  psBank->aData[0x11] = (uint8_t)(randState >> 8);
+  psBank->aData[0x12] = idx;
+  psBank->aData[0x15] = 0x08;          //101 version 2.0
+  psBank->aData[0x16] = 0x08;          //102 version 2.0
+  psBank->aData[0x17] = GEARSIM_YES;   //no 103
+  psBank->aData[0x19] = 0x01;          //one logical gear unit
+  psBank              = &psGear->saBank[1];
+  psBank->num         = 1;
+  memset(psBank->aData, GEARSIM_YES, sizeof(psBank->aData));
+  psBank->aData[0x00] = 0x77;
+  psBank->aData[0x02] = GEARSIM_YES;   //locked
+  daliGearSimUpdateBank0(psGear);
+}
+
+
+void daliGearSimInit(uint8_t numGearOnBus, uint32_t seed)
+{
+  uint8_t i;
+  numGear       = (numGearOnBus > DALI_GEARSIM_MAX_GEAR) ? DALI_GEARSIM_MAX_GEAR : numGearOnBus;
+  randState     = (0 != seed) ? seed : 1;
+  nowTE         = 0;
+  frameTEs      = 0;
+  idleTEs       = GEARSIM_STOP_TES;
+  bTwiceArmed   = false;
+  bReplyPending = false;
+  memset(&sStats, 0, sizeof(sStats));
+  for(i = 0; i < numGear; i++)
+  {
+    daliGearSimDefaults(&saGear[i], i);
+  }
+}
+
+
+sDaliGear_t *daliGearSimGet(uint8_t idx)
+{
+  return (idx < numGear) ? &saGear[idx] : NULL;
+}
+
+
+_Bool daliGearSimSetBank(uint8_t idx, uint8_t bankNum, const uint8_t *pData, uint8_t len)
+{
+  sDaliGear_t     *psGear = daliGearSimGet(idx);
+  sDaliGearBank_t *psBank;
+  if(  (NULL == psGear                )
+     ||(0    == len                   )
+     ||(len  >  DALI_GEARSIM_BANK_LEN )
+     ||(DALI_GEARSIM_MASK == bankNum  ))
+  {
+    return false;
+  }
+  psBank = daliGearSimBank(psGear, bankNum);
+  if(NULL == psBank)
+  {
+    psBank = daliGearSimBank(psGear, DALI_GEARSIM_MASK);
+  }
+  if(NULL == psBank)
+  {
+    return false;
+  }
+  psBank->num = bankNum;
+  memset(psBank->aData, GEARSIM_YES, sizeof(psBank->aData));
+  memcpy(psBank->aData, pData, len);
+  psBank->aData[0] = len - 1;
+  daliGearSimUpdateBank0(psGear);
+  return true;
+}
+
+
+/**
+ * @brief Address byte of a standard command or DAPC selects the gear
+ */
+static _Bool daliGearSimAddressed(const sDaliGear_t *psGear, uint8_t address)
+{
+  if(0 == (address & 0x80))
+  {//0AAAAAAS
+    return (psGear->shortAddr == ((address >> 1) & 0x3f));
+  }
+  if(0x80 == (address & 0xe0))
+  {//100GGGGS
+    return (0 != (psGear->groups & (1u << ((address >> 1) & 0x0f))));
+  }
+  if(0xfc == (address & 0xfe))
+  {
+    return (DALI_GEARSIM_MASK == psGear->shortAddr);
+  }
+  return (0xfe == (address & 0xfe));
+}
+
+/**
+ * @brief Decode a short address carried as 0AAAAAA1, or MASK
+ * @return int16_t short address, DALI_GEARSIM_MASK, or -1 for a value that changes nothing
+ */
+static int16_t daliGearSimShortData(uint8_t data)
+{
+  if(DALI_GEARSIM_MASK == data)
+  {
+    return DALI_GEARSIM_MASK;
+  }
+  return (0x01 == (data & 0x81)) ? (int16_t)(data >> 1) : -1;
+}
+
+/**
+ * @brief Commands that must arrive twice within 100mS
+ */
+static _Bool daliGearSimIsTwice(uint8_t first, uint8_t second)
+{
+  if(  ((0xa1 == (first & 0xe1)) || (0xc1 == (first & 0xe1)))
+     &&(0xdf >= first                                         ))
+  {//special command
+    return ((evInitialise == first) || (evRandomise == first));
+  }
+  return (  (0    != (first & 0x01))
+          &&(0x20 <= second        )
+          &&(0x81 >= second        ));
+}
+
+/**
+ * @brief Commands that leave writeEnableState alone
+ */
+static _Bool daliGearSimKeepsWriteEnable(uint8_t first, uint8_t second)
+{
+  switch(first)
+  {
+    case evSetDTR0:
+    case evSetDTR1:
+    case evSetDTR2:
+    case evWriteMemoryBank:
+    case evWriteMemBnkNoReply:
+      return true;
+    default:
+    break;
+  }
+  return (  (0                   != (first & 0x01))
+          &&(evEnableWriteMemory == second        ));
+}
+
+/**
+ * @brief Memory bank write of WRITE MEMORY LOCATION (NO REPLY)
+ * @return int16_t written value, or GEARSIM_NO_ANSWER
+ */
+static int16_t daliGearSimWrite(sDaliGear_t *psGear, uint8_t data)
+{
+  sDaliGearBank_t *psBank = daliGearSimBank(psGear, psGear->dtr1);
+  int16_t          answer = GEARSIM_NO_ANSWER;
+  if(  (false == psGear->bWriteEnabled)
+     ||(NULL  == psBank               ))
+  {
+    return GEARSIM_NO_ANSWER;
+  }
+  if(  (0                   != psBank->num              )
+     &&(psGear->dtr0        <= psBank->aData[0]         )
+     &&((0x02 == psGear->dtr0) || (0x55 == psBank->aData[2])))
+  {
+    psBank->aData[psGear->dtr0] = data;
+    answer                      = data;
+  }
+  if(0xff != psGear->dtr0)
+  {
+    psGear->dtr0++;
+  }
+  return answer;
+}
+
+/**
+ * @brief Special command (first byte 101xxxx1 or 110xxxx1), every gear sees it
+ * @return int16_t answer, or GEARSIM_NO_ANSWER
+ */
+static int16_t daliGearSimSpecial(sDaliGear_t *psGear, uint8_t opcode, uint8_t data, _Bool bTwiceOk)
+{
+  int16_t shortAddr;
+  _Bool   bSelected = (psGear->randomAddr == psGear->searchAddr);
+  switch(opcode)
+  {
+    case evTerminate:
+      psGear->eInit = evGearInitDisabled;
+    break;
+    case evSetDTR0:
+      psGear->dtr0 = data;
+    break;
+    case evSetDTR1:
+      psGear->dtr1 = data;
+    break;
+    case evSetDTR2:
+      psGear->dtr2 = data;
+    break;
+    case evInitialise:
+      shortAddr = daliGearSimShortData(data);
+      if(  (true == bTwiceOk)
+         &&(  (0x00 == data)
+            ||((0xff == data) && (DALI_GEARSIM_MASK == psGear->shortAddr))
+            ||((0xff != data) && (shortAddr         == psGear->shortAddr))))
+      {
+        psGear->eInit     = evGearInitEnabled;
+        psGear->initEndTE = nowTE + GEARSIM_INIT_TES;
+      }
+    break;
+    case evRandomise:
+      if(  (true               == bTwiceOk     )
+         &&(evGearInitDisabled != psGear->eInit))
+      {
+        psGear->randomAddr = daliGearSimRand() % 0xffffff;//0 to 0xfffffe
+      }
+    break;
+    case evCompare:
+      if(  (evGearInitEnabled == psGear->eInit     )
+         &&(psGear->randomAddr <= psGear->searchAddr))
+      {
+        return GEARSIM_YES;
+      }
+    break;
+    case evWithdraw:
+      if(  (evGearInitEnabled == psGear->eInit)
+         &&(true              == bSelected    ))
+      {
+        psGear->eInit = evGearInitWithdrawn;
+      }
+    break;
+    case evSearchAddrH:
+    case evSearchAddrM:
+    case evSearchAddrL:
+      if(evGearInitDisabled != psGear->eInit)
+      {
+        uint8_t shift      = (evSearchAddrH == opcode) ? 16 : ((evSearchAddrM == opcode) ? 8 : 0);
+        psGear->searchAddr = (psGear->searchAddr & ~(0xffu << shift)) | ((uint32_t)data << shift);
+      }
+    break;
+    case evprogramShortAddr:
+      shortAddr = daliGearSimShortData(data);
+      if(  (evGearInitDisabled != psGear->eInit)
+         &&(true               == bSelected    )
+         &&(0                  <= shortAddr    ))
+      {
+        psGear->shortAddr = (uint8_t)shortAddr;
+      }
+    break;
+    case evVerifyShortAddr:
+      if(  (evGearInitDisabled        != psGear->eInit     )
+         &&(daliGearSimShortData(data) == psGear->shortAddr))
+      {
+        return GEARSIM_YES;
+      }
+    break;
+    case evQueryShortAddr:
+      if(  (evGearInitDisabled != psGear->eInit)
+         &&(true               == bSelected    ))
+      {
+        return (DALI_GEARSIM_MASK == psGear->shortAddr) ? DALI_GEARSIM_MASK : (int16_t)((psGear->shortAddr << 1) | 1);
+      }
+    break;
+    case evWriteMemoryBank:
+      return daliGearSimWrite(psGear, data);
+    case evWriteMemBnkNoReply:
+      daliGearSimWrite(psGear, data);
+    break;
+    default:
+    break;
+  }
+  return GEARSIM_NO_ANSWER;
+}
+
+/**
+ * @brief Standard command to an addressed gear
+ * @return int16_t answer, or GEARSIM_NO_ANSWER
+ */
+static int16_t daliGearSimStandard(sDaliGear_t *psGear, uint8_t opcode, _Bool bTwiceOk)
+{
+  sDaliGearBank_t *psBank;
+  int16_t          shortAddr;
+  int16_t          answer = GEARSIM_NO_ANSWER;
+  if(  (0x20     <= opcode)
+     &&(0x81     >= opcode)
+     &&(false    == bTwiceOk))
+  {//first of a send twice pair
+    return GEARSIM_NO_ANSWER;
+  }
+  if((opcode & 0xf0) == evAddToGroupX)
+  {
+    psGear->groups |= (uint16_t)(1u << (opcode & 0x0f));
+    return GEARSIM_NO_ANSWER;
+  }
+  if((opcode & 0xf0) == evRemoveFromGroupX)
+  {
+    psGear->groups &= (uint16_t)~(1u << (opcode & 0x0f));
+    return GEARSIM_NO_ANSWER;
+  }
+  switch(opcode)
+  {
+    case evOff:
+      psGear->actualLevel = 0;
+    break;
+    case evRecallMaxLevel:
+      psGear->actualLevel = psGear->maxLevel;
+    break;
+    case evRecallMinLevel:
+      psGear->actualLevel = psGear->minLevel;
+    break;
+    case evReset:
+      psGear->actualLevel = 254;
+      psGear->maxLevel    = 254;
+      psGear->minLevel    = 1;
+      psGear->groups      = 0;
+      psGear->randomAddr  = 0xffffff;
+      psGear->searchAddr  = 0xffffff;
+    break;
+    case evStoreActualLevelInDTR0:
+      psGear->dtr0 = psGear->actualLevel;
+    break;
+    case evSetMaxLevelToDTR0:
+      psGear->maxLevel = (psGear->dtr0 <= psGear->minLevel) ? psGear->minLevel : ((psGear->dtr0 > 254) ? 254 : psGear->dtr0);
+    break;
+    case evSetMinLevelToDTR0:
+      psGear->minLevel = (psGear->dtr0 >= psGear->maxLevel) ? psGear->maxLevel : ((psGear->dtr0 < 1) ? 1 : psGear->dtr0);
+    break;
+    case evSetShortAddressToDTR0:
+      shortAddr = daliGearSimShortData(psGear->dtr0);
+      if(0 <= shortAddr)
+      {
+        psGear->shortAddr = (uint8_t)shortAddr;
+      }
+    break;
+    case evEnableWriteMemory:
+      psGear->bWriteEnabled = true;
+    break;
+    case evQueryStatus:
+      answer = (int16_t)(  ((0                 != psGear->actualLevel) ? 0x04 : 0)
+                         | ((DALI_GEARSIM_MASK == psGear->shortAddr  ) ? 0x40 : 0));
+    break;
+    case evQueryControlGearPresent:
+      answer = GEARSIM_YES;
+    break;
+    case evQueryMissingShortAddress:
+      answer = (DALI_GEARSIM_MASK == psGear->shortAddr) ? GEARSIM_YES : GEARSIM_NO_ANSWER;
+    break;
+    case evQueryVersionNumber:
+      answer = psGear->saBank[0].aData[0x16];
+    break;
+    case evQueryContentDTR0:
+      answer = psGear->dtr0;
+    break;
+    case evQueryContentDTR1:
+      answer = psGear->dtr1;
+    break;
+    case evQueryContentDTR2:
+      answer = psGear->dtr2;
+    break;
+    case evQueryDeviceType:
+      answer = 6;//LED gear
+    break;
+    case evQueryPhysicalMinimum:
+      answer = 1;
+    break;
+    case evQueryActualLevel:
+      answer = psGear->actualLevel;
+    break;
+    case evQueryMaxLevel:
+      answer = psGear->maxLevel;
+    break;
+    case evQueryMinLevel:
+      answer = psGear->minLevel;
+    break;
+    case evQueryGroups0To7:
+      answer = (int16_t)(psGear->groups & 0xff);
+    break;
+    case evQueryGroups8To15:
+      answer = (int16_t)(psGear->groups >> 8);
+    break;
+    case evQueryRandomAddrH:
+      answer = (int16_t)((psGear->randomAddr >> 16) & 0xff);
+    break;
+    case evQueryRandomAddrM:
+      answer = (int16_t)((psGear->randomAddr >>  8) & 0xff);
+    break;
+    case evQueryRandomAddrL:
+      answer = (int16_t)( psGear->randomAddr        & 0xff);
+    break;
+    case evReadMemoryBank:
+      psBank = daliGearSimBank(psGear, psGear->dtr1);
+      if(NULL != psBank)
+      {
+        if(psGear->dtr0 <= psBank->aData[0])
+        {
+          answer = psBank->aData[psGear->dtr0];
+        }
+        if(0xff != psGear->dtr0)
+        {
+          psGear->dtr0++;
+        }
+      }
+    break;
+    default:
+    break;
+  }
+  return answer;
+}
+
+/**
+ * @brief Backward frame TEs as the controller's receiver sees them, start bit then msb first
+ */
+static void daliGearSimEncodeReply(uint8_t value, uint8_t *pTE)
+{
+  uint8_t i;
+  pTE[0] = GEARSIM_BUS_LOW;
+  pTE[1] = GEARSIM_BUS_HIGH;
+  for(i = 0; i < NUM_DATA_BITS_BACK_FRAME; i++)
+  {
+    _Bool bOne = (0 != (value & (0x80 >> i)));
+    pTE[2 + 2 * i] = bOne ? GEARSIM_BUS_LOW  : GEARSIM_BUS_HIGH;
+    pTE[3 + 2 * i] = bOne ? GEARSIM_BUS_HIGH : GEARSIM_BUS_LOW ;
+  }
+}
+
+/**
+ * @brief Every gear acts on a decoded forward frame, answers are wired-AND onto the bus
+ */
+static void daliGearSimFrame(uint8_t first, uint8_t second)
+{
+  uint16_t     frame     = (uint16_t)((first << 8) | second);
+  _Bool        bTwice    = daliGearSimIsTwice(first, second);
+  _Bool        bTwiceOk  = false;
+  _Bool        bSpecial  = (  ((0xa1 == (first & 0xe1)) || (0xc1 == (first & 0xe1)))
+                            &&(0xdf >= first                                         ));
+  int16_t      answer;
+  int16_t      firstAnswer = GEARSIM_NO_ANSWER;
+  uint8_t      aTE[GEARSIM_REPLY_TES];
+  uint8_t      skew;
+  uint8_t      firstSkew   = 0;
+  uint8_t      i;
+  uint8_t      j;
+  sDaliGear_t *psGear;
+  sStats.frames++;
+  if(true == bTwice)
+  {
+    bTwiceOk    = (  (true  == bTwiceArmed                              )
+                   &&(frame == twiceFrame                               )
+                   &&((nowTE - twiceEndTE) <= GEARSIM_TWICE_TES         ));
+    bTwiceArmed = !bTwiceOk;
+    twiceFrame  = frame;
+    twiceEndTE  = nowTE;
+  }
+  else
+  {
+    bTwiceArmed = false;
+  }
+  memset(aReplyTE, GEARSIM_BUS_HIGH, sizeof(aReplyTE));
+  for(i = 0; i < numGear; i++)
+  {
+    psGear = &saGear[i];
+    if(  (evGearInitDisabled != psGear->eInit    )
+       &&(nowTE              >= psGear->initEndTE))
+    {
+      psGear->eInit = evGearInitDisabled;
+    }
+    if(false == daliGearSimKeepsWriteEnable(first, second))
+    {
+      psGear->bWriteEnabled = false;
+    }
+    if(true == bSpecial)
+    {
+      answer = daliGearSimSpecial(psGear, first, second, bTwiceOk);
+    }
+    else if(false == daliGearSimAddressed(psGear, first))
+    {
+      continue;
+    }
+    else if(0 == (first & 0x01))
+    {//DAPC, 255 stops a fade
+      if(0xff != second)
+      {
+        psGear->actualLevel = (0 == second) ? 0 : ((second < psGear->minLevel) ? psGear->minLevel : ((second > psGear->maxLevel) ? psGear->maxLevel : second));
+      }
+      continue;
+    }
+    else
+    {
+      answer = daliGearSimStandard(psGear, second, bTwiceOk);
+    }
+    if(GEARSIM_NO_ANSWER == answer)
+    {
+      continue;
+    }
+    skew = (psGear->replySkewTE > DALI_GEARSIM_MAX_SKEW_TE) ? DALI_GEARSIM_MAX_SKEW_TE : psGear->replySkewTE;
+    if(GEARSIM_NO_ANSWER == firstAnswer)
+    {
+      firstAnswer = answer;
+      firstSkew   = skew;
+      sStats.replies++;
+    }
+    else if(  (firstAnswer != answer)
+            ||(firstSkew   != skew  ))
+    {
+      sStats.collisions++;
+    }
+    daliGearSimEncodeReply((uint8_t)answer, aTE);
+    for(j = 0; j < GEARSIM_REPLY_TES; j++)
+    {
+      aReplyTE[skew + j] &= aTE[j];
+    }
+  }
+  bReplyPending = (GEARSIM_NO_ANSWER != firstAnswer);
+  replyStartTE  = nowTE + 1 + DALI_GEARSIM_REPLY_DELAY_TE;
+}
+
+
+uint8_t daliGearSimTE(uint8_t txByte)
+{
+  uint8_t rx = (uint8_t)~txByte;//transceiver echo
+  uint8_t i;
+  if(true == bReplyPending)
+  {
+    if(nowTE >= (replyStartTE + sizeof(aReplyTE)))
+    {
+      bReplyPending = false;
+    }
+    else if(nowTE >= replyStartTE)
+    {
+      rx &= aReplyTE[nowTE - replyStartTE];
+    }
+  }
+  if(0 != frameTEs)
+  {
+    aFrameTE[frameTEs++] = txByte;
+    if(GEARSIM_FRAME_TES == frameTEs)
+    {
+      uint16_t frame  = 0;
+      _Bool    bValid = (0 == aFrameTE[1]);
+      for(i = 0; i < NUM_DATA_BITS_FORWARD_FRAME; i++)
+      {
+        bValid &= (aFrameTE[2 + 2 * i] != aFrameTE[3 + 2 * i]);
+        frame   = (uint16_t)((frame << 1) | ((0 != aFrameTE[2 + 2 * i]) ? 1 : 0));
+      }
+      frameTEs = 0;
+      idleTEs  = 0;
+      if(true == bValid)
+      {
+        daliGearSimFrame((uint8_t)(frame >> 8), (uint8_t)frame);
+      }
+      else
+      {
+        sStats.badFrames++;
+      }
+    }
+  }
+  else if(0 != txByte)
+  {
+    if(idleTEs >= GEARSIM_STOP_TES)
+    {//start bit
+      aFrameTE[0] = txByte;
+      frameTEs    = 1;
+    }
+    idleTEs = 0;
+  }
+  else if(idleTEs < GEARSIM_STOP_TES)
+  {
+    idleTEs++;
+  }
+  nowTE++;
+  return rx;
+}
+
+
+void daliGearSimIdle(uint64_t numTE)
+{
+  nowTE        += numTE;
+  frameTEs      = 0;
+  idleTEs       = GEARSIM_STOP_TES;
+  bReplyPending = false;
+}
+
+
+uint64_t daliGearSimNowTE(void)
+{
+  return nowTE;
+}
+
+
+const sDaliGearSimStats_t *daliGearSimStats(void)
+{
+  return &sStats;
+}
+#endif
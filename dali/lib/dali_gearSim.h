@@ -0,0 +1,132 @@
+/**
+ * @file dali_gearSim.h
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Simulated IEC 62386-102 control gear on a virtual bus, for DALI_HOST builds. The gear
+ * listen to the transmitted TEs, decode forward frames and drive their backward frames onto the
+ * bus, wired-AND with each other so simultaneous answers collide as they would on a real bus
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*configuration*/
+#ifndef DALI_GEARSIM_MAX_GEAR
+#define DALI_GEARSIM_MAX_GEAR       64/**< Gear on the virtual bus*/
+#endif
+#ifndef DALI_GEARSIM_NUM_BANKS
+#define DALI_GEARSIM_NUM_BANKS       8/**< Memory banks per gear, including bank 0*/
+#endif
+#define DALI_GEARSIM_BANK_LEN      128/**< Locations per memory bank*/
+#define DALI_GEARSIM_REPLY_DELAY_TE 14/**< Forward frame stop to backward frame start, 5.8mS*/
+#define DALI_GEARSIM_MAX_SKEW_TE     8/**< Most replySkewTE, keeps the reply inside the 9.17mS window*/
+#define DALI_GEARSIM_MASK         0xff/**< No short address, no bank*/
+#define DALI_GEARSIM_US_TO_TE(us) (((uint64_t)(us) * 6u) / 2500u)/**< One TE is 416.67uS*/
+#define DALI_GEARSIM_TE_TO_US(te) (((uint64_t)(te) * 2500u) / 6u)
+
+/**
+ * @brief initialisationState of a gear
+ */
+typedef enum
+{
+  evGearInitDisabled ,
+  evGearInitEnabled  ,
+  evGearInitWithdrawn
+}eDaliGearInit_t;
+
+/**
+ * @brief One memory bank
+ */
+typedef struct
+{
+  uint8_t num                        ;/*!< Bank number, DALI_GEARSIM_MASK if the slot is unused*/
+  uint8_t aData[DALI_GEARSIM_BANK_LEN];/*!< aData[0] is the last accessible location, aData[2] the lock byte of banks above 0*/
+}sDaliGearBank_t;
+
+/**
+ * @brief State of one simulated gear, scenarios may read and change it between transfers
+ */
+typedef struct
+{
+  uint8_t         shortAddr    ;/*!< 0-63, DALI_GEARSIM_MASK if unaddressed*/
+  uint32_t        randomAddr   ;/*!< 24 bit*/
+  uint32_t        searchAddr   ;/*!< 24 bit*/
+  uint16_t        groups       ;
+  uint8_t         actualLevel  ;
+  uint8_t         maxLevel     ;
+  uint8_t         minLevel     ;
+  uint8_t         dtr0         ;
+  uint8_t         dtr1         ;
+  uint8_t         dtr2         ;
+  eDaliGearInit_t eInit        ;
+  uint64_t        initEndTE    ;/*!< initialisationState ends 15 minutes after INITIALISE*/
+  _Bool           bWriteEnabled;
+  uint8_t         replySkewTE  ;/*!< Extra delay before this gear answers, real gear differ so answers from several corrupt the frame. 0 by default*/
+  sDaliGearBank_t saBank[DALI_GEARSIM_NUM_BANKS];
+}sDaliGear_t;
+
+/**
+ * @brief Bus counters
+ */
+typedef struct
+{
+  uint32_t frames    ;/*!< Forward frames decoded*/
+  uint32_t badFrames ;/*!< Transmitted activity that was not a 16 bit forward frame*/
+  uint32_t replies   ;/*!< Backward frames driven, one per frame however many gear answered*/
+  uint32_t collisions;/*!< Replies where the gear answers or their timing differed*/
+}sDaliGearSimStats_t;
+
+
+/**
+ * @brief Put numGear factory fresh gear on the bus: no short address, random address 0xffffff, level 254
+ * @param numGear 0 leaves only the transceiver echo
+ * @param seed RANDOMISE generator seed, runs are repeatable
+ */
+void                       daliGearSimInit   (uint8_t numGear, uint32_t seed);
+
+/**
+ * @brief Direct access to a gear
+ * @param idx gear index, not its address
+ * @return sDaliGear_t* NULL if idx is out of range
+ */
+sDaliGear_t               *daliGearSimGet    (uint8_t idx);
+
+/**
+ * @brief Add or replace a memory bank of a gear. Location 0 is set to the last location given
+ * @param idx gear index
+ * @param bankNum bank number
+ * @param pData contents from location 0, location 0 is overwritten
+ * @param len number of locations
+ * @return _Bool false if the gear has no free bank slot or len is out of range
+ */
+_Bool                      daliGearSimSetBank(uint8_t idx, uint8_t bankNum, const uint8_t *pData, uint8_t len);
+
+/**
+ * @brief Clock one TE through the bus
+ * @param txByte TE sent by the controller, 0x00 idle
+ * @return uint8_t TE seen by the controller's receiver: its own echo wired-AND with the gear
+ */
+uint8_t                    daliGearSimTE     (uint8_t txByte);
+
+/**
+ * @brief Let the bus idle without clocking every TE
+ * @param numTE TEs to skip
+ */
+void                       daliGearSimIdle   (uint64_t numTE);
+
+/**
+ * @brief Simulated time
+ * @return uint64_t TEs since daliGearSimInit
+ */
+uint64_t                   daliGearSimNowTE  (void);
+
+/**
+ * @brief Bus counters since daliGearSimInit
+ * @return const sDaliGearSimStats_t*
+ */
+const sDaliGearSimStats_t *daliGearSimStats  (void);
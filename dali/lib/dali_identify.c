@@ -14,6 +14,9 @@
 #include "dali_dexal.h"
 #include "dali_sr.h"
 #include "dali_d4i.h"
+#include "dali_commands.h"
+#include "dali_driver.h"
+#include "dali_frames.h"
 
 #include <string.h>
 
@@ -74,6 +77,27 @@ void  verifyModelByGTIN         (sDaliDriverData_t  *);
  */
 _Bool identifyDaliDriver(sDaliDriverData_t *psDaliDriverData);
 
+/**
+ * @brief Read the 24 bit random address of a driver with QUERY RANDOM ADDRESS H, M and L, so a later
+ * restore can select it without a search. One query per step, each step takes the previous reply
+ * 
+ * @param psCtx progress
+ * @param psStaticData aRandomAddr is set, RANDOM_ADDR_UNKNOWN if a query went unanswered
+ * @return _Bool 
+ */
+static _Bool daliReadRandomAddr(sDaliCtx_t *psCtx, sStaticData_t *psStaticData);
+
+/**
+ * @brief Read the groups a driver is a member of with QUERY GROUPS 0-7 and 8-15, so DAPCs to all the
+ * members of a group can be sent as one group DAPC. One query per step, each step takes the previous reply
+ * 
+ * @param psCtx progress
+ * @param addr short address of the driver
+ * @param psUserConfig gearGroups is set, and bGroupsRead unless a query went unanswered
+ * @return _Bool 
+ */
+static _Bool daliReadGroups(sDaliCtx_t *psCtx, uint8_t addr, sUserConfig_t *psUserConfig);
+
 
 _Bool identifyDaliDriver(sDaliDriverData_t *psDaliDriverData)
 {
@@ -90,75 +114,145 @@ _Bool identifyDaliDriver(sDaliDriverData_t *psDaliDriverData)
   }
   return false;
  }
+
+
+static _Bool daliReadRandomAddr(sDaliCtx_t *psCtx, sStaticData_t *psStaticData)
+{
+  static const eDaliStandardCommands_t aeQuery[] = {evQueryRandomAddrH, evQueryRandomAddrM, evQueryRandomAddrL};
+  uint8_t         reply = 0;
+  eRXDataStatus_t eRXDataStatus;
+  if(0 != psCtx->state)
+  {//reply to the previous query
+    eRXDataStatus = getDaliBackFrame(&reply);
+    if(evValidDataFound != eRXDataStatus)
+    {//not answered, or several gear share the short address
+      memset(psStaticData->aRandomAddr, 0xff, sizeof(psStaticData->aRandomAddr));
+      psCtx->state = 0;
+      return true;
+    }
+    psStaticData->aRandomAddr[psCtx->state - 1] = reply;
+  }
+  if(psCtx->state < sizeof(aeQuery)/sizeof(aeQuery[0]))
+  {
+    sendStandardCmdWithReply(psStaticData->addr, evShortAddress, aeQuery[psCtx->state]);
+    psCtx->state++;
+    return false;
+  }
+  psCtx->state = 0;
+  return true;
+}
   
-_Bool identifyDaliDrivers(saDaliNetworkData_t *psaDaliNetworkData)
+static _Bool daliReadGroups(sDaliCtx_t *psCtx, uint8_t addr, sUserConfig_t *psUserConfig)
 {
-  static uint8_t ctrlGearIndex     = 0;
-  static uint8_t identifyState     = 0;
-
-  switch(identifyState)
+  static const eDaliStandardCommands_t aeQuery[] = {evQueryGroups0To7, evQueryGroups8To15};
+  uint8_t         reply = 0;
+  eRXDataStatus_t eRXDataStatus;
+  if(0 == psCtx->state)
+  {
+    psUserConfig->gearGroups  = 0;
+    psUserConfig->bGroupsRead = false;
+  }
+  else
+  {//reply to the previous query
+    eRXDataStatus = getDaliBackFrame(&reply);
+    if(evValidDataFound != eRXDataStatus)
+    {//unknown, no DAPC is folded into a group DAPC while it is
+      psCtx->state = 0;
+      return true;
+    }
+    psUserConfig->gearGroups |= (uint16_t)reply << (8 * (psCtx->state - 1));
+  }
+  if(psCtx->state < sizeof(aeQuery)/sizeof(aeQuery[0]))
+  {
+    sendStandardCmdWithReply(addr, evShortAddress, aeQuery[psCtx->state]);
+    psCtx->state++;
+    return false;
+  }
+  psUserConfig->bGroupsRead = true;
+  psCtx->state = 0;
+  return true;
+}
+  
+_Bool identifyDaliDrivers(sDaliIdentifyCtx_t *psCtx, saDaliNetworkData_t *psaDaliNetworkData)
+{
+  switch(psCtx->sCtx.state)
   {
     case 0:
-      while(ctrlGearIndex < psaDaliNetworkData->numDrivers)
+      while(psCtx->gearIndex < psaDaliNetworkData->numDrivers)
       {
-        if(ctrlGearIndex >= MAX_SUPPORTED_DRIVERS)
+        if(psCtx->gearIndex >= MAX_SUPPORTED_DRIVERS)
         {
           //TODO: Add some notification of more than MAX_SUPPORTED_DRIVERS on bus
-          ctrlGearIndex = 0;
+          psCtx->gearIndex = 0;
           return true;
         }
-        psaDaliNetworkData->uData[ctrlGearIndex].sData.sStaticData.addr = ctrlGearIndex;
-
-        ctrlGearIndex++;
+        psCtx->gearIndex++;//addressing set each driver's short address
       }
-      ctrlGearIndex = 0;
-      identifyState = 1;
+      psCtx->gearIndex  = 0;
+      psCtx->sCtx.state = 1;
+      //fall through
     case 1:
-      if(true == identifyDaliDriver(&psaDaliNetworkData->uData[ctrlGearIndex].sData))
+      if(false == identifyDaliDriver(&psaDaliNetworkData->uData[psCtx->gearIndex].sData))
+      {
+        break;
+      }
+      psCtx->sCtx.state = 4;
+      //fall through
+    case 4://random address, lets a later addressing restore skip the search
+      if(false == daliReadRandomAddr(&psCtx->sRandom, &psaDaliNetworkData->uData[psCtx->gearIndex].sData.sStaticData))
+      {
+        break;
+      }
+      psCtx->sCtx.state = 5;
+      //fall through
+    case 5://groups, for group DAPCs
+      if(true == daliReadGroups(&psCtx->sGroups, psaDaliNetworkData->uData[psCtx->gearIndex].sData.sStaticData.addr,
+                                &psaDaliNetworkData->uData[psCtx->gearIndex].sData.sUserConfig))
       {
-        if(psaDaliNetworkData->uData[ctrlGearIndex].sData.sStaticData.eDaliType == evD4i)
+        if(psaDaliNetworkData->uData[psCtx->gearIndex].sData.sStaticData.eDaliType == evD4i)
         {
-          identifyState = 2;//Get D4i reporting units, could vary by model
+          psCtx->sCtx.state = 2;//Get D4i reporting units, could vary by model
           break;
         }
-        else if(psaDaliNetworkData->uData[ctrlGearIndex].sData.sStaticData.eDaliType == evSR)
+        else if(psaDaliNetworkData->uData[psCtx->gearIndex].sData.sStaticData.eDaliType == evSR)
         {
-          identifyState = 3;//Get SR reporting units, could vary by model
+          psCtx->sCtx.state = 3;//Get SR reporting units, could vary by model
           break;
         }
-        ctrlGearIndex++;
-        if(ctrlGearIndex >= psaDaliNetworkData->numDrivers)
+        psCtx->gearIndex++;
+        psCtx->sCtx.state = 1;
+        if(psCtx->gearIndex >= psaDaliNetworkData->numDrivers)
         {
-          identifyState = 0;
-          ctrlGearIndex = 0;
+          psCtx->sCtx.state = 0;
+          psCtx->gearIndex  = 0;
           return true;
         }
       }
     break;
     case 2://get reporting units for D4i.  
-    if(true == getD4iUnits(&psaDaliNetworkData->uData[ctrlGearIndex].sData))
+    if(true == getD4iUnits(&psCtx->sUnits, &psaDaliNetworkData->uData[psCtx->gearIndex].sData))
     {
-      ctrlGearIndex++;
-      if(ctrlGearIndex >= psaDaliNetworkData->numDrivers)
+      psCtx->gearIndex++;
+      if(psCtx->gearIndex >= psaDaliNetworkData->numDrivers)
       {
-        identifyState = 0;
-        ctrlGearIndex = 0;
+        psCtx->sCtx.state = 0;
+        psCtx->gearIndex  = 0;
         return true;
       }
-      identifyState = 1;
+      psCtx->sCtx.state = 1;
     }
     break;
     case 3://get reporting units for SR.
-    if(true == getSRUnits(&psaDaliNetworkData->uData[ctrlGearIndex].sData))
+    if(true == getSRUnits(&psaDaliNetworkData->uData[psCtx->gearIndex].sData))
     {
-      ctrlGearIndex++;
-      if(ctrlGearIndex >= psaDaliNetworkData->numDrivers)
+      psCtx->gearIndex++;
+      if(psCtx->gearIndex >= psaDaliNetworkData->numDrivers)
       {
-        identifyState = 0;
-        ctrlGearIndex = 0;
+        psCtx->sCtx.state = 0;
+        psCtx->gearIndex  = 0;
         return true;
       }
-      identifyState = 1;
+      psCtx->sCtx.state = 1;
     }
     default:
     break;
@@ -167,6 +261,13 @@ _Bool identifyDaliDrivers(saDaliNetworkData_t *psaDaliNetworkData)
 }
 
 
+void identifyDaliDriversReset(sDaliIdentifyCtx_t *psCtx)
+{
+  memset(psCtx,0,sizeof(sDaliIdentifyCtx_t));
+  daliMemoryBankReset();
+}
+
+
 void verifyModelByGTIN(sDaliDriverData_t *sStaticData)
 {
   if(0 == memcmp(sStaticData->sMemBnk0.gtin,&uGTIN.sGtinTable.sDexal.OTi30DX,sizeof(sGTIN_t)))
@@ -11,10 +11,33 @@
 #pragma once
 #include <stdbool.h>
 #include "dali_staticData.h"
+#include "dali_ctx.h"
+
+/**
+ * @brief Progress of identifyDaliDrivers
+ */
+typedef struct
+{
+  sDaliCtx_t sCtx     ;
+  uint8_t    gearIndex;/*!<Entry of saDaliNetworkData being identified*/
+  sDaliCtx_t sUnits   ;/*!<getD4iUnits*/
+  sDaliCtx_t sRandom  ;/*!<Random address read*/
+  sDaliCtx_t sGroups  ;/*!<Group membership read*/
+}sDaliIdentifyCtx_t;
 
 /**
  * @brief id DALI driver type by GTIN, get wattage rating and reporting units
  * 
+ * @param psCtx progress, start from identifyDaliDriversReset
  * @return _Bool 
  */
-_Bool identifyDaliDrivers(saDaliNetworkData_t *);
\ No newline at end of file
+_Bool identifyDaliDrivers     (sDaliIdentifyCtx_t  *,
+                               saDaliNetworkData_t *);
+
+/**
+ * @brief Abandon identification part way, or set up for the first run, along with the memory bank
+ * read it had in progress. Clears the timeout and cancel of psCtx->sCtx too
+ * 
+ * @param psCtx progress
+ */
+void  identifyDaliDriversReset(sDaliIdentifyCtx_t  *psCtx);
\ No newline at end of file
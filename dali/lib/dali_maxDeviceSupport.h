@@ -1,2 +1,4 @@
 //Will not attempt to address more drivers than the number below.
-#define MAX_SUPPORTED_DRIVERS 4
\ No newline at end of file
+#ifndef MAX_SUPPORTED_DRIVERS
+#define MAX_SUPPORTED_DRIVERS 4
+#endif
@@ -2,37 +2,38 @@
 //These are not meant to be used with a dali task manager, as checking transmit status is
 //handled within
 #include <stdbool.h>
+#include <string.h>
 #include "dali_sequences.h"
 #include "dali_commands.h"
 #include "dali_driver.h"
 #include "dali_frames.h"
+#include "dali_MemoryBank.h"
 
 uint8_t response = 0;
 eRXDataStatus_t eRXDataStatus_l = evNoDataFound;
 
 
-_Bool daliAssignAddress(uint8_t addr)
+_Bool daliAssignAddress(sDaliCtx_t *psCtx, uint8_t addr)
 {
-  static uint8_t state = 0;
-  switch(state)
+  switch(psCtx->state)
   {
   case 0://set dtr0 to new address
     sendSpecialCmdNoReply(addr, evSetDTR0);
 //    transmitForwardFrame();
-    state = 1;
+    psCtx->state = 1;
   break;
   case 1://send set short address command
    if(true == getDaliTransferStatus())
    {
     sendStandardCmdTwice(0xff,evBroadcastAll,evSetShortAddressToDTR0);
 //    transmitForwardFrame();
-    state =2;
+    psCtx->state = 2;
    }
   break;
   case 2:
   if(true == getDaliTransferStatus())
   {
-    state = 0;
+    psCtx->state = 0;
     return true;
   }
   break;
@@ -40,28 +41,26 @@ _Bool daliAssignAddress(uint8_t addr)
   return false;
 }
 
-_Bool daliSingleAddressSequence(uint8_t addr)
+_Bool daliSingleAddressSequence(sDaliSingleAddrCtx_t *psCtx, uint8_t addr)
 {
-  static uint8_t state = 0;
-
-  switch(state)
+  switch(psCtx->sCtx.state)
   {
   case 0://query control gear present
-  if(true == daliPollForControlGear())
+  if(true == daliPollForControlGear(&psCtx->sPoll))
   {
-    state = 1;
+    psCtx->sCtx.state = 1;
   }
   break;
   case 1://clear address
-  if(true == daliAssignAddress(0xff))
+  if(true == daliAssignAddress(&psCtx->sAssign, 0xff))
   {
-    state = 2;
+    psCtx->sCtx.state = 2;
   }
   break;
   case 2://Assign new address
-  if(true == daliAssignAddress((addr<<1)+1))
+  if(true == daliAssignAddress(&psCtx->sAssign, (addr<<1)+1))
   {
-    state = 0;
+    psCtx->sCtx.state = 0;
     return true;
   }
   break;
@@ -86,47 +85,46 @@ _Bool daliTuneULTDriver(uint8_t addr, uint8_t  tuneVal)
   return bDone;
 }
 
-_Bool daliJCPHCommission(uint8_t addr, uint8_t tuneVal)
+_Bool daliJCPHCommission(sDaliCommissionCtx_t *psCtx, uint8_t addr, uint8_t tuneVal)
 {
-  static uint8_t state = 0;
-  switch(state)
+  switch(psCtx->sCtx.state)
   {
     case 0://driver found
-      if(true == daliPollForControlGear())
+      if(true == daliPollForControlGear(&psCtx->sPoll))
       {
-        state = 1;
+        psCtx->sCtx.state = 1;
       }
     break;
     case 2://Dim down for visual confirmation
     if(true == getDaliTransferStatus())
     {
       sendCmdDapc(addr,evShortAddress, 10);
-      state = 3;
+      psCtx->sCtx.state = 3;
     }
     break;
     case 1://Adress it
-      if(true == daliSingleAddressSequence(addr))
+      if(true == daliSingleAddressSequence(&psCtx->sSingleAddr, addr))
       {
-        state = 2;
+        psCtx->sCtx.state = 2;
       }
     break;
     case 3://Tune it
       if(true == daliTuneULTDriver(addr,tuneVal))
       {
-        state = 4;
+        psCtx->sCtx.state = 4;
       }
     break;
     case 4://Dim up using address for visual confirmation of assigned address and programmed tune value
     if(true == getDaliTransferStatus())
     {
       sendCmdDapc(addr,evShortAddress, 254);
-      state = 5;
+      psCtx->sCtx.state = 5;
     }
     break;
     case 5://wait for DAPC to be done
     if(true == getDaliTransferStatus())
     {
-      state = 0;
+      psCtx->sCtx.state = 0;
       return true;
     }
     break;
@@ -134,19 +132,18 @@ _Bool daliJCPHCommission(uint8_t addr, uint8_t tuneVal)
   return false;
 }
 
-_Bool daliPollForControlGear(void)
+_Bool daliPollForControlGear(sDaliCtx_t *psCtx)
 {
   eRXDataStatus_t eRXDataStatus_l;
-  static uint8_t state = 0;
   uint8_t pollResponse = 5;
-  switch(state)
+  switch(psCtx->state)
   {
     case 0:
       sendStandardCmdWithReply(0,evBroadcastAll, evQueryControlGearPresent);
-      state = 1;
+      psCtx->state = 1;
     break;
     case 1:
-      state = 0;
+      psCtx->state = 0;
       eRXDataStatus_l = getDaliBackFrame(&pollResponse);
       if(eRXDataStatus_l == evValidDataFound)
       { 
@@ -160,3 +157,9 @@ _Bool daliPollForControlGear(void)
     return false;
 }
 
+
+void daliJCPHCommissionReset(sDaliCommissionCtx_t *psCtx)
+{
+  memset(psCtx,0,sizeof(sDaliCommissionCtx_t));
+  daliMemoryBankReset();
+}
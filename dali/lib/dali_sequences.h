@@ -1,7 +1,26 @@
+#pragma once
 #include <stdint.h>
+#include "dali_ctx.h"
 
-_Bool daliAssignAddress(uint8_t addr);
-_Bool daliSingleAddressSequence(uint8_t addr);
+/*! Progress of daliSingleAddressSequence*/
+typedef struct
+{
+  sDaliCtx_t sCtx   ;
+  sDaliCtx_t sPoll  ;/*!<daliPollForControlGear*/
+  sDaliCtx_t sAssign;/*!<daliAssignAddress*/
+}sDaliSingleAddrCtx_t;
+
+/*! Progress of daliJCPHCommission*/
+typedef struct
+{
+  sDaliCtx_t           sCtx       ;
+  sDaliCtx_t           sPoll      ;/*!<daliPollForControlGear*/
+  sDaliSingleAddrCtx_t sSingleAddr;/*!<daliSingleAddressSequence*/
+}sDaliCommissionCtx_t;
+
+_Bool daliAssignAddress(sDaliCtx_t *psCtx, uint8_t addr);
+_Bool daliSingleAddressSequence(sDaliSingleAddrCtx_t *psCtx, uint8_t addr);
 _Bool daliTuneULTDriver(uint8_t addr, uint8_t tuneVal);
-_Bool daliJCPHCommission(uint8_t addr, uint8_t tuneVal);
-_Bool daliPollForControlGear(void);
\ No newline at end of file
+_Bool daliJCPHCommission(sDaliCommissionCtx_t *psCtx, uint8_t addr, uint8_t tuneVal);
+_Bool daliPollForControlGear(sDaliCtx_t *psCtx);
+void  daliJCPHCommissionReset(sDaliCommissionCtx_t *psCtx);/*!<Abandon commissioning part way, with the memory bank write it had in progress*/
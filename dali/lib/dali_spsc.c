@@ -0,0 +1,58 @@
+/**
+ * @file dali_spsc.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Lock free single producer, single consumer ring
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <string.h>
+#include "dali_spsc.h"
+
+/*The element is copied before head moves (release) and only read after head is seen (acquire),
+  likewise the slot is only reused once tail has moved past it. Indices run freely and wrap by mask*/
+
+void daliSpscInit(sDaliSpsc_t *psRing, void *pStorage, uint16_t elemSize, uint16_t numElems)
+{
+  psRing->pStorage = (uint8_t *)pStorage;
+  psRing->elemSize = elemSize;
+  psRing->numElems = numElems;
+  __atomic_store_n(&psRing->head, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&psRing->tail, 0, __ATOMIC_RELEASE);
+}
+
+
+_Bool daliSpscPush(sDaliSpsc_t *psRing, const void *pElem)
+{
+  uint32_t head = __atomic_load_n(&psRing->head, __ATOMIC_RELAXED);
+  uint32_t tail = __atomic_load_n(&psRing->tail, __ATOMIC_ACQUIRE);
+  if((head - tail) >= psRing->numElems)
+  {
+    return false;
+  }
+  memcpy(&psRing->pStorage[(head & (psRing->numElems - 1)) * psRing->elemSize], pElem, psRing->elemSize);
+  __atomic_store_n(&psRing->head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+
+_Bool daliSpscPop(sDaliSpsc_t *psRing, void *pElem)
+{
+  uint32_t tail = __atomic_load_n(&psRing->tail, __ATOMIC_RELAXED);
+  uint32_t head = __atomic_load_n(&psRing->head, __ATOMIC_ACQUIRE);
+  if(head == tail)
+  {
+    return false;
+  }
+  memcpy(pElem, &psRing->pStorage[(tail & (psRing->numElems - 1)) * psRing->elemSize], psRing->elemSize);
+  __atomic_store_n(&psRing->tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+
+uint16_t daliSpscCount(sDaliSpsc_t *psRing)
+{
+  return (uint16_t)(__atomic_load_n(&psRing->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&psRing->tail, __ATOMIC_ACQUIRE));
+}
@@ -0,0 +1,61 @@
+/**
+ * @file dali_spsc.h
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Lock free single producer, single consumer ring of fixed size elements. Producer and
+ * consumer may be different interrupt levels or different cores; only acquire/release loads and
+ * stores are used, so it runs on the Cortex-M0+ which has no exclusive access instructions
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Ring state, storage is supplied by the owner
+ */
+typedef struct
+{
+  uint8_t  *pStorage;/*!< numElems * elemSize bytes*/
+  uint16_t  elemSize;
+  uint16_t  numElems;/*!< Power of 2*/
+  uint32_t  head    ;/*!< Written by the producer only*/
+  uint32_t  tail    ;/*!< Written by the consumer only*/
+}sDaliSpsc_t;
+
+
+/**
+ * @brief Set up an empty ring. Call before either side uses it
+ * @param psRing ring
+ * @param pStorage numElems * elemSize bytes
+ * @param elemSize bytes per element
+ * @param numElems elements, power of 2
+ */
+void     daliSpscInit (sDaliSpsc_t *psRing, void *pStorage, uint16_t elemSize, uint16_t numElems);
+
+/**
+ * @brief Copy an element in, producer side only
+ * @param psRing ring
+ * @param pElem elemSize bytes
+ * @return _Bool false if the ring is full
+ */
+_Bool    daliSpscPush (sDaliSpsc_t *psRing, const void *pElem);
+
+/**
+ * @brief Copy the oldest element out, consumer side only
+ * @param psRing ring
+ * @param pElem elemSize bytes are written here
+ * @return _Bool false if the ring is empty
+ */
+_Bool    daliSpscPop  (sDaliSpsc_t *psRing, void *pElem);
+
+/**
+ * @brief Elements waiting, exact on either side, a snapshot from anywhere else
+ * @param psRing ring
+ * @return uint16_t
+ */
+uint16_t daliSpscCount(sDaliSpsc_t *psRing);
@@ -14,6 +14,7 @@
 
 #define SIZE_GTIN             6
 #define SIZE_IDNUM            8
+#define RANDOM_ADDR_UNKNOWN   0xffffff/**< aRandomAddr of a driver not read yet, gear never draw it*/
 
 //#define MAX_SUPPORTED_DRIVERS 4
 
@@ -80,6 +81,7 @@ typedef struct
 {
   eDaliType_t    eDaliType        ;
   uint8_t        addr             ;
+  uint8_t        aRandomAddr[3]   ;/*!<Random address H, M, L as read at identification, 0xffffff if not known*/
   uint32_t       ratedWattage     ;
   float          fPowerUnit       ;
   float          fEnergyUnit      ;
@@ -93,7 +95,8 @@ typedef struct
  */
 typedef struct
 {
-
+  uint16_t       gearGroups       ;/*!<Bit per group 0-15 the driver is a member of, as read by identification*/
+  _Bool          bGroupsRead      ;/*!<gearGroups was read from the gear since it got its short address, else unknown*/
 }sUserConfig_t;
 
 
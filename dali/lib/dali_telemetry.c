@@ -0,0 +1,388 @@
+/**
+ * @file dali_telemetry.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Background poller of power, energy, LED load and gear temperature of every identified driver
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <string.h>
+#include <math.h>
+#ifdef NRF
+#include <zephyr.h>
+#elif defined(DALI_HOST)
+#include "dali_bus.h"
+#else
+#include "pico/stdlib.h"
+#endif
+#include "dali_telemetry.h"
+
+#define TELEM_NOREPLY_US 30833/*!< Send once frame and inter-frame idle, 74 TE*/
+#define TELEM_READ_US(bytes) (2 * TELEM_NOREPLY_US + (bytes) * DALI_FRAME_US)/*!< DTR1, DTR0, then a query per byte*/
+
+/**
+ * @brief Poll state of one metric of one driver
+ */
+typedef struct
+{
+  sDaliTelemSample_t sSample  ;/*!< ageUs and bStale are filled in by daliTelemetryGet*/
+  uint64_t           dueUs    ;
+  _Bool              bRead    ;/*!< sSample holds a reading*/
+  _Bool              bInFlight;
+}sDaliTelemState_t;
+
+/**
+ * @brief Read queued on the task layer, its handle must stay put until the status is final
+ */
+typedef struct
+{
+  sDaliTaskHandle_t sHandle;
+  uint8_t           driver ;
+  uint8_t           eMetric;
+  uint8_t           gen    ;/*!< telemGen when queued, results of an older generation are dropped*/
+  _Bool             bBusy  ;
+}sDaliTelemReq_t;
+
+static sDaliTelemState_t     saTelem[MAX_SUPPORTED_DRIVERS][evDaliTelemNumMetrics];
+static sDaliTelemReq_t       saTelemReq[DALI_TELEMETRY_MAX_INFLIGHT];
+static sDaliTelemetryStats_t sTelemStats;
+static uint16_t              budgetPermille = DALI_TELEMETRY_BUDGET_PERMILLE;
+static int64_t               creditUs       = 0;    /*!< Bus time the poller may still spend, negative while paying off the last read*/
+static uint64_t              lastPollUs     = 0;
+static uint8_t               telemGen       = 0;
+static _Bool                 bTelemInit     = false;
+static uint8_t               telemDrivers   = 0;    /*!< numDrivers and checksum the states were set up for*/
+static uint8_t               telemChecksum  = 0;
+
+static const eDaliTaskType_t aeTelemTask[evDaliTelemNumMetrics] =
+{
+  [evDaliTelemPwr ] = evDaliGetPwr              ,
+  [evDaliTelemNrg ] = evDaliGetTotNrg           ,
+  [evDaliTelemIout] = evDaliGetOutputCurrent    ,
+  [evDaliTelemVout] = evDaliGetOutputVoltage    ,
+  [evDaliTelemTemp] = evDaliGetDriverTemperature,
+};
+
+static const uint32_t aTelemCostUs[evDaliTelemNumMetrics] =
+{//D4i memory bank reads, the other flavours are in the same range
+  [evDaliTelemPwr ] = TELEM_READ_US(4),
+  [evDaliTelemNrg ] = TELEM_READ_US(6),
+  [evDaliTelemIout] = TELEM_READ_US(2),
+  [evDaliTelemVout] = TELEM_READ_US(2),
+  [evDaliTelemTemp] = TELEM_READ_US(1),
+};
+
+/**
+ * @brief The driver's flavour reports the metric
+ * @param psData driver
+ * @param eMetric metric
+ * @return _Bool
+ */
+static _Bool daliTelemSupported(const sDaliDriverData_t *psData, eDaliTelemMetric_t eMetric)
+{
+  switch(psData->sStaticData.eDaliType)
+  {
+    case evD4i:
+      return true;
+    case evDexal:
+    case evSR:
+      return (  (evDaliTelemPwr == eMetric)
+              ||(evDaliTelemNrg == eMetric));
+    case evDali:
+    default:
+    break;
+  }
+  return false;
+}
+
+/**
+ * @brief Reading of a finished task as a float, for change detection
+ * @param psTask result of the task
+ * @param eMetric metric it read
+ * @param psSample the reading is also stored here
+ * @return float
+ */
+static float daliTelemTakeValue(const sDaliTask_t *psTask, eDaliTelemMetric_t eMetric, sDaliTelemSample_t *psSample)
+{
+  switch(eMetric)
+  {
+    case evDaliTelemPwr:
+      psSample->uValue.fPwr = psTask->uTask.sGetPwr.pfPwr;
+      return psSample->uValue.fPwr;
+    case evDaliTelemNrg:
+      psSample->uValue.nrg = psTask->uTask.sGetNrg.pNrg;
+      return (float)psSample->uValue.nrg;
+    case evDaliTelemIout:
+      psSample->uValue.amps = psTask->uTask.sGetIout.pAmps;
+      return psSample->uValue.amps;
+    case evDaliTelemVout:
+      psSample->uValue.volts = psTask->uTask.sGetVout.pVolts;
+      return psSample->uValue.volts;
+    case evDaliTelemTemp:
+    default:
+      psSample->uValue.temp = psTask->uTask.sGetGearTemp.temp;
+      return psSample->uValue.temp;
+  }
+}
+
+/**
+ * @brief Previous reading as a float
+ */
+static float daliTelemOldValue(const sDaliTelemSample_t *psSample, eDaliTelemMetric_t eMetric)
+{
+  switch(eMetric)
+  {
+    case evDaliTelemPwr:
+      return psSample->uValue.fPwr;
+    case evDaliTelemNrg:
+      return (float)psSample->uValue.nrg;
+    case evDaliTelemIout:
+      return psSample->uValue.amps;
+    case evDaliTelemVout:
+      return psSample->uValue.volts;
+    case evDaliTelemTemp:
+    default:
+      return psSample->uValue.temp;
+  }
+}
+
+/**
+ * @brief Take a finished read and set the metric's next poll. A moving value halves its period, a
+ * flat one doubles it; moving power also pulls the driver's LED current and voltage forward
+ * @param psReq finished read
+ * @param now clock
+ */
+static void daliTelemComplete(sDaliTelemReq_t *psReq, uint64_t now)
+{
+  sDaliTelemState_t *psState = &saTelem[psReq->driver][psReq->eMetric];
+  eDaliTelemMetric_t eMetric = (eDaliTelemMetric_t)psReq->eMetric;
+  float              fOld    = daliTelemOldValue(&psState->sSample, eMetric);
+  float              fNew;
+  _Bool              bMoved;
+  psState->bInFlight = false;
+  if(evDaliTaskComplete != getDaliTaskHandleStatus(&psReq->sHandle))
+  {//try again at the fast rate
+    sTelemStats.failed[eMetric]++;
+    psState->dueUs = now + DALI_TELEMETRY_MIN_PERIOD_US;
+    return;
+  }
+  fNew   = daliTelemTakeValue(&psReq->sHandle.sResult, eMetric, &psState->sSample);
+  bMoved = (  (true == psState->bRead)
+            &&((fabsf(fNew - fOld) * 1000.0f) > (fabsf(fOld) * DALI_TELEMETRY_CHANGE_PERMILLE)));
+  sTelemStats.reads[eMetric]++;
+  psState->bRead            = true;
+  psState->sSample.sampleUs = now;
+  if(evDaliTelemNrg == eMetric)
+  {//counter, nothing is lost reading it slowly
+    psState->sSample.periodUs = DALI_TELEMETRY_MAX_PERIOD_US;
+  }
+  else if(true == bMoved)
+  {
+    sTelemStats.changes[eMetric]++;
+    psState->sSample.periodUs /= 2;
+    if(psState->sSample.periodUs < DALI_TELEMETRY_MIN_PERIOD_US)
+    {
+      psState->sSample.periodUs = DALI_TELEMETRY_MIN_PERIOD_US;
+    }
+    if(evDaliTelemPwr == eMetric)
+    {
+      sDaliTelemState_t *psIout = &saTelem[psReq->driver][evDaliTelemIout];
+      sDaliTelemState_t *psVout = &saTelem[psReq->driver][evDaliTelemVout];
+      psIout->sSample.periodUs = DALI_TELEMETRY_MIN_PERIOD_US;
+      psVout->sSample.periodUs = DALI_TELEMETRY_MIN_PERIOD_US;
+      psIout->dueUs            = (psIout->dueUs > now) ? now : psIout->dueUs;
+      psVout->dueUs            = (psVout->dueUs > now) ? now : psVout->dueUs;
+    }
+  }
+  else if(psState->sSample.periodUs < (DALI_TELEMETRY_MAX_PERIOD_US / 2))
+  {
+    psState->sSample.periodUs *= 2;
+  }
+  else
+  {
+    psState->sSample.periodUs = DALI_TELEMETRY_MAX_PERIOD_US;
+  }
+  psState->dueUs = now + psState->sSample.periodUs;
+}
+
+
+void daliTelemetryInit(void)
+{
+  const saDaliNetworkData_t *psNet = (const saDaliNetworkData_t *)getAddressOfDaliData();
+  uint64_t                   now   = daliTelemetryNowUs();
+  uint8_t                    driver;
+  uint8_t                    eMetric;
+  memset(saTelem,0,sizeof(saTelem));
+  for(driver = 0; driver < MAX_SUPPORTED_DRIVERS; driver++)
+  {
+    for(eMetric = 0; eMetric < evDaliTelemNumMetrics; eMetric++)
+    {
+      saTelem[driver][eMetric].sSample.periodUs = (evDaliTelemNrg == eMetric) ? DALI_TELEMETRY_MAX_PERIOD_US : DALI_TELEMETRY_MIN_PERIOD_US;
+      saTelem[driver][eMetric].dueUs            = now;
+    }
+  }
+  telemGen++;//reads still queued belong to the old driver list
+  telemDrivers  = psNet->numDrivers;
+  telemChecksum = psNet->checksum;
+  lastPollUs    = now;
+  creditUs      = 0;
+  bTelemInit    = true;
+}
+
+
+void daliTelemetrySetBudget(uint16_t permille)
+{
+  budgetPermille = (0 == permille) ? 1 : ((permille > 1000) ? 1000 : permille);
+}
+
+
+void daliTelemetryPoll(void)
+{
+  const saDaliNetworkData_t *psNet = (const saDaliNetworkData_t *)getAddressOfDaliData();
+  sDaliTelemState_t         *psState;
+  sDaliTelemState_t         *psNext;
+  sDaliTelemReq_t           *psReq;
+  sDaliTask_t                sTask;
+  uint64_t                   now;
+  uint8_t                    numDrivers;
+  uint8_t                    driver;
+  uint8_t                    eMetric;
+  uint8_t                    nextDriver = 0;
+  uint8_t                    nextMetric = 0;
+  uint8_t                    i;
+  if(  (false         == bTelemInit         )
+     ||(telemDrivers  != psNet->numDrivers  )
+     ||(telemChecksum != psNet->checksum    ))
+  {//first call, or addressing/identification changed the driver list
+    daliTelemetryInit();
+  }
+  now         = daliTelemetryNowUs();
+  creditUs   += (int64_t)(((now - lastPollUs) * budgetPermille) / 1000);
+  lastPollUs  = now;
+  if(creditUs > (int64_t)aTelemCostUs[evDaliTelemNrg])
+  {//no saving up for a burst
+    creditUs = aTelemCostUs[evDaliTelemNrg];
+  }
+  for(i = 0; i < DALI_TELEMETRY_MAX_INFLIGHT; i++)
+  {
+    psReq = &saTelemReq[i];
+    if(  (true              == psReq->bBusy                             )
+       &&(evDaliTaskRunning != getDaliTaskHandleStatus(&psReq->sHandle)))
+    {
+      psReq->bBusy = false;
+      if(telemGen == psReq->gen)
+      {
+        daliTelemComplete(psReq, now);
+      }
+    }
+  }
+  numDrivers = (psNet->numDrivers > MAX_SUPPORTED_DRIVERS) ? MAX_SUPPORTED_DRIVERS : psNet->numDrivers;
+  for(i = 0; i < DALI_TELEMETRY_MAX_INFLIGHT; i++)
+  {
+    psReq = &saTelemReq[i];
+    if(true == psReq->bBusy)
+    {
+      continue;
+    }
+    psNext = NULL;
+    for(driver = 0; driver < numDrivers; driver++)
+    {//most overdue first
+      for(eMetric = 0; eMetric < evDaliTelemNumMetrics; eMetric++)
+      {
+        psState = &saTelem[driver][eMetric];
+        if(  (false == psState->bInFlight                                                     )
+           &&(now   >= psState->dueUs                                                         )
+           &&(true  == daliTelemSupported(&psNet->uData[driver].sData, (eDaliTelemMetric_t)eMetric))
+           &&(  (NULL          == psNext       )
+              ||(psState->dueUs <  psNext->dueUs)))
+        {
+          psNext     = psState;
+          nextDriver = driver;
+          nextMetric = eMetric;
+        }
+      }
+    }
+    if(NULL == psNext)
+    {
+      return;
+    }
+    if(creditUs < 0)
+    {
+      sTelemStats.budgetWaits++;
+      return;
+    }
+    memset(&sTask,0,sizeof(sTask));
+    sTask.eDaliTask = aeTelemTask[nextMetric];
+    switch(nextMetric)
+    {
+      case evDaliTelemPwr:
+        sTask.uTask.sGetPwr.addr = nextDriver;
+      break;
+      case evDaliTelemNrg:
+        sTask.uTask.sGetNrg.addr = nextDriver;
+      break;
+      case evDaliTelemIout:
+        sTask.uTask.sGetIout.addr = nextDriver;
+      break;
+      case evDaliTelemVout:
+        sTask.uTask.sGetVout.addr = nextDriver;
+      break;
+      default:
+        sTask.uTask.sGetGearTemp.addr = nextDriver;
+      break;
+    }
+    if(false == setDaliTaskHandle(&sTask, evDaliPrioTelemetry, &psReq->sHandle))
+    {//FIFO is full, come back at the fast rate
+      sTelemStats.failed[nextMetric]++;
+      psNext->dueUs = now + DALI_TELEMETRY_MIN_PERIOD_US;
+      return;
+    }
+    psReq->driver       = nextDriver;
+    psReq->eMetric      = nextMetric;
+    psReq->gen          = telemGen;
+    psReq->bBusy        = true;
+    psNext->bInFlight   = true;
+    creditUs           -= aTelemCostUs[nextMetric];
+    sTelemStats.busUs  += aTelemCostUs[nextMetric];
+  }
+}
+
+
+_Bool daliTelemetryGet(uint8_t driver, eDaliTelemMetric_t eMetric, sDaliTelemSample_t *psSample)
+{
+  const sDaliTelemState_t *psState;
+  if(  (driver  >= MAX_SUPPORTED_DRIVERS)
+     ||(eMetric >= evDaliTelemNumMetrics))
+  {
+    return false;
+  }
+  psState = &saTelem[driver][eMetric];
+  if(false == psState->bRead)
+  {
+    return false;
+  }
+  *psSample        = psState->sSample;
+  psSample->ageUs  = daliTelemetryNowUs() - psState->sSample.sampleUs;
+  psSample->bStale = (psSample->ageUs > (2ull * psState->sSample.periodUs));
+  return true;
+}
+
+
+uint64_t daliTelemetryNowUs(void)
+{
+#ifdef NRF
+  return k_ticks_to_us_floor64(k_uptime_ticks());
+#elif defined(DALI_HOST)
+  return daliHostNowUs();
+#else
+  return time_us_64();
+#endif
+}
+
+
+const sDaliTelemetryStats_t *getDaliTelemetryStats(void)
+{
+  return &sTelemStats;
+}
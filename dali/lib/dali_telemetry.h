@@ -0,0 +1,116 @@
+/**
+ * @file dali_telemetry.h
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Background poller of power, energy, LED load and gear temperature of every identified driver.
+ * Each metric of each driver has its own poll period, shortened while the value moves and stretched
+ * while it is flat, and all reads share a bus time budget
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "dali.h"
+
+/*configuration*/
+#ifndef DALI_TELEMETRY_MIN_PERIOD_US
+#define DALI_TELEMETRY_MIN_PERIOD_US     2000000/**< Poll period of a value that keeps moving*/
+#endif
+#ifndef DALI_TELEMETRY_MAX_PERIOD_US
+#define DALI_TELEMETRY_MAX_PERIOD_US    60000000/**< Poll period of a flat value, and of the energy counter*/
+#endif
+#ifndef DALI_TELEMETRY_CHANGE_PERMILLE
+#define DALI_TELEMETRY_CHANGE_PERMILLE        20/**< Change from the previous reading that counts as moving*/
+#endif
+#ifndef DALI_TELEMETRY_BUDGET_PERMILLE
+#define DALI_TELEMETRY_BUDGET_PERMILLE       250/**< Default share of bus time the poller may use*/
+#endif
+#ifndef DALI_TELEMETRY_MAX_INFLIGHT
+#define DALI_TELEMETRY_MAX_INFLIGHT            2/**< Reads queued at once, keeps the telemetry FIFO short*/
+#endif
+
+/*! Enum of polled metrics*/
+typedef enum
+{
+  evDaliTelemPwr  ,/*!<Power, W*/
+  evDaliTelemNrg  ,/*!<Energy counter, raw. Cumulative, always polled at DALI_TELEMETRY_MAX_PERIOD_US*/
+  evDaliTelemIout ,/*!<LED current, raw*/
+  evDaliTelemVout ,/*!<LED voltage, raw*/
+  evDaliTelemTemp ,/*!<Gear temperature, raw*/
+  evDaliTelemNumMetrics
+}eDaliTelemMetric_t;
+
+/**
+ * @brief Latest reading of one metric of one driver
+ */
+typedef struct
+{
+  union
+  {
+    float    fPwr ;
+    uint64_t nrg  ;
+    uint16_t amps ;
+    uint16_t volts;
+    uint16_t temp ;
+  }uValue;
+  uint64_t sampleUs;/*!<When it was read, on the daliTelemetryNowUs clock*/
+  uint64_t ageUs   ;/*!<How long ago that was*/
+  uint32_t periodUs;/*!<Current poll period*/
+  _Bool    bStale  ;/*!<Not refreshed within twice its poll period*/
+}sDaliTelemSample_t;
+
+/**
+ * @brief Poller counters
+ */
+typedef struct
+{
+  uint32_t reads      [evDaliTelemNumMetrics];/*!<Reads completed*/
+  uint32_t failed     [evDaliTelemNumMetrics];/*!<Reads not queued or not answered*/
+  uint32_t changes    [evDaliTelemNumMetrics];/*!<Reads that moved by more than DALI_TELEMETRY_CHANGE_PERMILLE*/
+  uint64_t busUs;                             /*!<Estimated bus time spent on reads*/
+  uint32_t budgetWaits;                       /*!<Polls where a due read waited for budget*/
+}sDaliTelemetryStats_t;
+
+
+/**
+ * @brief Forget all readings and poll every metric of every identified driver from now on. Call
+ * again after addressing or identification changes saDaliNetworkData
+ */
+void  daliTelemetryInit     (void);
+
+/**
+ * @brief Set the share of bus time the poller may use
+ * @param permille 1-1000
+ */
+void  daliTelemetrySetBudget(uint16_t permille);
+
+/**
+ * @brief Collect finished reads and queue the reads that are due, as the budget allows. Call from the
+ * application loop, one context only; the reads run as evDaliPrioTelemetry tasks
+ */
+void  daliTelemetryPoll     (void);
+
+/**
+ * @brief Get the latest reading of a metric
+ * @param driver index into saDaliNetworkData
+ * @param eMetric metric
+ * @param psSample copied here
+ * @return _Bool false if the driver does not report that metric or has not been read yet
+ */
+_Bool daliTelemetryGet      (uint8_t driver, eDaliTelemMetric_t eMetric, sDaliTelemSample_t *psSample);
+
+/**
+ * @brief Clock of sDaliTelemSample_t.sampleUs
+ * @return uint64_t microseconds
+ */
+uint64_t daliTelemetryNowUs (void);
+
+/**
+ * @brief Get the poller counters
+ * @return const sDaliTelemetryStats_t*
+ */
+const sDaliTelemetryStats_t *getDaliTelemetryStats(void);
@@ -0,0 +1,170 @@
+/**
+ * @file dali_trace.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Binary trace rings, one per context so every ring has a single producer
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stddef.h>
+#include "dali_trace.h"
+#ifdef NRF
+#include <zephyr.h>
+#elif !defined(DALI_HOST)
+#include "pico/stdlib.h"
+#include "pico/platform.h"
+#endif
+
+#define TRACE_CTX_THREAD 0
+#define TRACE_CTX_IRQ    1/*!< Interrupts of one priority never nest, so they can share a ring*/
+#define TRACE_NUM_CTX    2
+
+#ifdef NRF
+#define TRACE_PRINT printk
+#else
+#define TRACE_PRINT printf
+#endif
+
+#define TRACE_BARRIER() __asm volatile ("" ::: "memory")/*!< Record is complete before head moves*/
+
+/**
+ * @brief Single producer, single consumer ring
+ */
+typedef struct
+{
+  sDaliTraceRec_t   aRec[DALI_TRACE_RING_LEN];
+  volatile uint32_t head   ;/*!< Written by the producer only*/
+  volatile uint32_t tail   ;/*!< Written by the consumer only*/
+  volatile uint32_t dropped;/*!< Written by the producer only*/
+}sDaliTraceRing_t;
+
+static sDaliTraceRing_t saTraceRing[TRACE_NUM_CTX];
+static uint32_t         aTraceDroppedSeen[TRACE_NUM_CTX];/*!< dropped counts already reported by daliTraceDrain*/
+
+static const char * const apTraceFmt[evTraceNumIds] =
+{
+  [evTraceXferStart    ] = "xfer start kind %u rxLen %lu\n"            ,
+  [evTraceXferDone     ] = "xfer done kind %u queued %lu\n"             ,
+  [evTraceDapc         ] = "DAPC level %u address/type 0x%04lx\n"       ,
+  [evTraceTaskPreempted] = "Task %u interrupted for dimming task\n"     ,//extra args are ignored
+  [evTraceTaskRestored ] = "Task %u restored\n"                         ,
+  [evTraceSeqGaveWay   ] = "Sequence gave way after %u of %lu steps\n"  ,
+  [evTraceDeadlineMissed] = "Task %u started %luus past its deadline\n",
+  [evTraceTaskEnded    ] = "Task %u ended early, status %lu\n"          ,
+  [evTraceAddressed    ] = "Addressing complete, %u drivers\n"         ,
+  [evTraceIdentified   ] = "Identifying complete, %u drivers\n"        ,
+  [evTraceMsmtRead     ] = "Read task/driver 0x%04x raw %lu\n"         ,
+};
+
+/**
+ * @brief Ring of the calling context
+ * @return uint8_t TRACE_CTX_THREAD or TRACE_CTX_IRQ
+ */
+static inline uint8_t daliTraceCtx(void)
+{
+#ifdef NRF
+  return k_is_in_isr() ? TRACE_CTX_IRQ : TRACE_CTX_THREAD;
+#elif defined(DALI_HOST)
+  return TRACE_CTX_THREAD;
+#else
+  return (0 != __get_current_exception()) ? TRACE_CTX_IRQ : TRACE_CTX_THREAD;
+#endif
+}
+
+/**
+ * @brief Microsecond timestamp
+ * @return uint32_t
+ */
+static inline uint32_t daliTraceTime(void)
+{
+#ifdef NRF
+  return k_cyc_to_us_floor32(k_cycle_get_32());
+#elif defined(DALI_HOST)
+  static uint32_t hostTime = 0;
+  return hostTime++;//ordering only
+#else
+  return time_us_32();
+#endif
+}
+
+
+void daliTraceWrite(uint16_t id, uint16_t arg0, uint32_t arg1)
+{
+  sDaliTraceRing_t *psRing = &saTraceRing[daliTraceCtx()];
+  uint32_t          head   = psRing->head;
+  sDaliTraceRec_t  *psRec;
+  if((head - psRing->tail) >= DALI_TRACE_RING_LEN)
+  {
+    psRing->dropped++;
+    return;
+  }
+  psRec            = &psRing->aRec[head & (DALI_TRACE_RING_LEN - 1)];
+  psRec->timestamp = daliTraceTime();
+  psRec->id        = id;
+  psRec->arg0      = arg0;
+  psRec->arg1      = arg1;
+  TRACE_BARRIER();
+  psRing->head     = head + 1;
+}
+
+
+_Bool daliTraceRead(sDaliTraceRec_t *psRec)
+{
+  sDaliTraceRing_t *psOldest = NULL;
+  sDaliTraceRing_t *psRing;
+  uint8_t           ctx;
+  for(ctx = 0; ctx < TRACE_NUM_CTX; ctx++)
+  {//merge the rings by timestamp
+    psRing = &saTraceRing[ctx];
+    if(psRing->head == psRing->tail)
+    {
+      continue;
+    }
+    if(  (NULL == psOldest)
+       ||((int32_t)(psRing->aRec[psRing->tail & (DALI_TRACE_RING_LEN - 1)].timestamp -
+                    psOldest->aRec[psOldest->tail & (DALI_TRACE_RING_LEN - 1)].timestamp) < 0))
+    {
+      psOldest = psRing;
+    }
+  }
+  if(NULL == psOldest)
+  {
+    return false;
+  }
+  *psRec = psOldest->aRec[psOldest->tail & (DALI_TRACE_RING_LEN - 1)];
+  TRACE_BARRIER();
+  psOldest->tail++;
+  return true;
+}
+
+
+void daliTraceDrain(void)
+{
+  sDaliTraceRec_t sRec;
+  uint32_t        dropped;
+  uint8_t         ctx;
+  while(true == daliTraceRead(&sRec))
+  {
+    TRACE_PRINT("[%10lu] ", (unsigned long)sRec.timestamp);
+    if(sRec.id < evTraceNumIds)
+    {
+      TRACE_PRINT(apTraceFmt[sRec.id], (unsigned int)sRec.arg0, (unsigned long)sRec.arg1);
+    }
+    else
+    {
+      TRACE_PRINT("trace id %u %u %lu\n", (unsigned int)sRec.id, (unsigned int)sRec.arg0, (unsigned long)sRec.arg1);
+    }
+  }
+  for(ctx = 0; ctx < TRACE_NUM_CTX; ctx++)
+  {
+    dropped = saTraceRing[ctx].dropped;
+    if(dropped != aTraceDroppedSeen[ctx])
+    {
+      TRACE_PRINT("trace: %lu records dropped\n", (unsigned long)(dropped - aTraceDroppedSeen[ctx]));
+      aTraceDroppedSeen[ctx] = dropped;
+    }
+  }
+}
@@ -0,0 +1,96 @@
+/**
+ * @file dali_trace.h
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Binary trace of driver and task events. Records are written lock free from thread or
+ * interrupt context in a few cycles, and formatted later by daliTraceDrain outside the bus timing.
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*trace levels*/
+#define DALI_TRACE_LVL_NONE  0
+#define DALI_TRACE_LVL_ERROR 1
+#define DALI_TRACE_LVL_INFO  2
+#define DALI_TRACE_LVL_DEBUG 3
+
+/*configuration*/
+#ifndef DALI_TRACE_LEVEL
+#define DALI_TRACE_LEVEL DALI_TRACE_LVL_INFO/**< Trace points above this level compile to nothing*/
+#endif
+#ifndef DALI_TRACE_RING_LEN
+#define DALI_TRACE_RING_LEN 64/**< Records per context ring, power of 2*/
+#endif
+
+/**
+ * @brief Trace point ids, each has a format string in dali_trace.c
+ */
+typedef enum
+{
+  evTraceXferStart    ,/*!< arg0 transaction kind, arg1 rx length*/
+  evTraceXferDone     ,/*!< arg0 transaction kind, arg1 queue entries left*/
+  evTraceDapc         ,/*!< arg0 level, arg1 address | address type << 8*/
+  evTraceTaskPreempted,/*!< arg0 interrupted task, arg1 unused*/
+  evTraceTaskRestored ,/*!< arg0 restored task, arg1 unused*/
+  evTraceSeqGaveWay   ,/*!< arg0 steps sent, arg1 steps in the sequence*/
+  evTraceDeadlineMissed,/*!< arg0 task, arg1 microseconds late*/
+  evTraceTaskEnded    ,/*!< arg0 task, arg1 status, timed out or cancelled*/
+  evTraceAddressed    ,/*!< arg0 drivers on the bus, arg1 unused*/
+  evTraceIdentified   ,/*!< arg0 drivers on the bus, arg1 unused*/
+  evTraceMsmtRead     ,/*!< arg0 task | driver << 8, arg1 raw reading, energy cut to its low 32 bits*/
+  evTraceNumIds
+}eDaliTraceId_t;
+
+/**
+ * @brief One trace record
+ */
+typedef struct
+{
+  uint32_t timestamp;/*!< microseconds*/
+  uint16_t id       ;/*!< eDaliTraceId_t*/
+  uint16_t arg0     ;
+  uint32_t arg1     ;
+}sDaliTraceRec_t;
+
+/**
+ * @brief Record a trace point. The level test is against a constant, so disabled trace points
+ * leave no code behind
+ */
+#define DALI_TRACE(level, id, arg0, arg1)                                          \
+  do                                                                               \
+  {                                                                                \
+    if((level) <= DALI_TRACE_LEVEL)                                                \
+    {                                                                              \
+      daliTraceWrite((uint16_t)(id), (uint16_t)(arg0), (uint32_t)(arg1));          \
+    }                                                                              \
+  }while(0)
+
+/**
+ * @brief Append a record to the ring of the calling context (thread or interrupt). Each ring has a
+ * single producer, so no locking is needed. Records are dropped and counted when the ring is full
+ *
+ * @param id trace point
+ * @param arg0 first argument
+ * @param arg1 second argument
+ */
+void  daliTraceWrite(uint16_t id, uint16_t arg0, uint32_t arg1);
+
+/**
+ * @brief Pop the oldest record of either ring, single consumer
+ *
+ * @param psRec record is written here
+ * @return _Bool false if both rings are empty
+ */
+_Bool daliTraceRead (sDaliTraceRec_t *psRec);
+
+/**
+ * @brief Format and print every pending record, and a count of records dropped since the last drain.
+ * Call from the main loop or the CLI, never from an interrupt
+ */
+void  daliTraceDrain(void);
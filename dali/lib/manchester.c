@@ -8,7 +8,6 @@
  * @copyright Copyright (c) 2021
  * 
  */
-#include <string.h>
 #include "manchester.h"
 
 #define RX_START_INDEX 38//first TE in which receive data may start
@@ -18,8 +17,45 @@
 
 #define MANCHESTER_IDLE ((uint16_t)0x0000)//((uint16_t)0xffff)
 
-uint8_t alignedbuf    [22]     =   {0 };
-uint8_t alignedbufcopy[22]     =   {0 };
+/*Compile-time generation of the byte to 16 TE lookup table, msb is sent first*/
+#define MANCHESTER_LUT_BIT(byte,bit) ((((byte)>>(7-(bit)))&1) ? MANCHESTER_ONE : MANCHESTER_ZERO)
+#define MANCHESTER_LUT_ROW(b)  {MANCHESTER_LUT_BIT(b,0),MANCHESTER_LUT_BIT(b,1),MANCHESTER_LUT_BIT(b,2),MANCHESTER_LUT_BIT(b,3),\
+                                MANCHESTER_LUT_BIT(b,4),MANCHESTER_LUT_BIT(b,5),MANCHESTER_LUT_BIT(b,6),MANCHESTER_LUT_BIT(b,7)}
+#define MANCHESTER_LUT_ROW4(b)  MANCHESTER_LUT_ROW  (b),MANCHESTER_LUT_ROW  ((b)+ 1),MANCHESTER_LUT_ROW  ((b)+ 2),MANCHESTER_LUT_ROW  ((b)+ 3)
+#define MANCHESTER_LUT_ROW16(b) MANCHESTER_LUT_ROW4 (b),MANCHESTER_LUT_ROW4 ((b)+ 4),MANCHESTER_LUT_ROW4 ((b)+ 8),MANCHESTER_LUT_ROW4 ((b)+12)
+#define MANCHESTER_LUT_ROW64(b) MANCHESTER_LUT_ROW16(b),MANCHESTER_LUT_ROW16((b)+16),MANCHESTER_LUT_ROW16((b)+32),MANCHESTER_LUT_ROW16((b)+48)
+
+/**
+ * @brief 256 entry byte to manchester lookup table, each entry is the 16 TEs (8 halfwords) for one byte.
+ * Halfwords rather than words are stored since forward frames sit at 2 byte offsets (start bit, send twice layout)
+ * and the Cortex-M0+ faults on unaligned word stores.
+ */
+static const uint16_t manchesterByteLUT[256][8] =
+{
+  MANCHESTER_LUT_ROW64(  0),
+  MANCHESTER_LUT_ROW64( 64),
+  MANCHESTER_LUT_ROW64(128),
+  MANCHESTER_LUT_ROW64(192)
+};
+
+/**
+ * @brief Copies the 16 encoded TEs of a byte to the spi buffer, no per-bit branching
+ * 
+ * @param manchesterBuffer halfword aligned destination
+ * @param byte byte to encode
+ */
+static inline void manchesterEncodeByte(uint16_t *manchesterBuffer, uint8_t byte)
+{
+  const uint16_t *pLUT = &manchesterByteLUT[byte][0];
+  manchesterBuffer[0] = pLUT[0];
+  manchesterBuffer[1] = pLUT[1];
+  manchesterBuffer[2] = pLUT[2];
+  manchesterBuffer[3] = pLUT[3];
+  manchesterBuffer[4] = pLUT[4];
+  manchesterBuffer[5] = pLUT[5];
+  manchesterBuffer[6] = pLUT[6];
+  manchesterBuffer[7] = pLUT[7];
+}
 
 
 void manchesterEncodeBitTo16Bit(uint8_t bit, uint16_t *manchesterBit)
@@ -37,146 +73,253 @@ void manchesterEncodeBitTo16Bit(uint8_t bit, uint16_t *manchesterBit)
 
 void manchesterEncodeMsg(uint8_t * msgtoEncode, uint8_t msgLength, uint8_t *manchesterBuffer)
 {
+  uint16_t *pTE = (uint16_t *)manchesterBuffer;
   /*Encode start bit: logical one */
-  manchesterEncodeBitTo16Bit(1,(uint16_t *)manchesterBuffer);
-  manchesterBuffer += 2;
+  *pTE++ = MANCHESTER_ONE;
   /*Encode message*/
   while(msgLength != 0)
   {
-     manchesterEncodeBitTo16Bit(((*msgtoEncode)&0x80)>>7,(uint16_t *)(manchesterBuffer   ));//encode msb of byte
-     manchesterEncodeBitTo16Bit(((*msgtoEncode)&0x40)>>6,(uint16_t *)(manchesterBuffer+ 2));
-     manchesterEncodeBitTo16Bit(((*msgtoEncode)&0x20)>>5,(uint16_t *)(manchesterBuffer+ 4));
-     manchesterEncodeBitTo16Bit(((*msgtoEncode)&0x10)>>4,(uint16_t *)(manchesterBuffer+ 6));
-     manchesterEncodeBitTo16Bit(((*msgtoEncode)&0x08)>>3,(uint16_t *)(manchesterBuffer+ 8));
-     manchesterEncodeBitTo16Bit(((*msgtoEncode)&0x04)>>2,(uint16_t *)(manchesterBuffer+10));
-     manchesterEncodeBitTo16Bit(((*msgtoEncode)&0x02)>>1,(uint16_t *)(manchesterBuffer+12));
-     manchesterEncodeBitTo16Bit(((*msgtoEncode)&0x01)>>0,(uint16_t *)(manchesterBuffer+14));//encode lsb of byte
+     manchesterEncodeByte(pTE, *msgtoEncode);
      msgLength--;
-     manchesterBuffer+=16;
-     msgtoEncode     += 1;
+     pTE         += 8;
+     msgtoEncode += 1;
   }
   /*Encode stop: 4 idle high TEs*/
-  *(manchesterBuffer    ) = 0x00;//0xff;
-  *(manchesterBuffer + 1) = 0x00;//0xff;
-  *(manchesterBuffer + 2) = 0x00;//0xff;
-  *(manchesterBuffer + 3) = 0x00;//0xff;
+  pTE[0] = MANCHESTER_IDLE;
+  pTE[1] = MANCHESTER_IDLE;
 }
 
 
-eRXDataStatus_t manchesterDecodeBackFrame(uint8_t *rxManBuf, uint8_t *decodedByte, uint8_t maxLen)
+void manchesterEncodeFrame16(const uint8_t *fwdFrame, uint8_t *manchesterBuffer)
+{
+  uint16_t *pTE = (uint16_t *)manchesterBuffer;
+  pTE[ 0] = MANCHESTER_ONE;
+  manchesterEncodeByte(&pTE[1], fwdFrame[0]);
+  manchesterEncodeByte(&pTE[9], fwdFrame[1]);
+  pTE[17] = MANCHESTER_IDLE;
+  pTE[18] = MANCHESTER_IDLE;
+}
+
+
+void manchesterEncodeFrame24(const uint8_t *fwdFrame, uint8_t *manchesterBuffer)
 {
-  uint8_t  decodeCtr        = 0x00;
-  uint8_t  decodeIndex      = 0x00;
-  uint8_t  shift            = 0x00;
-  uint8_t  mask             = 0x00;
-  uint8_t  setBitCount      = 0x00;
-  const uint8_t  cBackFrameNumTEs =   22;      
-  volatile eRXDataStatus_t eRXDataStatusReturn;
-  while(decodeCtr++ < maxLen)
+  uint16_t *pTE = (uint16_t *)manchesterBuffer;
+  pTE[ 0] = MANCHESTER_ONE;
+  manchesterEncodeByte(&pTE[ 1], fwdFrame[0]);
+  manchesterEncodeByte(&pTE[ 9], fwdFrame[1]);
+  manchesterEncodeByte(&pTE[17], fwdFrame[2]);
+  pTE[25] = MANCHESTER_IDLE;
+  pTE[26] = MANCHESTER_IDLE;
+}
+
+
+#define BACKFRAME_NUM_DATA_TES 18/*!< TEs that must have been captured to decode the data (start + data)*/
+#define SAMPLES_PER_TE          8/*!< One spi byte per TE*/
+#define RX_IDLE_BYTE         0xff/*!< Raw spi byte while the bus idles high*/
+#define STREAM_FRAME_BYTES     24/*!< Bytes after the start bit needed to decide a frame, 22 TEs plus margin for slow gear*/
+
+/*Nibble lookup tables, the decoder runs from interrupt context so avoids per-bit loops and library popcount*/
+static const uint8_t nibblePopCount     [16] = {0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4};
+static const uint8_t nibbleLeadingOnes  [16] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,3,4};
+
+/**
+ * @brief Reads the 8 samples starting at an arbitrary sample offset, samples past the buffer read as idle
+ * 
+ * @param rxManBuf raw spi data
+ * @param maxLen number of bytes in rxManBuf
+ * @param sample sample (bit) offset, msb of byte 0 is sample 0
+ * @return uint8_t 8 samples, earliest in the msb
+ */
+static inline uint8_t manchesterReadTE(const uint8_t *rxManBuf, uint8_t maxLen, uint16_t sample)
+{
+  uint16_t idx   = sample >> 3;
+  uint16_t raw   = (uint16_t)(((idx     < maxLen) ? rxManBuf[idx    ] : RX_IDLE_BYTE) << 8)
+                 |            (((idx + 1) < maxLen) ? rxManBuf[idx + 1] : RX_IDLE_BYTE);
+  return (uint8_t)(raw >> (8 - (sample & 7)));
+}
+
+/**
+ * @brief Majority vote of the 8 samples of one TE (half-bit)
+ * 
+ * @param te 8 samples, earliest in the msb
+ * @return uint8_t 1 if 5 or more samples are high, 0 if 3 or fewer, 2 if undecided
+ */
+static inline uint8_t manchesterVoteTE(uint8_t te)
+{
+  static const uint8_t vote[9] = {0,0,0,0,2,1,1,1,1};
+  return vote[nibblePopCount[te >> 4] + nibblePopCount[te & 0x0f]];
+}
+
+
+eRXDataStatus_t manchesterDecodeBackFrameEx(const uint8_t *rxManBuf, uint8_t maxLen, sManchesterDecode_t *psDecode)
+{
+  uint8_t  decodeCtr = 1;//byte 0 may still hold the tail of the forward frame echo
+  uint8_t  bitCtr    = 0;
+  uint8_t  lead      = 0;
+  uint8_t  window    = 0;
+  uint8_t  early     = 0;
+  uint8_t  late      = 0;
+  uint8_t  bits      = 0;
+  uint8_t  stopHigh  = 0;
+  uint16_t start     = 0;
+  uint16_t edge      = 0;
+  uint16_t firstEdge = 0;
+
+  psDecode->backFrame   = 0;
+  psDecode->startSample = 0;
+  psDecode->teWidthQ4   = 0;
+  while((decodeCtr < maxLen) && (rxManBuf[decodeCtr] == RX_IDLE_BYTE))
   {
-    if(*(rxManBuf + decodeCtr) < 255)
-    {//start bit found
-      break;
-    }
+    decodeCtr++;
   }
   if(decodeCtr >= maxLen)
   {//no backward frame found
-    eRXDataStatusReturn = evNoDataFound;
-    return eRXDataStatusReturn;
+    psDecode->eStatus = evNoDataFound;
+    return psDecode->eStatus;
   }
-  else if((decodeCtr + 16) > maxLen)
+  /*Falling edge of the start bit is the first low sample*/
+  lead  = (rxManBuf[decodeCtr] >= 0xf0) ? (4 + nibbleLeadingOnes[rxManBuf[decodeCtr] & 0x0f])
+                                        :      nibbleLeadingOnes[rxManBuf[decodeCtr] >> 4  ] ;
+  start = (uint16_t)(decodeCtr * SAMPLES_PER_TE) + lead;
+  psDecode->startSample = start;
+  if((start + (BACKFRAME_NUM_DATA_TES * SAMPLES_PER_TE)) > (uint16_t)(maxLen * SAMPLES_PER_TE))
   {//there appears to be data, but the buffer did not capture it
-     eRXDataStatusReturn = evDataIncomplete;
-    return eRXDataStatusReturn;
+    psDecode->eStatus = evDataIncomplete;
+    return psDecode->eStatus;
   }
- //find the bit index and masking into the first non-0xff byte for byte-aligning acquired data
-  while(shift < 7)
+  /*Start bit plus 8 data bits. Every manchester bit has a mid-bit transition, the grid is
+    re-anchored on each one so the decoder tracks backward frames that run fast or slow*/
+  edge = start + SAMPLES_PER_TE;
+  while(bitCtr < 9)
   {
-    if((*(rxManBuf+decodeCtr) & (0x80>>shift)) == 0)
-    {//Stop once you find a zero.
-      break;
+    window = manchesterReadTE(rxManBuf, maxLen, edge - (SAMPLES_PER_TE/2));
+    early  = nibblePopCount[window >> 4  ];
+    late   = nibblePopCount[window & 0x0f];
+    if(early == late)
+    {//no transition near the expected mid-bit point
+      psDecode->eStatus = evDataCorrupt;
+      return psDecode->eStatus;
     }
-    mask += 1<<(7 - shift);
-    shift++;
-  }
-  /*realign the data into another buffer*/
-  while(decodeIndex < cBackFrameNumTEs)
-  {/*Each iteration is 1 TE*/
-    alignedbuf[decodeIndex] =   ((rxManBuf[decodeCtr +  decodeIndex    ]       )<<(shift    ))    
-                              + ((rxManBuf[decodeCtr +  decodeIndex + 1] & mask)>>(8 - shift)); 
-    /*convert bitfields into bit count      */
-    decodeIndex++;
-  }
-  memcpy(&alignedbufcopy,&alignedbuf,sizeof(alignedbuf));
-  decodeIndex = 0;
-/*Add up the bits set per aligned byte*/
-  while(decodeIndex < cBackFrameNumTEs)
-  {
-    while(alignedbuf[decodeIndex] != 0 )
-    {
-      setBitCount += (alignedbuf[decodeIndex] & 1);
-      alignedbuf[decodeIndex] >>= 1;
+    /*Locate the transition inside the window by counting samples on the leading side of it*/
+    edge = edge - (SAMPLES_PER_TE/2) + ((late > early) ? (8 - (early + late)) : (early + late));
+    /*Both half-bits either side of the transition must agree with its direction (majority of 8 samples each)*/
+    if(  (manchesterVoteTE(manchesterReadTE(rxManBuf, maxLen, edge - SAMPLES_PER_TE)) != (early > late))
+       ||(manchesterVoteTE(manchesterReadTE(rxManBuf, maxLen, edge                 )) != (late > early)))
+    {//pattern mismatch, several gear answering at once
+      psDecode->eStatus = evDataCorrupt;
+      return psDecode->eStatus;
     }
-
-    /*convert bit count into 1 or 0 decision*/
-    if(setBitCount < 4)
+    bits = (uint8_t)((bits << 1) | (late > early));//rising mid-bit transition is a logical 1
+    if(0 == bitCtr)
     {
-      alignedbuf[decodeIndex] = 0;
+      firstEdge = edge;
+      if(0 == bits)
+      {//start bit must be low then high
+        psDecode->eStatus = evDataCorrupt;
+        return psDecode->eStatus;
+      }
     }
-    else if((setBitCount == 4)&&(alignedbufcopy[decodeIndex] == 0xf0))
-    {
-      alignedbuf[decodeIndex] = 0;
-    }
-    else
+    edge += 2 * SAMPLES_PER_TE;
+    bitCtr++;
+  }
+  edge -= 2 * SAMPLES_PER_TE;
+  /*Check stop bit validity, 4 TEs after the last data bit should be (mostly) idle high*/
+  stopHigh = (manchesterVoteTE(manchesterReadTE(rxManBuf, maxLen, edge + (1 * SAMPLES_PER_TE))) == 1)
+           + (manchesterVoteTE(manchesterReadTE(rxManBuf, maxLen, edge + (2 * SAMPLES_PER_TE))) == 1)
+           + (manchesterVoteTE(manchesterReadTE(rxManBuf, maxLen, edge + (3 * SAMPLES_PER_TE))) == 1)
+           + (manchesterVoteTE(manchesterReadTE(rxManBuf, maxLen, edge + (4 * SAMPLES_PER_TE))) == 1);
+  if(stopHigh < 3)
+  {//stop bit pattern mismatch
+    psDecode->eStatus = evDataCorrupt;
+    return psDecode->eStatus;
+  }
+  psDecode->backFrame = bits;
+  psDecode->teWidthQ4 = (uint16_t)(edge - firstEdge);//16 TEs between first and last mid-bit transitions
+  psDecode->eStatus   = evValidDataFound;
+  return psDecode->eStatus;
+}
+
+
+void manchesterStreamInit(sManchesterStream_t *psStream, const uint8_t *rxManBuf, uint8_t windowLen, uint8_t maxLen)
+{
+  psStream->rxManBuf        = rxManBuf ;
+  psStream->maxLen          = maxLen   ;
+  psStream->windowLen       = windowLen;
+  psStream->scanned         = 1        ;//byte 0 skipped, as manchesterDecodeBackFrameEx
+  psStream->startByte       = 0        ;
+  psStream->endLen          = 0        ;
+  psStream->sDecode.eStatus = evDataIncomplete;
+}
+
+
+eRXDataStatus_t manchesterStreamFeed(sManchesterStream_t *psStream, uint8_t rxLen)
+{
+  uint8_t need    = 0;
+  uint8_t scanEnd = 0;
+  if(evDataIncomplete != psStream->sDecode.eStatus)
+  {//already decided
+    return psStream->sDecode.eStatus;
+  }
+  rxLen   = (rxLen > psStream->maxLen) ? psStream->maxLen : rxLen;
+  scanEnd = (rxLen > psStream->windowLen) ? (psStream->windowLen + 1) : rxLen;//a start past the window is no reply, however the bytes arrive
+  /*Only the bytes that arrived since the last call are searched*/
+  while((0 == psStream->startByte) && (psStream->scanned < scanEnd))
+  {
+    if(psStream->rxManBuf[psStream->scanned] != RX_IDLE_BYTE)
     {
-      alignedbuf[decodeIndex] = 1;
+      psStream->startByte = psStream->scanned;
     }
-    if(alignedbufcopy[decodeIndex] == 0x07)
-    {
-      alignedbuf[decodeIndex] = 1;
+    psStream->scanned++;
+  }
+  if(0 == psStream->startByte)
+  {
+    if(psStream->scanned > psStream->windowLen)
+    {//window elapsed with the line idle, no reply is coming
+      psStream->endLen          = psStream->scanned;
+      psStream->sDecode.eStatus = evNoDataFound;
     }
-    setBitCount = 0;
-    decodeIndex++;
-  }
-  decodeIndex = 0;
- /*Check start bit validity*/
-  if(  (alignedbuf[0] != 0)
-     ||(alignedbuf[1] != 1))
-  {//start bit pattern mismatch
-   eRXDataStatusReturn = evDataCorrupt;
-   return eRXDataStatusReturn;
-  }
-  /*Check stop bit validity*/
-  if((alignedbuf[18] + alignedbuf[19] + alignedbuf[20] + alignedbuf[21]) < 3)
-  {//stop bit pattern mismatch
-  eRXDataStatusReturn = evDataCorrupt;
-   return eRXDataStatusReturn;
+    return psStream->sDecode.eStatus;
   }
-  /*decode TEs to received backward frame byte*/
-  decodeIndex = 0;
-  while(decodeIndex < 8)
+  need = ((psStream->startByte + STREAM_FRAME_BYTES) > psStream->maxLen) ? psStream->maxLen
+                                                                         : (psStream->startByte + STREAM_FRAME_BYTES);
+  if(rxLen < need)
   {
-   if(  (alignedbuf[2 + (2*decodeIndex)] == 1)
-      &&(alignedbuf[3 + (2*decodeIndex)] == 0))
-   {
-     *decodedByte &= ~(1<<(7 - decodeIndex));
-   }
-   else if(  (alignedbuf[2 + (2*decodeIndex)] == 0)
-           &&(alignedbuf[3 + (2*decodeIndex)] == 1))
-   {
-     *decodedByte |= (1<<(7 - decodeIndex)); 
-   }
-   else
-   {//data pattern mismatch (2 high or 2 low TEs)
-    eRXDataStatusReturn = evDataCorrupt;
-     return eRXDataStatusReturn;
-   }
-   decodeIndex += 1;
-  }
-  return evValidDataFound;
+    return psStream->sDecode.eStatus;
+  }
+  psStream->endLen = need;
+  return manchesterDecodeBackFrameEx(psStream->rxManBuf, need, &psStream->sDecode);
 }
 
 
+uint8_t manchesterStreamNeed(const sManchesterStream_t *psStream)
+{
+  uint32_t need;
+  if(evDataIncomplete != psStream->sDecode.eStatus)
+  {
+    return psStream->endLen;
+  }
+  if(0 != psStream->startByte)
+  {//rest of the frame
+    need = psStream->startByte + STREAM_FRAME_BYTES;
+  }
+  else
+  {//a start bit in the next byte, or the window running out idle, whichever comes first
+    need = psStream->scanned + STREAM_FRAME_BYTES;
+    if(need > (uint32_t)(psStream->windowLen + 1))
+    {
+      need = psStream->windowLen + 1;
+    }
+  }
+  return (need > psStream->maxLen) ? psStream->maxLen : (uint8_t)need;
+}
 
 
- 
\ No newline at end of file
+eRXDataStatus_t manchesterDecodeBackFrame(uint8_t *rxManBuf, uint8_t *decodedByte, uint8_t maxLen)
+{
+  sManchesterDecode_t sDecode;
+  if(evValidDataFound == manchesterDecodeBackFrameEx(rxManBuf, maxLen, &sDecode))
+  {
+    *decodedByte = sDecode.backFrame;
+  }
+  return sDecode.eStatus;
+}
@@ -23,6 +23,33 @@ typedef enum eRXDataStatus_t
   evDataIncomplete //!< Received data determined to be incomplete   
 }eRXDataStatus_t;
 
+/**
+ * @brief Result of decoding a backward frame, filled by manchesterDecodeBackFrameEx
+ * 
+ */
+typedef struct
+{
+  eRXDataStatus_t eStatus    ;//!< Decode status, same as the returned value
+  uint8_t         backFrame  ;//!< Decoded backward frame, valid with evValidDataFound
+  uint16_t        startSample;//!< Sample (bit) offset into the raw buffer of the start bit falling edge
+  uint16_t        teWidthQ4  ;//!< Measured TE width in 1/16 samples, 128 nominal. 0 unless evValidDataFound
+}sManchesterDecode_t;
+
+/**
+ * @brief Incremental backward frame decoder state, fed as the dma fills the raw buffer
+ * 
+ */
+typedef struct
+{
+  const uint8_t      *rxManBuf ;//!< Raw spi buffer being filled by dma
+  uint8_t             maxLen   ;//!< Size of rxManBuf
+  uint8_t             windowLen;//!< Bytes in which the start bit must appear before the reply is declared missing
+  uint8_t             scanned  ;//!< Bytes already searched for the start bit
+  uint8_t             startByte;//!< Byte holding the start bit, 0 until found
+  uint8_t             endLen   ;//!< Bytes that had been received when the outcome was decided
+  sManchesterDecode_t sDecode  ;//!< Outcome, eStatus stays evDataIncomplete until decided
+}sManchesterStream_t;
+
 
 /**
  * @brief Encodes individual manchester bits (2 TEs) to a 16 bit value
@@ -44,6 +71,24 @@ void            manchesterEncodeMsg       (uint8_t * msgtoEncode    , //pointer
                                            uint8_t length           , //number of bytes to encode
                                            uint8_t *manchesterBuffer);//pointer to manchester encoded buffer
 
+/**
+ * @brief Encodes a 16 bit forward frame (start bit, 2 bytes, stop) using the byte lookup table
+ * 
+ * @param fwdFrame 2 bytes to encode, first byte sent first
+ * @param manchesterBuffer halfword aligned buffer of at least 38 bytes
+ */
+void            manchesterEncodeFrame16   (const uint8_t *fwdFrame  , //pointer to 2 byte forward frame
+                                           uint8_t *manchesterBuffer);//pointer to manchester encoded buffer
+
+/**
+ * @brief Encodes a 24 bit forward frame (start bit, 3 bytes, stop) using the byte lookup table
+ * 
+ * @param fwdFrame 3 bytes to encode, first byte sent first
+ * @param manchesterBuffer halfword aligned buffer of at least 54 bytes
+ */
+void            manchesterEncodeFrame24   (const uint8_t *fwdFrame  , //pointer to 3 byte forward frame
+                                           uint8_t *manchesterBuffer);//pointer to manchester encoded buffer
+
 /**
  * @brief searches the raw SPI buffer data for start of response (buffer contains tx and rx data)
  * 
@@ -54,4 +99,49 @@ void            manchesterEncodeMsg       (uint8_t * msgtoEncode    , //pointer
  */
 eRXDataStatus_t manchesterDecodeBackFrame (uint8_t *rxManchesterBuf , //pointer to raw spi received data
                                            uint8_t *backFrame       , //pointer to backwards frame buffer
-                                           uint8_t charLength       );//number of bytes allocated to rxManchesterBuf to search through                                     
+                                           uint8_t charLength       );//number of bytes allocated to rxManchesterBuf to search through
+
+/**
+ * @brief Reentrant backward frame decoder, keeps no state between calls so is safe from interrupt context
+ * and for several buses at once. Each TE is decided by a majority vote over its 8 samples.
+ * 
+ * @param rxManBuf Raw data to decode
+ * @param maxLen maximum number of bytes to search through in the raw data buffer
+ * @param psDecode decoded byte, start bit sample offset and measured bit timing are written here
+ * @return eRXDataStatus_t Decode status(data found, data not found, data incomplete, data corrupt)
+ */
+eRXDataStatus_t manchesterDecodeBackFrameEx(const uint8_t *rxManBuf       , //pointer to raw spi received data
+                                            uint8_t maxLen                , //number of bytes to search through
+                                            sManchesterDecode_t *psDecode );//decode result                                     
+
+/**
+ * @brief Prepare an incremental decoder for a new backward frame window
+ * 
+ * @param psStream decoder state
+ * @param rxManBuf raw spi buffer that will be filled by dma
+ * @param windowLen number of bytes in which the start bit must appear
+ * @param maxLen size of rxManBuf
+ */
+void            manchesterStreamInit      (sManchesterStream_t *psStream,
+                                           const uint8_t *rxManBuf      ,
+                                           uint8_t windowLen            ,
+                                           uint8_t maxLen               );
+
+/**
+ * @brief Feed the number of bytes received so far, returns as soon as the outcome is certain
+ * 
+ * @param psStream decoder state
+ * @param rxLen number of bytes of rxManBuf written so far
+ * @return eRXDataStatus_t evDataIncomplete while undecided, otherwise valid, no data or corrupt (collision)
+ */
+eRXDataStatus_t manchesterStreamFeed      (sManchesterStream_t *psStream,
+                                           uint8_t rxLen                );
+
+/**
+ * @brief Bytes of rxManBuf that must have been received before the next manchesterStreamFeed could
+ * decide the outcome: once decided, endLen
+ * 
+ * @param psStream decoder state
+ * @return uint8_t 
+ */
+uint8_t         manchesterStreamNeed      (const sManchesterStream_t *psStream);
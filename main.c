@@ -1,8 +1,9 @@
 #include <stdio.h>
+#include <string.h>
 #include "pico/stdlib.h"
 #include "dali.h"
-#include "dali_driver.h"
-#include "dali_commands.h"
+#include "dali_trace.h"
+#include "dali_telemetry.h"
 
 // Pico W devices use a GPIO on the WIFI chip for the LED,
 // so when building for Pico W, CYW43_WL_GPIO_LED_PIN will be defined
@@ -44,30 +45,28 @@ int main() {
     hard_assert(rc == PICO_OK);
     stdio_init_all();
     initDALI();
-    uint8_t addr = 0;
+    uint8_t pings = 0;
+    sDaliTask_t sPing;
+    sDaliTaskResult_t sResult;
     sleep_ms(5000);
     while (true) {
         pico_set_led(true);
         sleep_ms(125);
         pico_set_led(false);
         sleep_ms(125);
-        printf("Sending DALI ping.\n");
-        if(addr < 64)
+        daliTraceDrain();
+        daliTelemetryPoll();
+        while(getDaliTaskResult(&sResult))
         {
-            sendStandardCmdWithReply(addr,evBroadcastAll,evQueryControlGearPresent);
-            transmitForwardFrame();
-            addr++;
+            printf("DALI task %d done, status %d.\n", sResult.eDaliTask, sResult.eStatus);
         }
-        if(addr == 64)
+        //the engine owns the bus, so pings are queued as tasks like anything else
+        memset(&sPing, 0, sizeof(sPing));//cleared once queued
+        sPing.eDaliTask = evDaliPollForControlGear;
+        if((pings < 65) && (true == setDaliTask(&sPing)))
         {
-            sendStandardCmdWithReply(addr,evBroadcastUnaddressed,evQueryControlGearPresent);
-            transmitForwardFrame();
-            addr++;
+            printf("Sending DALI ping.\n");
+            pings++;
         }
-        if(addr == 65)
-        {
-
-        }
-        
     }
 }
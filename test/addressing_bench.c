@@ -0,0 +1,108 @@
+/**
+ * @file addressing_bench.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Host benchmark of a full addressing run against the simulated gear: forward frames per device
+ * and bus time for 1, 16 and 64 gear, averaged over a number of random address draws
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "dali_addressing.h"
+#include "dali_bus.h"
+#include "dali_commands.h"
+#include "dali_driver.h"
+#include "dali_gearSim.h"
+
+#define BENCH_DEFAULT_SEEDS 10
+#define BENCH_FIRST_SEED    1000u
+
+static const uint8_t caBenchGear[] = {1, 16, 64};
+
+/**
+ * @brief Address numGear simulated gear from scratch
+ *
+ * @param numGear gear on the bus
+ * @param seed of their random addresses
+ * @param pFrames forward frames the gear saw
+ * @param pBusUs bus time the run took
+ * @return _Bool true if every gear ended with a short address of its own
+ */
+static _Bool benchAddress(uint8_t numGear, uint32_t seed, uint32_t *pFrames, uint64_t *pBusUs)
+{
+  static sDaliAddrCtx_t sCtx;
+  uint64_t              seen      = 0;
+  uint8_t               numFound  = 0;
+  uint8_t               numUnique = 0;
+  uint8_t               shortAddr;
+  uint8_t               i;
+  uint32_t              frames0;
+  uint64_t              us0;
+  daliGearSimInit(numGear, seed);
+  daliInit();
+  frames0 = daliGearSimStats()->frames;
+  us0     = daliHostNowUs();
+  daliAddressingReset(&sCtx);
+  for(;;)
+  {
+    if(  (true == getDaliTransferStatus()                   )
+       &&(true == daliAddressingAlgorithm(&sCtx, &numFound)))
+    {
+      break;
+    }
+    daliHostRun();
+  }
+  *pFrames = daliGearSimStats()->frames - frames0;
+  *pBusUs  = daliHostNowUs() - us0;
+  for(i = 0; i < numGear; i++)
+  {
+    shortAddr = daliGearSimGet(i)->shortAddr;
+    if(  (shortAddr <= MAX_SHORT_ADDRESS         )
+       &&(0         == ((seen >> shortAddr) & 1u)))
+    {
+      seen |= 1ull << shortAddr;
+      numUnique++;
+    }
+  }
+  return ((numGear == numUnique) && (numGear == numFound));
+}
+
+int main(int argc, char **argv)
+{
+  int      seeds  = (argc > 1) ? atoi(argv[1]) : BENCH_DEFAULT_SEEDS;
+  int      failed = 0;
+  int      seed;
+  int      fails;
+  uint8_t  g;
+  uint32_t frames;
+  uint64_t busUs;
+  double   sumFrames;
+  double   sumUs;
+  if(seeds < 1)
+  {
+    seeds = 1;
+  }
+  for(g = 0; g < sizeof(caBenchGear); g++)
+  {
+    sumFrames = 0;
+    sumUs     = 0;
+    fails     = 0;
+    for(seed = 0; seed < seeds; seed++)
+    {
+      if(false == benchAddress(caBenchGear[g], BENCH_FIRST_SEED + (uint32_t)seed, &frames, &busUs))
+      {
+        fails++;
+      }
+      sumFrames += frames;
+      sumUs     += (double)busUs;
+    }
+    printf("%2u gear: %.1f frames/device, %.1f s bus time, %d/%d runs not fully addressed\n",
+           caBenchGear[g], sumFrames / seeds / caBenchGear[g], sumUs / seeds / 1e6, fails, seeds);
+    failed += fails;
+  }
+  return (0 != failed) ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+/**
+ * @file bus_start_timing.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Pico timing of a transfer start for each transaction kind, the prepared daliBusStart against the
+ * per frame dma_channel_configure start it replaced. Each transfer is aborted straight away and the spi
+ * emptied, so no gear or bus is needed; the spi runs at full speed for that to take little time. The loop
+ * of starts is timed as one interval and the mean per start reported, start, abort and drain included.
+ * Both variants share the abort, the difference between them is the difference in start cost
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/spi.h"
+#include "hardware/sync.h"
+#include "dali_bus.h"
+#include "dali_frames.h"
+
+#define TIMING_STARTS 10000u
+#define TIMING_BAUD   62500000u/*!< Fastest the spi goes, the drain after each abort is short*/
+
+typedef struct
+{
+  const char *pName;
+  uint8_t     txLen;
+  uint8_t     rxLen;
+}sTimingKind_t;
+
+typedef struct
+{
+  const char *pName;
+  void      (*pfnStart)(const sDaliBusXfer_t *psXfer);
+}sTimingStart_t;
+
+extern uint dma_tx;
+extern uint dma_rx;
+extern uint dma_txctl;
+
+static void timingStartPerFrame(const sDaliBusXfer_t *psXfer);
+
+/*Lengths the driver gives each kind*/
+static const sTimingKind_t caTimingKinds[] =
+{
+  {"no reply  ", sizeof(sEncodedFwdFrame_t)                       , sizeof(sEncodedFwdFrame_t) + INTERFRAMEIDLE                            },
+  {"send twice", sizeof(((uEncodedFwdFrameBuf_t *)0)->s2xFwdFrame), sizeof(((uRawDaliRXBuffer_t *)0)->sRXSendTwice)                        },
+  {"with reply", sizeof(sEncodedFwdFrame_t)                       , sizeof(((uRawDaliRXBuffer_t *)0)->sRXWithReply) + BACKFRAMESETTLINGTES},
+};
+
+static const sTimingStart_t caTimingStarts[] =
+{
+  {"prepared ", daliBusStart       },
+  {"per frame", timingStartPerFrame},
+};
+
+static uint8_t aTimingTx[sizeof(uEncodedFwdFrameBuf_t)];
+static uint8_t aTimingRx[sizeof(uRawDaliRXBuffer_t) + BACKFRAMESETTLINGTES];
+
+void daliBusOnDone(void)
+{//every transfer is aborted before it can complete
+}
+
+/**
+ * @brief The start before the configs were prepared once in daliBusInit: both channel configs built and
+ * dma_channel_configure called for each on every frame
+ * @param psXfer transfer
+ */
+static void timingStartPerFrame(const sDaliBusXfer_t *psXfer)
+{
+  dma_channel_config c = dma_channel_get_default_config(dma_tx);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+  channel_config_set_dreq(&c, spi_get_dreq(spi_default, true));
+  dma_channel_configure(dma_tx, &c,
+                        &spi_get_hw(spi_default)->dr, // write address
+                        psXfer->pTx                 , // read address
+                        psXfer->txLen               , // element count
+                        false                       ); // don't start yet
+  c = dma_channel_get_default_config(dma_rx);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+  channel_config_set_dreq(&c, spi_get_dreq(spi_default, false));
+  channel_config_set_read_increment(&c, false);
+  channel_config_set_write_increment(&c, true);
+  dma_channel_configure(dma_rx, &c,
+                        psXfer->pRx                 , // write address
+                        &spi_get_hw(spi_default)->dr, // read address
+                        psXfer->rxLen               , // element count
+                        false                       ); // don't start yet
+  dma_start_channel_mask((1u << dma_tx) | (1u << dma_rx));
+}
+
+/**
+ * @brief Stop the transfer and empty the spi, the same for both variants. The channel irq is masked around
+ * the abort (RP2040-E13)
+ */
+static void timingAbort(void)
+{
+  dma_channel_set_irq0_enabled(dma_rx, false);
+  dma_channel_abort(dma_txctl);
+  dma_channel_abort(dma_tx);
+  dma_channel_abort(dma_rx);
+  dma_hw->ints0 = 1u << dma_rx;
+  dma_channel_set_irq0_enabled(dma_rx, true);
+  while(true == spi_is_busy(spi_default))
+  {
+    tight_loop_contents();
+  }
+  while(true == spi_is_readable(spi_default))
+  {
+    (void)spi_get_hw(spi_default)->dr;
+  }
+}
+
+int main(void)
+{
+  sDaliBusXfer_t sXfer;
+  uint32_t       irqKey;
+  uint64_t       t0;
+  uint64_t       aLoopUs[sizeof(caTimingStarts) / sizeof(caTimingStarts[0])];
+  uint32_t       i;
+  uint8_t        k;
+  uint8_t        v;
+  stdio_init_all();
+  daliBusInit();
+  spi_set_baudrate(spi_default, TIMING_BAUD);
+  sleep_ms(5000);
+  for(k = 0; k < (sizeof(caTimingKinds) / sizeof(caTimingKinds[0])); k++)
+  {
+    sXfer.pTx   = aTimingTx;
+    sXfer.pRx   = aTimingRx;
+    sXfer.txLen = caTimingKinds[k].txLen;
+    sXfer.rxLen = caTimingKinds[k].rxLen;
+    for(v = 0; v < (sizeof(caTimingStarts) / sizeof(caTimingStarts[0])); v++)
+    {
+      t0 = time_us_64();
+      for(i = 0; i < TIMING_STARTS; i++)
+      {
+        irqKey = save_and_disable_interrupts();//start is called with interrupts masked
+        caTimingStarts[v].pfnStart(&sXfer);
+        timingAbort();
+        restore_interrupts(irqKey);
+      }
+      aLoopUs[v] = time_us_64() - t0;
+      printf("%s start %s: %lu ns mean over %lu starts\n", caTimingStarts[v].pName, caTimingKinds[k].pName,
+             (unsigned long)(aLoopUs[v] * 1000u / TIMING_STARTS), (unsigned long)TIMING_STARTS);
+    }
+    printf("%s: prepared start saves %ld ns\n", caTimingKinds[k].pName,
+           (long)(((int64_t)aLoopUs[1] - (int64_t)aLoopUs[0]) * 1000 / (int64_t)TIMING_STARTS));
+  }
+  while(true)
+  {
+    tight_loop_contents();
+  }
+}
@@ -0,0 +1,199 @@
+/**
+ * @file dapc_collapse_test.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Host test of DAPC collapsing against the simulated gear. Short address DAPCs to one level may only
+ * become a broadcast DAPC once addressing has listed every gear on the bus, and a group DAPC only once
+ * identification has read the groups of every driver; gear the list does not hold must keep their level
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "dali.h"
+#include "dali_bus.h"
+#include "dali_gearSim.h"
+
+#define TEST_GEAR       4u
+#define TEST_SEED       5000u
+#define TEST_GROUP      2u
+#define TEST_OUTSIDE    50u /*!< Short address of a gear some other controller addressed*/
+
+/**
+ * @brief Queue a task and run the simulated bus until it is done
+ * @return eDaliTaskStatus_t its final status
+ */
+static eDaliTaskStatus_t testRunTask(sDaliTask_t *psTask)
+{
+  static sDaliTaskHandle_t sHandle;
+  memset(&sHandle, 0, sizeof(sHandle));
+  if(false == setDaliTaskHandle(psTask, evDaliPrioCommission, &sHandle))
+  {
+    return evDaliTaskRejected;
+  }
+  while(evDaliTaskRunning == getDaliTaskHandleStatus(&sHandle))
+  {
+    daliEngineHostRun(10000);
+  }
+  return getDaliTaskHandleStatus(&sHandle);
+}
+
+/**
+ * @brief Run an addressing or identification task
+ * @return _Bool false if it did not complete
+ */
+static _Bool testCommission(eDaliTaskType_t eDaliTask, _Bool bIncremental)
+{
+  sDaliTask_t sTask;
+  memset(&sTask, 0, sizeof(sTask));
+  sTask.eDaliTask                    = eDaliTask;
+  sTask.uTask.sAddress.bIncremental  = bIncremental;
+  return (evDaliTaskComplete == testRunTask(&sTask));
+}
+
+/**
+ * @brief Gear holding a short address
+ * @return sDaliGear_t* NULL if none does
+ */
+static sDaliGear_t *testGearAt(uint8_t numGear, uint8_t shortAddr)
+{
+  uint8_t i;
+  for(i = 0; i < numGear; i++)
+  {
+    if(shortAddr == daliGearSimGet(i)->shortAddr)
+    {
+      return daliGearSimGet(i);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Queue a DAPC to each given short address, all in one go so the engine finds them together, and run
+ * the bus until they are sent
+ * @param pAddr short addresses
+ * @param num how many
+ * @param level arc power level
+ */
+static void testDapc(const uint8_t *pAddr, uint8_t num, uint8_t level)
+{
+  sDaliTask_t sTask;
+  uint8_t     i;
+  for(i = 0; i < num; i++)
+  {
+    memset(&sTask, 0, sizeof(sTask));
+    sTask.eDaliTask                          = evDaliSetLevel;
+    sTask.uTask.sSetDAPC.sAddrType.eAddrType = evShortAddress;
+    sTask.uTask.sSetDAPC.sAddrType.addr      = pAddr[i];
+    sTask.uTask.sSetDAPC.level               = level;
+    (void)setDaliTask(&sTask);
+  }
+  daliEngineHostRun(500000);
+}
+
+/**
+ * @brief Send DAPCs and check how many were collapsed and that every gear sent one is at the level
+ * @param pName case
+ * @param pAddr short addresses
+ * @param num how many
+ * @param level arc power level
+ * @param expected DAPCs expected to be collapsed
+ * @return int faults
+ */
+static int testCase(const char *pName, const uint8_t *pAddr, uint8_t num, uint8_t level, uint32_t expected)
+{
+  const sDaliGear_t *psGear;
+  uint8_t            i;
+  int                faults = 0;
+  resetDaliTaskQueueStats();
+  testDapc(pAddr, num, level);
+  for(i = 0; i < num; i++)
+  {
+    psGear = testGearAt(TEST_GEAR, pAddr[i]);
+    if(  (NULL  == psGear             )
+       ||(level != psGear->actualLevel))
+    {
+      faults++;
+    }
+  }
+  if(expected != getDaliTaskQueueStats()->dapcCollapsed)
+  {
+    faults++;
+  }
+  printf("%-28s collapsed %u of %u, expected %u, %d faults\n", pName, getDaliTaskQueueStats()->dapcCollapsed, num,
+         expected, faults);
+  return faults;
+}
+
+int main(void)
+{
+  saDaliNetworkData_t *psNet = (saDaliNetworkData_t *)getAddressOfDaliData();
+  const uint8_t        aAll[TEST_GEAR] = {0, 1, 2, 3};
+  const uint8_t        aGroup[2]       = {0, 1};
+  const uint8_t        aListed[3]      = {0, 1, 4};/*!< Listed addresses a gear holds after the incremental run*/
+  sDaliGear_t         *psGear;
+  int                  faults = 0;
+  uint8_t              i;
+  daliGearSimInit(TEST_GEAR, TEST_SEED);
+  for(i = 0; i < TEST_GEAR; i++)
+  {//addressed and grouped before this controller ever ran
+    psGear            = daliGearSimGet(i);
+    psGear->shortAddr = i;
+    psGear->minLevel  = 1;
+    psGear->groups    = (i < 2) ? (1u << TEST_GROUP) : 0;
+  }
+  initDALI();
+  /*A driver list from elsewhere: no addressing run has seen the bus*/
+  psNet->numDrivers = TEST_GEAR;
+  for(i = 0; i < TEST_GEAR; i++)
+  {
+    psNet->uData[i].sData.sStaticData.addr        = i;
+    psNet->uData[i].sData.sUserConfig.gearGroups  = (i < 2) ? (1u << TEST_GROUP) : 0;
+    psNet->uData[i].sData.sUserConfig.bGroupsRead = true;
+  }
+  faults += testCase("bus never addressed", aAll, TEST_GEAR, 120, 0);
+
+  /*Every gear listed, their groups unknown*/
+  if(false == testCommission(evDaliAddress, false))
+  {
+    printf("dapc collapse test: addressing did not complete\n");
+    return 1;
+  }
+  for(i = 0; i < TEST_GEAR; i++)
+  {//addressing hands out short addresses afresh, keep the group on the gear at 0 and 1
+    daliGearSimGet(i)->groups = (daliGearSimGet(i)->shortAddr < 2) ? (1u << TEST_GROUP) : 0;
+  }
+  faults += testCase("listed, all same"           , aAll  , TEST_GEAR, 100, TEST_GEAR - 1);
+  faults += testCase("listed, groups unknown"     , aGroup, 2        ,  60, 0);
+
+  /*Groups read*/
+  if(false == testCommission(evDaliIdentify, false))
+  {
+    printf("dapc collapse test: identification did not complete\n");
+    return 1;
+  }
+  faults += testCase("listed, groups read"        , aGroup, 2        ,  70, 1);
+
+  /*Another controller moved the gear at 3 to TEST_OUTSIDE and the one at 2 lost its short address: an
+    incremental run gives that one 4 and comes across the other*/
+  testGearAt(TEST_GEAR, 2)->shortAddr = DALI_GEARSIM_MASK;
+  psGear              = testGearAt(TEST_GEAR, 3);
+  psGear->shortAddr   = TEST_OUTSIDE;
+  psGear->actualLevel = 30;
+  if(  (false         == testCommission(evDaliAddress, true))
+     ||(TEST_GEAR + 1 != psNet->numDrivers                   ))
+  {
+    printf("dapc collapse test: incremental addressing did not list the new gear\n");
+    return 1;
+  }
+  faults += testCase("gear outside the list"      , aListed, 3        , 110, 0);
+  if(30 != psGear->actualLevel)
+  {
+    printf("gear outside the list followed the DAPCs to %u\n", psGear->actualLevel);
+    faults++;
+  }
+  return (0 != faults) ? 1 : 0;
+}
@@ -0,0 +1,198 @@
+/**
+ * @file identify_bench.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Host benchmark of identification and memory bank reads against the simulated gear. 1, 16 and
+ * 64 D4i gear are addressed, identified and have a block of memory bank 1 read back; frames per device
+ * and bus time are reported for each step, and every driver entry, its groups and every read are checked
+ * against the gear
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "dali.h"
+#include "dali_bus.h"
+#include "dali_gearSim.h"
+
+#define BENCH_SEED       2000u
+#define BENCH_MB1_INDEX  3u
+#define BENCH_MB1_LEN   16u
+#define BENCH_MAX_GEAR  64u
+
+static const uint8_t caBenchGear[] = {1, 16, 64};
+static const uint8_t caBenchGtin[] = {0x00,0x0A,0xBD,0xE8,0x23,0xEC};/*!< OTi30DX, identified as D4i*/
+
+static uint8_t aBenchMB1[BENCH_MAX_GEAR][BENCH_MB1_LEN];
+
+/**
+ * @brief Give a gear the memory banks identification and the memory bank read look at
+ * @param idx gear
+ */
+static void benchGearBanks(uint8_t idx)
+{
+  uint8_t aBank[DALI_GEARSIM_BANK_LEN];
+  uint8_t i;
+  memset(aBank, 0, sizeof(aBank));//the simulator sets the last accessible location from the length
+  memcpy(&aBank[3], caBenchGtin, sizeof(caBenchGtin));
+  aBank[0x0b] = idx;//identification number, unused by identification
+  daliGearSimSetBank(idx, 0, aBank, 0x1b);
+  memset(aBank, 0, sizeof(aBank));//energy and power scale 0: Wh and W
+  daliGearSimSetBank(idx, 202, aBank, 0x10);
+  for(i = 0; i < 0x40; i++)
+  {
+    aBank[i] = (uint8_t)(0x40 * idx + 3 * i);
+  }
+  daliGearSimSetBank(idx, 1, aBank, 0x40);
+}
+
+/**
+ * @brief Contents of one of a gear's memory banks
+ * @return const uint8_t* NULL if it does not have it
+ */
+static const uint8_t *benchBank(const sDaliGear_t *psGear, uint8_t bankNum)
+{
+  uint8_t i;
+  for(i = 0; i < DALI_GEARSIM_NUM_BANKS; i++)
+  {
+    if(bankNum == psGear->saBank[i].num)
+    {
+      return psGear->saBank[i].aData;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Queue a task and run the simulated bus until it is done
+ * @return eDaliTaskStatus_t its final status
+ */
+static eDaliTaskStatus_t benchRunTask(sDaliTask_t *psTask)
+{
+  static sDaliTaskHandle_t sHandle;
+  memset(&sHandle, 0, sizeof(sHandle));
+  if(false == setDaliTaskHandle(psTask, evDaliPrioCommission, &sHandle))
+  {
+    return evDaliTaskRejected;
+  }
+  while(evDaliTaskRunning == getDaliTaskHandleStatus(&sHandle))
+  {
+    daliEngineHostRun(10000);
+  }
+  return getDaliTaskHandleStatus(&sHandle);
+}
+
+/**
+ * @brief Gear holding a short address
+ * @return sDaliGear_t* NULL if none does
+ */
+static const sDaliGear_t *benchGearAt(uint8_t numGear, uint8_t shortAddr)
+{
+  uint8_t i;
+  for(i = 0; i < numGear; i++)
+  {
+    if(shortAddr == daliGearSimGet(i)->shortAddr)
+    {
+      return daliGearSimGet(i);
+    }
+  }
+  return NULL;
+}
+
+int main(void)
+{
+  const saDaliNetworkData_t *psNet = (const saDaliNetworkData_t *)getAddressOfDaliData();
+  const sStaticData_t       *psStatic;
+  const sUserConfig_t       *psUser;
+  const sDaliGear_t         *psGear;
+  sDaliTask_t                sTask;
+  int                        failed = 0;
+  int                        faults;
+  uint8_t                    g;
+  uint8_t                    n;
+  uint8_t                    i;
+  uint32_t                   frames0;
+  uint64_t                   us0;
+  for(g = 0; g < sizeof(caBenchGear); g++)
+  {
+    n      = caBenchGear[g];
+    faults = 0;
+    daliGearSimInit(n, BENCH_SEED + g);
+    for(i = 0; i < n; i++)
+    {
+      benchGearBanks(i);
+    }
+    initDALI();
+    memset(&sTask, 0, sizeof(sTask));
+    sTask.eDaliTask = evDaliAddress;
+    if(  (evDaliTaskComplete != benchRunTask(&sTask))
+       ||(n                  != psNet->numDrivers   ))
+    {
+      printf("%2u gear: addressing found %u\n", n, psNet->numDrivers);
+      failed++;
+      continue;
+    }
+
+    for(i = 0; i < n; i++)
+    {//group members as commissioning left them, some in none
+      daliGearSimGet(i)->groups = (uint16_t)((0x1111u << (i & 3)) & ((i < 4) ? 0 : 0xffffu));
+    }
+    frames0 = daliGearSimStats()->frames;
+    us0     = daliHostNowUs();
+    memset(&sTask, 0, sizeof(sTask));
+    sTask.eDaliTask = evDaliIdentify;
+    if(evDaliTaskComplete != benchRunTask(&sTask))
+    {
+      faults++;
+    }
+    for(i = 0; i < n; i++)
+    {//every entry is the D4i gear holding its address, with that gear's random address and groups
+      psStatic = &psNet->uData[i].sData.sStaticData;
+      psUser   = &psNet->uData[i].sData.sUserConfig;
+      psGear   = benchGearAt(n, psStatic->addr);
+      if(  (NULL                               == psGear                 )
+         ||(evD4i                              != psStatic->eDaliType    )
+         ||((uint8_t)(psGear->randomAddr >> 16) != psStatic->aRandomAddr[0])
+         ||((uint8_t)(psGear->randomAddr >>  8) != psStatic->aRandomAddr[1])
+         ||((uint8_t) psGear->randomAddr        != psStatic->aRandomAddr[2])
+         ||(false                              == psUser->bGroupsRead    )
+         ||(psGear->groups                     != psUser->gearGroups     ))
+      {
+        faults++;
+      }
+    }
+    printf("%2u gear: identify %.1f frames/device, %.2f s bus time, %d faults\n", n,
+           (double)(daliGearSimStats()->frames - frames0) / n, (double)(daliHostNowUs() - us0) / 1e6, faults);
+    failed += faults;
+    faults  = 0;
+
+    frames0 = daliGearSimStats()->frames;
+    us0     = daliHostNowUs();
+    memset(aBenchMB1, 0, sizeof(aBenchMB1));
+    for(i = 0; i < n; i++)
+    {
+      memset(&sTask, 0, sizeof(sTask));
+      sTask.eDaliTask                   = evDaliReadMemoryBank;
+      sTask.uTask.sDaliReadMB.eAddrType = evShortAddress;
+      sTask.uTask.sDaliReadMB.addr      = i;
+      sTask.uTask.sDaliReadMB.memBank   = 1;
+      sTask.uTask.sDaliReadMB.index     = BENCH_MB1_INDEX;
+      sTask.uTask.sDaliReadMB.len       = BENCH_MB1_LEN;
+      sTask.uTask.sDaliReadMB.cPtr      = aBenchMB1[i];
+      psGear = benchGearAt(n, i);
+      if(  (evDaliTaskComplete != benchRunTask(&sTask)                                             )
+         ||(NULL               == psGear                                                           )
+         ||(0                  != memcmp(aBenchMB1[i], benchBank(psGear, 1) + BENCH_MB1_INDEX, BENCH_MB1_LEN)))
+      {
+        faults++;
+      }
+    }
+    printf("%2u gear: memory bank 1, %u bytes: %.1f frames/device, %.2f s bus time, %d faults\n", n, BENCH_MB1_LEN,
+           (double)(daliGearSimStats()->frames - frames0) / n, (double)(daliHostNowUs() - us0) / 1e6, faults);
+    failed += faults;
+  }
+  return (0 != failed) ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+/**
+ * @file manchester_bench.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Host micro-benchmark of the lookup table forward frame encoder against the bit at a time
+ * encoder it replaced, in cycles per frame, after checking both give the same TEs for every 16 bit frame
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "manchester.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1/*!< Time stamp counter, ticks at the nominal core clock*/
+#else
+#define BENCH_HAVE_TSC 0
+#endif
+
+#define BENCH_FRAMES        2000000u
+#define BENCH_FRAME16_BYTES 38u/*!< Bytes of an encoded 16 bit frame: start bit, 16 bits, stop*/
+#define BENCH_FRAME24_BYTES 54u
+
+#define BIT_LOOP_ZERO ((uint16_t)0xff00)
+#define BIT_LOOP_ONE  ((uint16_t)0x00ff)
+
+static uint16_t          aBenchBuf[BENCH_FRAME24_BYTES / 2];
+static volatile uint16_t benchSink;/*!< Keeps the encoded frames live*/
+
+/**
+ * @brief The encoder before the lookup table: one branch per bit
+ */
+static void bitLoopEncodeBit(uint8_t bit, uint16_t *manchesterBit)
+{
+  if(1 == bit)
+  {
+    *manchesterBit = BIT_LOOP_ONE;
+  }
+  else
+  {
+    *manchesterBit = BIT_LOOP_ZERO;
+  }
+}
+
+static void bitLoopEncodeMsg(const uint8_t *msgtoEncode, uint8_t msgLength, uint8_t *manchesterBuffer)
+{
+  uint8_t bit;
+  bitLoopEncodeBit(1, (uint16_t *)manchesterBuffer);
+  manchesterBuffer += 2;
+  while(msgLength != 0)
+  {
+    for(bit = 0; bit < 8; bit++)
+    {
+      bitLoopEncodeBit(((*msgtoEncode) >> (7 - bit)) & 0x01, (uint16_t *)(manchesterBuffer + 2 * bit));
+    }
+    msgLength--;
+    manchesterBuffer += 16;
+    msgtoEncode      += 1;
+  }
+  /*Encode stop: 4 idle high TEs*/
+  memset(manchesterBuffer, 0x00, 4);
+}
+
+static uint64_t benchNowNs(void)
+{
+  struct timespec sNow;
+  clock_gettime(CLOCK_MONOTONIC, &sNow);
+  return (uint64_t)sNow.tv_sec * 1000000000u + (uint64_t)sNow.tv_nsec;
+}
+
+/**
+ * @brief Cycle count, 0 where the host has no counter user code can read
+ */
+static uint64_t benchNowCycles(void)
+{
+#if BENCH_HAVE_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @brief Whether the lookup table encoders match the bit loop, every 16 bit frame and a 24 bit frame
+ * for each of them
+ */
+static _Bool benchSame(void)
+{
+  uint16_t aRef[BENCH_FRAME24_BYTES / 2];
+  uint8_t  aFrame[3];
+  uint32_t i;
+  for(i = 0; i < 0x10000u; i++)
+  {
+    aFrame[0] = (uint8_t)(i >> 8);
+    aFrame[1] = (uint8_t) i;
+    aFrame[2] = (uint8_t)(i * 7u);
+    bitLoopEncodeMsg(aFrame, 2, (uint8_t *)aRef);
+    manchesterEncodeFrame16(aFrame, (uint8_t *)aBenchBuf);
+    if(0 != memcmp(aRef, aBenchBuf, BENCH_FRAME16_BYTES))
+    {
+      printf("manchester bench: frame16 %04x differs\n", (unsigned)i);
+      return false;
+    }
+    manchesterEncodeMsg(aFrame, 2, (uint8_t *)aBenchBuf);
+    if(0 != memcmp(aRef, aBenchBuf, BENCH_FRAME16_BYTES))
+    {
+      printf("manchester bench: msg %04x differs\n", (unsigned)i);
+      return false;
+    }
+    bitLoopEncodeMsg(aFrame, 3, (uint8_t *)aRef);
+    manchesterEncodeFrame24(aFrame, (uint8_t *)aBenchBuf);
+    if(0 != memcmp(aRef, aBenchBuf, BENCH_FRAME24_BYTES))
+    {
+      printf("manchester bench: frame24 %04x%02x differs\n", (unsigned)i, aFrame[2]);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(void)
+{
+  uint8_t  aFrame[2];
+  uint32_t i;
+  uint64_t aNs[3];
+  uint64_t aCycles[3];
+  if(false == benchSame())
+  {
+    return 1;
+  }
+  aNs[0]     = benchNowNs();
+  aCycles[0] = benchNowCycles();
+  for(i = 0; i < BENCH_FRAMES; i++)
+  {
+    aFrame[0] = (uint8_t)(i >> 8);
+    aFrame[1] = (uint8_t) i;
+    bitLoopEncodeMsg(aFrame, 2, (uint8_t *)aBenchBuf);
+    benchSink = aBenchBuf[i % (BENCH_FRAME16_BYTES / 2)];
+  }
+  aCycles[1] = benchNowCycles();
+  aNs[1]     = benchNowNs();
+  for(i = 0; i < BENCH_FRAMES; i++)
+  {
+    aFrame[0] = (uint8_t)(i >> 8);
+    aFrame[1] = (uint8_t) i;
+    manchesterEncodeFrame16(aFrame, (uint8_t *)aBenchBuf);
+    benchSink = aBenchBuf[i % (BENCH_FRAME16_BYTES / 2)];
+  }
+  aCycles[2] = benchNowCycles();
+  aNs[2]     = benchNowNs();
+  printf("manchester bench: all 65536 frames identical\n");
+#if BENCH_HAVE_TSC
+  printf("bit loop: %.1f cycles/frame (%.1f ns)\nlut     : %.1f cycles/frame (%.1f ns)\n",
+         (double)(aCycles[1] - aCycles[0]) / BENCH_FRAMES, (double)(aNs[1] - aNs[0]) / BENCH_FRAMES,
+         (double)(aCycles[2] - aCycles[1]) / BENCH_FRAMES, (double)(aNs[2] - aNs[1]) / BENCH_FRAMES);
+  printf("cycles are time stamp counter ticks, at the nominal clock rather than the boosted one\n");
+#else
+  printf("bit loop: %.1f ns/frame\nlut     : %.1f ns/frame\nno cycle counter on this host\n",
+         (double)(aNs[1] - aNs[0]) / BENCH_FRAMES, (double)(aNs[2] - aNs[1]) / BENCH_FRAMES);
+#endif
+  return 0;
+}
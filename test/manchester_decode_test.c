@@ -0,0 +1,440 @@
+/**
+ * @file manchester_decode_test.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Host regression test of the backward frame decoder. Raw spi buffers are synthesised for
+ * clean, skewed, noisy and colliding replies; clean ones are checked against the decoder it replaced,
+ * the rest against a table of expected results
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "manchester.h"
+
+#define TEST_WINDOW_LEN  48u/*!< Back frame region the driver decodes: window to the start bit plus the frame*/
+#define TEST_BUF_LEN     (TEST_WINDOW_LEN + 24u)/*!< The old decoder reads up to 22 TEs past the start byte*/
+#define TEST_REPLY_WINDOW 26u/*!< Bytes the start bit may appear in, MAXBYTESTOBACKFRAMESTART*/
+#define TEST_STREAM_FRAME 24u/*!< Bytes from the start byte the stream decoder waits for*/
+#define TEST_NO_FRAME    (-1)
+#define TEST_ANY         0xffff/*!< Field not checked*/
+
+/**
+ * @brief One reply on the wire, the line is the wired AND of all of them
+ */
+typedef struct
+{
+  int      backFrame ;/*!< TEST_NO_FRAME for none*/
+  uint16_t startQ4   ;/*!< Start bit falling edge, in 1/16 samples*/
+  uint16_t teQ4      ;/*!< TE width in 1/16 samples, 128 nominal*/
+}sTestReply_t;
+
+typedef struct
+{
+  const char     *pName;
+  sTestReply_t    saReply[2];
+  uint16_t        flipSample;/*!< First sample to invert as a glitch, TEST_ANY for none*/
+  uint8_t         flipLen   ;/*!< Samples inverted*/
+  eRXDataStatus_t eStatus;
+  int             backFrame;/*!< Expected with evValidDataFound*/
+  uint16_t        startSample;
+  uint16_t        teWidthQ4Min;
+  uint16_t        teWidthQ4Max;
+}sTestCase_t;
+
+static uint8_t aTestBuf[TEST_BUF_LEN];
+static int     testFailures = 0;
+
+static uint8_t oldAlignedBuf    [22];
+static uint8_t oldAlignedBufCopy[22];
+
+/**
+ * @brief The decoder before the reentrant rewrite, byte aligned with one vote per TE byte
+ */
+static eRXDataStatus_t oldDecodeBackFrame(const uint8_t *rxManBuf, uint8_t *decodedByte, uint8_t maxLen)
+{
+  uint8_t       decodeCtr   = 0x00;
+  uint8_t       decodeIndex = 0x00;
+  uint8_t       shift       = 0x00;
+  uint8_t       mask        = 0x00;
+  uint8_t       setBitCount = 0x00;
+  const uint8_t cBackFrameNumTEs = 22;
+  while(decodeCtr++ < maxLen)
+  {
+    if(*(rxManBuf + decodeCtr) < 255)
+    {//start bit found
+      break;
+    }
+  }
+  if(decodeCtr >= maxLen)
+  {
+    return evNoDataFound;
+  }
+  else if((decodeCtr + 16) > maxLen)
+  {
+    return evDataIncomplete;
+  }
+  while(shift < 7)
+  {
+    if((*(rxManBuf + decodeCtr) & (0x80 >> shift)) == 0)
+    {
+      break;
+    }
+    mask += 1 << (7 - shift);
+    shift++;
+  }
+  while(decodeIndex < cBackFrameNumTEs)
+  {
+    oldAlignedBuf[decodeIndex] = (uint8_t)((rxManBuf[decodeCtr + decodeIndex] << shift)
+                                         + ((rxManBuf[decodeCtr + decodeIndex + 1] & mask) >> (8 - shift)));
+    decodeIndex++;
+  }
+  memcpy(oldAlignedBufCopy, oldAlignedBuf, sizeof(oldAlignedBuf));
+  decodeIndex = 0;
+  while(decodeIndex < cBackFrameNumTEs)
+  {
+    while(oldAlignedBuf[decodeIndex] != 0)
+    {
+      setBitCount += (oldAlignedBuf[decodeIndex] & 1);
+      oldAlignedBuf[decodeIndex] >>= 1;
+    }
+    if(setBitCount < 4)
+    {
+      oldAlignedBuf[decodeIndex] = 0;
+    }
+    else if((setBitCount == 4) && (oldAlignedBufCopy[decodeIndex] == 0xf0))
+    {
+      oldAlignedBuf[decodeIndex] = 0;
+    }
+    else
+    {
+      oldAlignedBuf[decodeIndex] = 1;
+    }
+    if(oldAlignedBufCopy[decodeIndex] == 0x07)
+    {
+      oldAlignedBuf[decodeIndex] = 1;
+    }
+    setBitCount = 0;
+    decodeIndex++;
+  }
+  if(  (oldAlignedBuf[0] != 0)
+     ||(oldAlignedBuf[1] != 1))
+  {
+    return evDataCorrupt;
+  }
+  if((oldAlignedBuf[18] + oldAlignedBuf[19] + oldAlignedBuf[20] + oldAlignedBuf[21]) < 3)
+  {
+    return evDataCorrupt;
+  }
+  for(decodeIndex = 0; decodeIndex < 8; decodeIndex++)
+  {
+    if(  (oldAlignedBuf[2 + (2 * decodeIndex)] == 1)
+       &&(oldAlignedBuf[3 + (2 * decodeIndex)] == 0))
+    {
+      *decodedByte &= (uint8_t)~(1 << (7 - decodeIndex));
+    }
+    else if(  (oldAlignedBuf[2 + (2 * decodeIndex)] == 0)
+            &&(oldAlignedBuf[3 + (2 * decodeIndex)] == 1))
+    {
+      *decodedByte |= (uint8_t)(1 << (7 - decodeIndex));
+    }
+    else
+    {
+      return evDataCorrupt;
+    }
+  }
+  return evValidDataFound;
+}
+
+/**
+ * @brief Line level a reply drives at a sample, high while it is not sending
+ */
+static uint8_t testReplyLevel(const sTestReply_t *psReply, uint16_t sample)
+{
+  uint32_t te;
+  uint8_t  bit;
+  if(  (TEST_NO_FRAME              == psReply->backFrame)
+     ||((uint32_t)sample * 16u + 8u <  psReply->startQ4  ))
+  {//sampled mid-sample, before the start bit
+    return 1;
+  }
+  te = ((uint32_t)sample * 16u + 8u - psReply->startQ4) / psReply->teQ4;
+  if(te < 2)
+  {//start bit, low then high
+    return (uint8_t)te;
+  }
+  if(te >= 18)
+  {//stop
+    return 1;
+  }
+  bit = (uint8_t)((psReply->backFrame >> (7 - ((te - 2) / 2))) & 1);
+  return (0 == (te & 1)) ? (uint8_t)!bit : bit;//a 1 is low then high
+}
+
+/**
+ * @brief Fill aTestBuf with what the spi samples, one bit per sample, earliest in the msb
+ */
+static void testSynth(const sTestReply_t *psReplies, uint8_t numReplies, uint16_t flipSample, uint8_t flipLen)
+{
+  uint16_t sample;
+  uint8_t  level;
+  uint8_t  r;
+  memset(aTestBuf, 0, sizeof(aTestBuf));
+  for(sample = 0; sample < (TEST_BUF_LEN * 8u); sample++)
+  {
+    level = 1;
+    for(r = 0; r < numReplies; r++)
+    {
+      level &= testReplyLevel(&psReplies[r], sample);
+    }
+    if(  (TEST_ANY != flipSample                      )
+       &&(sample   >= flipSample                      )
+       &&(sample   <  (uint16_t)(flipSample + flipLen)))
+    {
+      level ^= 1;
+    }
+    aTestBuf[sample >> 3] |= (uint8_t)(level << (7 - (sample & 7)));
+  }
+}
+
+static void testFail(const char *pName, const char *pWhat, unsigned expected, unsigned got)
+{
+  printf("manchester decode: %s: %s expected %u got %u\n", pName, pWhat, expected, got);
+  testFailures++;
+}
+
+/**
+ * @brief Every backward frame at every sample phase of a few start bytes, nominal timing: same
+ * outcome as the old decoder, start sample where it was put and a nominal TE width
+ */
+static void testCleanAgainstOld(void)
+{
+  static const uint8_t caStartByte[] = {1, 2, 9, 26};
+  sTestReply_t         sReply;
+  sManchesterDecode_t  sDecode;
+  eRXDataStatus_t      eOld;
+  uint8_t              oldByte;
+  uint8_t              b;
+  uint8_t              phase;
+  uint16_t             value;
+  char                 aName[32];
+  for(b = 0; b < sizeof(caStartByte); b++)
+  {
+    for(phase = 0; phase < 8; phase++)
+    {
+      for(value = 0; value < 256; value++)
+      {
+        snprintf(aName, sizeof(aName), "clean %02x at %u.%u", value, caStartByte[b], phase);
+        sReply.backFrame = value;
+        sReply.startQ4   = (uint16_t)((caStartByte[b] * 8u + phase) * 16u);
+        sReply.teQ4      = 128;
+        testSynth(&sReply, 1, TEST_ANY, 0);
+        oldByte = 0;
+        eOld    = oldDecodeBackFrame(aTestBuf, &oldByte, TEST_WINDOW_LEN);
+        (void)manchesterDecodeBackFrameEx(aTestBuf, TEST_WINDOW_LEN, &sDecode);
+        if(eOld != sDecode.eStatus)
+        {
+          testFail(aName, "status of the old decoder", eOld, sDecode.eStatus);
+          continue;
+        }
+        if(evValidDataFound != sDecode.eStatus)
+        {
+          testFail(aName, "status", evValidDataFound, sDecode.eStatus);
+          continue;
+        }
+        if(oldByte != sDecode.backFrame)
+        {
+          testFail(aName, "frame of the old decoder", oldByte, sDecode.backFrame);
+        }
+        if(sReply.startQ4 / 16u != sDecode.startSample)
+        {
+          testFail(aName, "startSample", sReply.startQ4 / 16u, sDecode.startSample);
+        }
+        if(128 != sDecode.teWidthQ4)
+        {
+          testFail(aName, "teWidthQ4", 128, sDecode.teWidthQ4);
+        }
+      }
+    }
+  }
+}
+
+/*Start sample 83: byte 10, phase 3. Stop TEs start at sample 83 + 18 * 8*/
+static const sTestCase_t caTestCases[] =
+{
+  {"no reply"          , {{TEST_NO_FRAME,       0, 128}, {TEST_NO_FRAME,           0, 128}}, TEST_ANY , 0, evNoDataFound   ,    0, TEST_ANY,        0,        0},
+  {"0xff"              , {{0xff         , 83 * 16, 128}, {TEST_NO_FRAME,           0, 128}}, TEST_ANY , 0, evValidDataFound, 0xff,       83,      128,      128},
+  {"0x00"              , {{0x00         , 83 * 16, 128}, {TEST_NO_FRAME,           0, 128}}, TEST_ANY , 0, evValidDataFound, 0x00,       83,      128,      128},
+  {"fast gear -6%"     , {{0xa5         , 83 * 16, 120}, {TEST_NO_FRAME,           0, 128}}, TEST_ANY , 0, evValidDataFound, 0xa5,       83,      116,      124},
+  {"slow gear +6%"     , {{0xa5         , 83 * 16, 136}, {TEST_NO_FRAME,           0, 128}}, TEST_ANY , 0, evValidDataFound, 0xa5,       83,      132,      140},
+  {"slow gear +10%"    , {{0x3c         , 83 * 16, 141}, {TEST_NO_FRAME,           0, 128}}, TEST_ANY , 0, evValidDataFound, 0x3c,       83,      137,      145},
+  {"glitch in data"    , {{0x5a         , 83 * 16, 128}, {TEST_NO_FRAME,           0, 128}}, 83 +  50 , 1, evValidDataFound, 0x5a,       83,      128,      128},
+  {"glitch in stop"    , {{0x5a         , 83 * 16, 128}, {TEST_NO_FRAME,           0, 128}}, 83 + 148 , 1, evValidDataFound, 0x5a,       83,      128,      128},
+  {"one stop TE low"   , {{0x5a         , 83 * 16, 128}, {TEST_NO_FRAME,           0, 128}}, 83 + 152 , 8, evValidDataFound, 0x5a,       83,      128,      128},
+  {"two stop TEs low"  , {{0x5a         , 83 * 16, 128}, {TEST_NO_FRAME,           0, 128}}, 83 + 152 ,16, evDataCorrupt   ,    0,       83,        0,        0},
+  {"start bit high"    , {{0x5a         , 83 * 16, 128}, {TEST_NO_FRAME,           0, 128}}, 83 +   8 , 8, evDataCorrupt   ,    0,       83,        0,        0},
+  {"same frame, skewed", {{0x5a         , 83 * 16, 128}, {0x5a         , 84 * 16 + 8, 128}}, TEST_ANY , 0, evValidDataFound, 0x5a,       83, TEST_ANY, TEST_ANY},
+  {"collision"         , {{0x5a         , 83 * 16, 128}, {0x3c         ,     83 * 16, 128}}, TEST_ANY , 0, evDataCorrupt   ,    0,       83,        0,        0},
+  {"collision, skewed" , {{0x80         , 83 * 16, 128}, {0x7f         ,     86 * 16, 128}}, TEST_ANY , 0, evDataCorrupt   ,    0,       83,        0,        0},
+  {"collision, one bit", {{0x01         , 83 * 16, 128}, {0x00         ,     83 * 16, 128}}, TEST_ANY , 0, evDataCorrupt   ,    0,       83,        0,        0},
+  {"too late for buffer",{{0x5a    , 40 * 8 * 16, 128}, {TEST_NO_FRAME,           0, 128}}, TEST_ANY , 0, evDataIncomplete,    0,      320,        0,        0},
+};
+
+static void testTable(void)
+{
+  const sTestCase_t  *psCase;
+  sManchesterDecode_t sDecode;
+  uint8_t             numReplies;
+  uint8_t             i;
+  for(i = 0; i < (sizeof(caTestCases) / sizeof(caTestCases[0])); i++)
+  {
+    psCase     = &caTestCases[i];
+    numReplies = (TEST_NO_FRAME == psCase->saReply[1].backFrame) ? 1 : 2;
+    testSynth(psCase->saReply, numReplies, psCase->flipSample, psCase->flipLen);
+    (void)manchesterDecodeBackFrameEx(aTestBuf, TEST_WINDOW_LEN, &sDecode);
+    if(psCase->eStatus != sDecode.eStatus)
+    {
+      testFail(psCase->pName, "status", psCase->eStatus, sDecode.eStatus);
+      continue;
+    }
+    if(  (evValidDataFound  == sDecode.eStatus  )
+       &&(psCase->backFrame != sDecode.backFrame))
+    {
+      testFail(psCase->pName, "frame", (unsigned)psCase->backFrame, sDecode.backFrame);
+    }
+    if(  (evNoDataFound       != sDecode.eStatus    )
+       &&(TEST_ANY            != psCase->startSample)
+       &&(psCase->startSample != sDecode.startSample))
+    {
+      testFail(psCase->pName, "startSample", psCase->startSample, sDecode.startSample);
+    }
+    if(  (TEST_ANY != psCase->teWidthQ4Min)
+       &&(  (sDecode.teWidthQ4 < psCase->teWidthQ4Min)
+          ||(sDecode.teWidthQ4 > psCase->teWidthQ4Max)))
+    {
+      testFail(psCase->pName, "teWidthQ4", psCase->teWidthQ4Min, sDecode.teWidthQ4);
+    }
+  }
+}
+
+/**
+ * @brief Feed aTestBuf to the stream decoder in chunks of every size, as the dma would fill it. The
+ * outcome must not depend on the chunks, must be reported at the first feed that holds the byte
+ * which makes it certain and not before, and manchesterStreamNeed must never ask past that byte
+ */
+static void testStreamChunks(const char *pName)
+{
+  sManchesterStream_t sStream;
+  sManchesterDecode_t sOneShot;
+  eRXDataStatus_t     eStatus;
+  uint8_t             decideLen = TEST_REPLY_WINDOW + 1;//no start bit in the window: idle through it
+  _Bool               bStart    = false;
+  uint8_t             rxLen;
+  uint8_t             lastLen;
+  uint8_t             need;
+  uint8_t             chunk;
+  uint8_t             i;
+  for(i = 1; i <= TEST_REPLY_WINDOW; i++)
+  {
+    if(0xff != aTestBuf[i])
+    {
+      decideLen = ((i + TEST_STREAM_FRAME) > TEST_WINDOW_LEN) ? TEST_WINDOW_LEN : (uint8_t)(i + TEST_STREAM_FRAME);
+      bStart    = true;
+      break;
+    }
+  }
+  if(false == bStart)
+  {
+    sOneShot.eStatus = evNoDataFound;
+  }
+  else
+  {
+    (void)manchesterDecodeBackFrameEx(aTestBuf, decideLen, &sOneShot);
+  }
+  for(chunk = 1; chunk <= TEST_WINDOW_LEN; chunk++)
+  {
+    manchesterStreamInit(&sStream, aTestBuf, TEST_REPLY_WINDOW, TEST_WINDOW_LEN);
+    lastLen = 0;
+    eStatus = evDataIncomplete;
+    for(rxLen = chunk; lastLen < TEST_WINDOW_LEN; rxLen = ((rxLen + chunk) > TEST_WINDOW_LEN) ? TEST_WINDOW_LEN : (uint8_t)(rxLen + chunk))
+    {
+      need = manchesterStreamNeed(&sStream);
+      if(  (need <= lastLen  )
+         ||(need >  decideLen))
+      {
+        testFail(pName, "need", decideLen, need);
+        return;
+      }
+      eStatus = manchesterStreamFeed(&sStream, rxLen);
+      if((evDataIncomplete != eStatus) != (rxLen >= decideLen))
+      {
+        testFail(pName, "decided at feed", decideLen, rxLen);
+        return;
+      }
+      lastLen = rxLen;
+      if(evDataIncomplete != eStatus)
+      {
+        break;
+      }
+    }
+    if(  (eStatus        != sOneShot.eStatus)
+       ||(sStream.endLen != decideLen       ))
+    {
+      testFail(pName, "chunked status", sOneShot.eStatus, eStatus);
+      return;
+    }
+    if(  (evValidDataFound == eStatus              )
+       &&(  (sOneShot.backFrame   != sStream.sDecode.backFrame  )
+          ||(sOneShot.startSample != sStream.sDecode.startSample)
+          ||(sOneShot.teWidthQ4   != sStream.sDecode.teWidthQ4  )))
+    {
+      testFail(pName, "chunked frame", sOneShot.backFrame, sStream.sDecode.backFrame);
+      return;
+    }
+  }
+}
+
+static void testStream(void)
+{
+  const sTestCase_t *psCase;
+  sTestReply_t       saReply[2];
+  char               aName[40];
+  uint8_t            startByte;
+  uint8_t            i;
+  for(i = 0; i < (sizeof(caTestCases) / sizeof(caTestCases[0])); i++)
+  {
+    psCase = &caTestCases[i];
+    testSynth(psCase->saReply, (TEST_NO_FRAME == psCase->saReply[1].backFrame) ? 1 : 2, psCase->flipSample, psCase->flipLen);
+    snprintf(aName, sizeof(aName), "stream %s", psCase->pName);
+    testStreamChunks(aName);
+  }
+  /*Every start byte, in the window, at its last byte and past it*/
+  for(startByte = 1; startByte <= TEST_REPLY_WINDOW + 4; startByte++)
+  {
+    saReply[0].backFrame = 0xa5;
+    saReply[0].startQ4   = (uint16_t)((startByte * 8u + 5u) * 16u);
+    saReply[0].teQ4      = 128;
+    saReply[1].backFrame = 0x5a;
+    saReply[1].startQ4   = saReply[0].startQ4;
+    saReply[1].teQ4      = 128;
+    testSynth(saReply, 1, TEST_ANY, 0);
+    snprintf(aName, sizeof(aName), "stream clean at %u", startByte);
+    testStreamChunks(aName);
+    testSynth(saReply, 2, TEST_ANY, 0);
+    snprintf(aName, sizeof(aName), "stream collision at %u", startByte);
+    testStreamChunks(aName);
+  }
+}
+
+int main(void)
+{
+  testCleanAgainstOld();
+  testTable();
+  testStream();
+  printf("manchester decode: %d failures\n", testFailures);
+  return (0 != testFailures) ? 1 : 0;
+}
@@ -0,0 +1,222 @@
+/**
+ * @file restore_test.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Host test of addressing restore runs against the simulated gear. A bus of 5 gear is addressed
+ * and identified, then changed: gear taken off, new gear put on, gear that drew another random address.
+ * After each restore run the driver list must hold exactly the gear on the bus, the ones it knew in
+ * their old order and with their old short addresses, then the new ones
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "dali.h"
+#include "dali_bus.h"
+#include "dali_gearSim.h"
+
+#define TEST_GEAR  5u
+#define TEST_SEED  4000u
+#define TEST_NONE  0xffu
+
+/**
+ * @brief A changed bus: which of the addressed gear stay on it, how many new ones join
+ */
+typedef struct
+{
+  const char *pName;
+  uint8_t     aGone[2];     /*!< Gear taken off, TEST_NONE for none*/
+  uint8_t     reRandomised; /*!< Gear that drew another random address, TEST_NONE for none*/
+  uint8_t     numNew;       /*!< Factory fresh gear put on*/
+}sTestCase_t;
+
+static const sTestCase_t caTestCases[] =
+{
+  {"unchanged"                      , {TEST_NONE, TEST_NONE}, TEST_NONE, 0},
+  {"one gone"                       , {3        , TEST_NONE}, TEST_NONE, 0},
+  {"one gone, one new"              , {3        , TEST_NONE}, TEST_NONE, 1},
+  {"first gone, two new"            , {0        , TEST_NONE}, TEST_NONE, 2},
+  {"two gone, one new"              , {1        , 4        }, TEST_NONE, 1},
+  {"one re-randomised, one gone"    , {2        , TEST_NONE}, 0        , 0},
+  {"one re-randomised, one gone, new", {4        , TEST_NONE}, 1        , 1},
+};
+
+static sDaliGear_t         saAddressed[TEST_GEAR];/*!< Gear as addressing and identification left them*/
+static saDaliNetworkData_t sAddressedNet;
+
+/**
+ * @brief Queue a task and run the simulated bus until it is done
+ * @return eDaliTaskStatus_t its final status
+ */
+static eDaliTaskStatus_t testRunTask(sDaliTask_t *psTask)
+{
+  static sDaliTaskHandle_t sHandle;
+  memset(&sHandle, 0, sizeof(sHandle));
+  if(false == setDaliTaskHandle(psTask, evDaliPrioCommission, &sHandle))
+  {
+    return evDaliTaskRejected;
+  }
+  while(evDaliTaskRunning == getDaliTaskHandleStatus(&sHandle))
+  {
+    daliEngineHostRun(10000);
+  }
+  return getDaliTaskHandleStatus(&sHandle);
+}
+
+static uint32_t testEntryRandom(const sStaticData_t *psStatic)
+{
+  return ((uint32_t)psStatic->aRandomAddr[0] << 16) | ((uint32_t)psStatic->aRandomAddr[1] << 8) | psStatic->aRandomAddr[2];
+}
+
+/**
+ * @brief Whether a gear of the addressed bus is still on it
+ */
+static _Bool testStays(const sTestCase_t *psCase, uint8_t gear)
+{
+  return ((gear != psCase->aGone[0]) && (gear != psCase->aGone[1]));
+}
+
+/**
+ * @brief Run a restore over the changed bus and check the driver list it leaves
+ * @return int faults
+ */
+static int testRestore(const sTestCase_t *psCase)
+{
+  saDaliNetworkData_t *psNet = (saDaliNetworkData_t *)getAddressOfDaliData();
+  const sStaticData_t *psStatic;
+  const sDaliGear_t   *psGear;
+  sDaliTask_t          sTask;
+  uint8_t              aGearOf[TEST_GEAR + 2];/*!< Gear slot of each entry of sAddressedNet that stays*/
+  uint8_t              numOn = 0;
+  uint8_t              numStay;
+  uint8_t              gear;
+  uint8_t              pos;
+  uint8_t              held;
+  int                  faults = 0;
+  for(gear = 0; gear < TEST_GEAR; gear++)
+  {
+    if(true == testStays(psCase, gear))
+    {
+      numOn++;
+    }
+  }
+  numStay = numOn;
+  numOn  += psCase->numNew;
+  /*Gear that stay go first, in the order the list had them; new gear are factory fresh*/
+  daliGearSimInit(numOn, TEST_SEED + 1);
+  for(pos = 0, numStay = 0; pos < sAddressedNet.numDrivers; pos++)
+  {
+    for(gear = 0; gear < TEST_GEAR; gear++)
+    {
+      if(  (saAddressed[gear].shortAddr == sAddressedNet.uData[pos].sData.sStaticData.addr)
+         &&(true                        == testStays(psCase, gear)                          ))
+      {
+        *daliGearSimGet(numStay) = saAddressed[gear];
+        if(gear == psCase->reRandomised)
+        {
+          daliGearSimGet(numStay)->randomAddr ^= 0x5a5a5a;
+        }
+        aGearOf[numStay++] = pos;
+      }
+    }
+  }
+  initDALI();
+  *psNet = sAddressedNet;
+  memset(&sTask, 0, sizeof(sTask));
+  sTask.eDaliTask                    = evDaliAddress;
+  sTask.uTask.sAddress.bRestore      = true;
+  if(evDaliTaskComplete != testRunTask(&sTask))
+  {
+    printf("%s: restore did not complete\n", psCase->pName);
+    return 1;
+  }
+  if(numOn != psNet->numDrivers)
+  {
+    printf("%s: numDrivers %u, %u gear on the bus\n", psCase->pName, psNet->numDrivers, numOn);
+    faults++;
+  }
+  for(pos = 0; (pos < psNet->numDrivers) && (pos < numOn); pos++)
+  {
+    psStatic = &psNet->uData[pos].sData.sStaticData;
+    held     = 0;
+    for(gear = 0; gear < numOn; gear++)
+    {
+      if(daliGearSimGet(gear)->shortAddr == psStatic->addr)
+      {
+        held++;
+      }
+    }
+    if(1 != held)
+    {
+      printf("%s: entry %u addr %u held by %u gear\n", psCase->pName, pos, psStatic->addr, held);
+      faults++;
+    }
+    if(pos < numStay)
+    {//known gear, in the old order, with their old short address and data
+      psGear = daliGearSimGet(pos);
+      if(  (psStatic->addr      != sAddressedNet.uData[aGearOf[pos]].sData.sStaticData.addr     )
+         ||(psStatic->addr      != psGear->shortAddr                                            )
+         ||(psStatic->eDaliType != sAddressedNet.uData[aGearOf[pos]].sData.sStaticData.eDaliType))
+      {
+        printf("%s: entry %u addr %u, expected the gear at %u\n", psCase->pName, pos, psStatic->addr,
+               sAddressedNet.uData[aGearOf[pos]].sData.sStaticData.addr);
+        faults++;
+      }
+      if(  (RANDOM_ADDR_UNKNOWN != testEntryRandom(psStatic))
+         &&(psGear->randomAddr  != testEntryRandom(psStatic)))
+      {
+        printf("%s: entry %u keeps a random address its gear no longer has\n", psCase->pName, pos);
+        faults++;
+      }
+    }
+    else if(RANDOM_ADDR_UNKNOWN != testEntryRandom(psStatic))
+    {
+      printf("%s: new entry %u has a random address\n", psCase->pName, pos);
+      faults++;
+    }
+  }
+  for(pos = numOn; pos < MAX_SUPPORTED_DRIVERS; pos++)
+  {
+    if(0 != psNet->uData[pos].sData.sStaticData.addr)
+    {
+      printf("%s: entry %u past the list left set\n", psCase->pName, pos);
+      faults++;
+    }
+  }
+  printf("%-34s %u gear, numDrivers %u, %d faults\n", psCase->pName, numOn, psNet->numDrivers, faults);
+  return faults;
+}
+
+int main(void)
+{
+  saDaliNetworkData_t *psNet  = (saDaliNetworkData_t *)getAddressOfDaliData();
+  sDaliTask_t          sTask;
+  int                  faults = 0;
+  uint8_t              i;
+  daliGearSimInit(TEST_GEAR, TEST_SEED);
+  initDALI();
+  memset(&sTask, 0, sizeof(sTask));
+  sTask.eDaliTask = evDaliAddress;
+  (void)testRunTask(&sTask);
+  memset(&sTask, 0, sizeof(sTask));
+  sTask.eDaliTask = evDaliIdentify;
+  (void)testRunTask(&sTask);
+  if(TEST_GEAR != psNet->numDrivers)
+  {
+    printf("restore test: addressing found %u of %u gear\n", psNet->numDrivers, TEST_GEAR);
+    return 1;
+  }
+  for(i = 0; i < TEST_GEAR; i++)
+  {
+    saAddressed[i] = *daliGearSimGet(i);
+  }
+  sAddressedNet = *psNet;
+  for(i = 0; i < (sizeof(caTestCases) / sizeof(caTestCases[0])); i++)
+  {
+    faults += testRestore(&caTestCases[i]);
+  }
+  return (0 != faults) ? 1 : 0;
+}
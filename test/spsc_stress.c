@@ -0,0 +1,133 @@
+/**
+ * @file spsc_stress.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Host stress test of the lock free rings between the cores: a second thread plays core1,
+ * popping requests and pushing them back as results, while the main thread plays core0
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "dali_spsc.h"
+
+#define STRESS_ROUND_TRIPS 2000000u
+#define STRESS_RING_LEN    16u
+#define STRESS_PAYLOAD     36u
+
+typedef struct
+{
+  uint32_t seq;
+  uint8_t  aPayload[STRESS_PAYLOAD];
+}sStressElem_t;/*!< Same size class as a task request*/
+
+static sStressElem_t saReqStore[STRESS_RING_LEN];
+static sStressElem_t saResStore[STRESS_RING_LEN];
+static sDaliSpsc_t   sReqRing;
+static sDaliSpsc_t   sResRing;
+static uint32_t      core1Bad = 0;
+
+static void stressFill(sStressElem_t *psElem, uint32_t seq)
+{
+  uint8_t i;
+  psElem->seq = seq;
+  for(i = 0; i < STRESS_PAYLOAD; i++)
+  {
+    psElem->aPayload[i] = (uint8_t)(seq * 31u + i);
+  }
+}
+
+/**
+ * @brief Whether an element is the one expected next, whole
+ * @return _Bool false if it is out of order or torn
+ */
+static _Bool stressCheck(const sStressElem_t *psElem, uint32_t seq)
+{
+  uint8_t i;
+  if(seq != psElem->seq)
+  {
+    return false;
+  }
+  for(i = 0; i < STRESS_PAYLOAD; i++)
+  {
+    if((uint8_t)(seq * 31u + i) != psElem->aPayload[i])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void *stressCore1(void *pArg)
+{
+  sStressElem_t sElem;
+  uint32_t      seq = 0;
+  (void)pArg;
+  while(seq < STRESS_ROUND_TRIPS)
+  {
+    if(false == daliSpscPop(&sReqRing, &sElem))
+    {
+      sched_yield();
+      continue;
+    }
+    if(false == stressCheck(&sElem, seq))
+    {
+      core1Bad++;
+    }
+    seq++;
+    while(false == daliSpscPush(&sResRing, &sElem))
+    {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+int main(void)
+{
+  pthread_t     core1;
+  sStressElem_t sElem;
+  uint32_t      sent    = 0;
+  uint32_t      got     = 0;
+  uint32_t      bad     = 0;
+  uint32_t      reqFull = 0;
+  daliSpscInit(&sReqRing, saReqStore, sizeof(sStressElem_t), STRESS_RING_LEN);
+  daliSpscInit(&sResRing, saResStore, sizeof(sStressElem_t), STRESS_RING_LEN);
+  if(0 != pthread_create(&core1, NULL, stressCore1, NULL))
+  {
+    printf("spsc stress: no thread\n");
+    return 1;
+  }
+  while(got < STRESS_ROUND_TRIPS)
+  {
+    if(sent < STRESS_ROUND_TRIPS)
+    {
+      stressFill(&sElem, sent);
+      if(true == daliSpscPush(&sReqRing, &sElem))
+      {
+        sent++;
+      }
+      else
+      {
+        reqFull++;
+        sched_yield();
+      }
+    }
+    if(true == daliSpscPop(&sResRing, &sElem))
+    {
+      if(false == stressCheck(&sElem, got))
+      {
+        bad++;
+      }
+      got++;
+    }
+  }
+  pthread_join(core1, NULL);
+  printf("spsc stress: round trips %u, corrupt or out of order %u requests %u results, request ring full %u times, left %u/%u\n",
+         got, core1Bad, bad, reqFull, daliSpscCount(&sReqRing), daliSpscCount(&sResRing));
+  return ((0 != core1Bad) || (0 != bad) || (0 != daliSpscCount(&sReqRing)) || (0 != daliSpscCount(&sResRing))) ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+/**
+ * @file telemetry_bench.c
+ * @author Scott Price (sprice@unvlt.com)
+ * @brief Host benchmark of the telemetry poller over 64 simulated D4i gear: after addressing and
+ * identification the poller runs for a stretch of simulated time at its default budget. Reports reads per
+ * metric, the share of the bus they took and how long a full sweep of every metric of every driver took,
+ * and checks LED current and voltage against what the gear hold
+ * @version 0.1
+ * @date 2021-02-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "dali.h"
+#include "dali_bus.h"
+#include "dali_driver.h"
+#include "dali_gearSim.h"
+#include "dali_telemetry.h"
+
+#define BENCH_GEAR     64u
+#define BENCH_SEED     3000u
+#define BENCH_RUN_US   1200000000ull/*!< Simulated time the poller runs for*/
+#define BENCH_STEP_US  10000u       /*!< Application loop period*/
+
+static const uint8_t caBenchGtin[] = {0x00,0x0A,0xBD,0xE8,0x23,0xEC};/*!< OTi30DX, identified as D4i*/
+static const char   *caBenchMetric[evDaliTelemNumMetrics] = {"power", "energy", "current", "voltage", "temp"};
+
+/**
+ * @brief LED current and voltage a gear reports, raw
+ */
+static uint16_t benchAmps (uint8_t idx) { return (uint16_t)(0x0200u + idx); }
+static uint16_t benchVolts(uint8_t idx) { return (uint16_t)(0x1000u + 3u * idx); }
+
+/**
+ * @brief Give a gear bank 0 for identification and the D4i banks the poller reads
+ * @param idx gear
+ */
+static void benchGearBanks(uint8_t idx)
+{
+  uint8_t aBank[DALI_GEARSIM_BANK_LEN];
+  memset(aBank, 0, sizeof(aBank));
+  memcpy(&aBank[3], caBenchGtin, sizeof(caBenchGtin));
+  daliGearSimSetBank(idx, 0, aBank, 0x1b);
+  memset(aBank, 0, sizeof(aBank));//energy and power scale 0: Wh and W
+  aBank[0x0a] = (uint8_t)(100u + idx);//energy, low byte
+  aBank[0x0f] = (uint8_t)( 30u + idx);//power, low byte
+  daliGearSimSetBank(idx, 202, aBank, 0x10);
+  memset(aBank, 0, sizeof(aBank));
+  aBank[0x1b] = (uint8_t)(60u + 25u + (idx % 10u));//gear temperature, 25C and up
+  daliGearSimSetBank(idx, 205, aBank, 0x1c);
+  memset(aBank, 0, sizeof(aBank));
+  aBank[0x12] = (uint8_t)(benchVolts(idx) >> 8);
+  aBank[0x13] = (uint8_t) benchVolts(idx);
+  aBank[0x14] = (uint8_t)(benchAmps(idx) >> 8);
+  aBank[0x15] = (uint8_t) benchAmps(idx);
+  daliGearSimSetBank(idx, 206, aBank, 0x21);
+}
+
+/**
+ * @brief Queue a task and run the simulated bus until it is done
+ * @return eDaliTaskStatus_t its final status
+ */
+static eDaliTaskStatus_t benchRunTask(sDaliTask_t *psTask)
+{
+  static sDaliTaskHandle_t sHandle;
+  memset(&sHandle, 0, sizeof(sHandle));
+  if(false == setDaliTaskHandle(psTask, evDaliPrioCommission, &sHandle))
+  {
+    return evDaliTaskRejected;
+  }
+  while(evDaliTaskRunning == getDaliTaskHandleStatus(&sHandle))
+  {
+    daliEngineHostRun(10000);
+  }
+  return getDaliTaskHandleStatus(&sHandle);
+}
+
+/**
+ * @brief Whether every metric of every driver has been read at least once
+ */
+static _Bool benchAllRead(void)
+{
+  sDaliTelemSample_t sSample;
+  uint8_t            driver;
+  uint8_t            eMetric;
+  for(driver = 0; driver < BENCH_GEAR; driver++)
+  {
+    for(eMetric = 0; eMetric < evDaliTelemNumMetrics; eMetric++)
+    {
+      if(false == daliTelemetryGet(driver, (eDaliTelemMetric_t)eMetric, &sSample))
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+int main(void)
+{
+  const saDaliNetworkData_t   *psNet = (const saDaliNetworkData_t *)getAddressOfDaliData();
+  const sDaliTelemetryStats_t *psStats;
+  sDaliTelemSample_t           sSample;
+  sDaliTask_t                  sTask;
+  uint64_t                     us0;
+  uint64_t                     busUs0;
+  uint64_t                     sweepUs = 0;
+  uint8_t                      shortAddr;
+  uint8_t                      driver;
+  uint8_t                      gear;
+  uint8_t                      eMetric;
+  uint32_t                     reads  = 0;
+  uint32_t                     stale  = 0;
+  int                          faults = 0;
+  daliGearSimInit(BENCH_GEAR, BENCH_SEED);
+  for(driver = 0; driver < BENCH_GEAR; driver++)
+  {
+    benchGearBanks(driver);
+  }
+  initDALI();
+  memset(&sTask, 0, sizeof(sTask));
+  sTask.eDaliTask = evDaliAddress;
+  (void)benchRunTask(&sTask);
+  memset(&sTask, 0, sizeof(sTask));
+  sTask.eDaliTask = evDaliIdentify;
+  if(  (evDaliTaskComplete != benchRunTask(&sTask))
+     ||(BENCH_GEAR         != psNet->numDrivers   ))
+  {
+    printf("telemetry bench: %u of %u gear identified\n", psNet->numDrivers, BENCH_GEAR);
+    return 1;
+  }
+
+  daliTelemetryInit();
+  us0    = daliHostNowUs();
+  busUs0 = getDaliBusStats()->busUs;
+  while((daliHostNowUs() - us0) < BENCH_RUN_US)
+  {
+    daliTelemetryPoll();
+    daliEngineHostRun(BENCH_STEP_US);
+    if(  (0    == sweepUs       )
+       &&(true == benchAllRead()))
+    {
+      sweepUs = daliHostNowUs() - us0;
+    }
+  }
+  psStats = getDaliTelemetryStats();
+  for(eMetric = 0; eMetric < evDaliTelemNumMetrics; eMetric++)
+  {
+    reads += psStats->reads[eMetric];
+    printf("%-8s %5u reads %3u failed %4u changed\n", caBenchMetric[eMetric],
+           psStats->reads[eMetric], psStats->failed[eMetric], psStats->changes[eMetric]);
+    faults += (int)psStats->failed[eMetric];
+  }
+  for(driver = 0; driver < BENCH_GEAR; driver++)
+  {//entries follow addressing order, the gear behind each one is found by its short address
+    shortAddr = psNet->uData[driver].sData.sStaticData.addr;
+    for(gear = 0; gear < BENCH_GEAR; gear++)
+    {
+      if(shortAddr == daliGearSimGet(gear)->shortAddr)
+      {
+        break;
+      }
+    }
+    if(  (gear             >= BENCH_GEAR                                         )
+       ||(false            == daliTelemetryGet(driver, evDaliTelemIout, &sSample))
+       ||(benchAmps(gear)  != sSample.uValue.amps                                )
+       ||(false            == daliTelemetryGet(driver, evDaliTelemVout, &sSample))
+       ||(benchVolts(gear) != sSample.uValue.volts                               ))
+    {
+      faults++;
+    }
+    for(eMetric = 0; eMetric < evDaliTelemNumMetrics; eMetric++)
+    {
+      if(  (true == daliTelemetryGet(driver, (eDaliTelemMetric_t)eMetric, &sSample))
+         &&(true == sSample.bStale                                                 ))
+      {
+        stale++;
+      }
+    }
+  }
+  printf("%u gear, %.0f s: %u reads (%.1f/s), %.1f%% of bus time, first full sweep %.1f s, %u of %u samples stale, %u budget waits, %d faults\n",
+         BENCH_GEAR, (double)BENCH_RUN_US / 1e6, reads, reads * 1e6 / (double)BENCH_RUN_US,
+         100.0 * (double)(getDaliBusStats()->busUs - busUs0) / (double)BENCH_RUN_US, (double)sweepUs / 1e6,
+         stale, BENCH_GEAR * evDaliTelemNumMetrics, psStats->budgetWaits, faults);
+  return ((0 != faults) || (0 == sweepUs)) ? 1 : 0;
+}